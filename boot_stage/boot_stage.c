@@ -0,0 +1,145 @@
+// Boot stage: the first image in flash. Installs a firmware update staged and
+// confirmed by src/fw_update.c, then starts the firmware from
+// FLASH_LAYOUT_FIRMWARE_OFFSET.
+//
+// The update record is erased only after the installed firmware verifies, so
+// an install cut short by a power loss starts over on the next boot. Blocks
+// that already match staging are skipped, which makes the restart quick.
+// Without a firmware to start, the pad comes up as the USB bootloader.
+
+#include "flash_layout.h"
+#include "fw_update_record.h"
+
+#include "hardware/flash.h"
+#include "hardware/structs/nvic.h"
+#include "hardware/structs/scb.h"
+#include "hardware/sync.h"
+#include "pico/bootrom.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define BLOCK_SIZE       FLASH_SECTOR_SIZE
+#define INSTALL_ATTEMPTS 3
+
+// flash_range_program can't read its data from flash
+static uint8_t block_buf[BLOCK_SIZE] __attribute__((aligned(4)));
+
+static const uint8_t *flash_ptr(uint32_t offset) {
+    return (const uint8_t *)(XIP_BASE + offset);
+}
+
+// Same as crc32() in src/utils.c, bit by bit to keep the boot stage small
+static uint32_t crc32(const void *data, size_t len, uint32_t crc) {
+    const uint8_t *p = data;
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= p[i];
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320u & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
+
+static const fw_update_record_t *update_record() {
+    const fw_update_record_t *record =
+        (const fw_update_record_t *)flash_ptr(FLASH_LAYOUT_UPDATE_RECORD_OFFSET);
+    if (record->magic != FW_UPDATE_RECORD_MAGIC ||
+        record->record_crc != crc32(record, offsetof(fw_update_record_t, record_crc), 0) ||
+        record->image_size == 0 || record->image_size > FLASH_LAYOUT_STAGING_SIZE) {
+        return NULL;
+    }
+    return record;
+}
+
+static void erase(uint32_t offset, uint32_t len) {
+    uint32_t irq_state = save_and_disable_interrupts();
+    flash_range_erase(offset, len);
+    restore_interrupts(irq_state);
+}
+
+static void copy_block(uint32_t block) {
+    uint32_t src = FLASH_LAYOUT_STAGING_OFFSET + block * BLOCK_SIZE;
+    uint32_t dst = FLASH_LAYOUT_FIRMWARE_OFFSET + block * BLOCK_SIZE;
+    if (memcmp(flash_ptr(dst), flash_ptr(src), BLOCK_SIZE) == 0) {
+        return;
+    }
+    memcpy(block_buf, flash_ptr(src), BLOCK_SIZE);
+
+    uint32_t irq_state = save_and_disable_interrupts();
+    flash_range_erase(dst, BLOCK_SIZE);
+    flash_range_program(dst, block_buf, BLOCK_SIZE);
+    restore_interrupts(irq_state);
+}
+
+// Returns whether the firmware now is the staged image
+static bool install(const fw_update_record_t *record) {
+    uint32_t blocks = (record->image_size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    const uint8_t *firmware = flash_ptr(FLASH_LAYOUT_FIRMWARE_OFFSET);
+
+    for (uint8_t attempt = 0; attempt < INSTALL_ATTEMPTS; attempt++) {
+        for (uint32_t block = 0; block < blocks; block++) {
+            copy_block(block);
+        }
+        if (crc32(firmware, record->image_size, 0) == record->image_crc) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void check_update() {
+    const fw_update_record_t *record = update_record();
+    if (!record) {
+        return;
+    }
+
+    uint32_t image_size = record->image_size;
+    if (crc32(flash_ptr(FLASH_LAYOUT_STAGING_OFFSET), image_size, 0) != record->image_crc) {
+        // Staging was overwritten since, keep the firmware we have
+        erase(FLASH_LAYOUT_UPDATE_RECORD_OFFSET, FLASH_LAYOUT_UPDATE_RECORD_SIZE);
+        return;
+    }
+    if (!install(record)) {
+        // Half a firmware: leave the record for another try after a power cycle
+        reset_usb_boot(0, 0);
+    }
+
+    erase(FLASH_LAYOUT_UPDATE_RECORD_OFFSET, FLASH_LAYOUT_UPDATE_RECORD_SIZE);
+    // The next update then only stalls the firmware for page programming
+    uint32_t staged_len = (image_size + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE;
+    erase(FLASH_LAYOUT_STAGING_OFFSET, staged_len);
+}
+
+static void __attribute__((noreturn)) start_firmware() {
+    const uint32_t *vectors = (const uint32_t *)flash_ptr(
+        FLASH_LAYOUT_FIRMWARE_OFFSET + FW_UPDATE_VECTOR_TABLE_OFFSET);
+    uint32_t sp = vectors[0];
+    uint32_t reset = vectors[1];
+    uint32_t firmware_start = XIP_BASE + FLASH_LAYOUT_FIRMWARE_OFFSET;
+
+    // An erased or foreign firmware region
+    if (sp < SRAM_BASE || sp > SRAM_END || !(reset & 1) ||
+        reset - firmware_start >= FLASH_LAYOUT_FIRMWARE_SIZE) {
+        reset_usb_boot(0, 0);
+    }
+
+    // Nothing of the boot stage's runtime (the default alarm pool) may
+    // interrupt into the firmware before it has set itself up
+    nvic_hw->icer = 0xffffffff;
+    nvic_hw->icpr = 0xffffffff;
+    scb_hw->vtor = (uint32_t)vectors;
+    __asm volatile("msr msp, %0\n"
+                   "bx %1\n"
+                   :
+                   : "r"(sp), "r"(reset));
+    __builtin_unreachable();
+}
+
+int main() {
+    check_update();
+    start_firmware();
+}
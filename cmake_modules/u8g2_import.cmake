@@ -5,4 +5,35 @@ if (NOT EXISTS ${U8G2_ROOT_PATH})
     message(FATAL_ERROR "u8g2 source directory not found, submodule not initialized?")
 endif()
 
-file(GLOB U8G2_SRC_FILES CONFIGURE_DEPENDS ${U8G2_SRC_PATH}/*.c)
\ No newline at end of file
+# The fonts are added separately, see MACROPAD_FONT_SUBSET
+set(U8G2_FONTS_FILE ${U8G2_SRC_PATH}/u8g2_fonts.c)
+
+option(MACROPAD_U8G2_ALL_SOURCES "Compile all of u8g2 instead of the parts the firmware uses" OFF)
+if (MACROPAD_U8G2_ALL_SOURCES)
+    file(GLOB U8G2_SRC_FILES CONFIGURE_DEPENDS ${U8G2_SRC_PATH}/*.c)
+    list(REMOVE_ITEM U8G2_SRC_FILES ${U8G2_FONTS_FILE})
+else()
+    # The core, the graphics primitives the UI draws with (boxes, frames and the XBM
+    # icons) and the SSD1306 128x32 driver.
+    # u8g2_d_setup.c refers to every driver, --gc-sections drops the setup functions
+    # of the displays that aren't linked.
+    set(U8G2_SRC_FILES
+        u8g2_setup.c
+        u8g2_d_setup.c
+        u8g2_d_memory.c
+        u8g2_buffer.c
+        u8g2_font.c
+        u8g2_hvline.c
+        u8g2_ll_hvline.c
+        u8g2_box.c
+        u8g2_bitmap.c
+        u8g2_intersection.c
+        u8x8_setup.c
+        u8x8_display.c
+        u8x8_cad.c
+        u8x8_byte.c
+        u8x8_gpio.c
+        u8x8_8x8.c
+        u8x8_d_ssd1306_128x32.c)
+    list(TRANSFORM U8G2_SRC_FILES PREPEND ${U8G2_SRC_PATH}/)
+endif()
@@ -0,0 +1,263 @@
+// Host daemon that keeps every connected macropad showing the active profile.
+//
+// Reads focus changes from stdin, one JSON object per line (see
+// focus_change.h), and pushes them to all connected pads. Bursts of focus
+// changes are coalesced into one update, and a pad is never sent a report it
+// already has (see macropad.h). Each pad has an I/O thread of its own, a new
+// focus change goes to all of them at once.
+//
+//   window-watcher | macropad_hostd
+//   macropad_hostd --mock 2 -v < focus_log.jsonl
+//
+// With --mock, in-process mock pads that implement the firmware's side of the
+// protocol stand in for real hardware.
+
+#include "focus_change.h"
+#include "macropad.h"
+#include "mock_device.h"
+#if defined(MACROPAD_HOST_HIDAPI)
+#include "hid_device.h"
+#include <hidapi.h>
+#endif
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+
+using namespace macropad;
+
+namespace {
+
+constexpr auto RESCAN_INTERVAL = std::chrono::seconds(2);
+
+struct Options {
+    unsigned mock = 0;
+    unsigned coalesce_ms = 50;
+    bool verbose = false;
+};
+
+class Daemon {
+  public:
+    explicit Daemon(const Options &options) : options_(options) {
+    }
+
+    void run();
+
+  private:
+    void add_pad(const std::string &key, std::unique_ptr<Device> dev);
+    void apply_latest(std::unique_lock<std::mutex> &lock);
+    void push_updates();
+#if defined(MACROPAD_HOST_HIDAPI)
+    void rescan();
+#endif
+
+    Options options_;
+
+    // Everything below, and the condition variable waking the threads on changes
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    // By hidapi path or mock serial
+    std::map<std::string, std::unique_ptr<PadWorker>> pads_;
+    // Most recent focus change, applied to new pads too
+    std::optional<EncodedProfile> latest_;
+    // The focus change all pads have
+    std::optional<EncodedProfile> applied_;
+    bool pending_ = false;
+    bool input_closed_ = false;
+};
+
+void Daemon::add_pad(const std::string &key, std::unique_ptr<Device> dev) {
+    // Reads the pad's cache status, not under the lock
+    auto pad = std::make_unique<Macropad>(std::move(dev), options_.verbose);
+    fprintf(stderr, "Connected %s\n", pad->serial().c_str());
+    std::lock_guard<std::mutex> lock(mutex_);
+    pads_[key] = std::make_unique<PadWorker>(std::move(pad));
+    if (latest_) {
+        pending_ = true;
+        changed_.notify_all();
+    }
+}
+
+// Send the latest focus change to all pads, at once, and wait for them.
+// Unlocks the lock while they work.
+void Daemon::apply_latest(std::unique_lock<std::mutex> &lock) {
+    EncodedProfile profile = *latest_;
+    std::vector<std::pair<std::string, std::future<void>>> updates;
+    for (auto &[key, worker] : pads_) {
+        updates.emplace_back(key, worker->apply(profile));
+    }
+
+    lock.unlock();
+    std::vector<std::string> lost;
+    for (auto &[key, update] : updates) {
+        try {
+            update.get();
+        } catch (const std::runtime_error &e) {
+            fprintf(stderr, "Lost %s: %s\n", key.c_str(), e.what());
+            lost.push_back(key);
+        }
+    }
+    lock.lock();
+
+    for (const auto &key : lost) {
+        pads_.erase(key);
+    }
+    applied_ = profile;
+}
+
+void Daemon::push_updates() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        changed_.wait(lock, [this] { return pending_ || input_closed_; });
+        // Let a burst of focus changes settle, only the last one is sent
+        changed_.wait_for(
+            lock, std::chrono::milliseconds(options_.coalesce_ms), [this] { return input_closed_; });
+        if (input_closed_) {
+            // run() flushes the last one
+            return;
+        }
+        pending_ = false;
+        apply_latest(lock);
+    }
+}
+
+#if defined(MACROPAD_HOST_HIDAPI)
+void Daemon::rescan() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!input_closed_) {
+        lock.unlock();
+        for (const auto &path : HidDevice::enumerate()) {
+            {
+                std::lock_guard<std::mutex> check(mutex_);
+                if (pads_.count(path)) {
+                    continue;
+                }
+            }
+            try {
+                add_pad(path, HidDevice::open(path));
+            } catch (const std::runtime_error &e) {
+                fprintf(stderr, "Can't open %s: %s\n", path.c_str(), e.what());
+            }
+        }
+        lock.lock();
+        changed_.wait_for(lock, RESCAN_INTERVAL, [this] { return input_closed_; });
+    }
+}
+#endif
+
+void Daemon::run() {
+    for (unsigned i = 0; i < options_.mock; i++) {
+        add_pad("mock" + std::to_string(i), std::make_unique<MockDevice>("MOCK" + std::to_string(i)));
+    }
+
+    std::vector<std::thread> background;
+    background.emplace_back(&Daemon::push_updates, this);
+#if defined(MACROPAD_HOST_HIDAPI)
+    if (!options_.mock) {
+        background.emplace_back(&Daemon::rescan, this);
+    }
+#endif
+
+    std::string line;
+    while (std::getline(std::cin, line)) {
+        if (line.find_first_not_of(" \t\r") == std::string::npos) {
+            continue;
+        }
+        EncodedProfile profile;
+        try {
+            profile = encode_profile(parse_focus_change(line));
+        } catch (const FocusChangeError &e) {
+            fprintf(stderr, "Ignoring bad focus change '%s': %s\n", line.c_str(), e.what());
+            continue;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        latest_ = profile;
+        pending_ = true;
+        changed_.notify_all();
+    }
+
+    // Input closed: let the update being sent finish, flush the last one and exit
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        input_closed_ = true;
+        changed_.notify_all();
+    }
+    for (auto &thread : background) {
+        thread.join();
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (latest_ && latest_ != applied_) {
+        apply_latest(lock);
+    }
+    for (auto &[key, worker] : pads_) {
+        try {
+            fprintf(stderr, "%s\n", worker->pad().stats().c_str());
+        } catch (const std::runtime_error &e) {
+            fprintf(stderr, "Lost %s: %s\n", key.c_str(), e.what());
+        }
+    }
+}
+
+[[noreturn]] void usage(const char *argv0, int status) {
+    fprintf(
+        status ? stderr : stdout,
+        "usage: %s [--mock N] [--coalesce-ms MS] [-v]\n"
+        "\n"
+        "Host daemon that keeps every connected macropad showing the active profile.\n"
+        "\n"
+        "  --mock N          use N mock pads\n"
+        "  --coalesce-ms MS  wait for more focus changes this long (default 50)\n"
+        "  -v, --verbose     log every report sent\n",
+        argv0);
+    exit(status);
+}
+
+unsigned parse_count(const char *argv0, const char *arg) {
+    char *end;
+    unsigned long v = arg ? strtoul(arg, &end, 10) : 0;
+    if (!arg || *end != '\0' || v > 100000) {
+        usage(argv0, 2);
+    }
+    return v;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--mock") == 0) {
+            options.mock = parse_count(argv[0], i + 1 < argc ? argv[++i] : nullptr);
+        } else if (strcmp(argv[i], "--coalesce-ms") == 0) {
+            options.coalesce_ms = parse_count(argv[0], i + 1 < argc ? argv[++i] : nullptr);
+        } else if (strcmp(argv[i], "-v") == 0 || strcmp(argv[i], "--verbose") == 0) {
+            options.verbose = true;
+        } else if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            usage(argv[0], 0);
+        } else {
+            usage(argv[0], 2);
+        }
+    }
+
+#if defined(MACROPAD_HOST_HIDAPI)
+    if (hid_init() != 0) {
+        fprintf(stderr, "Can't initialize hidapi\n");
+        return 1;
+    }
+#else
+    if (!options.mock) {
+        fprintf(stderr, "Built without hidapi, only --mock pads are available\n");
+        return 2;
+    }
+#endif
+
+    Daemon(options).run();
+
+#if defined(MACROPAD_HOST_HIDAPI)
+    hid_exit();
+#endif
+    return 0;
+}
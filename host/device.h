@@ -0,0 +1,36 @@
+#if !defined(MACROPAD_HOST_DEVICE__H)
+#define MACROPAD_HOST_DEVICE__H
+
+// A pad's HID interface, as much of it as the host library uses: hidapi's
+// feature reports, with the report id as the first byte. HidDevice
+// (hid_device.h) is a real pad, MockDevice (mock_device.h) stands in for one.
+
+#include "protocol.h"
+
+#include <stdexcept>
+#include <string>
+
+namespace macropad {
+
+// The device is gone or refused a report
+class DeviceError : public std::runtime_error {
+  public:
+    using std::runtime_error::runtime_error;
+};
+
+class Device {
+  public:
+    virtual ~Device() = default;
+
+    virtual std::string serial() const = 0;
+
+    // Throws DeviceError
+    virtual void send_feature_report(const Bytes &report) = 0;
+
+    // At most length bytes, the report id first. Throws DeviceError.
+    virtual Bytes get_feature_report(uint8_t report_id, size_t length) = 0;
+};
+
+} // namespace macropad
+
+#endif // MACROPAD_HOST_DEVICE__H
@@ -0,0 +1,322 @@
+#include "focus_change.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <utility>
+
+namespace macropad {
+
+namespace {
+
+// Just enough JSON for the focus changes
+struct Value {
+    enum class Type { NUL, BOOL, NUMBER, STRING, ARRAY, OBJECT };
+
+    Type type = Type::NUL;
+    bool boolean = false;
+    double number = 0;
+    std::string string;
+    std::vector<Value> array;
+    std::vector<std::pair<std::string, Value>> object;
+
+    const Value *get(const std::string &key) const {
+        for (const auto &[k, v] : object) {
+            if (k == key) {
+                return &v;
+            }
+        }
+        return nullptr;
+    }
+};
+
+class Parser {
+  public:
+    explicit Parser(const std::string &text) : text_(text) {
+    }
+
+    Value parse() {
+        Value v = value();
+        skip_space();
+        if (pos_ != text_.size()) {
+            fail("trailing characters");
+        }
+        return v;
+    }
+
+  private:
+    [[noreturn]] void fail(const std::string &what) {
+        throw FocusChangeError(what + " at " + std::to_string(pos_));
+    }
+
+    void skip_space() {
+        while (pos_ < text_.size() && (text_[pos_] == ' ' || text_[pos_] == '\t' ||
+                                       text_[pos_] == '\n' || text_[pos_] == '\r')) {
+            pos_++;
+        }
+    }
+
+    char peek() {
+        skip_space();
+        if (pos_ == text_.size()) {
+            fail("unexpected end");
+        }
+        return text_[pos_];
+    }
+
+    void expect(char c) {
+        if (peek() != c) {
+            fail(std::string("expected '") + c + "'");
+        }
+        pos_++;
+    }
+
+    // Whether a comma follows, another item of the object or array
+    bool next_item() {
+        if (peek() != ',') {
+            return false;
+        }
+        pos_++;
+        return true;
+    }
+
+    bool literal(const char *word) {
+        size_t len = std::char_traits<char>::length(word);
+        if (text_.compare(pos_, len, word) != 0) {
+            return false;
+        }
+        pos_ += len;
+        return true;
+    }
+
+    Value value() {
+        Value v;
+        char c = peek();
+        if (c == '{') {
+            v.type = Value::Type::OBJECT;
+            pos_++;
+            if (peek() == '}') {
+                pos_++;
+                return v;
+            }
+            while (true) {
+                if (peek() != '"') {
+                    fail("expected a key");
+                }
+                std::string key = string();
+                expect(':');
+                v.object.emplace_back(std::move(key), value());
+                if (!next_item()) {
+                    break;
+                }
+            }
+            expect('}');
+        } else if (c == '[') {
+            v.type = Value::Type::ARRAY;
+            pos_++;
+            if (peek() == ']') {
+                pos_++;
+                return v;
+            }
+            while (true) {
+                v.array.push_back(value());
+                if (!next_item()) {
+                    break;
+                }
+            }
+            expect(']');
+        } else if (c == '"') {
+            v.type = Value::Type::STRING;
+            v.string = string();
+        } else if (literal("null")) {
+            v.type = Value::Type::NUL;
+        } else if (literal("true")) {
+            v.type = Value::Type::BOOL;
+            v.boolean = true;
+        } else if (literal("false")) {
+            v.type = Value::Type::BOOL;
+        } else {
+            v.type = Value::Type::NUMBER;
+            const char *start = text_.c_str() + pos_;
+            char *end;
+            v.number = strtod(start, &end);
+            if (end == start) {
+                fail("unexpected character");
+            }
+            pos_ += end - start;
+        }
+        return v;
+    }
+
+    // Non-ASCII characters, escaped or in UTF-8, become '?'
+    std::string string() {
+        std::string s;
+        pos_++;
+        while (true) {
+            if (pos_ >= text_.size()) {
+                fail("unterminated string");
+            }
+            unsigned char c = text_[pos_++];
+            if (c == '"') {
+                return s;
+            }
+            if (c >= 0x80) {
+                // Skip the continuation bytes of the character
+                while (pos_ < text_.size() && (text_[pos_] & 0xC0) == 0x80) {
+                    pos_++;
+                }
+                s += '?';
+            } else if (c != '\\') {
+                s += c;
+            } else {
+                if (pos_ >= text_.size()) {
+                    fail("unterminated string");
+                }
+                char e = text_[pos_++];
+                switch (e) {
+                case 'b':
+                    s += '\b';
+                    break;
+                case 'f':
+                    s += '\f';
+                    break;
+                case 'n':
+                    s += '\n';
+                    break;
+                case 'r':
+                    s += '\r';
+                    break;
+                case 't':
+                    s += '\t';
+                    break;
+                case 'u': {
+                    if (pos_ + 4 > text_.size()) {
+                        fail("short \\u escape");
+                    }
+                    unsigned long code = strtoul(text_.substr(pos_, 4).c_str(), nullptr, 16);
+                    pos_ += 4;
+                    // The second half of a surrogate pair goes with the first
+                    if (code >= 0xD800 && code < 0xDC00 && text_.compare(pos_, 2, "\\u") == 0) {
+                        pos_ += 6;
+                    }
+                    s += code < 0x80 ? static_cast<char>(code) : '?';
+                    break;
+                }
+                default:
+                    s += e;
+                }
+            }
+        }
+    }
+
+    const std::string &text_;
+    size_t pos_ = 0;
+};
+
+std::string as_string(const Value &v, const char *what) {
+    if (v.type != Value::Type::STRING) {
+        throw FocusChangeError(std::string(what) + " isn't a string");
+    }
+    return v.string;
+}
+
+const std::vector<Value> &as_array(const Value &v, const char *what) {
+    if (v.type != Value::Type::ARRAY) {
+        throw FocusChangeError(std::string(what) + " isn't a list");
+    }
+    return v.array;
+}
+
+// An integer from 0 to highest, or null
+std::optional<uint8_t> as_byte(const Value &v, const char *what, int highest) {
+    if (v.type == Value::Type::NUL) {
+        return std::nullopt;
+    }
+    if (v.type != Value::Type::NUMBER || v.number != std::floor(v.number) || v.number < 0 ||
+        v.number > highest) {
+        throw FocusChangeError(std::string("bad ") + what);
+    }
+    return static_cast<uint8_t>(v.number);
+}
+
+// The values of a list, count of them or up to count when count_exact is false
+template <size_t N>
+void parse_bytes(
+    const Value &v, const char *what, int highest, bool count_exact,
+    std::array<std::optional<uint8_t>, N> &out) {
+    const auto &values = as_array(v, what);
+    if (count_exact && values.size() != N) {
+        throw FocusChangeError(std::string(what) + " needs " + std::to_string(N) + " values");
+    }
+    out.fill(std::nullopt);
+    for (size_t i = 0; i < values.size() && i < N; i++) {
+        out[i] = as_byte(values[i], what, highest);
+    }
+}
+
+MidiMap parse_midi(const Value &v) {
+    if (v.type != Value::Type::OBJECT) {
+        throw FocusChangeError("midi isn't an object");
+    }
+    MidiMap midi;
+    if (const Value *channel = v.get("channel")) {
+        auto c = as_byte(*channel, "MIDI channel", 16);
+        if (!c || *c < 1) {
+            throw FocusChangeError("bad MIDI channel");
+        }
+        midi.channel = *c;
+    }
+    if (const Value *notes = v.get("notes")) {
+        parse_bytes(*notes, "MIDI notes", 127, false, midi.key_notes);
+    }
+    // Controllers 120-127 are channel mode messages
+    if (const Value *encoders = v.get("encoders")) {
+        parse_bytes(*encoders, "MIDI encoders", 119, true, midi.encoder_ccs);
+    }
+    if (const Value *buttons = v.get("buttons")) {
+        parse_bytes(*buttons, "MIDI buttons", 127, true, midi.button_notes);
+    }
+    return midi;
+}
+
+} // namespace
+
+Profile parse_focus_change(const std::string &line) {
+    Value change = Parser(line).parse();
+    if (change.type != Value::Type::OBJECT) {
+        throw FocusChangeError("not an object");
+    }
+
+    Profile profile;
+    const Value *name = change.get("name");
+    if (!name) {
+        throw FocusChangeError("no name");
+    }
+    profile.name = as_string(*name, "name");
+    if (const Value *keys = change.get("keys")) {
+        for (const Value &key : as_array(*keys, "keys")) {
+            profile.key_names.push_back(as_string(key, "key name"));
+        }
+    }
+    if (const Value *encoders = change.get("encoders")) {
+        const auto &modes = as_array(*encoders, "encoders");
+        if (modes.size() != ENCODER_COUNT) {
+            throw FocusChangeError("bad encoder modes");
+        }
+        for (size_t i = 0; i < ENCODER_COUNT; i++) {
+            auto mode = encoder_mode_from_name(as_string(modes[i], "encoder mode"));
+            if (!mode) {
+                throw FocusChangeError("bad encoder mode " + modes[i].string);
+            }
+            profile.encoder_modes[i] = *mode;
+        }
+    }
+    if (const Value *midi = change.get("midi")) {
+        profile.midi = parse_midi(*midi);
+    }
+    if (const Value *icons = change.get("icons")) {
+        parse_bytes(*icons, "icons", 255, false, profile.icons);
+    }
+    return profile;
+}
+
+} // namespace macropad
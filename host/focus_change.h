@@ -0,0 +1,29 @@
+#if !defined(MACROPAD_HOST_FOCUS_CHANGE__H)
+#define MACROPAD_HOST_FOCUS_CHANGE__H
+
+// Focus changes as the daemon reads them, one JSON object per line:
+//
+//   {"name": "Firefox", "keys": ["Back", "Fwd", "Tab", ...], "encoders": ["none", "wheel"]}
+//
+// with an optional "midi" object of "channel" (1-16), "notes" (of the keys),
+// "encoders" (controllers) and "buttons" (notes of the encoder buttons), and
+// an optional "icons" list of icon atlas numbers; null sets nothing. Text
+// outside ASCII becomes '?', the pad can't show it.
+
+#include "protocol.h"
+
+#include <stdexcept>
+
+namespace macropad {
+
+class FocusChangeError : public std::invalid_argument {
+  public:
+    using std::invalid_argument::invalid_argument;
+};
+
+// Throws FocusChangeError
+Profile parse_focus_change(const std::string &line);
+
+} // namespace macropad
+
+#endif // MACROPAD_HOST_FOCUS_CHANGE__H
@@ -0,0 +1,71 @@
+#include "hid_device.h"
+
+#include <hidapi.h>
+
+namespace macropad {
+
+namespace {
+
+// hidapi's strings are wide, the pad's are ASCII
+std::string narrow(const wchar_t *s) {
+    std::string out;
+    for (; s && *s; s++) {
+        out += *s < 128 ? static_cast<char>(*s) : '?';
+    }
+    return out;
+}
+
+} // namespace
+
+std::vector<std::string> HidDevice::enumerate() {
+    std::vector<std::string> paths;
+    hid_device_info *devices = hid_enumerate(VID, PID);
+    for (hid_device_info *d = devices; d; d = d->next) {
+        paths.push_back(d->path);
+    }
+    hid_free_enumeration(devices);
+    return paths;
+}
+
+std::unique_ptr<HidDevice> HidDevice::open(const std::string &path) {
+    hid_device *dev = hid_open_path(path.c_str());
+    if (!dev) {
+        throw DeviceError("can't open " + path);
+    }
+    wchar_t serial[64] = {0};
+    if (hid_get_serial_number_string(dev, serial, sizeof(serial) / sizeof(serial[0])) < 0) {
+        serial[0] = 0;
+    }
+    return std::unique_ptr<HidDevice>(new HidDevice(dev, narrow(serial)));
+}
+
+HidDevice::HidDevice(hid_device *dev, std::string serial) : dev_(dev), serial_(std::move(serial)) {
+}
+
+HidDevice::~HidDevice() {
+    hid_close(dev_);
+}
+
+std::string HidDevice::error(const char *fallback) const {
+    std::string e = narrow(hid_error(dev_));
+    return e.empty() ? fallback : e;
+}
+
+void HidDevice::send_feature_report(const Bytes &report) {
+    if (hid_send_feature_report(dev_, report.data(), report.size()) < 0) {
+        throw DeviceError(error("sending a feature report failed"));
+    }
+}
+
+Bytes HidDevice::get_feature_report(uint8_t report_id, size_t length) {
+    Bytes r(length);
+    r[0] = report_id;
+    int n = hid_get_feature_report(dev_, r.data(), r.size());
+    if (n < 0) {
+        throw DeviceError(error("getting a feature report failed"));
+    }
+    r.resize(n);
+    return r;
+}
+
+} // namespace macropad
@@ -0,0 +1,44 @@
+#if !defined(MACROPAD_HOST_HID_DEVICE__H)
+#define MACROPAD_HOST_HID_DEVICE__H
+
+// A pad on USB through hidapi. Only built when CMake finds hidapi
+// (MACROPAD_HOST_HIDAPI).
+
+#include "device.h"
+
+#include <memory>
+#include <vector>
+
+struct hid_device_;
+
+namespace macropad {
+
+class HidDevice : public Device {
+  public:
+    // hidapi paths of the connected pads
+    static std::vector<std::string> enumerate();
+
+    // Throws DeviceError
+    static std::unique_ptr<HidDevice> open(const std::string &path);
+
+    ~HidDevice() override;
+
+    std::string serial() const override {
+        return serial_;
+    }
+    void send_feature_report(const Bytes &report) override;
+    Bytes get_feature_report(uint8_t report_id, size_t length) override;
+
+  private:
+    HidDevice(hid_device_ *dev, std::string serial);
+
+    // hidapi's error for the device, or the fallback
+    std::string error(const char *fallback) const;
+
+    hid_device_ *dev_;
+    std::string serial_;
+};
+
+} // namespace macropad
+
+#endif // MACROPAD_HOST_HID_DEVICE__H
@@ -0,0 +1,148 @@
+#include "macropad.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <sstream>
+
+namespace macropad {
+
+Macropad::Macropad(std::unique_ptr<Device> dev, bool verbose)
+    : dev_(std::move(dev)), serial_(dev_->serial()), verbose_(verbose) {
+    status_ = read_status();
+}
+
+CacheStatus Macropad::read_status() {
+    return parse_cache_status(dev_->get_feature_report(REPORT_PROFILE_CACHE, 1 + CACHE_STATUS_LEN));
+}
+
+void Macropad::send(uint8_t report_id, const Bytes &payload) {
+    if (verbose_) {
+        std::string hex;
+        char byte[3];
+        for (uint8_t b : payload) {
+            snprintf(byte, sizeof(byte), "%02x", b);
+            hex += byte;
+        }
+        fprintf(stderr, "[%s] report %u: %s\n", serial_.c_str(), report_id, hex.c_str());
+    }
+    Bytes report = {report_id};
+    report.insert(report.end(), payload.begin(), payload.end());
+    dev_->send_feature_report(report);
+    reports_sent_++;
+}
+
+void Macropad::remember_cached(uint32_t hash) {
+    cached_.remove(hash);
+    cached_.push_back(hash);
+    while (cached_.size() > status_.capacity) {
+        cached_.pop_front();
+    }
+}
+
+void Macropad::forget_uploaded() {
+    name_.clear();
+    modes_.clear();
+    midi_.clear();
+    icons_.clear();
+    keys_.clear();
+}
+
+void Macropad::apply(const EncodedProfile &profile) {
+    uint32_t h = profile_hash(profile);
+    if (h == status_.current_hash) {
+        updates_skipped_++;
+        return;
+    }
+
+    if (std::find(cached_.begin(), cached_.end(), h) != cached_.end()) {
+        send(REPORT_PROFILE_HASH, {uint8_t(h), uint8_t(h >> 8), uint8_t(h >> 16), uint8_t(h >> 24)});
+        status_ = read_status();
+        if (status_.current_hash == h) {
+            remember_cached(h);
+            // The pad's current profile no longer matches what we last uploaded
+            forget_uploaded();
+            return;
+        }
+        // Evicted behind our back (e.g. another host), fall back to uploading
+        cached_.remove(h);
+    }
+
+    if (profile.name != name_) {
+        send(REPORT_PROFILE_NAME, profile.name);
+        // The name starts a new profile on the pad
+        name_ = profile.name;
+        modes_ = DEFAULT_ENCODER_MODES;
+        midi_ = DEFAULT_MIDI;
+        icons_ = NO_ICONS;
+    }
+    if (profile.modes != modes_) {
+        send(REPORT_ENCODER_MODES, profile.modes);
+        modes_ = profile.modes;
+    }
+    if (profile.midi != midi_) {
+        send(REPORT_MIDI_MAP, profile.midi);
+        midi_ = profile.midi;
+    }
+    if (profile.icons != icons_) {
+        send(REPORT_KEY_ICONS, profile.icons);
+        icons_ = profile.icons;
+    }
+    if (profile.keys != keys_) {
+        send(REPORT_KEY_NAMES, profile.keys);
+        keys_ = profile.keys;
+        // The pad caches the profile when the key names arrive
+        remember_cached(h);
+    }
+    status_.current_hash = h;
+}
+
+std::string Macropad::stats() {
+    CacheStatus s = read_status();
+    std::ostringstream out;
+    out << "[" << serial_ << "] " << reports_sent_ << " reports sent, " << updates_skipped_
+        << " updates skipped, pad cache " << s.hits << " hits / " << s.misses << " misses";
+    return out.str();
+}
+
+PadWorker::PadWorker(std::unique_ptr<Macropad> pad)
+    : pad_(std::move(pad)), thread_(&PadWorker::run, this) {
+}
+
+PadWorker::~PadWorker() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_one();
+    // Finishes the jobs already queued
+    thread_.join();
+}
+
+std::future<void> PadWorker::apply(EncodedProfile profile) {
+    std::packaged_task<void()> job(
+        [this, profile = std::move(profile)]() { pad_->apply(profile); });
+    std::future<void> done = job.get_future();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        jobs_.push_back(std::move(job));
+    }
+    wake_.notify_one();
+    return done;
+}
+
+void PadWorker::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        wake_.wait(lock, [this] { return stopping_ || !jobs_.empty(); });
+        if (jobs_.empty()) {
+            return;
+        }
+        std::packaged_task<void()> job = std::move(jobs_.front());
+        jobs_.pop_front();
+        lock.unlock();
+        job();
+        lock.lock();
+    }
+}
+
+} // namespace macropad
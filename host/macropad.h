@@ -0,0 +1,97 @@
+#if !defined(MACROPAD_HOST_MACROPAD__H)
+#define MACROPAD_HOST_MACROPAD__H
+
+// One pad and what the host knows about its state, so that a profile change
+// sends only what the pad doesn't have: profiles the pad has cached are
+// activated by hash, and on a miss only the reports whose contents differ are
+// uploaded. Macropad blocks on the pad's I/O, PadWorker runs it on a thread of
+// its own.
+
+#include "device.h"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace macropad {
+
+class Macropad {
+  public:
+    // Reads the pad's cache status. Throws DeviceError.
+    explicit Macropad(std::unique_ptr<Device> dev, bool verbose = false);
+
+    const std::string &serial() const {
+        return serial_;
+    }
+
+    // Make the profile the pad's current one. Throws DeviceError.
+    void apply(const EncodedProfile &profile);
+
+    // Reports sent and updates skipped, and the pad's cache stats. Throws DeviceError.
+    std::string stats();
+
+    unsigned reports_sent() const {
+        return reports_sent_;
+    }
+    unsigned updates_skipped() const {
+        return updates_skipped_;
+    }
+
+  private:
+    CacheStatus read_status();
+    void send(uint8_t report_id, const Bytes &payload);
+    void remember_cached(uint32_t hash);
+    void forget_uploaded();
+
+    std::unique_ptr<Device> dev_;
+    std::string serial_;
+    bool verbose_;
+
+    // Last contents sent in reports 3, 11, 21, 23 and 4, empty when unknown
+    Bytes name_, modes_, midi_, icons_, keys_;
+    CacheStatus status_;
+    // The pad's cache as far as we know, least recently used first
+    std::list<uint32_t> cached_;
+
+    unsigned reports_sent_ = 0;
+    unsigned updates_skipped_ = 0;
+};
+
+// Runs jobs on a pad in order on a thread of its own, so that a slow or
+// stuck pad doesn't hold up the others
+class PadWorker {
+  public:
+    explicit PadWorker(std::unique_ptr<Macropad> pad);
+    ~PadWorker();
+
+    PadWorker(const PadWorker &) = delete;
+    PadWorker &operator=(const PadWorker &) = delete;
+
+    // Apply the profile once the jobs before it are done. The future throws
+    // what apply threw.
+    std::future<void> apply(EncodedProfile profile);
+
+    // The pad, for when no job is running
+    Macropad &pad() {
+        return *pad_;
+    }
+
+  private:
+    void run();
+
+    std::unique_ptr<Macropad> pad_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::deque<std::packaged_task<void()>> jobs_;
+    bool stopping_ = false;
+    std::thread thread_;
+};
+
+} // namespace macropad
+
+#endif // MACROPAD_HOST_MACROPAD__H
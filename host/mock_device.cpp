@@ -0,0 +1,88 @@
+#include "mock_device.h"
+
+#include <algorithm>
+
+namespace macropad {
+
+MockDevice::MockDevice(std::string serial) : serial_(std::move(serial)) {
+    current_.name = Bytes(PROFILE_NAME_LENGTH, 0);
+    current_.keys = Bytes(KEY_COUNT * KEY_NAME_LENGTH, 0);
+    current_.modes = DEFAULT_ENCODER_MODES;
+    current_.midi = DEFAULT_MIDI;
+    current_.icons = NO_ICONS;
+    stats_.capacity = CAPACITY;
+}
+
+void MockDevice::send_feature_report(const Bytes &report) {
+    if (report.empty()) {
+        throw DeviceError("empty report");
+    }
+    uint8_t report_id = report[0];
+    Bytes payload(report.begin() + 1, report.end());
+    switch (report_id) {
+    case REPORT_PROFILE_NAME:
+        current_.name = payload;
+        current_.modes = DEFAULT_ENCODER_MODES;
+        current_.midi = DEFAULT_MIDI;
+        current_.icons = NO_ICONS;
+        break;
+    case REPORT_ENCODER_MODES:
+        current_.modes = payload;
+        break;
+    case REPORT_MIDI_MAP:
+        current_.midi = payload;
+        break;
+    case REPORT_KEY_ICONS:
+        current_.icons = payload;
+        break;
+    case REPORT_KEY_NAMES: {
+        // The profile is complete: cache it
+        current_.keys = payload;
+        uint32_t h = profile_hash(current_);
+        auto it = std::find_if(
+            cache_.begin(), cache_.end(), [h](const CacheEntry &e) { return e.hash == h; });
+        if (it != cache_.end()) {
+            cache_.erase(it);
+        } else if (cache_.size() == CAPACITY) {
+            cache_.pop_front();
+            stats_.evictions++;
+        }
+        cache_.push_back({h, current_});
+        break;
+    }
+    case REPORT_PROFILE_HASH: {
+        if (payload.size() < 4) {
+            throw DeviceError("short profile hash report");
+        }
+        uint32_t h = read_u32(payload, 0);
+        auto it = std::find_if(
+            cache_.begin(), cache_.end(), [h](const CacheEntry &e) { return e.hash == h; });
+        if (it != cache_.end()) {
+            stats_.hits++;
+            current_ = it->profile;
+            cache_.splice(cache_.end(), cache_, it);
+        } else {
+            stats_.misses++;
+        }
+        break;
+    }
+    default:
+        throw DeviceError("mock pad doesn't handle report " + std::to_string(report_id));
+    }
+}
+
+Bytes MockDevice::get_feature_report(uint8_t report_id, size_t length) {
+    if (report_id != REPORT_PROFILE_CACHE) {
+        throw DeviceError("mock pad doesn't return report " + std::to_string(report_id));
+    }
+    CacheStatus s = stats_;
+    s.current_hash = profile_hash(current_);
+    s.entries = cache_.size();
+    Bytes r = {report_id};
+    Bytes status = pack_cache_status(s);
+    r.insert(r.end(), status.begin(), status.end());
+    r.resize(std::min(r.size(), length));
+    return r;
+}
+
+} // namespace macropad
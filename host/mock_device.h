@@ -0,0 +1,41 @@
+#if !defined(MACROPAD_HOST_MOCK_DEVICE__H)
+#define MACROPAD_HOST_MOCK_DEVICE__H
+
+// The firmware's profile handling (profiles.c, usb_hid.c) behind the Device
+// interface, to run the host side on a machine without pads.
+
+#include "device.h"
+
+#include <cstdint>
+#include <list>
+
+namespace macropad {
+
+class MockDevice : public Device {
+  public:
+    static constexpr size_t CAPACITY = 8;
+
+    explicit MockDevice(std::string serial);
+
+    std::string serial() const override {
+        return serial_;
+    }
+    void send_feature_report(const Bytes &report) override;
+    Bytes get_feature_report(uint8_t report_id, size_t length) override;
+
+  private:
+    struct CacheEntry {
+        uint32_t hash;
+        EncodedProfile profile;
+    };
+
+    std::string serial_;
+    EncodedProfile current_;
+    // Least recently used first
+    std::list<CacheEntry> cache_;
+    CacheStatus stats_;
+};
+
+} // namespace macropad
+
+#endif // MACROPAD_HOST_MOCK_DEVICE__H
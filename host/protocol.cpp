@@ -0,0 +1,128 @@
+#include "protocol.h"
+
+#include <stdexcept>
+
+namespace macropad {
+
+namespace {
+
+const std::array<const char *, 5> ENCODER_MODE_NAMES = {"none", "dial", "volume", "wheel", "pan"};
+
+// ASCII characters stay, anything else was made a '?' by the JSON parser
+Bytes ascii_padded(const std::string &s, size_t length, uint8_t pad) {
+    Bytes out(s.begin(), s.begin() + std::min(s.size(), length));
+    out.resize(length, pad);
+    return out;
+}
+
+template <size_t N> void append_values(Bytes &out, const std::array<std::optional<uint8_t>, N> &v) {
+    for (const auto &value : v) {
+        out.push_back(value ? *value : MIDI_NONE);
+    }
+}
+
+Bytes encode_midi(const MidiMap &midi) {
+    Bytes out = {static_cast<uint8_t>(midi.channel - 1)};
+    append_values(out, midi.key_notes);
+    append_values(out, midi.encoder_ccs);
+    append_values(out, midi.button_notes);
+    return out;
+}
+
+void write_u32(Bytes &b, uint32_t v) {
+    for (int i = 0; i < 4; i++) {
+        b.push_back(v >> (8 * i));
+    }
+}
+
+} // namespace
+
+std::optional<EncoderMode> encoder_mode_from_name(const std::string &name) {
+    for (size_t i = 0; i < ENCODER_MODE_NAMES.size(); i++) {
+        if (name == ENCODER_MODE_NAMES[i]) {
+            return static_cast<EncoderMode>(i);
+        }
+    }
+    return std::nullopt;
+}
+
+MidiMap::MidiMap() {
+    // Two octaves up from C2, the drum pads of most software
+    for (size_t i = 0; i < KEY_COUNT; i++) {
+        key_notes[i] = 36 + i;
+    }
+}
+
+bool EncodedProfile::operator==(const EncodedProfile &other) const {
+    return name == other.name && keys == other.keys && modes == other.modes &&
+           midi == other.midi && icons == other.icons;
+}
+
+const Bytes DEFAULT_ENCODER_MODES = {
+    static_cast<uint8_t>(EncoderMode::NONE), static_cast<uint8_t>(EncoderMode::DIAL)};
+const Bytes DEFAULT_MIDI = encode_midi(MidiMap());
+const Bytes NO_ICONS(KEY_COUNT, 0);
+
+EncodedProfile encode_profile(const Profile &profile) {
+    EncodedProfile e;
+    e.name = ascii_padded(profile.name, PROFILE_NAME_LENGTH, 0);
+    for (size_t i = 0; i < KEY_COUNT; i++) {
+        std::string key = i < profile.key_names.size() ? profile.key_names[i] : "";
+        Bytes k = ascii_padded(key, KEY_NAME_LENGTH, ' ');
+        e.keys.insert(e.keys.end(), k.begin(), k.end());
+    }
+    for (auto &c : e.keys) {
+        c = c >= 32 && c <= 126 ? c : ' ';
+    }
+    for (auto mode : profile.encoder_modes) {
+        e.modes.push_back(static_cast<uint8_t>(mode));
+    }
+    e.midi = encode_midi(profile.midi);
+    for (const auto &icon : profile.icons) {
+        e.icons.push_back(icon ? *icon : 0);
+    }
+    return e;
+}
+
+uint32_t profile_hash(const EncodedProfile &profile) {
+    // 32-bit FNV-1a over the fields in the order of profile_t
+    uint32_t h = 2166136261u;
+    for (const Bytes *field : {&profile.name, &profile.keys, &profile.modes, &profile.midi,
+                               &profile.icons}) {
+        for (uint8_t c : *field) {
+            h = (h ^ c) * 16777619u;
+        }
+    }
+    return h;
+}
+
+uint32_t read_u32(const Bytes &b, size_t offset) {
+    return b[offset] | b[offset + 1] << 8 | b[offset + 2] << 16 | uint32_t(b[offset + 3]) << 24;
+}
+
+CacheStatus parse_cache_status(const Bytes &report) {
+    if (report.size() < 1 + CACHE_STATUS_LEN) {
+        throw std::runtime_error("short profile cache report");
+    }
+    CacheStatus s;
+    s.current_hash = read_u32(report, 1);
+    s.hits = read_u32(report, 5);
+    s.misses = read_u32(report, 9);
+    s.evictions = read_u32(report, 13);
+    s.entries = report[17];
+    s.capacity = report[18];
+    return s;
+}
+
+Bytes pack_cache_status(const CacheStatus &status) {
+    Bytes b;
+    write_u32(b, status.current_hash);
+    write_u32(b, status.hits);
+    write_u32(b, status.misses);
+    write_u32(b, status.evictions);
+    b.push_back(status.entries);
+    b.push_back(status.capacity);
+    return b;
+}
+
+} // namespace macropad
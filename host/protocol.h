@@ -0,0 +1,107 @@
+#if !defined(MACROPAD_HOST_PROTOCOL__H)
+#define MACROPAD_HOST_PROTOCOL__H
+
+// The pad's profile feature reports and how a profile is encoded in them,
+// the same as scripts/send_profile.py and src/profiles.h.
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace macropad {
+
+using Bytes = std::vector<uint8_t>;
+
+constexpr uint16_t VID = 0x2E8A;
+constexpr uint16_t PID = 0xFFEE;
+
+constexpr uint8_t REPORT_PROFILE_NAME = 3;
+constexpr uint8_t REPORT_KEY_NAMES = 4;
+constexpr uint8_t REPORT_PROFILE_HASH = 6;
+constexpr uint8_t REPORT_PROFILE_CACHE = 7;
+constexpr uint8_t REPORT_ENCODER_MODES = 11;
+constexpr uint8_t REPORT_MIDI_MAP = 21;
+constexpr uint8_t REPORT_KEY_ICONS = 23;
+
+constexpr size_t PROFILE_NAME_LENGTH = 18;
+constexpr size_t KEY_NAME_LENGTH = 4;
+constexpr size_t KEY_COUNT = 12;
+constexpr size_t ENCODER_COUNT = 2;
+
+// Length of the profile cache status, without the report id
+constexpr size_t CACHE_STATUS_LEN = 18;
+
+constexpr uint8_t MIDI_NONE = 0xFF;
+
+enum class EncoderMode : uint8_t { NONE, DIAL, VOLUME, WHEEL, PAN };
+
+// The mode named as in the focus changes ("none", "dial", ...), if there is one
+std::optional<EncoderMode> encoder_mode_from_name(const std::string &name);
+
+// A MIDI map, values that aren't set send nothing
+struct MidiMap {
+    uint8_t channel = 1; // 1-16
+    std::array<std::optional<uint8_t>, KEY_COUNT> key_notes;
+    std::array<std::optional<uint8_t>, ENCODER_COUNT> encoder_ccs = {std::nullopt, 16};
+    std::array<std::optional<uint8_t>, ENCODER_COUNT> button_notes = {std::nullopt, 48};
+
+    MidiMap();
+};
+
+// What the host wants a pad to show
+struct Profile {
+    std::string name;
+    std::vector<std::string> key_names;
+    std::array<EncoderMode, ENCODER_COUNT> encoder_modes = {EncoderMode::NONE, EncoderMode::DIAL};
+    MidiMap midi;
+    // Icon atlas number of each key, see scripts/icon_atlas.py
+    std::array<std::optional<uint8_t>, KEY_COUNT> icons;
+};
+
+// A profile as the pad stores it, the payloads of its reports
+struct EncodedProfile {
+    Bytes name;  // Zero padded
+    Bytes keys;  // Space padded, characters the pad can't show replaced by spaces
+    Bytes modes;
+    Bytes midi;  // prof_midi_t
+    Bytes icons; // 0 for none
+
+    bool operator==(const EncodedProfile &other) const;
+    bool operator!=(const EncodedProfile &other) const {
+        return !(*this == other);
+    }
+};
+
+EncodedProfile encode_profile(const Profile &profile);
+
+// The reports that the name report resets to
+extern const Bytes DEFAULT_ENCODER_MODES;
+extern const Bytes DEFAULT_MIDI;
+extern const Bytes NO_ICONS;
+
+// Same as prof_hash() in profiles.c
+uint32_t profile_hash(const EncodedProfile &profile);
+
+struct CacheStatus {
+    uint32_t current_hash = 0;
+    uint32_t hits = 0;
+    uint32_t misses = 0;
+    uint32_t evictions = 0;
+    uint8_t entries = 0;
+    uint8_t capacity = 0;
+};
+
+// Little-endian, as in the reports
+uint32_t read_u32(const Bytes &b, size_t offset);
+
+// Parse a GET_REPORT of the profile cache status, the report id first
+CacheStatus parse_cache_status(const Bytes &report);
+
+// The status as the pad sends it, without the report id
+Bytes pack_cache_status(const CacheStatus &status);
+
+} // namespace macropad
+
+#endif // MACROPAD_HOST_PROTOCOL__H
@@ -0,0 +1,26 @@
+"""Show how long the macropad took to reach its boot milestones.
+
+Replug the pad (or reset the hub port) and run this once it's up.
+"""
+
+import struct
+
+REPORT_BOOT_TIMES = 15
+MILESTONES = ["main", "USB mounted", "display ready", "first frame", "first report"]
+
+
+def main():
+    import hid
+
+    d = hid.device()
+    d.open(vendor_id=0x2E8A, product_id=0xFFEE)
+    r = bytes(d.get_feature_report(REPORT_BOOT_TIMES, 1 + 4 * len(MILESTONES)))
+    d.close()
+
+    times = struct.unpack_from(f"<{len(MILESTONES)}I", r[1:])
+    for name, t in zip(MILESTONES, times):
+        print(f"{name:14}{t / 1000:>10.1f} ms" if t else f"{name:14}{'-':>10}")
+
+
+if __name__ == "__main__":
+    main()
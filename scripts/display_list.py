@@ -0,0 +1,140 @@
+"""Draw host-driven widgets on the macropad's display with the display list report.
+
+Entries are set once and then patched: changing a counter sends only the
+changed bytes of its entry, and the pad redraws only that widget.
+
+    python display_list.py demo        # clock and seconds progress bar
+    python display_list.py clear
+    python display_list.py status
+"""
+
+import argparse
+import struct
+import sys
+import time
+
+VID, PID = 0x2E8A, 0xFFEE
+
+REPORT_DISPLAY_LIST = 17
+REPORT_LEN = 60
+
+OP_END, OP_CLEAR, OP_SET, OP_PATCH, OP_SHOW = range(5)
+TYPE_NONE, TYPE_TEXT, TYPE_BOX, TYPE_FRAME, TYPE_PROGRESS, TYPE_GLYPH = range(6)
+FONTS = {"t0_11": 0, "t0_14": 1, "4x6": 2, "icons": 3}
+
+ENTRIES = 16
+TEXT_LEN = 16
+PROGRESS_MAX = 1000
+ENTRY_FORMAT = f"<BBBBBBH{TEXT_LEN}s"
+ENTRY_LEN = struct.calcsize(ENTRY_FORMAT)
+VALUE_OFFSET, TEXT_OFFSET = 6, 8
+STATUS_FORMAT = "<HII"
+
+
+class DisplayList:
+    """Queues operations and packs them into as few reports as fit."""
+
+    def __init__(self, dev):
+        self.dev = dev
+        self.ops = []
+        self.entries = [None] * ENTRIES  # Last sent contents, for patching
+        self.bytes_sent = 0
+
+    def _entry(self, index, entry):
+        if self.entries[index] is None:
+            self.ops.append(bytes([OP_SET, index]) + entry)
+        else:
+            old = self.entries[index]
+            diff = [i for i in range(ENTRY_LEN) if old[i] != entry[i]]
+            if diff:
+                start, end = diff[0], diff[-1] + 1
+                self.ops.append(bytes([OP_PATCH, index, start, end - start]) + entry[start:end])
+        self.entries[index] = entry
+
+    def text(self, index, x, y, text, font="t0_11"):
+        data = text.encode("ascii", "replace")[:TEXT_LEN]
+        self._entry(index, struct.pack(ENTRY_FORMAT, TYPE_TEXT, FONTS[font], x, y, 0, 0, 0, data))
+
+    def glyph(self, index, x, y, encoding, font="icons"):
+        self._entry(
+            index, struct.pack(ENTRY_FORMAT, TYPE_GLYPH, FONTS[font], x, y, 0, 0, encoding, b"")
+        )
+
+    def box(self, index, x, y, w, h, frame=False):
+        kind = TYPE_FRAME if frame else TYPE_BOX
+        self._entry(index, struct.pack(ENTRY_FORMAT, kind, 0, x, y, w, h, 0, b""))
+
+    def progress(self, index, x, y, w, h, fraction):
+        value = round(max(0.0, min(1.0, fraction)) * PROGRESS_MAX)
+        self._entry(index, struct.pack(ENTRY_FORMAT, TYPE_PROGRESS, 0, x, y, w, h, value, b""))
+
+    def clear(self):
+        self.ops.append(bytes([OP_CLEAR]))
+        self.entries = [None] * ENTRIES
+
+    def show(self):
+        self.ops.append(bytes([OP_SHOW]))
+
+    def flush(self):
+        report = b""
+        for op in self.ops:
+            if len(report) + len(op) > REPORT_LEN:
+                self._send(report)
+                report = b""
+            report += op
+        if report:
+            self._send(report)
+        self.ops = []
+
+    def _send(self, payload):
+        self.bytes_sent += len(payload)
+        self.dev.send_feature_report([REPORT_DISPLAY_LIST] + list(payload.ljust(REPORT_LEN, b"\0")))
+
+    def status(self):
+        r = bytes(self.dev.get_feature_report(REPORT_DISPLAY_LIST, 1 + REPORT_LEN))
+        used, ops, rejected = struct.unpack_from(STATUS_FORMAT, r[1:])
+        return {"used": used, "ops": ops, "rejected": rejected}
+
+
+def demo(dl):
+    dl.clear()
+    dl.glyph(0, 0, 24, 0x0040)
+    dl.text(1, 24, 12, "Host clock")
+    dl.progress(3, 24, 20, 100, 10, 0)
+    dl.show()
+    while True:
+        now = time.localtime()
+        dl.text(2, 96, 12, time.strftime("%H:%M", now), font="4x6")
+        dl.progress(3, 24, 20, 100, 10, now.tm_sec / 59)
+        dl.flush()
+        time.sleep(1)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("command", choices=["demo", "clear", "status"])
+    args = parser.parse_args()
+
+    import hid
+
+    d = hid.device()
+    d.open(vendor_id=VID, product_id=PID)
+    dl = DisplayList(d)
+    try:
+        if args.command == "demo":
+            demo(dl)
+        elif args.command == "clear":
+            dl.clear()
+            dl.flush()
+        else:
+            s = dl.status()
+            print(f"Entries used: {bin(s['used']).count('1')} (mask 0x{s['used']:04x})")
+            print(f"Operations applied: {s['ops']}, reports rejected: {s['rejected']}")
+    except KeyboardInterrupt:
+        print(f"{dl.bytes_sent} payload bytes sent", file=sys.stderr)
+    finally:
+        d.close()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,267 @@
+"""Generate u8g2 fonts that only contain the glyphs the firmware draws.
+
+Scans the firmware sources for the u8g2_SetFont calls and the strings and
+glyphs drawn after each of them, then cuts those glyphs out of the fonts in
+u8g2's u8g2_fonts.c. The generated file defines the fonts under their
+original names, so it replaces u8g2_fonts.c in the build.
+
+Text that isn't a string literal may contain any printable ASCII character,
+unless the line drawing it (or the line above) lists the possible ones:
+
+    // glyphs: [0-9a-z_ ]
+    u8g2_DrawStr(&u8g2, 0, 14, line);
+
+Fonts referenced other than as the argument of u8g2_SetFont, like the
+display list's font table, are kept whole since the glyphs drawn with them
+aren't known at build time, unless a glyphs comment on the same line lists
+them. Drawing after u8g2_SetFont with such an expression isn't scanned.
+
+    python font_subset.py --fonts u8g2/csrc/u8g2_fonts.c --out build/ui_fonts.c src/*.c
+"""
+
+import argparse
+import re
+import sys
+
+HEADER_LEN = 23
+DYNAMIC_FONT = object()  # u8g2_SetFont with an expression, e.g. from a table
+PRINTABLE_ASCII = set(range(0x20, 0x7F))
+
+SET_FONT_RE = re.compile(r"u8g2_SetFont\(\s*[^,]+,\s*([^;]+?)\s*\);")
+FONT_NAME_RE = re.compile(r"\bu8g2_font_\w+")
+DRAW_RE = re.compile(r"u8g2_Draw(Str|UTF8|Glyph)\(\s*[^,]+,[^,]+,[^,]+,\s*(.+?)\s*\);", re.S)
+GLYPHS_COMMENT_RE = re.compile(r"//\s*glyphs:\s*\[(.*)\]")
+FUNCTION_START_RE = re.compile(r"^\w[^;]*\)\s*\{\s*$", re.M)
+FONT_ARRAY_RE = re.compile(
+    r"const\s+uint8_t\s+(\w+)\[\d+\]\s+U8G2_FONT_SECTION\(\"\w+\"\)\s*=\s*((?:\s*\"(?:[^\"\\]|\\.)*\")+)\s*;"
+)
+C_STRING_RE = re.compile(r"\"((?:[^\"\\]|\\.)*)\"")
+C_ESCAPE_RE = re.compile(r"\\([0-7]{1,3}|x[0-9a-fA-F]+|.)")
+SIMPLE_ESCAPES = {"n": 10, "t": 9, "r": 13, "a": 7, "b": 8, "f": 12, "v": 11, "0": 0}
+
+
+def parse_char_class(spec):
+    """Characters of a [..] style class body, e.g. "0-9a-f_ "."""
+    chars = set()
+    i = 0
+    while i < len(spec):
+        if i + 2 < len(spec) and spec[i + 1] == "-":
+            chars.update(range(ord(spec[i]), ord(spec[i + 2]) + 1))
+            i += 3
+        else:
+            chars.add(ord(spec[i]))
+            i += 1
+    return chars
+
+
+def decode_c_string(literal):
+    out = bytearray()
+    pos = 0
+    for m in C_ESCAPE_RE.finditer(literal):
+        out += literal[pos : m.start()].encode("latin-1")
+        esc = m.group(1)
+        if esc[0] in "01234567":
+            out.append(int(esc, 8) & 0xFF)
+        elif esc[0] == "x":
+            out.append(int(esc[1:], 16) & 0xFF)
+        else:
+            out.append(SIMPLE_ESCAPES.get(esc, ord(esc)))
+        pos = m.end()
+    out += literal[pos:].encode("latin-1")
+    return bytes(out)
+
+
+def scan_sources(paths):
+    """Map font name -> set of encodings drawn with it, None for all of them."""
+    used = {}
+    referenced = {}  # Fonts used other than through u8g2_SetFont
+    for path in paths:
+        text = open(path).read()
+        lines = text.splitlines()
+
+        set_font_args = {m.start(1) for m in SET_FONT_RE.finditer(text)}
+        for m in FONT_NAME_RE.finditer(text):
+            if m.start() in set_font_args:
+                continue
+            line = lines[text.count("\n", 0, m.start())]
+            glyphs = GLYPHS_COMMENT_RE.search(line)
+            font = m.group(0)
+            if glyphs and referenced.get(font, set()) is not None:
+                referenced[font] = referenced.get(font, set()) | parse_char_class(glyphs.group(1))
+            else:
+                referenced[font] = None
+        function_starts = [m.start() for m in FUNCTION_START_RE.finditer(text)]
+
+        events = [(m.start(), "font", m) for m in SET_FONT_RE.finditer(text)]
+        events += [(m.start(), "draw", m) for m in DRAW_RE.finditer(text)]
+        events += [(p, "function", None) for p in function_starts]
+        events.sort(key=lambda e: e[0])
+
+        font = None
+        for pos, kind, m in events:
+            if kind == "function":
+                font = None
+            elif kind == "font":
+                font = m.group(1)
+                if not FONT_NAME_RE.fullmatch(font):
+                    font = DYNAMIC_FONT
+                else:
+                    used.setdefault(font, set())
+            elif font == DYNAMIC_FONT:
+                continue
+            else:
+                line_no = text.count("\n", 0, pos)
+                if font is None:
+                    print(
+                        f"{path}:{line_no + 1}: drawing without u8g2_SetFont in the same "
+                        "function, can't tell the font",
+                        file=sys.stderr,
+                    )
+                    sys.exit(1)
+                used[font] |= glyphs_of_call(m.group(1), m.group(2), lines, line_no)
+    for font, glyphs in referenced.items():
+        if glyphs is None or used.get(font) is None:
+            used[font] = glyphs
+        else:
+            used[font] |= glyphs
+    return used
+
+
+def glyphs_of_call(kind, arg, lines, line_no):
+    arg = re.sub(r"/\*.*?\*/", "", arg).strip()
+    if kind == "Glyph":
+        if arg.startswith("'"):
+            return set(decode_c_string(arg[1:-1]))
+        return {int(arg, 0)}
+    literal = C_STRING_RE.fullmatch(arg)
+    if literal:
+        return set(decode_c_string(literal.group(1)))
+    for n in (line_no, line_no - 1):
+        m = GLYPHS_COMMENT_RE.search(lines[n]) if n >= 0 else None
+        if m:
+            return parse_char_class(m.group(1))
+    return set(PRINTABLE_ASCII)
+
+
+def read_fonts(path, names):
+    fonts = {}
+    for m in FONT_ARRAY_RE.finditer(open(path, encoding="latin-1").read()):
+        if m.group(1) in names:
+            fonts[m.group(1)] = b"".join(
+                decode_c_string(s) for s in C_STRING_RE.findall(m.group(2))
+            )
+    missing = names - fonts.keys()
+    if missing:
+        raise SystemExit(f"fonts not found in {path}: {', '.join(sorted(missing))}")
+    return fonts
+
+
+def glyphs_8bit(font):
+    """(encoding, glyph bytes) of the glyphs with 8-bit encodings."""
+    pos = HEADER_LEN
+    while font[pos + 1] != 0:
+        size = font[pos + 1]
+        yield font[pos], font[pos : pos + size]
+        pos += size
+
+
+def glyphs_unicode(font):
+    table = HEADER_LEN + int.from_bytes(font[21:23], "big")
+    # The first lookup table entry leads from the table to the first glyph
+    pos = table + int.from_bytes(font[table : table + 2], "big")
+    while True:
+        encoding = int.from_bytes(font[pos : pos + 2], "big")
+        if encoding == 0:
+            return
+        size = font[pos + 2]
+        yield encoding, font[pos : pos + size]
+        pos += size
+
+
+def subset_font(font, wanted):
+    """A u8g2 font with only the wanted encodings, in the same format."""
+    kept = [(e, g) for e, g in glyphs_8bit(font) if e in wanted]
+    if any(e > 0xFF for e in wanted):
+        kept_unicode = [(e, g) for e, g in glyphs_unicode(font) if e in wanted]
+    else:
+        kept_unicode = []
+
+    body = bytearray()
+    start_upper_a = start_lower_a = None
+    for encoding, glyph in kept:
+        if start_upper_a is None and encoding >= ord("A"):
+            start_upper_a = len(body)
+        if start_lower_a is None and encoding >= ord("a"):
+            start_lower_a = len(body)
+        body += glyph
+    if start_upper_a is None:
+        start_upper_a = len(body)
+    if start_lower_a is None:
+        start_lower_a = len(body)
+    body += b"\0\0"  # End of the 8-bit glyphs
+
+    start_unicode = len(body)
+    # One lookup entry: skip the table, then search the list up to the end
+    body += (4).to_bytes(2, "big") + (0xFFFF).to_bytes(2, "big")
+    for _, glyph in kept_unicode:
+        body += glyph
+    body += b"\0\0"  # End of the unicode glyphs
+
+    header = bytearray(font[:HEADER_LEN])
+    header[0] = len(kept) + len(kept_unicode)
+    header[17:19] = start_upper_a.to_bytes(2, "big")
+    header[19:21] = start_lower_a.to_bytes(2, "big")
+    header[21:23] = start_unicode.to_bytes(2, "big")
+
+    missing = wanted - {e for e, _ in kept} - {e for e, _ in kept_unicode}
+    return bytes(header + body), missing
+
+
+def c_array(name, data):
+    lines = [f"const uint8_t {name}[{len(data)}] U8G2_FONT_SECTION(\"{name}\") = {{"]
+    for i in range(0, len(data), 16):
+        lines.append("    " + ", ".join(f"0x{b:02x}" for b in data[i : i + 16]) + ",")
+    lines.append("};")
+    return "\n".join(lines)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("sources", nargs="+", help="firmware sources to scan")
+    parser.add_argument("--fonts", required=True, help="u8g2's csrc/u8g2_fonts.c")
+    parser.add_argument("--out", required=True, help="generated C file")
+    args = parser.parse_args()
+
+    used = scan_sources(args.sources)
+    fonts = read_fonts(args.fonts, set(used))
+
+    out = [
+        "// Generated by scripts/font_subset.py, do not edit.",
+        "// Subsets of the u8g2 fonts with only the glyphs the firmware draws.",
+        "",
+        '#include "u8g2.h"',
+        "",
+    ]
+    for name in sorted(used):
+        if used[name] is None:
+            print(f"{name}: kept whole, {len(fonts[name])} bytes", file=sys.stderr)
+            out += [c_array(name, fonts[name]), ""]
+            continue
+        subset, missing = subset_font(fonts[name], used[name])
+        if missing - PRINTABLE_ASCII:
+            print(
+                f"{name}: glyphs {sorted(missing - PRINTABLE_ASCII)} not in the font",
+                file=sys.stderr,
+            )
+        print(
+            f"{name}: {len(used[name])} glyphs, {len(fonts[name])} -> {len(subset)} bytes",
+            file=sys.stderr,
+        )
+        out += [c_array(name, subset), ""]
+
+    with open(args.out, "w") as f:
+        f.write("\n".join(out))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,124 @@
+"""Print the firmware's flash and RAM use per component from the linker map.
+
+    python footprint.py build/macropad.elf.map
+    python footprint.py build/macropad.elf.map --files
+
+Initialized data counts towards both flash (its load image) and RAM.
+"""
+
+import argparse
+import re
+from collections import defaultdict
+
+FLASH_BASE, FLASH_END = 0x10000000, 0x11000000
+RAM_BASE, RAM_END = 0x20000000, 0x20042000
+
+OUTPUT_SECTION_RE = re.compile(
+    r"^(\.\S+)\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)(.*load address 0x([0-9a-f]+))?"
+)
+INPUT_SECTION_RE = re.compile(r"^ (\.\S+|COMMON)?\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)\s+(\S.*)$")
+
+COMPONENTS = [
+    ("tinyusb", re.compile(r"tinyusb")),
+    ("pico-sdk", re.compile(r"pico[-_]sdk|/rp2_common/|/common/|boot_stage2")),
+    ("u8g2 fonts", re.compile(r"u8g2_fonts\.c")),
+    ("fonts (subset)", re.compile(r"ui_fonts\.c")),
+    ("u8g2", re.compile(r"u8g2/csrc")),
+    ("libc/libgcc", re.compile(r"lib(c|c_nano|m|gcc|nosys|g|g_nano)\.a")),
+]
+SRC_RE = re.compile(r"macropad\.dir/src/(\w+\.c)\.obj")
+
+
+def component(obj):
+    for name, pattern in COMPONENTS:
+        if pattern.search(obj):
+            return name
+    m = SRC_RE.search(obj)
+    return m.group(1) if m else "other"
+
+
+def in_flash(addr):
+    return FLASH_BASE <= addr < FLASH_END
+
+
+def in_ram(addr):
+    return RAM_BASE <= addr < RAM_END
+
+
+def parse_map(path):
+    """Map object file -> [flash bytes, RAM bytes]."""
+    usage = defaultdict(lambda: [0, 0])
+    lines = open(path).read().splitlines()
+    try:
+        # Discarded input sections come before this, don't count them
+        start = lines.index("Linker script and memory map")
+    except ValueError:
+        raise SystemExit(f"{path} doesn't look like a GNU ld map file")
+
+    in_output = None  # (VMA in RAM, loaded from flash)
+    pending = None  # Section name on its own line, values on the next
+    for line in lines[start + 1 :]:
+        m = OUTPUT_SECTION_RE.match(line)
+        if m:
+            vma = int(m.group(2), 16)
+            # .bss gets a load address too, but nothing is copied from there
+            loaded = m.group(5) is not None and not m.group(1).startswith(".bss")
+            in_output = (in_ram(vma), loaded and in_flash(int(m.group(5), 16)))
+            pending = None
+            continue
+        if in_output is None:
+            continue
+        if pending is None and re.fullmatch(r" (\.\S+|COMMON)", line):
+            pending = line
+            continue
+        if pending is not None:
+            line = pending + line
+            pending = None
+        m = INPUT_SECTION_RE.match(line)
+        if not m or m.group(4).startswith("load address"):
+            continue
+        addr, size, obj = int(m.group(2), 16), int(m.group(3), 16), m.group(4).strip()
+        if size == 0:
+            continue
+        ram, loaded = in_output
+        if in_flash(addr):
+            usage[obj][0] += size
+        elif in_ram(addr) or ram:
+            usage[obj][1] += size
+            if loaded:
+                usage[obj][0] += size
+    return usage
+
+
+def print_table(rows, title):
+    total_flash = sum(f for _, f, _ in rows)
+    total_ram = sum(r for _, _, r in rows)
+    width = max([len(title)] + [len(name) for name, _, _ in rows])
+    print(f"{title:<{width}}  {'flash':>8}  {'RAM':>8}")
+    for name, flash, ram in sorted(rows, key=lambda r: (-r[1], -r[2])):
+        print(f"{name:<{width}}  {flash:>8}  {ram:>8}")
+    print(f"{'total':<{width}}  {total_flash:>8}  {total_ram:>8}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("map", help="linker map, e.g. build/macropad.elf.map")
+    parser.add_argument("--files", action="store_true", help="list every object file")
+    args = parser.parse_args()
+
+    usage = parse_map(args.map)
+    if args.files:
+        rows = [(obj, flash, ram) for obj, (flash, ram) in usage.items()]
+        print_table(rows, "object")
+        return
+
+    by_component = defaultdict(lambda: [0, 0])
+    for obj, (flash, ram) in usage.items():
+        c = by_component[component(obj)]
+        c[0] += flash
+        c[1] += ram
+    print_table([(name, f, r) for name, (f, r) in by_component.items()], "component")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,488 @@
+"""Update the macropad's firmware over HID, without BOOTSEL.
+
+The image is streamed into the pad's staging flash region one 4 kB block at a
+time and each block is checked against its CRC. Once the whole staged image
+verifies, the pad asks for the update to be confirmed on its display. It then
+reboots, and the boot stage copies the image over the firmware (resuming after
+a power loss).
+
+Updates resume where they left off: blocks already staged with the right
+contents are skipped. Blocks identical to a block of the running firmware are
+copied on the pad instead of sent (delta update).
+
+    python fw_update.py build/macropad.uf2
+    python fw_update.py --mock --mock-flash /tmp/pad.bin --mock-disconnect-after 200 fw.bin
+    python fw_update.py --mock --mock-power-loss-after 3 fw.bin
+
+With --mock, an in-process flash mock that implements the firmware's side of
+the protocol (fw_update.c) and the boot stage stands in for the pad. It
+confirms updates by itself, unless given --mock-decline.
+"""
+
+import argparse
+import random
+import struct
+import sys
+import time
+import zlib
+
+VID, PID = 0x2E8A, 0xFFEE
+REPORT_FW_UPDATE = 12
+REPORT_LEN = 60
+
+BLOCK_SIZE = 4096
+DATA_CHUNK_LEN = 52
+# As in src/flash_layout.h
+FIRMWARE_OFFSET = 0x008000
+FIRMWARE_SIZE = 0x0F8000
+STAGING_OFFSET = 0x100000
+STAGING_SIZE = 0x0F0000
+UPDATE_RECORD_OFFSET = 0x1FD000
+FLASH_SIZE = 0x200000
+BOOT2_SIZE = 256
+VECTOR_TABLE_OFFSET = 0x100
+RECORD_MAGIC = 0x5055574D
+RECORD_FORMAT = "<IIII"
+# Between status polls while the pad is busy
+POLL_INTERVAL = 0.005
+# How far past the end of the new image to look for blocks to copy
+DELTA_SEARCH_SLACK = 16
+COMMIT_RETRIES = 3
+
+CMD_BEGIN, CMD_DATA, CMD_COMMIT_BLOCK, CMD_COPY_BLOCK, CMD_QUERY_CRC, CMD_FINISH, CMD_APPLY = range(7)
+STATE_IDLE, STATE_RECEIVING, STATE_VERIFIED, STATE_APPLYING, STATE_CONFIRMING = range(5)
+OK, ERR_BAD_REQUEST, ERR_BAD_STATE, ERR_CRC, ERR_VERIFY, ERR_IMAGE, BUSY, ERR_DECLINED = range(8)
+RESULT_NAMES = [
+    "ok", "bad request", "bad state", "crc mismatch", "verify failed", "not an image", "busy",
+    "declined on the pad",
+]
+REGION_FIRMWARE, REGION_STAGING = 0, 1
+
+STATUS_FORMAT = "<BBHIIIHHH"
+STATUS_FIELDS = (
+    "state result block crc image_size max_image_size block_size blocks_written blocks_copied"
+).split()
+
+UF2_MAGIC = (0x0A324655, 0x9E5D5157, 0x0AB16F30)
+XIP_BASE = 0x10000000
+UF2_FIRMWARE_BASE = XIP_BASE + FIRMWARE_OFFSET
+
+
+def boot2_crc(data):
+    """CRC-32/MPEG-2, which the boot ROM checks over the second stage bootloader."""
+    crc = 0xFFFFFFFF
+    for b in data:
+        crc ^= b << 24
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x04C11DB7 if crc & 0x80000000 else crc << 1) & 0xFFFFFFFF
+    return crc
+
+
+def boot2_valid(image):
+    if len(image) < BOOT2_SIZE:
+        return False
+    (expected,) = struct.unpack_from("<I", image, BOOT2_SIZE - 4)
+    return boot2_crc(image[: BOOT2_SIZE - 4]) == expected
+
+
+def reset_vector_valid(image):
+    """The boot stage starts the image at its reset vector, which must be in the image."""
+    if len(image) < VECTOR_TABLE_OFFSET + 8:
+        return False
+    (reset,) = struct.unpack_from("<I", image, VECTOR_TABLE_OFFSET + 4)
+    return bool(reset & 1) and 0 <= reset - UF2_FIRMWARE_BASE < len(image)
+
+
+def load_image(path):
+    data = open(path, "rb").read()
+    if not path.endswith(".uf2"):
+        return data
+
+    image = bytearray()
+    for pos in range(0, len(data), 512):
+        m0, m1, _flags, addr, size, _, _, _ = struct.unpack_from("<8I", data, pos)
+        (m_end,) = struct.unpack_from("<I", data, pos + 508)
+        if (m0, m1, m_end) != UF2_MAGIC:
+            raise ValueError(f"bad UF2 block at offset {pos}")
+        offset = addr - UF2_FIRMWARE_BASE
+        if offset < 0 or offset + size > FIRMWARE_SIZE:
+            raise ValueError(
+                f"UF2 block outside the firmware region: {addr:#x} (not linked for {UF2_FIRMWARE_BASE:#x})"
+            )
+        if len(image) < offset + size:
+            image.extend(b"\xff" * (offset + size - len(image)))
+        image[offset : offset + size] = data[pos + 32 : pos + 32 + size]
+    return bytes(image)
+
+
+def block_of(image, index):
+    """Block as the pad stores it: bytes past the end of the image stay erased."""
+    block = image[index * BLOCK_SIZE : (index + 1) * BLOCK_SIZE]
+    return block + b"\xff" * (BLOCK_SIZE - len(block))
+
+
+def pack_request(cmd, block=0, body=b""):
+    req = struct.pack("<BH", cmd, block) + body
+    return req + bytes(REPORT_LEN - len(req))
+
+
+class MockFlashDevice:
+    """The firmware's update handling (fw_update.c) and the boot stage (boot_stage.c) over a
+    flash image in a file or in memory."""
+
+    def __init__(
+        self, flash_path=None, firmware=None, corrupt_rate=0.0, disconnect_after=None,
+        decline=False, power_loss_after=None,
+    ):
+        self.flash_path = flash_path
+        self.flash = bytearray(b"\xff" * FLASH_SIZE)
+        if flash_path:
+            try:
+                self.flash[:] = open(flash_path, "rb").read()
+            except FileNotFoundError:
+                pass
+        if firmware is not None:
+            self.flash[FIRMWARE_OFFSET : FIRMWARE_OFFSET + len(firmware)] = firmware
+        self.corrupt_rate = corrupt_rate
+        self.disconnect_after = disconnect_after
+        self.decline = decline
+        self.power_loss_after = power_loss_after
+        self.reports = 0
+        # The command fw_update_task is working on, done by the next status read
+        self.job = None
+
+        self.status = dict.fromkeys(STATUS_FIELDS, 0)
+        self.status.update(max_image_size=STAGING_SIZE, block_size=BLOCK_SIZE)
+        self.image_crc = 0
+        self.buf = None
+        self.buf_index = -1
+        self.rebooted = False
+
+    def _count_report(self):
+        self.reports += 1
+        if self.disconnect_after is not None and self.reports > self.disconnect_after:
+            raise OSError("mock device disconnected")
+
+    def _region_offset(self, region):
+        return STAGING_OFFSET if region == REGION_STAGING else FIRMWARE_OFFSET
+
+    def _flash_crc(self, region, block):
+        start = self._region_offset(region) + block * BLOCK_SIZE
+        return zlib.crc32(self.flash[start : start + BLOCK_SIZE])
+
+    def _stage(self, block, crc, copied):
+        if zlib.crc32(self.buf) != crc:
+            return ERR_CRC
+        start = STAGING_OFFSET + block * BLOCK_SIZE
+        self.flash[start : start + BLOCK_SIZE] = self.buf
+        self.status["blocks_copied" if copied else "blocks_written"] += 1
+        return OK
+
+    def _verify(self):
+        s = self.status
+        staged = bytes(self.flash[STAGING_OFFSET : STAGING_OFFSET + s["image_size"]])
+        if zlib.crc32(staged) != self.image_crc:
+            return ERR_VERIFY
+        if not boot2_valid(staged) or not reset_vector_valid(staged):
+            return ERR_IMAGE
+        s["state"] = STATE_VERIFIED
+        return OK
+
+    def _confirm(self):
+        s = self.status
+        if self.decline:
+            s["state"] = STATE_VERIFIED
+            return ERR_DECLINED
+        record = struct.pack("<III", RECORD_MAGIC, s["image_size"], self.image_crc)
+        record += struct.pack("<I", zlib.crc32(record))
+        self.flash[UPDATE_RECORD_OFFSET : UPDATE_RECORD_OFFSET + BLOCK_SIZE] = record.ljust(
+            BLOCK_SIZE, b"\xff"
+        )
+        s["state"] = STATE_APPLYING
+        self.rebooted = True
+        return OK
+
+    def boot(self, power_loss_after=None):
+        """What the boot stage does, returns whether it got to start the firmware. The power
+        is cut after copying power_loss_after blocks."""
+        magic, size, crc, record_crc = struct.unpack_from(RECORD_FORMAT, self.flash, UPDATE_RECORD_OFFSET)
+        record = self.flash[UPDATE_RECORD_OFFSET : UPDATE_RECORD_OFFSET + 12]
+        if magic != RECORD_MAGIC or record_crc != zlib.crc32(record):
+            return True
+        erased_record = b"\xff" * BLOCK_SIZE
+        if zlib.crc32(self.flash[STAGING_OFFSET : STAGING_OFFSET + size]) != crc:
+            self.flash[UPDATE_RECORD_OFFSET : UPDATE_RECORD_OFFSET + BLOCK_SIZE] = erased_record
+            return True
+
+        copied = 0
+        for i in range((size + BLOCK_SIZE - 1) // BLOCK_SIZE):
+            src = STAGING_OFFSET + i * BLOCK_SIZE
+            dst = FIRMWARE_OFFSET + i * BLOCK_SIZE
+            if self.flash[dst : dst + BLOCK_SIZE] == self.flash[src : src + BLOCK_SIZE]:
+                continue
+            if power_loss_after is not None and copied == power_loss_after:
+                # Mid-erase
+                self.flash[dst : dst + BLOCK_SIZE] = b"\xff" * BLOCK_SIZE
+                return False
+            self.flash[dst : dst + BLOCK_SIZE] = self.flash[src : src + BLOCK_SIZE]
+            copied += 1
+        if zlib.crc32(self.flash[FIRMWARE_OFFSET : FIRMWARE_OFFSET + size]) != crc:
+            return False
+
+        self.flash[UPDATE_RECORD_OFFSET : UPDATE_RECORD_OFFSET + BLOCK_SIZE] = erased_record
+        staged_len = (size + BLOCK_SIZE - 1) // BLOCK_SIZE * BLOCK_SIZE
+        self.flash[STAGING_OFFSET : STAGING_OFFSET + staged_len] = b"\xff" * staged_len
+        return True
+
+    def _image_blocks(self):
+        return (self.status["image_size"] + BLOCK_SIZE - 1) // BLOCK_SIZE
+
+    def _handle(self, cmd, block, body):
+        s = self.status
+        receiving = s["state"] == STATE_RECEIVING
+        if cmd == CMD_BEGIN:
+            size, crc = struct.unpack_from("<II", body)
+            if s["state"] == STATE_APPLYING:
+                return ERR_BAD_STATE
+            if size == 0 or size > STAGING_SIZE:
+                return ERR_BAD_REQUEST
+            s.update(state=STATE_RECEIVING, image_size=size, blocks_written=0, blocks_copied=0)
+            self.image_crc = crc
+            self.buf_index = -1
+            return OK
+        if cmd == CMD_DATA:
+            offset, length = struct.unpack_from("<HB", body)
+            if not receiving:
+                return ERR_BAD_STATE
+            if block >= self._image_blocks() or length > DATA_CHUNK_LEN:
+                return ERR_BAD_REQUEST
+            if offset + length > BLOCK_SIZE:
+                return ERR_BAD_REQUEST
+            if self.buf_index != block:
+                self.buf = bytearray(b"\xff" * BLOCK_SIZE)
+                self.buf_index = block
+            chunk = bytearray(body[3 : 3 + length])
+            if chunk and random.random() < self.corrupt_rate:
+                chunk[random.randrange(length)] ^= 0x01
+            self.buf[offset : offset + length] = chunk
+            return OK
+        if cmd == CMD_COMMIT_BLOCK:
+            (crc,) = struct.unpack_from("<I", body)
+            if not receiving:
+                return ERR_BAD_STATE
+            if self.buf_index != block:
+                return ERR_BAD_REQUEST
+            self.buf_index = -1
+            self.job = lambda: self._stage(block, crc, copied=False)
+            return BUSY
+        if cmd == CMD_COPY_BLOCK:
+            crc, src = struct.unpack_from("<IH", body)
+            if not receiving:
+                return ERR_BAD_STATE
+            if block >= self._image_blocks() or src >= FIRMWARE_SIZE // BLOCK_SIZE:
+                return ERR_BAD_REQUEST
+            start = FIRMWARE_OFFSET + src * BLOCK_SIZE
+            self.buf = self.flash[start : start + BLOCK_SIZE]
+            self.buf_index = -1
+            self.job = lambda: self._stage(block, crc, copied=True)
+            return BUSY
+        if cmd == CMD_QUERY_CRC:
+            region = body[0]
+            size = STAGING_SIZE if region == REGION_STAGING else FIRMWARE_SIZE
+            if region > REGION_STAGING or block >= size // BLOCK_SIZE:
+                return ERR_BAD_REQUEST
+            s["crc"] = self._flash_crc(region, block)
+            return OK
+        if cmd == CMD_FINISH:
+            size, crc = struct.unpack_from("<II", body)
+            if not receiving:
+                return ERR_BAD_STATE
+            if size != s["image_size"] or crc != self.image_crc:
+                return ERR_BAD_REQUEST
+            self.job = self._verify
+            return BUSY
+        if cmd == CMD_APPLY:
+            if s["state"] != STATE_VERIFIED:
+                return ERR_BAD_STATE
+            s["state"] = STATE_CONFIRMING
+            self.job = self._confirm
+            return BUSY
+        return ERR_BAD_REQUEST
+
+    def send_feature_report(self, data):
+        self._count_report()
+        assert data[0] == REPORT_FW_UPDATE and len(data) == 1 + REPORT_LEN
+        payload = bytes(data[1:])
+        cmd, block = struct.unpack_from("<BH", payload)
+        if self.job:
+            # Ignored while busy
+            return len(data)
+        self.status["block"] = block
+        self.status["result"] = self._handle(cmd, block, payload[3:])
+        return len(data)
+
+    def get_feature_report(self, report_id, length):
+        self._count_report()
+        assert report_id == REPORT_FW_UPDATE
+        if self.job:
+            self.status["result"] = self.job()
+            self.job = None
+        status = struct.pack(STATUS_FORMAT, *(self.status[f] for f in STATUS_FIELDS))
+        report = bytes([report_id]) + status + bytes(REPORT_LEN - len(status))
+        return list(report)[:length]
+
+    def close(self):
+        if self.flash_path:
+            with open(self.flash_path, "wb") as f:
+                f.write(self.flash)
+
+
+class UpdateError(Exception):
+    pass
+
+
+class Updater:
+    def __init__(self, dev, verbose=False):
+        self.dev = dev
+        self.verbose = verbose
+        self.reports = 0
+
+    def _send(self, cmd, block=0, body=b""):
+        self.dev.send_feature_report([REPORT_FW_UPDATE] + list(pack_request(cmd, block, body)))
+        self.reports += 1
+
+    def status(self):
+        r = bytes(self.dev.get_feature_report(REPORT_FW_UPDATE, 1 + REPORT_LEN))
+        self.reports += 1
+        return dict(zip(STATUS_FIELDS, struct.unpack_from(STATUS_FORMAT, r[1:])))
+
+    def _command(self, cmd, block=0, body=b"", allowed=(OK,)):
+        self._send(cmd, block, body)
+        s = self.status()
+        while s["result"] == BUSY:
+            time.sleep(POLL_INTERVAL)
+            s = self.status()
+        if s["result"] not in allowed:
+            raise UpdateError(f"command {cmd} for block {block}: {RESULT_NAMES[s['result']]}")
+        return s
+
+    def query_crc(self, region, block):
+        return self._command(CMD_QUERY_CRC, block, bytes([region]))["crc"]
+
+    def _send_block(self, index, block, crc):
+        for attempt in range(COMMIT_RETRIES):
+            for offset in range(0, BLOCK_SIZE, DATA_CHUNK_LEN):
+                chunk = block[offset : offset + DATA_CHUNK_LEN]
+                body = struct.pack("<HB", offset, len(chunk)) + chunk
+                self._send(CMD_DATA, index, body)
+            s = self._command(CMD_COMMIT_BLOCK, index, struct.pack("<I", crc), (OK, ERR_CRC))
+            if s["result"] == OK:
+                return
+            print(f"Block {index} arrived corrupted, resending", file=sys.stderr)
+        raise UpdateError(f"block {index} failed {COMMIT_RETRIES} times")
+
+    def update(self, image, apply=True):
+        s = self.status()
+        if len(image) > s["max_image_size"]:
+            raise UpdateError(f"image is {len(image)} bytes, the pad takes {s['max_image_size']}")
+        if s["block_size"] != BLOCK_SIZE:
+            raise UpdateError(f"unexpected block size {s['block_size']}")
+        if not boot2_valid(image):
+            raise UpdateError("not an RP2040 image (boot2 checksum mismatch)")
+        if not reset_vector_valid(image):
+            raise UpdateError(f"not an image linked for the firmware region at {UF2_FIRMWARE_BASE:#x}")
+
+        image_crc = zlib.crc32(image)
+        n_blocks = (len(image) + BLOCK_SIZE - 1) // BLOCK_SIZE
+        self._command(CMD_BEGIN, 0, struct.pack("<II", len(image), image_crc))
+
+        # Where each block could come from without sending it
+        n_search = min(FIRMWARE_SIZE // BLOCK_SIZE, n_blocks + DELTA_SEARCH_SLACK)
+        firmware_blocks = {}
+        for i in range(n_search):
+            firmware_blocks.setdefault(self.query_crc(REGION_FIRMWARE, i), i)
+
+        skipped = copied = sent = 0
+        start = time.monotonic()
+        for i in range(n_blocks):
+            block = block_of(image, i)
+            crc = zlib.crc32(block)
+            if self.query_crc(REGION_STAGING, i) == crc:
+                skipped += 1
+            elif crc in firmware_blocks:
+                self._command(CMD_COPY_BLOCK, i, struct.pack("<IH", crc, firmware_blocks[crc]))
+                copied += 1
+            else:
+                self._send_block(i, block, crc)
+                sent += 1
+            if self.verbose:
+                print(f"\rBlock {i + 1}/{n_blocks}", end="", file=sys.stderr)
+        if self.verbose:
+            print(file=sys.stderr)
+
+        self._command(CMD_FINISH, 0, struct.pack("<II", len(image), image_crc))
+        elapsed = time.monotonic() - start
+        print(
+            f"Staged {n_blocks} blocks in {elapsed:.1f} s: {sent} sent, {copied} copied from the "
+            f"running firmware, {skipped} already staged ({self.reports} reports)"
+        )
+        if apply:
+            print("Confirm the update on the pad")
+            self._command(CMD_APPLY)
+            print("Installing, the pad reboots into the new firmware")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("image", help="firmware image, .bin or .uf2")
+    parser.add_argument("--no-apply", action="store_true", help="stage and verify only")
+    parser.add_argument("-v", "--verbose", action="store_true")
+    mock = parser.add_argument_group("mock device")
+    mock.add_argument("--mock", action="store_true", help="update a flash mock instead of a pad")
+    mock.add_argument("--mock-flash", metavar="FILE", help="keep the mock's flash in FILE")
+    mock.add_argument("--mock-firmware", metavar="FILE", help="running firmware of the mock")
+    mock.add_argument("--mock-corrupt", type=float, default=0.0, metavar="P",
+                      help="corrupt a data chunk with probability P")
+    mock.add_argument("--mock-disconnect-after", type=int, metavar="N",
+                      help="fail after N reports, to try resuming")
+    mock.add_argument("--mock-decline", action="store_true", help="decline the update on the pad")
+    mock.add_argument("--mock-power-loss-after", type=int, metavar="N",
+                      help="cut the power after the boot stage copied N blocks")
+    args = parser.parse_args()
+
+    image = load_image(args.image)
+
+    if args.mock:
+        firmware = load_image(args.mock_firmware) if args.mock_firmware else None
+        dev = MockFlashDevice(
+            args.mock_flash, firmware, args.mock_corrupt, args.mock_disconnect_after,
+            args.mock_decline,
+        )
+    else:
+        import hid
+
+        dev = hid.device()
+        dev.open(vendor_id=VID, product_id=PID)
+
+    try:
+        Updater(dev, args.verbose).update(image, apply=not args.no_apply)
+        if args.mock and dev.rebooted:
+            if not dev.boot(args.mock_power_loss_after):
+                print("Mock lost power while installing, booting again")
+            if not dev.boot():
+                raise UpdateError("mock boot stage failed to install the update")
+    except (UpdateError, OSError) as e:
+        print(f"Update failed: {e}", file=sys.stderr)
+        sys.exit(1)
+    finally:
+        dev.close()
+
+    if args.mock and dev.rebooted:
+        firmware = bytes(dev.flash[FIRMWARE_OFFSET : FIRMWARE_OFFSET + len(image)])
+        ok = firmware == image
+        print(f"Mock firmware {'matches' if ok else 'DOES NOT MATCH'} the image")
+        sys.exit(0 if ok else 1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,135 @@
+"""Upload key icons to the macropad's icon atlas.
+
+The icons are 8x8 PBM images (P1 or P4, e.g. from `convert play.png play.pbm`),
+numbered from 1 in the order given. Black PBM pixels are lit on the display.
+Profiles pick icons by number (send_profile.py --icons), and the upload is
+skipped when the pad already has the same atlas.
+
+    python icon_atlas.py upload play.pbm stop.pbm rec.pbm
+    python icon_atlas.py status
+"""
+
+import argparse
+import struct
+import sys
+
+VID, PID = 0x2E8A, 0xFFEE
+
+REPORT_ICON_ATLAS = 22
+REPORT_LEN = 51
+STATUS_FORMAT = "<IBBBB"
+OP_BEGIN, OP_ICONS, OP_COMMIT = 1, 2, 3
+CHUNK_ICONS = 6
+ICON_W, ICON_H = 8, 8
+MAX_ICONS = 255
+RESULTS = ["ok", "bad request", "bad state", "icons missing"]
+
+
+def read_pbm(path):
+    """The icon as XBM rows, one byte per row with the leftmost pixel in bit 0"""
+    with open(path, "rb") as f:
+        data = f.read()
+    # Header: magic, width, height, with comments and any whitespace in between
+    fields, pos = [], 0
+    while len(fields) < 3:
+        while data[pos : pos + 1].isspace():
+            pos += 1
+        if data[pos : pos + 1] == b"#":
+            pos = data.index(b"\n", pos)
+            continue
+        end = pos
+        while end < len(data) and not data[end : end + 1].isspace():
+            end += 1
+        fields.append(data[pos:end])
+        pos = end
+    magic, w, h = fields[0], int(fields[1]), int(fields[2])
+    if w > ICON_W or h > ICON_H:
+        raise ValueError(f"{path} is {w}x{h}, icons are at most {ICON_W}x{ICON_H}")
+
+    if magic == b"P1":
+        bits = [int(c) for c in data[pos:].decode("ascii") if c in "01"]
+        pixel = lambda x, y: bits[y * w + x]
+    elif magic == b"P4":
+        raster = data[pos + 1 :]
+        stride = (w + 7) // 8
+        pixel = lambda x, y: raster[y * stride + x // 8] >> (7 - x % 8) & 1
+    else:
+        raise ValueError(f"{path} is not a PBM image")
+
+    rows = bytearray(ICON_H)
+    for y in range(h):
+        for x in range(w):
+            rows[y] |= pixel(x, y) << x
+    return bytes(rows)
+
+
+def atlas_id(icons):
+    """FNV-1a over the icons, never 0 (no atlas)"""
+    h = 2166136261
+    for c in bytes([len(icons)]) + b"".join(icons):
+        h = ((h ^ c) * 16777619) & 0xFFFFFFFF
+    return h or 1
+
+
+def read_status(dev):
+    r = bytes(dev.get_feature_report(REPORT_ICON_ATLAS, 1 + REPORT_LEN))[1:]
+    names = "id count receiving received result".split()
+    return dict(zip(names, struct.unpack_from(STATUS_FORMAT, r)))
+
+
+def send(dev, payload):
+    dev.send_feature_report([REPORT_ICON_ATLAS] + list(payload.ljust(REPORT_LEN, b"\0")))
+
+
+def upload(dev, icons):
+    h = atlas_id(icons)
+    status = read_status(dev)
+    if status["id"] == h and status["count"] == len(icons):
+        print(f"Atlas {h:08x} with {len(icons)} icons already on the pad")
+        return
+
+    send(dev, struct.pack("<BBI", OP_BEGIN, len(icons), h))
+    for first in range(0, len(icons), CHUNK_ICONS):
+        chunk = icons[first : first + CHUNK_ICONS]
+        send(dev, struct.pack("<BBB", OP_ICONS, first + 1, len(chunk)) + b"".join(chunk))
+    send(dev, bytes([OP_COMMIT]))
+
+    status = read_status(dev)
+    if status["result"] != 0 or status["id"] != h:
+        sys.exit(f"Upload failed: {RESULTS[status['result']]}")
+    print(f"Stored atlas {h:08x} with {len(icons)} icons")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    sub = parser.add_subparsers(dest="command", required=True)
+    up = sub.add_parser("upload", help="store the icons as the atlas, numbered from 1")
+    up.add_argument("icons", nargs="+", metavar="PBM")
+    sub.add_parser("status", help="show the stored atlas")
+    args = parser.parse_args()
+
+    icons = []
+    if args.command == "upload":
+        if len(args.icons) > MAX_ICONS:
+            parser.error(f"at most {MAX_ICONS} icons")
+        icons = [read_pbm(path) for path in args.icons]
+
+    import hid
+
+    d = hid.device()
+    d.open(vendor_id=VID, product_id=PID)
+    try:
+        if args.command == "upload":
+            upload(d, icons)
+        else:
+            s = read_status(d)
+            if s["id"] == 0:
+                print("No icon atlas stored")
+            else:
+                print(f"Atlas {s['id']:08x} with {s['count']} icons")
+    finally:
+        d.close()
+
+
+if __name__ == "__main__":
+    main()
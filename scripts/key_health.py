@@ -0,0 +1,50 @@
+"""Show the macropad's per-key bounce counts and debounce times.
+
+A key whose debounce keeps climbing to the maximum is wearing out and worth
+replacing.
+
+    python key_health.py           # show the counts
+    python key_health.py reset     # clear the counts and debounce times
+"""
+
+import argparse
+import struct
+
+REPORT_KEY_HEALTH = 18
+WIDTH, HEIGHT = 4, 3
+KEYS = WIDTH * HEIGHT
+REPORT_LEN = 3 * KEYS
+MAX_EXTRA_MS = 40
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("command", nargs="?", choices=["show", "reset"], default="show")
+    args = parser.parse_args()
+
+    import hid
+
+    d = hid.device()
+    d.open(vendor_id=0x2E8A, product_id=0xFFEE)
+    try:
+        if args.command == "reset":
+            d.send_feature_report([REPORT_KEY_HEALTH] + [0] * REPORT_LEN)
+            return
+        r = bytes(d.get_feature_report(REPORT_KEY_HEALTH, 1 + REPORT_LEN))
+    finally:
+        d.close()
+
+    bounces = struct.unpack_from(f"<{KEYS}H", r[1:])
+    extra_ms = r[1 + 2 * KEYS : 1 + 3 * KEYS]
+    print("key (row,col)   bounces   extra debounce")
+    for key in range(KEYS):
+        row, col = divmod(key, WIDTH)
+        print(f"{key:3} ({row},{col})  {bounces[key]:>10}   {extra_ms[key]:>4} ms")
+
+    worn = [key for key in range(KEYS) if extra_ms[key] >= MAX_EXTRA_MS]
+    if worn:
+        print(f"Consider replacing the switches of keys {', '.join(map(str, worn))}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,386 @@
+"""Host daemon that keeps every connected macropad showing the active profile.
+
+Reads focus changes from stdin, one JSON object per line:
+
+    {"name": "Firefox", "keys": ["Back", "Fwd", "Tab", ...], "encoders": ["none", "wheel"]}
+
+and pushes them to all connected pads. Bursts of focus changes are coalesced
+into one update, and a pad is never sent a report it already has: profiles the
+pad has cached are activated by hash, and on a miss only the reports whose
+contents differ are uploaded.
+
+    window-watcher | python macropad_host.py
+    python macropad_host.py --mock 2 -v < focus_log.jsonl
+
+With --mock, in-process mock pads that implement the firmware's side of the
+protocol stand in for real hardware.
+
+An optional "midi" object sets the profile's MIDI map, with any of "channel"
+(1-16), "notes" (of the keys), "encoders" (controllers) and "buttons" (notes of
+the encoder buttons); null sends nothing:
+
+    {"name": "Live", "keys": [...], "midi": {"channel": 2, "notes": [60, 62, null, ...]}}
+
+An optional "icons" list sets the icon atlas number of each key (see
+icon_atlas.py), null for none.
+
+The same daemon in C++, and the library it's built on, is in host/ (see
+host/CMakeLists.txt). This one is kept for the other scripts here, which share
+send_profile.py with it, and the two are run against the same test.
+"""
+
+import argparse
+import asyncio
+import json
+import struct
+import sys
+from collections import OrderedDict
+from concurrent.futures import ThreadPoolExecutor
+
+from send_profile import (
+    CACHE_FORMAT,
+    DEFAULT_ENCODER_MODES,
+    DEFAULT_MIDI,
+    ENCODER_MODES,
+    NO_ICONS,
+    PID,
+    REPORT_ENCODER_MODES,
+    REPORT_KEY_ICONS,
+    REPORT_KEY_NAMES,
+    REPORT_MIDI_MAP,
+    REPORT_PROFILE_CACHE,
+    REPORT_PROFILE_HASH,
+    REPORT_PROFILE_NAME,
+    VID,
+    encode_icons,
+    encode_midi,
+    encode_profile,
+    profile_hash,
+)
+
+RESCAN_INTERVAL_S = 2.0
+
+
+class MockDevice:
+    """The firmware's profile handling (profiles.c, usb_hid.c) with an hidapi-like interface."""
+
+    CAPACITY = 8
+
+    def __init__(self, serial):
+        self.serial = serial
+        self.name = bytes(18)
+        self.keys = bytes(48)
+        self.modes = DEFAULT_ENCODER_MODES
+        self.midi = DEFAULT_MIDI
+        self.icons = NO_ICONS
+        # hash -> (name, keys, modes, midi, icons), least recently used first
+        self.cache = OrderedDict()
+        self.hits = self.misses = self.evictions = 0
+        self.reports_received = 0
+
+    def get_serial_number_string(self):
+        return self.serial
+
+    def send_feature_report(self, data):
+        self.reports_received += 1
+        report_id, payload = data[0], bytes(data[1:])
+        if report_id == REPORT_PROFILE_NAME:
+            self.name = payload
+            self.modes = DEFAULT_ENCODER_MODES
+            self.midi = DEFAULT_MIDI
+            self.icons = NO_ICONS
+        elif report_id == REPORT_ENCODER_MODES:
+            self.modes = payload
+        elif report_id == REPORT_MIDI_MAP:
+            self.midi = payload
+        elif report_id == REPORT_KEY_ICONS:
+            self.icons = payload
+        elif report_id == REPORT_KEY_NAMES:
+            self.keys = payload
+            h = profile_hash(self.name, self.keys, self.modes, self.midi, self.icons)
+            if h not in self.cache and len(self.cache) == self.CAPACITY:
+                self.cache.popitem(last=False)
+                self.evictions += 1
+            self.cache[h] = (self.name, self.keys, self.modes, self.midi, self.icons)
+            self.cache.move_to_end(h)
+        elif report_id == REPORT_PROFILE_HASH:
+            (h,) = struct.unpack("<I", payload)
+            if h in self.cache:
+                self.hits += 1
+                self.cache.move_to_end(h)
+                self.name, self.keys, self.modes, self.midi, self.icons = self.cache[h]
+            else:
+                self.misses += 1
+        return len(data)
+
+    def get_feature_report(self, report_id, length):
+        assert report_id == REPORT_PROFILE_CACHE
+        status = struct.pack(
+            CACHE_FORMAT,
+            profile_hash(self.name, self.keys, self.modes, self.midi, self.icons),
+            self.hits,
+            self.misses,
+            self.evictions,
+            len(self.cache),
+            self.CAPACITY,
+        )
+        return list(bytes([report_id]) + status)[:length]
+
+    def close(self):
+        pass
+
+
+class Macropad:
+    """One pad and what the host knows about its state. All methods block on USB I/O."""
+
+    def __init__(self, dev, verbose=False):
+        self.dev = dev
+        self.serial = dev.get_serial_number_string()
+        self.verbose = verbose
+
+        # Last contents sent in reports 3, 4, 11, 21 and 23, None when unknown
+        self.name = None
+        self.keys = None
+        self.modes = None
+        self.midi = None
+        self.icons = None
+        self.status = self._read_status()
+        # The pad's cache as far as we know, least recently used first
+        self.cached = OrderedDict()
+
+        self.reports_sent = 0
+        self.updates_skipped = 0
+
+    def _read_status(self):
+        length = 1 + struct.calcsize(CACHE_FORMAT)
+        r = bytes(self.dev.get_feature_report(REPORT_PROFILE_CACHE, length))
+        names = "current_hash hits misses evictions entries capacity".split()
+        return dict(zip(names, struct.unpack_from(CACHE_FORMAT, r[1:])))
+
+    def _send(self, report_id, payload):
+        if self.verbose:
+            print(f"[{self.serial}] report {report_id}: {bytes(payload).hex()}", file=sys.stderr)
+        self.dev.send_feature_report([report_id] + list(payload))
+        self.reports_sent += 1
+
+    def _remember_cached(self, h):
+        self.cached[h] = True
+        self.cached.move_to_end(h)
+        while len(self.cached) > self.status["capacity"]:
+            self.cached.popitem(last=False)
+
+    def apply(self, name, key_names, encoder_modes, midi, icons):
+        name, keys, modes = encode_profile(name, key_names, encoder_modes)
+        h = profile_hash(name, keys, modes, midi, icons)
+
+        if h == self.status["current_hash"]:
+            self.updates_skipped += 1
+            return
+
+        if h in self.cached:
+            self._send(REPORT_PROFILE_HASH, struct.pack("<I", h))
+            self.status = self._read_status()
+            if self.status["current_hash"] == h:
+                self._remember_cached(h)
+                # The pad's current profile no longer matches what we last uploaded
+                self.name = self.keys = self.modes = self.midi = self.icons = None
+                return
+            # Evicted behind our back (e.g. another host), fall back to uploading
+            del self.cached[h]
+
+        if name != self.name:
+            self._send(REPORT_PROFILE_NAME, name)
+            self.name = name
+            self.modes = DEFAULT_ENCODER_MODES
+            self.midi = DEFAULT_MIDI
+            self.icons = NO_ICONS
+        if modes != self.modes:
+            self._send(REPORT_ENCODER_MODES, modes)
+            self.modes = modes
+        if midi != self.midi:
+            self._send(REPORT_MIDI_MAP, midi)
+            self.midi = midi
+        if icons != self.icons:
+            self._send(REPORT_KEY_ICONS, icons)
+            self.icons = icons
+        if keys != self.keys:
+            self._send(REPORT_KEY_NAMES, keys)
+            self.keys = keys
+            # The pad caches the profile when the key names arrive
+            self._remember_cached(h)
+        self.status["current_hash"] = h
+
+    def stats(self):
+        s = self._read_status()
+        return (
+            f"[{self.serial}] {self.reports_sent} reports sent, {self.updates_skipped} updates "
+            f"skipped, pad cache {s['hits']} hits / {s['misses']} misses"
+        )
+
+    def close(self):
+        self.dev.close()
+
+
+def parse_midi(midi):
+    args = {}
+    if "channel" in midi:
+        args["channel"] = int(midi["channel"])
+        if not 1 <= args["channel"] <= 16:
+            raise ValueError(f"bad MIDI channel {args['channel']}")
+    # Controllers 120-127 are channel mode messages
+    for key, arg, count, highest in (
+        ("notes", "notes", None, 127),
+        ("encoders", "encoder_ccs", 2, 119),
+        ("buttons", "button_notes", 2, 127),
+    ):
+        if key not in midi:
+            continue
+        values = [None if v is None else int(v) for v in midi[key]]
+        if count is not None and len(values) != count:
+            raise ValueError(f"MIDI {key} needs {count} values")
+        if not all(v is None or 0 <= v <= highest for v in values):
+            raise ValueError(f"bad MIDI {key} {values}")
+        args[arg] = values
+    return encode_midi(**args)
+
+
+def parse_icons(icons):
+    icons = [None if i is None else int(i) for i in icons]
+    if not all(i is None or 0 <= i <= 255 for i in icons):
+        raise ValueError(f"bad icons {icons}")
+    return encode_icons(icons)
+
+
+class Daemon:
+    def __init__(self, args):
+        self.args = args
+        self.pads = {}  # path or mock serial -> (Macropad, executor)
+        self.latest = None  # Most recent focus change, applied to new pads too
+        self.applied = None  # The focus change all pads have
+        self.in_flight = None  # Task applying one
+        self.pending = asyncio.Event()
+
+    def _open_real(self):
+        import hid
+
+        found = {}
+        for info in hid.enumerate(VID, PID):
+            path = info["path"]
+            if path in self.pads or path in found:
+                continue
+            dev = hid.device()
+            try:
+                dev.open_path(path)
+            except OSError as e:
+                print(f"Can't open {path}: {e}", file=sys.stderr)
+                continue
+            found[path] = dev
+        return found
+
+    async def _add_pads(self, devices):
+        loop = asyncio.get_running_loop()
+        for key, dev in devices.items():
+            # One thread per pad keeps each pad's reports in order
+            executor = ThreadPoolExecutor(max_workers=1)
+            pad = await loop.run_in_executor(executor, Macropad, dev, self.args.verbose)
+            self.pads[key] = (pad, executor)
+            print(f"Connected {pad.serial}", file=sys.stderr)
+        if devices and self.latest:
+            self.pending.set()
+
+    async def _rescan(self):
+        while True:
+            await self._add_pads(await asyncio.to_thread(self._open_real))
+            await asyncio.sleep(RESCAN_INTERVAL_S)
+
+    async def _read_focus_changes(self):
+        # A thread blocks on stdin, unlike a pipe transport it takes regular files too
+        loop = asyncio.get_running_loop()
+        while line := await loop.run_in_executor(None, sys.stdin.readline):
+            line = line.strip()
+            if not line:
+                continue
+            try:
+                change = json.loads(line)
+                encoders = tuple(change.get("encoders", ("none", "dial")))
+                if len(encoders) != 2 or not all(m in ENCODER_MODES for m in encoders):
+                    raise ValueError(f"bad encoder modes {encoders}")
+                self.latest = (
+                    str(change["name"]),
+                    [str(k) for k in change.get("keys", [])],
+                    encoders,
+                    parse_midi(change.get("midi", {})),
+                    parse_icons(change.get("icons", [])),
+                )
+            except (ValueError, KeyError, TypeError) as e:
+                print(f"Ignoring bad focus change {line!r}: {e}", file=sys.stderr)
+                continue
+            self.pending.set()
+
+    async def _apply_to(self, key, pad, executor, profile):
+        try:
+            await asyncio.get_running_loop().run_in_executor(executor, pad.apply, *profile)
+        except OSError as e:
+            print(f"Lost {pad.serial}: {e}", file=sys.stderr)
+            del self.pads[key]
+            executor.shutdown(wait=False)
+
+    async def _push_updates(self):
+        while True:
+            await self.pending.wait()
+            # Let a burst of focus changes settle, only the last one is sent
+            await asyncio.sleep(self.args.coalesce_ms / 1000)
+            self.pending.clear()
+            self.in_flight = asyncio.create_task(self._apply_latest())
+            # Cancelling this loop leaves the pads' update to finish
+            await asyncio.shield(self.in_flight)
+
+    async def _apply_latest(self):
+        profile = self.latest
+        await asyncio.gather(
+            *(self._apply_to(k, p, e, profile) for k, (p, e) in list(self.pads.items()))
+        )
+        self.applied = profile
+
+    async def run(self):
+        if self.args.mock:
+            await self._add_pads(
+                {f"mock{i}": MockDevice(f"MOCK{i}") for i in range(self.args.mock)}
+            )
+            background = [asyncio.create_task(self._push_updates())]
+        else:
+            background = [
+                asyncio.create_task(self._rescan()),
+                asyncio.create_task(self._push_updates()),
+            ]
+
+        await self._read_focus_changes()
+
+        # Input closed: let the update being sent finish, flush the last one and exit
+        for task in background:
+            task.cancel()
+        if self.in_flight:
+            await self.in_flight
+        if self.latest != self.applied:
+            await self._apply_latest()
+        for pad, executor in self.pads.values():
+            print(pad.stats(), file=sys.stderr)
+            pad.close()
+            executor.shutdown()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--mock", type=int, default=0, metavar="N", help="use N mock pads")
+    parser.add_argument("--coalesce-ms", type=int, default=50)
+    parser.add_argument("-v", "--verbose", action="store_true", help="log every report sent")
+    args = parser.parse_args()
+
+    try:
+        asyncio.run(Daemon(args).run())
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,82 @@
+"""Print the macropad's cycle and XIP cache counters (firmware built with MACROPAD_PERF).
+
+Run it against a MACROPAD_RAM_HOT_PATH build and a normal one to compare
+the input path's latency and cache misses.
+
+    python perf_report.py
+    python perf_report.py --reset
+    python perf_report.py --watch 1
+"""
+
+import argparse
+import struct
+import time
+
+REPORT_PERF = 13
+REPORT_LEN = 51
+REPORT_FORMAT = "<BBIIQII8sQQB"
+FLAG_RAM_HOT_PATH = 1 << 0
+CMD_SELECT, CMD_RESET = 0, 1
+
+
+def request(cmd, slot=0):
+    req = struct.pack("<BB", cmd, slot)
+    return [REPORT_PERF] + list(req + bytes(REPORT_LEN - len(req)))
+
+
+def read_slot(d, slot):
+    d.send_feature_report(request(CMD_SELECT, slot))
+    r = bytes(d.get_feature_report(REPORT_PERF, 1 + REPORT_LEN))
+    fields = struct.unpack_from(REPORT_FORMAT, r[1:])
+    _, slot_count, clk_hz, count, total, min_c, max_c, name, xip_acc, xip_miss, flags = fields
+    name = name.rstrip(b"\0").decode()
+    return slot_count, clk_hz, flags, name, count, total, min_c, max_c, xip_acc, xip_miss
+
+
+def print_table(d):
+    slot_count, clk_hz, flags, *_ = read_slot(d, 0)
+    us = clk_hz / 1e6
+    variant = "SRAM" if flags & FLAG_RAM_HOT_PATH else "XIP flash"
+    print(f"clk_sys {clk_hz / 1e6:.0f} MHz, hot path in {variant}, times in us")
+    print(
+        f"{'slot':10}{'count':>10}{'avg':>10}{'min':>10}{'max':>10}{'total ms':>12}"
+        f"{'xip miss/run':>14}{'hit %':>8}"
+    )
+    for slot in range(slot_count):
+        _, _, _, name, count, total, min_c, max_c, xip_acc, xip_miss = read_slot(d, slot)
+        avg = total / count if count else 0
+        misses_per_run = xip_miss / count if count else 0
+        hit_rate = 100 * (xip_acc - xip_miss) / xip_acc if xip_acc else 100
+        print(
+            f"{name:10}{count:>10}{avg / us:>10.1f}{min_c / us:>10.1f}{max_c / us:>10.1f}"
+            f"{total / us / 1000:>12.1f}{misses_per_run:>14.1f}{hit_rate:>8.1f}"
+        )
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--reset", action="store_true", help="clear the counters")
+    parser.add_argument("--watch", type=float, metavar="S", help="print every S seconds")
+    args = parser.parse_args()
+
+    import hid
+
+    d = hid.device()
+    d.open(vendor_id=0x2E8A, product_id=0xFFEE)
+
+    if args.reset:
+        d.send_feature_report(request(CMD_RESET))
+    try:
+        while True:
+            print_table(d)
+            if not args.watch:
+                break
+            time.sleep(args.watch)
+            print()
+    except KeyboardInterrupt:
+        pass
+    d.close()
+
+
+if __name__ == "__main__":
+    main()
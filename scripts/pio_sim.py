@@ -0,0 +1,527 @@
+"""Cycle-level PIO emulation of key_matrix.pio and encoder.pio.
+
+Runs the PIO programs straight from src/*.pio against scripted pin waveforms
+(bouncing contacts, simultaneous presses, fast encoder spins) and checks what
+ends up in the RX FIFO. Also measures the real scan rate and debounce time
+with the clock divider main.c computes.
+
+Input pins are read through the 2 system clock cycle synchronizer the GPIOs
+have in front of the PIO, so a state machine sees each level that much later.
+
+Only the PIO instructions and options used by the macropad are supported.
+
+    python pio_sim.py [--sys-freq 125000000]
+
+Exits with status 1 if any scenario fails.
+"""
+
+import argparse
+import os
+import random
+import re
+import sys
+from collections import deque
+
+SRC_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "src")
+
+MASK32 = 0xFFFFFFFF
+
+# Synchronizer stages on the GPIO inputs, in system clock cycles. The firmware
+# leaves INPUT_SYNC_BYPASS at its default of off.
+INPUT_SYNC_CYCLES = 2
+
+
+class Program:
+    def __init__(self, path):
+        self.defines = {}
+        self.labels = {}
+        self.instructions = []  # (op, args, delay)
+        self.wrap_target = 0
+
+        in_sdk_block = False
+        with open(path) as f:
+            for line in f:
+                line = line.split("//")[0].strip()
+                if line.startswith("% c-sdk"):
+                    in_sdk_block = True
+                    continue
+                if in_sdk_block:
+                    if line.startswith("%}"):
+                        in_sdk_block = False
+                    continue
+                if not line or line.startswith(".program"):
+                    continue
+                if line.startswith(".define"):
+                    parts = line.split()
+                    self.defines[parts[-2]] = int(parts[-1], 0)
+                    continue
+                if line.startswith(".origin"):
+                    # mov pc jumps to absolute addresses, this runs the program at 0
+                    assert int(line.split()[1], 0) == 0
+                    continue
+                if line.startswith(".wrap_target"):
+                    self.wrap_target = len(self.instructions)
+                    continue
+                if line.endswith(":"):
+                    self.labels[line[:-1]] = len(self.instructions)
+                    continue
+
+                delay = 0
+                m = re.search(r"\[(\d+)\]\s*$", line)
+                if m:
+                    delay = int(m.group(1))
+                    line = line[: m.start()]
+                tokens = line.replace(",", " ").split()
+                self.instructions.append((tokens[0], tokens[1:], delay))
+
+
+class StateMachine:
+    """One PIO state machine. pins(t_us, set_pins) returns the GPIO input levels."""
+
+    def __init__(self, program, index, in_base, set_base, pins, sys_freq):
+        self.p = program
+        self.index = index
+        self.in_base = in_base
+        self.set_base = set_base
+        self.pins = pins
+        self.sync_delay_us = INPUT_SYNC_CYCLES * 1e6 / sys_freq
+
+        self.pc = 0
+        self.x = self.y = 0
+        self.isr = self.isr_count = 0
+        self.osr = 0
+        self.osr_count = 32  # Empty after restart
+        self.set_pins = 0
+        # Recent (t_us, set_pins) changes, to drive the pins as they were when
+        # the synchronizer sampled them
+        self.set_pins_history = deque([(float("-inf"), 0)], maxlen=4)
+        self.delay = 0
+
+        self.rx_fifo = deque()
+        self.pushes = []  # (t_us, value), including ones dropped on a full FIFO
+        self.irqs = []  # (t_us, flag)
+        self.pc_hits = [0] * len(program.instructions)
+        self.pc_times = [[] for _ in program.instructions]
+
+    def _read_pins(self, t):
+        sampled = t - self.sync_delay_us
+        outputs = self.set_pins_history[0][1]
+        for changed_t, value in self.set_pins_history:
+            if changed_t > sampled:
+                break
+            outputs = value
+        return self.pins(sampled, outputs << self.set_base)
+
+    def _source(self, name, t):
+        if name.startswith("~"):
+            return ~self._source(name[1:], t) & MASK32
+        return {
+            "x": self.x,
+            "y": self.y,
+            "null": 0,
+            "isr": self.isr,
+            "osr": self.osr,
+            "pins": self._read_pins(t) >> self.in_base,
+        }[name]
+
+    def step(self, t):
+        if self.delay:
+            self.delay -= 1
+            return
+
+        op, args, delay = self.p.instructions[self.pc]
+        next_pc = self.pc + 1
+
+        if op == "wait":
+            polarity, source, index = int(args[0]), args[1], int(args[2])
+            assert source == "pin"
+            if (self._read_pins(t) >> (self.in_base + index)) & 1 != polarity:
+                return  # Stall, delay only counts once the wait completes
+        elif op == "in":
+            n = int(args[1])
+            value = self._source(args[0], t) & ((1 << n) - 1)
+            self.isr = value if n == 32 else ((self.isr << n) | value) & MASK32
+            self.isr_count = min(32, self.isr_count + n)
+        elif op == "out":
+            # Shifting right, the only direction the programs use
+            n = int(args[1])
+            value = self.osr & ((1 << n) - 1)
+            self.osr >>= n
+            self.osr_count = min(32, self.osr_count + n)
+            if args[0] == "isr":
+                self.isr, self.isr_count = value, n
+            else:
+                assert args[0] == "null"
+        elif op == "mov":
+            dst, src = args
+            value = self._source(src, t)
+            if dst == "x":
+                self.x = value
+            elif dst == "y":
+                self.y = value
+            elif dst == "osr":
+                self.osr, self.osr_count = value, 0
+            elif dst == "isr":
+                self.isr, self.isr_count = value, 0
+            elif dst == "pc":
+                next_pc = value
+        elif op == "set":
+            value = int(args[1], 0)
+            if args[0] == "pins":
+                self.set_pins = value
+                self.set_pins_history.append((t, value))
+            elif args[0] == "x":
+                self.x = value
+            elif args[0] == "y":
+                self.y = value
+        elif op == "jmp":
+            cond, target = (args[0], args[1]) if len(args) == 2 else (None, args[0])
+            taken = {
+                None: True,
+                "x!=y": self.x != self.y,
+                "!x": self.x == 0,
+                "!y": self.y == 0,
+                "y--": self.y != 0,
+                "!osre": self.osr_count < 32,
+            }[cond]
+            if cond == "y--":
+                self.y = (self.y - 1) & MASK32
+            if taken:
+                next_pc = self.p.labels[target]
+        elif op == "push":
+            assert args == ["noblock"]
+            self.pushes.append((t, self.isr))
+            if len(self.rx_fifo) < 4:
+                self.rx_fifo.append(self.isr)
+            self.isr = self.isr_count = 0
+        elif op == "irq":
+            flag = int(args[0])
+            if "rel" in args:
+                flag = (flag + self.index) % 4
+            self.irqs.append((t, flag))
+        else:
+            raise ValueError(f"Unsupported instruction {op}")
+
+        self.pc_hits[self.pc] += 1
+        self.pc_times[self.pc].append(t)
+        self.delay = delay
+        self.pc = self.p.wrap_target if next_pc >= len(self.p.instructions) else next_pc
+
+
+def run(sm, clk_div, sys_freq, duration_us):
+    cycle_us = clk_div * 1e6 / sys_freq
+    cycles = int(duration_us / cycle_us)
+    for c in range(cycles):
+        sm.step(c * cycle_us)
+    return cycle_us
+
+
+# Key matrix
+# ==========
+
+ROW_PIN = 2
+COL_PIN = 5
+
+
+def key_matrix_clk_div(program, sys_freq, target_debounce_ms=5):
+    """Same maths as setup_key_matrix() in main.c"""
+    total = program.defines["DEBOUNCE_CYCLE_INSTRUCTIONS"] * program.defines["DEBOUNCE_CYCLES"]
+    target = (target_debounce_ms * (sys_freq // 1000)) // total
+    return min(target, 0xFFFF)
+
+
+def key_bit(row, col):
+    # The first row read ends up in the highest nibble, see get_current_key_state()
+    return 1 << ((2 - row) * 4 + col)
+
+
+class Contact:
+    """Contact state over time: a sorted list of (t_us, closed) edges."""
+
+    def __init__(self):
+        self.edges = []
+
+    def press(self, t, bounce_us=0, rng=None):
+        self._transition(t, True, bounce_us, rng)
+        return self
+
+    def release(self, t, bounce_us=0, rng=None):
+        self._transition(t, False, bounce_us, rng)
+        return self
+
+    def glitch(self, t, length_us):
+        self.edges += [(t, True), (t + length_us, False)]
+        return self
+
+    def _transition(self, t, closed, bounce_us, rng):
+        state = closed
+        end = t + bounce_us
+        while t < end:
+            self.edges.append((t, state))
+            t += rng.uniform(20, 400)
+            state = not state
+        self.edges.append((max(t, end), closed))
+
+    def closed(self, t):
+        state = False
+        for edge_t, s in self.edges:
+            if edge_t > t:
+                break
+            state = s
+        return state
+
+
+def key_matrix_pins(contacts):
+    """contacts: {(row, col): Contact}. Rows are driven, columns pulled down."""
+
+    def pins(t, outputs):
+        value = outputs
+        for (row, col), contact in contacts.items():
+            if (outputs >> (ROW_PIN + row)) & 1 and contact.closed(t):
+                value |= 1 << (COL_PIN + col)
+        return value
+
+    return pins
+
+
+def run_key_matrix(program, contacts, sys_freq, duration_us, clk_div=None):
+    sm = StateMachine(program, 0, COL_PIN, ROW_PIN, key_matrix_pins(contacts), sys_freq)
+    if clk_div is None:
+        clk_div = key_matrix_clk_div(program, sys_freq)
+    run(sm, clk_div, sys_freq, duration_us)
+    return sm
+
+
+# Encoder
+# =======
+
+ENCODER_A_PIN = 13
+ENCODER_CLK_DIV = 1250  # encoder_pio_init()
+QUARTER_STEPS_PER_DETENT = 4
+
+
+def encoder_pins(steps, quarter_us, start_us=1000.0, bounce=None):
+    """steps: list of +1 (clockwise, B leads) / -1 (counter-clockwise, A leads).
+    Both pins idle high and are pulled low by the encoder."""
+    edges = []  # (t, pin, level)
+    t = start_us
+    for step in steps:
+        first, second = (1, 0) if step > 0 else (0, 1)
+        edges += [(t, first, 0), (t + quarter_us, second, 0)]
+        edges += [(t + 2 * quarter_us, first, 1), (t + 3 * quarter_us, second, 1)]
+        if bounce:
+            # A short burst of chatter right after the first falling edge
+            for i, dt in enumerate(bounce):
+                edges.append((t + dt, first, i % 2))
+            edges.append((t + bounce[-1] + 1, first, 0))
+        t += 4 * quarter_us + quarter_us
+    edges.sort()
+
+    def pins(t_now, _outputs):
+        levels = [1, 1]
+        for edge_t, pin, level in edges:
+            if edge_t > t_now:
+                break
+            levels[pin] = level
+        return (levels[0] << ENCODER_A_PIN) | (levels[1] << (ENCODER_A_PIN + 1))
+
+    return pins, t + 1000
+
+
+def signed32(value):
+    return value - (1 << 32) if value & 0x80000000 else value
+
+
+def run_encoder(program, steps, quarter_us, sys_freq, bounce=None):
+    """The quarter step counts the program pushed"""
+    pins, duration = encoder_pins(steps, quarter_us, bounce=bounce)
+    sm = StateMachine(program, 0, ENCODER_A_PIN, 0, pins, sys_freq)
+    run(sm, ENCODER_CLK_DIV, sys_freq, duration)
+    return [signed32(v) for _, v in sm.pushes]
+
+
+def counts_one_apart(counts):
+    return all(abs(b - a) == 1 for a, b in zip([0] + counts, counts))
+
+
+# Scenarios
+# =========
+
+
+class Results:
+    def __init__(self):
+        self.failures = 0
+
+    def check(self, name, ok, detail=""):
+        print(f"  [{'PASS' if ok else 'FAIL'}] {name}" + (f" ({detail})" if detail else ""))
+        if not ok:
+            self.failures += 1
+
+
+def key_matrix_scenarios(sys_freq, res):
+    program = Program(os.path.join(SRC_DIR, "key_matrix.pio"))
+    clk_div = key_matrix_clk_div(program, sys_freq)
+    cycle_us = clk_div * 1e6 / sys_freq
+    debounce_instructions = (
+        program.defines["DEBOUNCE_CYCLE_INSTRUCTIONS"] * program.defines["DEBOUNCE_CYCLES"]
+    )
+    rng = random.Random(1)
+
+    print(f"key_matrix.pio @ {sys_freq} Hz, clock divider {clk_div}, cycle {cycle_us:.3f} us")
+
+    # Scan rate and the real length of a debounce loop
+    idle = run_key_matrix(program, {}, sys_freq, 10_000)
+    idle_scans = idle.pc_hits[0]
+    print(f"  idle scan rate: {idle_scans / 0.01:.0f} scans/s")
+
+    key = (1, 2)
+    contacts = {key: Contact().press(1000)}
+    sm = run_key_matrix(program, contacts, sys_freq, 20_000)
+    debounce_loop = program.labels["debounce"]
+    loops = sm.pc_hits[debounce_loop]
+    times = sm.pc_times[debounce_loop]
+    loop_cycles = round((times[-1] - times[-2]) / cycle_us) if len(times) >= 2 else 0
+    res.check(
+        "DEBOUNCE_CYCLE_INSTRUCTIONS matches the program",
+        loop_cycles == program.defines["DEBOUNCE_CYCLE_INSTRUCTIONS"],
+        f"{loop_cycles} cycles per debounce loop",
+    )
+    res.check(
+        "clean press: one push with the key set",
+        [v for _, v in sm.pushes] == [key_bit(*key)],
+        f"pushes {[hex(v) for _, v in sm.pushes]}, {loops} debounce loops",
+    )
+    if sm.pushes:
+        debounce_us = sm.pushes[0][0] - 1000
+        expected_us = debounce_instructions * cycle_us
+        print(f"  debounce time: {debounce_us:.0f} us (divider maths says {expected_us:.0f} us)")
+        res.check(
+            "debounce time within 10% of 5 ms",
+            4500 <= debounce_us <= 5500,
+            f"{debounce_us:.0f} us",
+        )
+
+    # Bouncing press and release
+    contacts = {key: Contact().press(1000, 1500, rng).release(15_000, 1500, rng)}
+    sm = run_key_matrix(program, contacts, sys_freq, 30_000)
+    values = [v for _, v in sm.pushes]
+    res.check(
+        "bouncing press and release: exactly press then release",
+        values == [key_bit(*key), 0],
+        f"pushes {[hex(v) for v in values]}",
+    )
+    if len(sm.pushes) == 2:
+        settled_at = max(t for t, _ in contacts[key].edges if t < 15_000)
+        settle = sm.pushes[0][0] - settled_at
+        print(f"  press reported {settle:.0f} us after the contact settled")
+
+    # Simultaneous presses land in a single push
+    a, b = (0, 0), (2, 3)
+    contacts = {a: Contact().press(1000), b: Contact().press(1800)}
+    sm = run_key_matrix(program, contacts, sys_freq, 20_000)
+    res.check(
+        "presses 0.8 ms apart: one push with both keys",
+        [v for _, v in sm.pushes] == [key_bit(*a) | key_bit(*b)],
+        f"pushes {[hex(v) for _, v in sm.pushes]}",
+    )
+
+    # All twelve keys
+    contacts = {(r, c): Contact().press(1000) for r in range(3) for c in range(4)}
+    sm = run_key_matrix(program, contacts, sys_freq, 20_000)
+    res.check(
+        "all keys at once",
+        [v for _, v in sm.pushes] == [0xFFF],
+        f"pushes {[hex(v) for _, v in sm.pushes]}",
+    )
+
+    # A glitch shorter than the debounce time never reaches the FIFO as a key press
+    contacts = {key: Contact().glitch(1000, 300)}
+    sm = run_key_matrix(program, contacts, sys_freq, 20_000)
+    values = [v for _, v in sm.pushes]
+    res.check(
+        "300 us glitch is not reported as a press",
+        all(v == 0 for v in values),
+        f"pushes {[hex(v) for v in values]}",
+    )
+    if values:
+        print("  note: the glitch causes a repeated push of the unchanged state")
+
+    # Each column read comes one cycle after its row is driven, which the
+    # synchronizer only sees in time with a divider over its 2 cycles
+    slowest_missing = None
+    for div in range(1, INPUT_SYNC_CYCLES + 2):
+        contacts = {key: Contact().press(10)}
+        debounce_us = debounce_instructions * div * 1e6 / sys_freq
+        sm = run_key_matrix(program, contacts, sys_freq, 10 + 2 * debounce_us, div)
+        if [v for _, v in sm.pushes] != [key_bit(*key)]:
+            slowest_missing = div
+    print(f"  highest clock divider that misses keys: {slowest_missing}")
+    res.check(
+        "the clock divider leaves the synchronizer time to see the driven row",
+        slowest_missing is None or clk_div > slowest_missing,
+        f"divider {clk_div}",
+    )
+
+
+def encoder_scenarios(sys_freq, res):
+    program = Program(os.path.join(SRC_DIR, "encoder.pio"))
+    cycle_us = ENCODER_CLK_DIV * 1e6 / sys_freq
+    print(f"encoder.pio @ {sys_freq} Hz, clock divider {ENCODER_CLK_DIV}, cycle {cycle_us:.1f} us")
+
+    counts = run_encoder(program, [1] * 10, 2000, sys_freq)
+    res.check(
+        "10 clockwise detents, every quarter step",
+        counts == list(range(1, 41)),
+        f"last count {counts[-1:]}, {len(counts)} pushes",
+    )
+    counts = run_encoder(program, [-1] * 10, 2000, sys_freq)
+    res.check(
+        "10 counter-clockwise detents, every quarter step",
+        counts == list(range(-1, -41, -1)),
+        f"last count {counts[-1:]}, {len(counts)} pushes",
+    )
+
+    steps = [1, 1, -1, 1, -1, -1, -1, 1]
+    counts = run_encoder(program, steps, 1500, sys_freq)
+    res.check(
+        "direction changes",
+        len(counts) == len(steps) * QUARTER_STEPS_PER_DETENT and counts[-1] == 0
+        and counts_one_apart(counts),
+        f"counts {counts}",
+    )
+
+    counts = run_encoder(program, [1] * 10, 2000, sys_freq, bounce=[15, 40, 70])
+    res.check(
+        "contact chatter on the leading edge nets out",
+        counts[-1:] == [40] and counts_one_apart(counts),
+        f"last count {counts[-1:]}, {len(counts)} pushes",
+    )
+
+    # Fastest spin that still decodes every quarter step
+    fastest = None
+    for quarter_us in range(2000, 0, -25):
+        counts = run_encoder(program, [1] * 20, quarter_us, sys_freq)
+        if counts != list(range(1, 81)):
+            break
+        fastest = quarter_us
+    if fastest:
+        detents_per_s = 1e6 / (5 * fastest)
+        print(f"  fastest clean spin: {fastest} us per quarter step ({detents_per_s:.0f} detents/s)")
+    res.check("a 1 ms quarter step spin decodes cleanly", fastest is not None and fastest <= 1000)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--sys-freq", type=int, default=125_000_000)
+    args = parser.parse_args()
+
+    res = Results()
+    key_matrix_scenarios(args.sys_freq, res)
+    encoder_scenarios(args.sys_freq, res)
+
+    print("FAILED" if res.failures else "OK")
+    sys.exit(1 if res.failures else 0)
+
+
+if __name__ == "__main__":
+    main()
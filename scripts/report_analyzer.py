@@ -0,0 +1,193 @@
+"""Record the macropad's input report stream and check its timing (Linux).
+
+Reads the keypad (1) and encoder (2) reports, or the combined report (16)
+of a MACROPAD_COMBINED_REPORT build, straight from the pad's hidraw
+node and timestamps them on arrival. Prints the interval between reports and
+their jitter against the USB polling grid, and uses the sequence number in
+each report to count reports the host never got. Reports that carry changes
+of more than one input event are counted as merged.
+
+    python report_analyzer.py --record run.cap --seconds 30
+    python report_analyzer.py run.cap
+    python report_analyzer.py v0.5.cap v0.6.cap
+
+Analyzing capture files doesn't need the pad, so captures of different
+firmware versions can be compared later. Capture format: one report per
+line, "arrival_time_us report_hex"; lines starting with # are comments.
+"""
+
+import argparse
+import glob
+import os
+import select
+import sys
+import time
+
+from send_profile import REPORT_COMBINED, REPORT_ENCODER, REPORT_KEYPAD, SEQ_OFFSETS
+
+VID, PID = 0x2E8A, 0xFFEE
+
+REPORT_NAMES = {REPORT_KEYPAD: "keypad", REPORT_ENCODER: "encoder", REPORT_COMBINED: "combined"}
+
+PERCENTILES = (50, 90, 99, 99.9)
+
+
+def find_hidraw():
+    for uevent in sorted(glob.glob("/sys/class/hidraw/hidraw*/device/uevent")):
+        with open(uevent) as f:
+            ids = dict(line.strip().split("=", 1) for line in f if "=" in line)
+        _, vid, pid = ids.get("HID_ID", "0:0:0").split(":")
+        if int(vid, 16) == VID and int(pid, 16) == PID:
+            return "/dev/" + uevent.split("/")[4]
+    raise SystemExit("No macropad hidraw device found")
+
+
+def record(path, device, seconds):
+    fd = os.open(device or find_hidraw(), os.O_RDONLY)
+    end = time.monotonic() + seconds if seconds else None
+    count = 0
+    with open(path, "w") as out:
+        out.write(f"# macropad report capture, {time.strftime('%Y-%m-%d %H:%M:%S')}\n")
+        try:
+            while end is None or time.monotonic() < end:
+                timeout = 0.1 if end is None else max(0.0, min(0.1, end - time.monotonic()))
+                if not select.select([fd], [], [], timeout)[0]:
+                    continue
+                data = os.read(fd, 64)
+                t_us = time.monotonic_ns() // 1000
+                if data and data[0] in REPORT_NAMES:
+                    out.write(f"{t_us} {data.hex()}\n")
+                    count += 1
+        except KeyboardInterrupt:
+            pass
+        finally:
+            os.close(fd)
+    print(f"Recorded {count} reports to {path}", file=sys.stderr)
+
+
+def load_capture(path):
+    reports = []
+    with open(path) as f:
+        for line in f:
+            line = line.strip()
+            if not line or line.startswith("#"):
+                continue
+            t, data = line.split()
+            reports.append((int(t), bytes.fromhex(data)))
+    return reports
+
+
+def percentile(values, p):
+    if not values:
+        return 0
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * p / 100))]
+
+
+def keys_merged(prev, curr):
+    """Keys pressed and others released in one report. Keys that go down or up
+    together are a chord, one scan of the matrix. The layer bits change with
+    the key that selects the layer, so they don't count."""
+    prev_keys = int.from_bytes(prev[1:3], "little") & 0x0FFF
+    keys = int.from_bytes(curr[1:3], "little") & 0x0FFF
+    return bool(keys & ~prev_keys) and bool(prev_keys & ~keys)
+
+
+def is_merged(report_id, prev, curr):
+    """Whether curr carries more than one input event since prev."""
+    if report_id == REPORT_KEYPAD:
+        return keys_merged(prev, curr)
+    if report_id == REPORT_COMBINED:
+        # Keys and the dial changing together is what this report is for, only
+        # count merges within one part. Dial steps are since the last report.
+        steps = abs(curr[3] - 256 if curr[3] > 127 else curr[3])
+        return keys_merged(prev, curr) or steps + ((prev[4] ^ curr[4]) & 1) > 1
+    # Encoder: each detent (the position wraps as int8) and button change is an event
+    steps = abs(((curr[1] - prev[1] + 128) & 0xFF) - 128)
+    return steps + ((prev[2] ^ curr[2]) & 1) > 1
+
+
+def analyze(reports, poll_ms):
+    poll_us = poll_ms * 1000
+    results = {}
+    for report_id, name in REPORT_NAMES.items():
+        seq_offset = 1 + SEQ_OFFSETS[report_id]
+        stream = [(t, r) for t, r in reports if r[0] == report_id and len(r) > seq_offset]
+        intervals, jitter = [], []
+        lost = duplicates = merged = 0
+        for (t0, r0), (t1, r1) in zip(stream, stream[1:]):
+            interval = t1 - t0
+            intervals.append(interval)
+            # Reports can only arrive on a poll, anything else is host side delay
+            jitter.append(abs(interval - round(interval / poll_us) * poll_us))
+
+            gap = (r1[seq_offset] - r0[seq_offset]) & 0xFF
+            if gap == 0:
+                duplicates += 1
+            elif gap > 1:
+                lost += gap - 1
+            elif is_merged(report_id, r0, r1):
+                merged += 1
+        results[name] = {
+            "reports": len(stream),
+            "lost": lost,
+            "duplicates": duplicates,
+            "merged": merged,
+            "interval": [percentile(intervals, p) for p in PERCENTILES]
+            + [max(intervals, default=0)],
+            "jitter": [percentile(jitter, p) for p in PERCENTILES] + [max(jitter, default=0)],
+        }
+    return results
+
+
+def print_results(columns):
+    """columns: [(title, analyze() result)], one column per capture."""
+    width = 12
+    header = f"{'':<22}" + "".join(f"{title[-width:]:>{width}}" for title, _ in columns)
+    for name in REPORT_NAMES.values():
+        if not any(res[name]["reports"] for _, res in columns):
+            continue
+        print(name + header[len(name) :])
+        rows = [
+            ("reports", lambda r: r["reports"]),
+            ("lost (seq gaps)", lambda r: r["lost"]),
+            ("duplicates", lambda r: r["duplicates"]),
+            ("merged events", lambda r: r["merged"]),
+        ]
+        for i, p in enumerate(PERCENTILES):
+            rows.append((f"interval p{p} ms", lambda r, i=i: f"{r['interval'][i] / 1000:.3f}"))
+        rows.append(("interval max ms", lambda r: f"{r['interval'][-1] / 1000:.3f}"))
+        for i, p in enumerate(PERCENTILES):
+            rows.append((f"jitter p{p} us", lambda r, i=i: r["jitter"][i]))
+        rows.append(("jitter max us", lambda r: r["jitter"][-1]))
+        for label, get in rows:
+            print(f"  {label:<20}" + "".join(f"{get(res[name])!s:>{width}}" for _, res in columns))
+        print()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("captures", nargs="*", help="capture files to analyze side by side")
+    parser.add_argument("--record", metavar="FILE", help="record a capture from the pad")
+    parser.add_argument("--seconds", type=float, default=0, help="recording length, 0 until ^C")
+    parser.add_argument("--device", help="hidraw node, found by VID/PID by default")
+    parser.add_argument(
+        "--poll-ms",
+        type=float,
+        default=5,
+        help="endpoint polling interval, 1 for MACROPAD_POLL_ALIGN builds",
+    )
+    args = parser.parse_args()
+
+    captures = list(args.captures)
+    if args.record:
+        record(args.record, args.device, args.seconds)
+        captures.append(args.record)
+    if not captures:
+        parser.error("give capture files to analyze, or --record")
+
+    print_results([(os.path.basename(c), analyze(load_capture(c), args.poll_ms)) for c in captures])
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,67 @@
+"""Print the macropad's scheduler stats: runs, worst-case runtime and missed deadlines per task.
+
+    python sched_stats.py
+    python sched_stats.py --reset
+    python sched_stats.py --watch 1
+"""
+
+import argparse
+import struct
+import time
+
+REPORT_SCHED_STATS = 24
+REPORT_LEN = 22
+REPORT_FORMAT = "<BB8sIII"
+CMD_SELECT, CMD_RESET = 0, 1
+
+
+def request(cmd, task=0):
+    req = struct.pack("<BB", cmd, task)
+    return [REPORT_SCHED_STATS] + list(req + bytes(REPORT_LEN - len(req)))
+
+
+def read_task(d, task):
+    d.send_feature_report(request(CMD_SELECT, task))
+    r = bytes(d.get_feature_report(REPORT_SCHED_STATS, 1 + REPORT_LEN))
+    _, task_count, name, runs, max_us, missed = struct.unpack_from(REPORT_FORMAT, r[1:])
+    return task_count, name.rstrip(b"\0").decode(), runs, max_us, missed
+
+
+def print_table(d):
+    task_count, *_ = read_task(d, 0)
+    print(f"{'task':10}{'runs':>12}{'max us':>10}{'missed':>10}")
+    for task in range(task_count):
+        _, name, runs, max_us, missed = read_task(d, task)
+        if not name:
+            # Not built in
+            continue
+        print(f"{name:10}{runs:>12}{max_us:>10}{missed:>10}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--reset", action="store_true", help="clear the stats")
+    parser.add_argument("--watch", type=float, metavar="S", help="print every S seconds")
+    args = parser.parse_args()
+
+    import hid
+
+    d = hid.device()
+    d.open(vendor_id=0x2E8A, product_id=0xFFEE)
+
+    if args.reset:
+        d.send_feature_report(request(CMD_RESET))
+    try:
+        while True:
+            print_table(d)
+            if not args.watch:
+                break
+            time.sleep(args.watch)
+            print()
+    except KeyboardInterrupt:
+        pass
+    d.close()
+
+
+if __name__ == "__main__":
+    main()
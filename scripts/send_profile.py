@@ -0,0 +1,210 @@
+"""Switch the macropad to a profile, uploading it only if the pad doesn't have it cached.
+
+    python send_profile.py "Firefox" "Back" "Fwd" "Tab" "Home" ...
+    python send_profile.py --encoders wheel volume "Firefox" "Back" ...
+    python send_profile.py --midi-channel 2 --midi-notes 60 62 64 - ... "Live" "Play" ...
+    python send_profile.py --icons 1 2 - 3 ... "Live" "Play" ...   (see icon_atlas.py)
+    python send_profile.py --stats
+"""
+
+import argparse
+import struct
+import sys
+
+VID, PID = 0x2E8A, 0xFFEE
+
+REPORT_PROFILE_NAME = 3
+REPORT_KEY_NAMES = 4
+REPORT_PROFILE_HASH = 6
+REPORT_PROFILE_CACHE = 7
+REPORT_ENCODER_MODES = 11
+REPORT_MIDI_MAP = 21
+REPORT_KEY_ICONS = 23
+
+# Input reports: offset of the sequence number in the report, after the id
+# (hid_report_keypad_t, hid_report_encoder_t, hid_report_combined_t)
+REPORT_KEYPAD = 1
+REPORT_ENCODER = 2
+REPORT_COMBINED = 16
+SEQ_OFFSETS = {REPORT_KEYPAD: 2, REPORT_ENCODER: 2, REPORT_COMBINED: 4}
+
+PROFILE_NAME_LENGTH = 18
+KEY_NAME_LENGTH = 4
+KEY_COUNT = 12
+
+CACHE_FORMAT = "<IIIIBB"
+
+ENCODER_MODES = {"none": 0, "dial": 1, "volume": 2, "wheel": 3, "pan": 4}
+DEFAULT_ENCODER_MODES = bytes([ENCODER_MODES["none"], ENCODER_MODES["dial"]])
+
+MIDI_NONE = 0xFF
+DEFAULT_MIDI_NOTES = tuple(range(36, 36 + KEY_COUNT))
+
+
+def encode_midi(
+    channel=1, notes=DEFAULT_MIDI_NOTES, encoder_ccs=(None, 16), button_notes=(None, 48)
+):
+    """The MIDI map as the pad stores it (prof_midi_t). Channel is 1-16, None sends nothing."""
+    values = list(notes) + [None] * (KEY_COUNT - len(notes))
+    values = values[:KEY_COUNT] + list(encoder_ccs) + list(button_notes)
+    return bytes([channel - 1] + [MIDI_NONE if v is None else v for v in values])
+
+
+DEFAULT_MIDI = encode_midi()
+
+NO_ICONS = bytes(KEY_COUNT)
+
+
+def encode_icons(icons):
+    """Icon atlas numbers of the keys, None (or 0) for no icon"""
+    icons = (list(icons) + [None] * KEY_COUNT)[:KEY_COUNT]
+    return bytes(0 if i is None else i for i in icons)
+
+
+def encode_profile(name, key_names, encoder_modes=("none", "dial")):
+    """The profile as the pad stores it: zero padded name, space padded key names
+    with the characters the pad can't show replaced by spaces, and encoder modes."""
+    name = name.encode("ascii", "replace")[:PROFILE_NAME_LENGTH].ljust(PROFILE_NAME_LENGTH, b"\0")
+    keys = b""
+    for k in (key_names + [""] * KEY_COUNT)[:KEY_COUNT]:
+        keys += k.encode("ascii", "replace")[:KEY_NAME_LENGTH].ljust(KEY_NAME_LENGTH)
+    keys = bytes(c if 32 <= c <= 126 else 32 for c in keys)
+    modes = bytes(ENCODER_MODES[m] for m in encoder_modes)
+    return name, keys, modes
+
+
+def profile_hash(name, keys, modes, midi=DEFAULT_MIDI, icons=NO_ICONS):
+    """Same as prof_hash() in profiles.c"""
+    h = 2166136261
+    for c in name + keys + modes + midi + icons:
+        h = ((h ^ c) * 16777619) & 0xFFFFFFFF
+    return h
+
+
+def read_cache_status(d):
+    r = bytes(d.get_feature_report(REPORT_PROFILE_CACHE, 1 + struct.calcsize(CACHE_FORMAT)))[1:]
+    names = "current_hash hits misses evictions entries capacity".split()
+    return dict(zip(names, struct.unpack_from(CACHE_FORMAT, r)))
+
+
+def activate(d, name, key_names, encoder_modes, midi=DEFAULT_MIDI, icons=NO_ICONS):
+    name, keys, modes = encode_profile(name, key_names, encoder_modes)
+    h = profile_hash(name, keys, modes, midi, icons)
+
+    d.send_feature_report([REPORT_PROFILE_HASH] + list(struct.pack("<I", h)))
+    if read_cache_status(d)["current_hash"] == h:
+        return h, True
+
+    # Cache miss: upload the full profile, the pad caches it once the key names arrive.
+    # The name resets the encoder modes, the MIDI map and the icons to the defaults.
+    d.send_feature_report([REPORT_PROFILE_NAME] + list(name))
+    if modes != DEFAULT_ENCODER_MODES:
+        d.send_feature_report([REPORT_ENCODER_MODES] + list(modes))
+    if midi != DEFAULT_MIDI:
+        d.send_feature_report([REPORT_MIDI_MAP] + list(midi))
+    if icons != NO_ICONS:
+        d.send_feature_report([REPORT_KEY_ICONS] + list(icons))
+    d.send_feature_report([REPORT_KEY_NAMES] + list(keys))
+    return h, False
+
+
+def midi_value(s, highest):
+    if s == "-":
+        return None
+    v = int(s)
+    if not 0 <= v <= highest:
+        raise argparse.ArgumentTypeError(f"{v} is not 0-{highest}")
+    return v
+
+
+def icon_number(s):
+    return midi_value(s, 255)
+
+
+def midi_note(s):
+    return midi_value(s, 127)
+
+
+def midi_cc(s):
+    # 120-127 are channel mode messages
+    return midi_value(s, 119)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--stats", action="store_true", help="only print the cache stats")
+    parser.add_argument(
+        "--encoders",
+        nargs=2,
+        default=("none", "dial"),
+        choices=ENCODER_MODES,
+        metavar=("MODE0", "MODE1"),
+        help=f"encoder modes, one of {', '.join(ENCODER_MODES)}",
+    )
+    parser.add_argument("--midi-channel", type=int, default=1, choices=range(1, 17), metavar="1-16")
+    parser.add_argument(
+        "--midi-notes",
+        nargs=KEY_COUNT,
+        type=midi_note,
+        metavar="NOTE",
+        help="note of each key, - for none",
+    )
+    parser.add_argument(
+        "--midi-encoders",
+        nargs=2,
+        type=midi_cc,
+        default=(None, 16),
+        metavar=("CC0", "CC1"),
+        help="controller of each encoder's relative steps, - for none",
+    )
+    parser.add_argument(
+        "--midi-buttons",
+        nargs=2,
+        type=midi_note,
+        default=(None, 48),
+        metavar=("NOTE0", "NOTE1"),
+        help="note of each encoder button, - for none",
+    )
+    parser.add_argument(
+        "--icons",
+        nargs=KEY_COUNT,
+        type=icon_number,
+        default=(),
+        metavar="ICON",
+        help="icon atlas number of each key, - for none",
+    )
+    parser.add_argument("name", nargs="?")
+    parser.add_argument("key_names", nargs="*")
+    args = parser.parse_args()
+
+    if not args.stats and args.name is None:
+        parser.error("profile name required")
+
+    import hid
+
+    d = hid.device()
+    d.open(vendor_id=VID, product_id=PID)
+
+    if not args.stats:
+        midi = encode_midi(
+            args.midi_channel,
+            args.midi_notes or DEFAULT_MIDI_NOTES,
+            args.midi_encoders,
+            args.midi_buttons,
+        )
+        icons = encode_icons(args.icons)
+        h, hit = activate(d, args.name, args.key_names, args.encoders, midi, icons)
+        print(f"Profile {h:08x}: {'cache hit' if hit else 'uploaded'}")
+
+    s = read_cache_status(d)
+    d.close()
+    total = s["hits"] + s["misses"]
+    hit_rate = 100 * s["hits"] / total if total else 0
+    print(
+        f"Cache: {s['entries']}/{s['capacity']} entries, {s['hits']} hits, {s['misses']} misses "
+        f"({hit_rate:.0f}% hit rate), {s['evictions']} evictions"
+    )
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,66 @@
+"""Configure the macropad's layer keys and tap-hold keys.
+
+Keys are numbered by their bit in the keypad report (0-11).
+
+    python set_keymap.py --tap-hold 0:1 --layer-key 3:2 --button-layer 0:1 --tapping-term 180
+    python set_keymap.py --show
+"""
+
+import argparse
+import struct
+
+KEY_COUNT = 12
+REPORT_KEYMAP_CONFIG = 8
+CONFIG_FORMAT = f"<{KEY_COUNT}B{KEY_COUNT}B2BH"
+NORMAL, LAYER_KEY, TAP_HOLD = 0, 1, 2
+KIND_NAMES = {NORMAL: "normal", LAYER_KEY: "layer", TAP_HOLD: "tap-hold"}
+
+
+def pair(s):
+    a, b = s.split(":")
+    return int(a), int(b)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--layer-key", type=pair, action="append", default=[], metavar="KEY:LAYER")
+    parser.add_argument("--tap-hold", type=pair, action="append", default=[], metavar="KEY:LAYER")
+    parser.add_argument(
+        "--button-layer", type=pair, action="append", default=[], metavar="ENCODER:LAYER"
+    )
+    parser.add_argument("--tapping-term", type=int, default=200, metavar="MS")
+    parser.add_argument("--show", action="store_true", help="print the current config")
+    args = parser.parse_args()
+
+    import hid
+
+    d = hid.device()
+    d.open(vendor_id=0x2E8A, product_id=0xFFEE)
+
+    if not args.show:
+        kinds = [NORMAL] * KEY_COUNT
+        layers = [0] * KEY_COUNT
+        buttons = [0, 0]
+        for kind, pairs in ((LAYER_KEY, args.layer_key), (TAP_HOLD, args.tap_hold)):
+            for key, layer in pairs:
+                kinds[key], layers[key] = kind, layer
+        for encoder, layer in args.button_layer:
+            buttons[encoder] = layer
+        config = struct.pack(CONFIG_FORMAT, *kinds, *layers, *buttons, args.tapping_term)
+        d.send_feature_report([REPORT_KEYMAP_CONFIG] + list(config))
+
+    r = bytes(d.get_feature_report(REPORT_KEYMAP_CONFIG, 1 + struct.calcsize(CONFIG_FORMAT)))
+    d.close()
+    fields = struct.unpack_from(CONFIG_FORMAT, r[1:])
+    kinds, layers = fields[:KEY_COUNT], fields[KEY_COUNT : 2 * KEY_COUNT]
+    for key in range(KEY_COUNT):
+        if kinds[key] != NORMAL:
+            print(f"Key {key}: {KIND_NAMES.get(kinds[key], '?')} for layer {layers[key]}")
+    for encoder in range(2):
+        if fields[2 * KEY_COUNT + encoder]:
+            print(f"Encoder {encoder} button: layer {fields[2 * KEY_COUNT + encoder]}")
+    print(f"Tapping term: {fields[-1]} ms")
+
+
+if __name__ == "__main__":
+    main()
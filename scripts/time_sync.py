@@ -0,0 +1,190 @@
+"""Measure end-to-end input latency with the macropad's USB frame time sync report.
+
+Needs firmware built with -DMACROPAD_TIME_SYNC=ON. The pad gives times as USB
+frame number and microseconds into the frame. The host starts a frame every
+millisecond, so pairing one frame with host time (from the quickest of a few
+feature report round trips) converts any of them to host time.
+
+    python time_sync.py status      # sync state and the pad's clock drift
+    python time_sync.py latency     # press keys, get the latency of each report
+    python time_sync.py poll        # how long reports wait for the host's poll
+    python time_sync.py poll-reset
+
+Build once with -DMACROPAD_POLL_ALIGN=ON and once without, and compare the
+poll stats of the two after the same typing.
+"""
+
+import argparse
+import math
+import struct
+import sys
+import time
+
+from send_profile import SEQ_OFFSETS
+
+VID, PID = 0x2E8A, 0xFFEE
+
+REPORT_TIME_SYNC = 19
+REPORT_LEN = 57
+HEADER_FORMAT = "<BHHIII"
+TAG_FORMAT = "<BBHHHH"
+TAGS = 4
+NO_FRAME = 0xFFFF
+FRAME_US = 1000
+FRAME_WRAP = 2048
+ANCHOR_SAMPLES = 8
+
+REPORT_POLL_PHASE = 20
+POLL_REPORT_LEN = 54
+POLL_FORMAT = "<BBHHIHHIQ14H"
+POLL_BUCKET_US = 400
+
+
+def now_us():
+    return time.monotonic_ns() / 1000
+
+
+def read_report(dev):
+    r = bytes(dev.get_feature_report(REPORT_TIME_SYNC, 1 + REPORT_LEN))[1:]
+    locked, frame, offset, q16, sofs, resyncs = struct.unpack_from(HEADER_FORMAT, r)
+    tags = []
+    pos = struct.calcsize(HEADER_FORMAT)
+    for _ in range(TAGS):
+        tags.append(struct.unpack_from(TAG_FORMAT, r, pos))
+        pos += struct.calcsize(TAG_FORMAT)
+    return {
+        "locked": bool(locked),
+        "now": (frame, offset),
+        "us_per_frame": q16 / 65536,
+        "sofs": sofs,
+        "resyncs": resyncs,
+        "tags": [t for t in tags if t[0] != 0],
+    }
+
+
+class FrameClock:
+    """Host time of a USB frame, from the feature report round trip."""
+
+    def __init__(self):
+        self.frame = None
+        self.host_us = None
+        self.rtt_us = None
+
+    def anchor(self, dev, samples=ANCHOR_SAMPLES):
+        best = None
+        for _ in range(samples):
+            t0 = now_us()
+            rep = read_report(dev)
+            t1 = now_us()
+            frame, offset = rep["now"]
+            if frame == NO_FRAME:
+                continue
+            # The pad read its timer somewhere between sending and receiving
+            if best is None or t1 - t0 < best[0]:
+                best = (t1 - t0, frame, (t0 + t1) / 2 - offset)
+        if best is None:
+            return False
+        self.rtt_us, self.frame, self.host_us = best
+        return True
+
+    def to_host(self, frame, offset):
+        diff = (frame - self.frame) % FRAME_WRAP
+        if diff >= FRAME_WRAP // 2:
+            diff -= FRAME_WRAP
+        return self.host_us + diff * FRAME_US + offset
+
+
+def frame_diff_us(a, b):
+    """b - a for two (frame, offset) times less than a second apart"""
+    diff = (b[0] - a[0]) % FRAME_WRAP
+    if diff >= FRAME_WRAP // 2:
+        diff -= FRAME_WRAP
+    return diff * FRAME_US + b[1] - a[1]
+
+
+def status(dev):
+    rep = read_report(dev)
+    print(f"Locked: {rep['locked']}, SOFs: {rep['sofs']}, resyncs: {rep['resyncs']}")
+    drift = (rep["us_per_frame"] - FRAME_US) / FRAME_US * 1e6
+    print(f"Pad timer: {rep['us_per_frame']:.3f} us per frame ({drift:+.1f} ppm)")
+    clock = FrameClock()
+    if clock.anchor(dev):
+        rtt = clock.rtt_us
+        print(f"Quickest round trip {rtt:.0f} us, host times within +-{rtt / 2:.0f} us")
+
+
+def poll(dev):
+    r = bytes(dev.get_feature_report(REPORT_POLL_PHASE, 1 + POLL_REPORT_LEN))[1:]
+    aligned, locked, offset, lead, n, lo, hi, total, total_sq, *hist = struct.unpack_from(
+        POLL_FORMAT, r
+    )
+    mode = "aligned to the polls" if aligned else "free-running"
+    if locked:
+        print(f"Reports {mode}, host polls {offset} us into the frame")
+    else:
+        print(f"Reports {mode}, poll phase not known yet")
+    if aligned:
+        print(f"HID task runs {lead} us before the poll")
+    if n == 0:
+        print("No reports measured yet")
+        return
+    mean = total / n
+    stddev = math.sqrt(max(0.0, total_sq / n - mean * mean))
+    print(f"Queued to polled over {n} reports: mean {mean:.0f} us, jitter (stddev) "
+          f"{stddev:.0f} us, min {lo} us, max {hi} us")
+    for i, count in enumerate(hist):
+        end = f"{(i + 1) * POLL_BUCKET_US:5}" if i < len(hist) - 1 else "    -"
+        print(f"{i * POLL_BUCKET_US:5}-{end} us {count:6} {'#' * round(40 * count / n)}")
+
+
+def latency(dev):
+    clock = FrameClock()
+    if not clock.anchor(dev):
+        sys.exit("The pad isn't synced to the USB frames yet")
+    print(f"Synced, within +-{clock.rtt_us / 2:.0f} us. Press keys, Ctrl-C to stop.")
+    print("report seq   input->queued   queued->host   input->host")
+    while True:
+        data = dev.read(64, 1000)
+        received = now_us()
+        if not data or data[0] not in SEQ_OFFSETS:
+            continue
+        report_id, seq = data[0], data[1 + SEQ_OFFSETS[data[0]]]
+
+        # Frame numbers wrap every 2 s, keep the anchor fresh
+        clock.anchor(dev)
+        for tag_id, tag_seq, ev_frame, ev_off, q_frame, q_off in read_report(dev)["tags"]:
+            if (tag_id, tag_seq) != (report_id, seq) or ev_frame == NO_FRAME:
+                continue
+            queued = frame_diff_us((ev_frame, ev_off), (q_frame, q_off))
+            to_host = received - clock.to_host(q_frame, q_off)
+            print(f"{report_id:6} {seq:3} {queued:12.0f} us {to_host:11.0f} us "
+                  f"{queued + to_host:10.0f} us")
+            break
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("command", choices=["status", "latency", "poll", "poll-reset"])
+    args = parser.parse_args()
+
+    import hid
+
+    d = hid.device()
+    d.open(vendor_id=VID, product_id=PID)
+    try:
+        if args.command == "status":
+            status(d)
+        elif args.command == "poll":
+            poll(d)
+        elif args.command == "poll-reset":
+            d.send_feature_report([REPORT_POLL_PHASE] + [0] * POLL_REPORT_LEN)
+        else:
+            latency(d)
+    except KeyboardInterrupt:
+        pass
+    finally:
+        d.close()
+
+
+if __name__ == "__main__":
+    main()
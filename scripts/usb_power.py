@@ -0,0 +1,32 @@
+"""Show the macropad's USB suspend state and remote wakeup latency.
+
+Suspend the host, wake it up with a key press, then run this.
+"""
+
+import struct
+
+REPORT_USB_POWER = 14
+POWER_FORMAT = "<BBHIII"
+
+
+def main():
+    import hid
+
+    d = hid.device()
+    d.open(vendor_id=0x2E8A, product_id=0xFFEE)
+    r = bytes(d.get_feature_report(REPORT_USB_POWER, 1 + struct.calcsize(POWER_FORMAT)))
+    d.close()
+
+    suspended, wakeup_enabled, wakeups, to_resume, to_report, max_to_report = struct.unpack_from(
+        POWER_FORMAT, r[1:]
+    )
+    print(f"Suspended: {bool(suspended)}, remote wakeup enabled: {bool(wakeup_enabled)}")
+    print(f"Remote wakeups: {wakeups}")
+    if wakeups:
+        print(f"Last wakeup: bus resumed after {to_resume / 1000:.1f} ms, "
+              f"first report after {to_report / 1000:.1f} ms")
+        print(f"Slowest wakeup to first report: {max_to_report / 1000:.1f} ms")
+
+
+if __name__ == "__main__":
+    main()
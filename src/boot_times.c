@@ -0,0 +1,35 @@
+#include "boot_times.h"
+
+#include "hal.h"
+#include "log.h"
+
+#include <assert.h>
+#include <string.h>
+
+static_assert(BOOT_MILESTONE_COUNT * sizeof(uint32_t) == BOOT_TIMES_REPORT_LEN, "length mismatch");
+
+static const char *const milestone_names[BOOT_MILESTONE_COUNT] = {
+    [BOOT_MILESTONE_MAIN] = "main",
+    [BOOT_MILESTONE_USB_MOUNTED] = "USB mounted",
+    [BOOT_MILESTONE_DISPLAY_READY] = "display ready",
+    [BOOT_MILESTONE_FIRST_FRAME] = "first frame",
+    [BOOT_MILESTONE_FIRST_REPORT] = "first report",
+};
+
+static uint32_t times_us[BOOT_MILESTONE_COUNT];
+
+void boot_times_mark(boot_milestone_t milestone) {
+    if (times_us[milestone] != 0) {
+        return;
+    }
+    // The timer starts from 0 at reset, so this is the time since boot
+    uint32_t now = hal_time_us();
+    times_us[milestone] = now ? now : 1;
+    LOGI("Boot: %s at %lu us", milestone_names[milestone], now);
+}
+
+uint16_t boot_times_get_report(uint8_t *buffer, uint16_t reqlen) {
+    uint16_t len = reqlen < sizeof(times_us) ? reqlen : sizeof(times_us);
+    memcpy(buffer, times_us, len);
+    return len;
+}
@@ -0,0 +1,29 @@
+#if !defined(BOOT_TIMES__H)
+#define BOOT_TIMES__H
+
+// When the boot milestones were reached, in microseconds since reset
+
+#include <stdint.h>
+
+// Payload length of the boot times feature report
+#define BOOT_TIMES_REPORT_LEN 20
+
+typedef enum boot_milestone_t {
+    BOOT_MILESTONE_MAIN,          // main() entered
+    BOOT_MILESTONE_USB_MOUNTED,   // Host configured the device
+    BOOT_MILESTONE_DISPLAY_READY, // Display initialized
+    BOOT_MILESTONE_FIRST_FRAME,   // First frame sent to the display
+    BOOT_MILESTONE_FIRST_REPORT,  // Host received the first input report
+
+    // Last
+    BOOT_MILESTONE_COUNT,
+} boot_milestone_t;
+
+// Record the milestone, only the first time it's reached counts
+void boot_times_mark(boot_milestone_t milestone);
+
+// Fill a GET_REPORT of the boot times feature report, returns the length.
+// Milestones not reached yet are 0.
+uint16_t boot_times_get_report(uint8_t *buffer, uint16_t reqlen);
+
+#endif // BOOT_TIMES__H
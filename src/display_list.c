@@ -0,0 +1,119 @@
+#include "display_list.h"
+
+#include "log.h"
+
+#include <assert.h>
+#include <string.h>
+
+static_assert(sizeof(display_list_entry_t) == 24, "display list entry size changed");
+
+typedef struct __attribute__((packed)) {
+    uint16_t used;     // Bit per entry that isn't DISPLAY_LIST_TYPE_NONE
+    uint32_t ops;      // Operations applied
+    uint32_t rejected; // Reports with an invalid operation, the rest of the report is skipped
+} display_list_status_t;
+
+static display_list_entry_t entries[DISPLAY_LIST_ENTRIES];
+static uint16_t changed = 0;
+static bool show_requested = false;
+static display_list_status_t status;
+
+const display_list_entry_t *display_list_get(uint8_t index) {
+    return &entries[index];
+}
+
+uint16_t display_list_take_changed() {
+    uint16_t c = changed;
+    changed = 0;
+    return c;
+}
+
+bool display_list_take_show_request() {
+    bool s = show_requested;
+    show_requested = false;
+    return s;
+}
+
+static void entry_written(uint8_t index) {
+    changed |= 1 << index;
+    if (entries[index].type != DISPLAY_LIST_TYPE_NONE) {
+        status.used |= 1 << index;
+    } else {
+        status.used &= ~(1 << index);
+    }
+}
+
+// Length of each operation without PATCH's data, 0 for unknown operations
+static const uint8_t op_header_len[] = {
+    [DISPLAY_LIST_OP_CLEAR] = 1,
+    [DISPLAY_LIST_OP_SET] = 2 + sizeof(display_list_entry_t),
+    [DISPLAY_LIST_OP_PATCH] = 4,
+    [DISPLAY_LIST_OP_SHOW] = 1,
+};
+
+// Length of the operation at data, or 0 if it's unknown or runs past len
+static uint16_t op_length(const uint8_t *data, uint16_t len) {
+    if (data[0] >= sizeof(op_header_len) || op_header_len[data[0]] == 0 ||
+        len < op_header_len[data[0]]) {
+        return 0;
+    }
+    uint16_t op_len = op_header_len[data[0]];
+    if (data[0] == DISPLAY_LIST_OP_PATCH) {
+        op_len += data[3];
+    }
+    return op_len <= len ? op_len : 0;
+}
+
+// Apply the operation at data, already checked to fit in the report.
+// Returns false if it's invalid.
+static bool apply_op(const uint8_t *data) {
+    switch (data[0]) {
+    case DISPLAY_LIST_OP_CLEAR:
+        memset(entries, 0, sizeof(entries));
+        changed |= status.used;
+        status.used = 0;
+        return true;
+    case DISPLAY_LIST_OP_SET:
+        if (data[1] >= DISPLAY_LIST_ENTRIES) {
+            return false;
+        }
+        memcpy(&entries[data[1]], data + 2, sizeof(display_list_entry_t));
+        entry_written(data[1]);
+        return true;
+    case DISPLAY_LIST_OP_PATCH: {
+        uint8_t offset = data[2];
+        uint8_t patch_len = data[3];
+        if (data[1] >= DISPLAY_LIST_ENTRIES || offset + patch_len > sizeof(display_list_entry_t)) {
+            return false;
+        }
+        memcpy((uint8_t *)&entries[data[1]] + offset, data + 4, patch_len);
+        entry_written(data[1]);
+        return true;
+    }
+    case DISPLAY_LIST_OP_SHOW:
+        show_requested = true;
+        return true;
+    default:
+        return false;
+    }
+}
+
+void display_list_handle_report(const uint8_t *data, uint16_t len) {
+    uint16_t pos = 0;
+    while (pos < len && data[pos] != DISPLAY_LIST_OP_END) {
+        uint16_t op_len = op_length(data + pos, len - pos);
+        if (op_len == 0 || !apply_op(data + pos)) {
+            LOGW("Invalid display list operation %u at %u", data[pos], pos);
+            status.rejected++;
+            return;
+        }
+        status.ops++;
+        pos += op_len;
+    }
+}
+
+uint16_t display_list_get_report(uint8_t *buffer, uint16_t reqlen) {
+    uint16_t len = reqlen < sizeof(status) ? reqlen : sizeof(status);
+    memcpy(buffer, &status, len);
+    return len;
+}
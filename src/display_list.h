@@ -0,0 +1,70 @@
+#if !defined(DISPLAY_LIST__H)
+#define DISPLAY_LIST__H
+
+// Host-driven widgets: a list of text, box, frame, progress bar and glyph
+// entries uploaded over HID and drawn by display_ui on its own screen. The
+// host sets whole entries or patches a few bytes of one, and only the changed
+// entries are redrawn. scripts/display_list.py is the host side.
+//
+// Report payload: a sequence of operations, ended by DISPLAY_LIST_OP_END or
+// the end of the report:
+//   CLEAR                          remove all entries
+//   SET   index entry[24]          replace an entry
+//   PATCH index offset len data    overwrite len bytes of an entry
+//   SHOW                           switch the display to the widget screen
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Payload length of the display list feature report
+#define DISPLAY_LIST_REPORT_LEN 60
+
+#define DISPLAY_LIST_ENTRIES  16
+#define DISPLAY_LIST_TEXT_LEN 16
+
+// Full scale of a progress bar value
+#define DISPLAY_LIST_PROGRESS_MAX 1000
+
+typedef enum display_list_op_t {
+    DISPLAY_LIST_OP_END,
+    DISPLAY_LIST_OP_CLEAR,
+    DISPLAY_LIST_OP_SET,
+    DISPLAY_LIST_OP_PATCH,
+    DISPLAY_LIST_OP_SHOW,
+} display_list_op_t;
+
+typedef enum display_list_type_t {
+    DISPLAY_LIST_TYPE_NONE,
+    DISPLAY_LIST_TYPE_TEXT,
+    DISPLAY_LIST_TYPE_BOX,
+    DISPLAY_LIST_TYPE_FRAME,
+    DISPLAY_LIST_TYPE_PROGRESS,
+    DISPLAY_LIST_TYPE_GLYPH,
+} display_list_type_t;
+
+typedef struct __attribute__((packed)) display_list_entry_t {
+    uint8_t type;
+    uint8_t font;   // TEXT, GLYPH: index to the UI's font table
+    uint8_t x;      // TEXT, GLYPH: start of the baseline, others: top left corner
+    uint8_t y;
+    uint8_t w;      // BOX, FRAME, PROGRESS
+    uint8_t h;
+    uint16_t value; // PROGRESS: 0-DISPLAY_LIST_PROGRESS_MAX, GLYPH: encoding
+    char text[DISPLAY_LIST_TEXT_LEN]; // TEXT, null terminated unless full
+} display_list_entry_t;
+
+const display_list_entry_t *display_list_get(uint8_t index);
+
+// Bit per entry changed since the previous call
+uint16_t display_list_take_changed();
+
+// Whether the host asked for the widget screen since the previous call
+bool display_list_take_show_request();
+
+// Handle a SET_REPORT of the display list feature report
+void display_list_handle_report(const uint8_t *data, uint16_t len);
+
+// Fill a GET_REPORT of the display list feature report (the status), returns the length
+uint16_t display_list_get_report(uint8_t *buffer, uint16_t reqlen);
+
+#endif // DISPLAY_LIST__H
@@ -3,25 +3,43 @@
 
 #include "display_ui.h"
 
-#include "hardware/clocks.h"
-#include "pico/bootrom.h"
-#include "pico/stdlib.h"
 #include "u8g2.h"
 
+#include "boot_times.h"
 #include "constants.h"
+#include "display_list.h"
+#include "fw_update.h"
+#include "hal.h"
+#include "icon_atlas.h"
+#include "input_bus.h"
+#include "keymap.h"
 #include "log.h"
+#include "perf.h"
 #include "pico_u8g2_i2c.h"
 #include "profiles.h"
+#include "scheduler.h"
 #include "usb_hid.h"
 #include "utils.h"
 #include "version.h"
 
-#define FPS           20
-#define FRAME_TIME_US 1000000 / FPS
-
 static bool display_on = true;
-static absolute_time_t next_display_off = {0};
-static absolute_time_t next_frame = {0};
+static bool usb_suspended = false;
+
+// The display is initialized a step at a time from ui_task, so that USB
+// enumeration and input don't wait for it at boot
+typedef enum display_init_state_t {
+    DISPLAY_INIT_POWER_UP_WAIT, // Panel needs time after power up before it takes commands
+    DISPLAY_INIT_SEQUENCE,      // Send the controller init sequence
+    DISPLAY_INIT_POWER_ON,
+    DISPLAY_INIT_DONE,
+} display_init_state_t;
+
+// The display goes off after this long without input
+#define DISPLAY_OFF_DELAY_US (5000 * 1000)
+
+static display_init_state_t display_init_state = DISPLAY_INIT_POWER_UP_WAIT;
+static uint32_t display_init_wait_end_us;
+static uint32_t next_display_off_us;
 
 enum ui_state_t {
     UI_STATE_SCREEN_VERSION,
@@ -32,6 +50,10 @@ enum ui_state_t {
     UI_STATE_SCREEN_KEYMAP,
     UI_STATE_SCREEN_FW_FLASH_CONFIRM,
     UI_STATE_SCREEN_FW_FLASH_REBOOTING,
+    UI_STATE_SCREEN_PERF,
+    UI_STATE_SCREEN_DISPLAY_LIST,
+    UI_STATE_SCREEN_FW_UPDATE_CONFIRM,
+    UI_STATE_SCREEN_FW_UPDATE_INSTALLING,
 } current_ui_state = UI_STATE_SCREEN_VERSION;
 
 typedef struct {
@@ -42,24 +64,47 @@ typedef struct {
     bool encoder_1_button;
 } input_state_t;
 
-static volatile input_state_t unsafe_current_input_state;
+static input_consumer_t input_consumer;
 static input_state_t current_input_state;
 static input_state_t previous_input_state;
-static volatile bool input_changed;
+static bool input_changed;
 
 static uint8_t menu_selected_index = 0;
 static uint8_t usb_config_selected_index = 0;
 static uint8_t fw_flash_confirm_selected_index = 0;
-
-static absolute_time_t profile_name_exit = {0};
-
-static const char *const menu_items[] = {"Debug", "USBConf", "Keymap", "Version", "FW Flash"};
+static uint8_t fw_update_selected_index = 0;
+// Screen to go back to after the host's update was declined
+static enum ui_state_t ui_state_before_fw_update;
+#if defined(MACROPAD_PERF)
+static uint8_t perf_first_row = 0;
+#endif
+static uint32_t next_perf_refresh_us;
+
+static uint32_t profile_name_exit_us;
+
+// What the display currently shows, to skip frames where nothing changed
+static bool frame_drawn = false;
+static enum ui_state_t drawn_ui_state;
+static uint32_t drawn_profile_generation;
+static uint8_t drawn_layer;
+static uint32_t drawn_icon_generation;
+
+static const char *const menu_items[] = {
+    "Debug", "USBConf", "Keymap", "Version", "FW Flash", "Widgets",
+#if defined(MACROPAD_PERF)
+    "Perf",
+#endif
+};
 typedef enum menu_index_t {
     MENU_INDEX_DEBUG,
     MENU_INDEX_USB_CONF,
     MENU_INDEX_KEYMAP,
     MENU_INDEX_VERSION,
     MENU_INDEX_FW_FLASH,
+    MENU_INDEX_WIDGETS,
+#if defined(MACROPAD_PERF)
+    MENU_INDEX_PERF,
+#endif
 
     // Last
     MENU_ITEMS_TOTAL,
@@ -67,6 +112,29 @@ typedef enum menu_index_t {
 
 static u8g2_t u8g2;
 
+// Fonts of the host's display list entries, by the entry's font index. The
+// host may draw any glyph of the icon font, so font_subset.py keeps it whole.
+static const uint8_t *const display_list_fonts[] = {
+    u8g2_font_t0_11_mr, // glyphs: [ -~]
+    u8g2_font_t0_14_mr, // glyphs: [ -~]
+    u8g2_font_4x6_mr,   // glyphs: [ -~]
+    u8g2_font_streamline_computers_devices_electronics_t,
+};
+#define DISPLAY_LIST_FONT_COUNT (sizeof(display_list_fonts) / sizeof(display_list_fonts[0]))
+
+#define DISPLAY_WIDTH  128
+#define DISPLAY_HEIGHT 32
+#define DISPLAY_TILE_COLUMNS (DISPLAY_WIDTH / 8)
+#define DISPLAY_TILE_ROWS    (DISPLAY_HEIGHT / 8)
+
+// Pixel area, x1 and y1 exclusive
+typedef struct {
+    uint8_t x0, y0, x1, y1;
+} ui_area_t;
+
+// Where each display list entry was drawn last, to clear it when it changes
+static ui_area_t display_list_drawn[DISPLAY_LIST_ENTRIES];
+
 static void ui_display_on() {
     u8g2_SetPowerSave(&u8g2, false);
 }
@@ -123,6 +191,33 @@ static void ui_draw_fw_flash_rebooting_screen() {
     u8g2_DrawStr(&u8g2, 24, 24, "FW flash mode...");
 }
 
+static void ui_draw_fw_update_confirm_screen() {
+    u8g2_SetDrawColor(&u8g2, 1);
+
+    u8g2_SetFont(&u8g2, u8g2_font_streamline_computers_devices_electronics_t);
+    u8g2_DrawGlyph(&u8g2, 0, 24, 0x0043 /* Streamline SD card icon */);
+
+    u8g2_SetFont(&u8g2, u8g2_font_t0_11_mr);
+    u8g2_DrawStr(&u8g2, 24, 12, "Install update?");
+
+    u8g2_SetDrawColor(&u8g2, fw_update_selected_index == 0 ? 0 : 1);
+    u8g2_DrawStr(&u8g2, 24, 24, "No");
+
+    u8g2_SetDrawColor(&u8g2, fw_update_selected_index == 1 ? 0 : 1);
+    u8g2_DrawStr(&u8g2, 64, 24, "Yes");
+}
+
+static void ui_draw_fw_update_installing_screen() {
+    u8g2_SetDrawColor(&u8g2, 1);
+
+    u8g2_SetFont(&u8g2, u8g2_font_streamline_computers_devices_electronics_t);
+    u8g2_DrawGlyph(&u8g2, 0, 24, 0x0043 /* Streamline SD card icon */);
+
+    u8g2_SetFont(&u8g2, u8g2_font_t0_11_mr);
+    u8g2_DrawStr(&u8g2, 24, 12, "Rebooting to");
+    u8g2_DrawStr(&u8g2, 24, 24, "install update...");
+}
+
 static void ui_draw_input_debug_screen() {
     const uint8_t key_side = 6;
 
@@ -189,19 +284,19 @@ static void ui_draw_usb_config_screen() {
     u8g2_DrawStr(&u8g2, 72, 24, "Disable");
 }
 
-static void ui_draw_profile_name_screen() {
-    const char *name = prof_get_current_name();
-
+static void ui_draw_profile_name_screen(const profile_t *profile) {
     u8g2_SetFont(&u8g2, u8g2_font_t0_14_mr);
     u8g2_SetDrawColor(&u8g2, 1);
-    u8g2_DrawStr(&u8g2, 0, 20, name);
+    u8g2_DrawStr(&u8g2, 0, 20, profile->name);
 }
 
-static void ui_draw_keymap_screen() {
-    const uint8_t item_w = 34;
+static void ui_draw_keymap_screen(const profile_t *profile, uint8_t layer) {
+    const uint8_t item_w = 32;
     const uint8_t item_h = 8;
+    const uint8_t char_w = 6;
+    const uint8_t layer_x = 121;
 
-    const char *key_names = prof_get_current_key_names();
+    const char *key_names = profile->key_names;
 
     // 4x3 array (width x height)
     // The key_names array contains the names as four-character
@@ -225,9 +320,238 @@ static void ui_draw_keymap_screen() {
 
             uint8_t text_x = x * item_w;
             uint8_t text_y = (y + 1) * item_h + (y * MACROPAD_KEY_MATRIX_WIDTH);
+
+            // The icon is drawn from flash as is, with as much of the name
+            // as fits after it
+            uint8_t key = y * MACROPAD_KEY_MATRIX_WIDTH + x;
+            const uint8_t *icon = icon_atlas_get(profile->key_icons[key]);
+            if (icon) {
+                uint8_t icon_y = text_y - ICON_ATLAS_ICON_H;
+                if (key_state) {
+                    u8g2_SetDrawColor(&u8g2, 1);
+                    u8g2_DrawBox(&u8g2, text_x, icon_y, ICON_ATLAS_ICON_W + 1, ICON_ATLAS_ICON_H);
+                    u8g2_SetDrawColor(&u8g2, 0);
+                }
+                u8g2_DrawXBM(
+                    &u8g2, text_x, icon_y, ICON_ATLAS_ICON_W, ICON_ATLAS_ICON_H, icon);
+                text_x += ICON_ATLAS_ICON_W + 1;
+                uint8_t end = x * item_w + item_w < layer_x ? x * item_w + item_w : layer_x;
+                current_key_name[(end - text_x) / char_w] = '\0';
+            }
             u8g2_DrawStr(&u8g2, text_x, text_y, current_key_name);
         }
     }
+
+    // Active layer at the right edge, inverted when not on the base layer
+    char layer_str[2] = {0};
+    snprintf(layer_str, sizeof(layer_str), "%X", layer & 0xf);
+    u8g2_SetDrawColor(&u8g2, 1);
+    if (layer != 0) {
+        u8g2_DrawBox(&u8g2, layer_x, 0, DISPLAY_WIDTH - layer_x, DISPLAY_HEIGHT);
+        u8g2_SetDrawColor(&u8g2, 0);
+    }
+    u8g2_DrawStr(&u8g2, layer_x + 1, 20, layer_str);
+}
+
+#if defined(MACROPAD_PERF)
+#define PERF_ROWS 3
+
+static void ui_draw_perf_screen() {
+    uint32_t cycles_per_us = hal_sys_clock_hz() / 1000000;
+    char line[33];
+
+    u8g2_SetDrawColor(&u8g2, 1);
+    u8g2_SetFont(&u8g2, u8g2_font_4x6_mr);
+#if defined(MACROPAD_RAM_HOT_PATH)
+    u8g2_DrawStr(&u8g2, 0, 6, "RAM us     avg   min   max miss");
+#else
+    u8g2_DrawStr(&u8g2, 0, 6, "XIP us     avg   min   max miss");
+#endif
+
+    for (uint8_t row = 0; row < PERF_ROWS; row++) {
+        uint8_t slot = perf_first_row + row;
+        if (slot >= PERF_SLOT_COUNT) {
+            break;
+        }
+        const perf_slot_stats_t *s = &perf_stats[slot];
+        uint32_t avg = s->count ? (uint32_t)(s->total_cycles / s->count) : 0;
+        uint32_t min = s->count ? s->min_cycles : 0;
+        // XIP cache misses per run
+        uint32_t misses = s->count ? (uint32_t)(s->xip_misses / s->count) : 0;
+        snprintf(
+            line, sizeof(line), "%-8s %5lu %5lu %5lu %4lu", perf_slot_name(slot),
+            avg / cycles_per_us, min / cycles_per_us, s->max_cycles / cycles_per_us, misses);
+        // glyphs: [0-9a-z_ ]
+        u8g2_DrawStr(&u8g2, 0, 14 + row * 8, line);
+    }
+}
+#endif
+
+static uint8_t clamp_coord(int16_t v, uint8_t max) {
+    return v < 0 ? 0 : v > max ? max : v;
+}
+
+static const uint8_t *display_list_font(const display_list_entry_t *e) {
+    return display_list_fonts[e->font < DISPLAY_LIST_FONT_COUNT ? e->font : 0];
+}
+
+// The area the entry draws to. Leaves the entry's font set.
+static ui_area_t display_list_entry_area(const display_list_entry_t *e) {
+    int16_t x0 = e->x, y0 = e->y, x1 = e->x + e->w, y1 = e->y + e->h;
+    switch (e->type) {
+    case DISPLAY_LIST_TYPE_TEXT:
+    case DISPLAY_LIST_TYPE_GLYPH: {
+        u8g2_SetFont(&u8g2, display_list_font(e));
+        if (e->type == DISPLAY_LIST_TYPE_TEXT) {
+            char text[DISPLAY_LIST_TEXT_LEN + 1] = {0};
+            memcpy(text, e->text, DISPLAY_LIST_TEXT_LEN);
+            x1 = e->x + u8g2_GetStrWidth(&u8g2, text);
+        } else {
+            x1 = e->x + u8g2_GetMaxCharWidth(&u8g2);
+        }
+        // Text is drawn on the baseline, descenders go below it
+        y0 = e->y - u8g2_GetAscent(&u8g2) - 1;
+        y1 = e->y - u8g2_GetDescent(&u8g2) + 1;
+        break;
+    }
+    case DISPLAY_LIST_TYPE_BOX:
+    case DISPLAY_LIST_TYPE_FRAME:
+    case DISPLAY_LIST_TYPE_PROGRESS:
+        break;
+    default:
+        x1 = x0;
+        y1 = y0;
+        break;
+    }
+    return (ui_area_t){
+        .x0 = clamp_coord(x0, DISPLAY_WIDTH),
+        .y0 = clamp_coord(y0, DISPLAY_HEIGHT),
+        .x1 = clamp_coord(x1, DISPLAY_WIDTH),
+        .y1 = clamp_coord(y1, DISPLAY_HEIGHT),
+    };
+}
+
+// Bit per 8x8 display tile the area covers, row by row
+static uint64_t area_tiles(ui_area_t a) {
+    if (a.x1 <= a.x0 || a.y1 <= a.y0) {
+        return 0;
+    }
+    uint64_t tiles = 0;
+    uint16_t columns = ((1 << ((a.x1 + 7) / 8)) - 1) & ~((1 << (a.x0 / 8)) - 1);
+    for (uint8_t row = a.y0 / 8; row < (a.y1 + 7) / 8; row++) {
+        tiles |= (uint64_t)columns << (row * DISPLAY_TILE_COLUMNS);
+    }
+    return tiles;
+}
+
+static void display_list_draw_entry(const display_list_entry_t *e) {
+    switch (e->type) {
+    case DISPLAY_LIST_TYPE_TEXT: {
+        char text[DISPLAY_LIST_TEXT_LEN + 1] = {0};
+        memcpy(text, e->text, DISPLAY_LIST_TEXT_LEN);
+        u8g2_SetFont(&u8g2, display_list_font(e));
+        u8g2_DrawStr(&u8g2, e->x, e->y, text);
+        break;
+    }
+    case DISPLAY_LIST_TYPE_GLYPH:
+        u8g2_SetFont(&u8g2, display_list_font(e));
+        u8g2_DrawGlyph(&u8g2, e->x, e->y, e->value);
+        break;
+    case DISPLAY_LIST_TYPE_BOX:
+        u8g2_DrawBox(&u8g2, e->x, e->y, e->w, e->h);
+        break;
+    case DISPLAY_LIST_TYPE_FRAME:
+        u8g2_DrawFrame(&u8g2, e->x, e->y, e->w, e->h);
+        break;
+    case DISPLAY_LIST_TYPE_PROGRESS: {
+        u8g2_DrawFrame(&u8g2, e->x, e->y, e->w, e->h);
+        if (e->w <= 4 || e->h <= 4) {
+            break;
+        }
+        uint16_t value = e->value;
+        if (value > DISPLAY_LIST_PROGRESS_MAX) {
+            value = DISPLAY_LIST_PROGRESS_MAX;
+        }
+        uint8_t fill = (uint32_t)(e->w - 4) * value / DISPLAY_LIST_PROGRESS_MAX;
+        if (fill > 0) {
+            u8g2_DrawBox(&u8g2, e->x + 2, e->y + 2, fill, e->h - 4);
+        }
+        break;
+    }
+    }
+}
+
+static void ui_draw_display_list_screen() {
+    // Everything is redrawn, so the pending changes are too
+    display_list_take_changed();
+    u8g2_SetDrawColor(&u8g2, 1);
+    // Text doesn't clear the background, entries under it stay visible
+    u8g2_SetFontMode(&u8g2, 1);
+    for (uint8_t i = 0; i < DISPLAY_LIST_ENTRIES; i++) {
+        const display_list_entry_t *e = display_list_get(i);
+        display_list_drawn[i] = display_list_entry_area(e);
+        display_list_draw_entry(e);
+    }
+    u8g2_SetFontMode(&u8g2, 0);
+}
+
+// Redraw only the tiles of the entries the host changed and send just those
+// to the display, instead of the whole frame
+static void ui_update_display_list() {
+    uint16_t changed = display_list_take_changed();
+    if (changed == 0) {
+        return;
+    }
+
+    uint64_t dirty = 0;
+    for (uint8_t i = 0; i < DISPLAY_LIST_ENTRIES; i++) {
+        if (changed & (1 << i)) {
+            dirty |= area_tiles(display_list_drawn[i]);
+            display_list_drawn[i] = display_list_entry_area(display_list_get(i));
+            dirty |= area_tiles(display_list_drawn[i]);
+        }
+    }
+    if (dirty == 0) {
+        return;
+    }
+
+    u8g2_SetDrawColor(&u8g2, 0);
+    for (uint8_t t = 0; t < DISPLAY_TILE_COLUMNS * DISPLAY_TILE_ROWS; t++) {
+        if (dirty & ((uint64_t)1 << t)) {
+            uint8_t x = (t % DISPLAY_TILE_COLUMNS) * 8;
+            uint8_t y = (t / DISPLAY_TILE_COLUMNS) * 8;
+            u8g2_DrawBox(&u8g2, x, y, 8, 8);
+        }
+    }
+    // Entries overlapping the cleared tiles are drawn whole. Drawing only
+    // sets pixels, text too in the transparent font mode, so the parts
+    // outside the tiles and the entries under the text don't change.
+    u8g2_SetDrawColor(&u8g2, 1);
+    u8g2_SetFontMode(&u8g2, 1);
+    for (uint8_t i = 0; i < DISPLAY_LIST_ENTRIES; i++) {
+        if (area_tiles(display_list_drawn[i]) & dirty) {
+            display_list_draw_entry(display_list_get(i));
+        }
+    }
+    u8g2_SetFontMode(&u8g2, 0);
+
+    PERF_BEGIN(PERF_SLOT_UI_SEND_BUFFER);
+    for (uint8_t row = 0; row < DISPLAY_TILE_ROWS; row++) {
+        uint16_t columns = (dirty >> (row * DISPLAY_TILE_COLUMNS)) & 0xFFFF;
+        uint8_t col = 0;
+        while (col < DISPLAY_TILE_COLUMNS) {
+            if (!(columns & (1 << col))) {
+                col++;
+                continue;
+            }
+            uint8_t start = col;
+            while (col < DISPLAY_TILE_COLUMNS && (columns & (1 << col))) {
+                col++;
+            }
+            u8g2_UpdateDisplayArea(&u8g2, start, row, col - start, 1);
+        }
+    }
+    PERF_END(PERF_SLOT_UI_SEND_BUFFER);
 }
 
 #pragma endregion
@@ -270,10 +594,27 @@ __attribute__((noreturn)) static void ui_handle_input_fw_flash_rebooting_screen(
 
     // No actual input handling here,
     // just reboot the device into the storage flash (BOOTSEL) mode.
-    reset_usb_boot(0, 0);
+    hal_reboot_to_bootloader();
     // Bye
 }
 
+static void ui_handle_input_fw_update_confirm_screen(
+    __attribute__((unused)) bool button_raising, bool button_falling, int8_t encoder_delta) {
+    while (encoder_delta < 0) {
+        encoder_delta += 2;
+    }
+    if (encoder_delta > 0) {
+        fw_update_selected_index = (fw_update_selected_index + encoder_delta) % 2;
+    }
+
+    if (button_falling) {
+        bool install = fw_update_selected_index == 1;
+        fw_update_confirm(install);
+        current_ui_state =
+            install ? UI_STATE_SCREEN_FW_UPDATE_INSTALLING : ui_state_before_fw_update;
+    }
+}
+
 static void ui_handle_input_input_debug_screen(
     __attribute__((unused)) bool button_raising, bool button_falling,
     __attribute__((unused)) int8_t encoder_delta) {
@@ -331,22 +672,59 @@ static void ui_handle_input_menu_screen(
         case MENU_INDEX_FW_FLASH:
             current_ui_state = UI_STATE_SCREEN_FW_FLASH_CONFIRM;
             break;
+        case MENU_INDEX_WIDGETS:
+            current_ui_state = UI_STATE_SCREEN_DISPLAY_LIST;
+            break;
+#if defined(MACROPAD_PERF)
+        case MENU_INDEX_PERF:
+            // The last refresh may be too long ago for time_passed
+            next_perf_refresh_us = hal_time_us();
+            current_ui_state = UI_STATE_SCREEN_PERF;
+            break;
+#endif
         default:
             LOGW("Unknown menu item selected: %hhu", menu_selected_index);
         }
     }
 }
 
+#if defined(MACROPAD_PERF)
+static void ui_handle_input_perf_screen(
+    __attribute__((unused)) bool button_raising, bool button_falling, int8_t encoder_delta) {
+    int16_t row = perf_first_row + encoder_delta;
+    if (row < 0) {
+        row = 0;
+    } else if (row > PERF_SLOT_COUNT - PERF_ROWS) {
+        row = PERF_SLOT_COUNT - PERF_ROWS;
+    }
+    perf_first_row = row;
+
+    if (button_falling) {
+        // Go back to menu
+        current_ui_state = UI_STATE_SCREEN_MENU;
+    }
+}
+#endif
+
 static void ui_handle_input_profile_name_screen(
     __attribute__((unused)) bool button_raising, __attribute__((unused)) bool button_falling,
     __attribute__((unused)) int8_t encoder_delta) {
     // Key events actually not handled for now
 
-    if (time_passed(profile_name_exit)) {
+    if (time_passed(profile_name_exit_us)) {
         current_ui_state = UI_STATE_SCREEN_KEYMAP;
     }
 }
 
+static void ui_handle_input_display_list_screen(
+    __attribute__((unused)) bool button_raising, bool button_falling,
+    __attribute__((unused)) int8_t encoder_delta) {
+    if (button_falling) {
+        // Go back to menu
+        current_ui_state = UI_STATE_SCREEN_MENU;
+    }
+}
+
 static void ui_handle_input_keymap_screen(
     __attribute__((unused)) bool button_raising, bool button_falling,
     __attribute__((unused)) int8_t encoder_delta) {
@@ -358,34 +736,185 @@ static void ui_handle_input_keymap_screen(
 
 #pragma endregion
 
+static void ui_show_profile_name() {
+    // Only interrupt the screens that are not in the middle of something
+    if (current_ui_state == UI_STATE_SCREEN_PROFILE_NAME ||
+        current_ui_state == UI_STATE_SCREEN_MENU || current_ui_state == UI_STATE_SCREEN_VERSION ||
+        current_ui_state == UI_STATE_SCREEN_KEYMAP) {
+        LOGD("Showing profile name screen");
+        profile_name_exit_us = hal_time_us() + 700 * 1000;
+        current_ui_state = UI_STATE_SCREEN_PROFILE_NAME;
+        input_changed = true;
+    }
+}
+
+static void ui_show_display_list() {
+    // Same screens as for the profile name
+    if (current_ui_state == UI_STATE_SCREEN_PROFILE_NAME ||
+        current_ui_state == UI_STATE_SCREEN_MENU || current_ui_state == UI_STATE_SCREEN_VERSION ||
+        current_ui_state == UI_STATE_SCREEN_KEYMAP) {
+        LOGD("Showing display list screen");
+        current_ui_state = UI_STATE_SCREEN_DISPLAY_LIST;
+        input_changed = true;
+    }
+}
+
+// The host's firmware update only installs once the user says yes on the pad
+static void ui_check_fw_update_confirm() {
+    bool pending = fw_update_confirm_pending();
+    if (pending && current_ui_state != UI_STATE_SCREEN_FW_UPDATE_CONFIRM) {
+        LOGD("Showing firmware update confirmation");
+        ui_state_before_fw_update = current_ui_state;
+        fw_update_selected_index = 0;
+        current_ui_state = UI_STATE_SCREEN_FW_UPDATE_CONFIRM;
+        input_changed = true;
+    } else if (!pending && current_ui_state == UI_STATE_SCREEN_FW_UPDATE_CONFIRM) {
+        // Not answered in time
+        current_ui_state = ui_state_before_fw_update;
+        input_changed = true;
+    }
+}
+
+// Encoder 0 drives the UI unless its profile mode reports it to the host.
+// Only the volume mode reports the button, as a mute.
+static bool encoder_0_for_ui(bool button) {
+    switch (prof_get_snapshot()->profile.encoder_modes[0]) {
+    case PROF_ENCODER_MODE_VOLUME:
+        return false;
+    case PROF_ENCODER_MODE_WHEEL:
+    case PROF_ENCODER_MODE_PAN:
+        return button;
+    default:
+        return true;
+    }
+}
+
+// Apply all the pending input events to current_input_state
+static void ui_read_input_events() {
+    input_event_t ev;
+    while (input_bus_poll(&input_consumer, &ev)) {
+        switch (ev.type) {
+        case INPUT_EVENT_KEYS:
+            current_input_state.key_matrix = ev.keys;
+            break;
+        case INPUT_EVENT_ENCODER:
+            if (ev.index == 0) {
+                // Not for the UI when the profile reports it to the host
+                if (encoder_0_for_ui(false)) {
+                    current_input_state.encoder_0 += ev.delta;
+                }
+            } else {
+                current_input_state.encoder_1 += ev.delta;
+            }
+            break;
+        case INPUT_EVENT_BUTTON:
+            if (ev.index == 0) {
+                // Not for the UI when it's used as a layer key or mutes
+                if (keymap_get_config()->button_layer[0] == 0 && encoder_0_for_ui(true)) {
+                    current_input_state.encoder_0_button = ev.pressed;
+                }
+            } else {
+                current_input_state.encoder_1_button = ev.pressed;
+            }
+            break;
+        case INPUT_EVENT_PROFILE:
+            ui_show_profile_name();
+            break;
+        }
+        input_changed = true;
+    }
+}
+
 void ui_init() {
+    // No I/O yet, ui_task does the rest
     u8g2_Setup_ssd1306_i2c_128x32_univision_f(
         &u8g2, U8G2_R0, pico_u8g2_byte_i2c, pico_u8g2_delay_cb);
-    u8g2_InitDisplay(&u8g2);
-    u8g2_SetPowerSave(&u8g2, false);
 
-    next_display_off = make_timeout_time_ms(5000);
+    // The delays u8g2_InitDisplay would block for before sending the init sequence
+    const u8x8_display_info_t *info = u8g2_GetU8x8(&u8g2)->display_info;
+    uint16_t wait_ms = 2 * info->reset_pulse_width_ms + info->post_reset_wait_ms;
+    pico_u8g2_delay_credit(wait_ms);
+    display_init_wait_end_us = hal_time_us() + wait_ms * 1000;
+
+    input_bus_subscribe(&input_consumer);
 }
 
-void ui_task() {
-    // Limit FPS to save resources and cycles and stuff
-    if (!time_passed(next_frame)) {
+// Run one step of the display init. Each step only blocks for a short I2C transfer.
+static void ui_display_init_step() {
+    switch (display_init_state) {
+    case DISPLAY_INIT_POWER_UP_WAIT:
+        if ((int32_t)(hal_time_us() - display_init_wait_end_us) < 0) {
+            sched_set_deadline(SCHED_TASK_UI, display_init_wait_end_us);
+            return;
+        }
+        display_init_state = DISPLAY_INIT_SEQUENCE;
+        break;
+    case DISPLAY_INIT_SEQUENCE:
+        // Doesn't sleep, the reset delays were waited for above
+        u8g2_InitDisplay(&u8g2);
+        display_init_state = DISPLAY_INIT_POWER_ON;
+        break;
+    case DISPLAY_INIT_POWER_ON:
+        display_on = !usb_suspended;
+        u8g2_SetPowerSave(&u8g2, !display_on);
+        next_display_off_us = hal_time_us() + DISPLAY_OFF_DELAY_US;
+        display_init_state = DISPLAY_INIT_DONE;
+        boot_times_mark(BOOT_MILESTONE_DISPLAY_READY);
+        break;
+    case DISPLAY_INIT_DONE:
+        break;
+    }
+    // Continue on the next scheduler pass instead of the next frame
+    sched_wake(SCHED_TASK_UI);
+}
+
+void ui_set_suspended(bool suspended) {
+    usb_suspended = suspended;
+    if (display_init_state != DISPLAY_INIT_DONE) {
+        // Powered on (or not) when the init finishes
         return;
     }
-    next_frame = delayed_by_us(next_frame, FRAME_TIME_US);
+    if (suspended) {
+        LOGD("Display off for USB suspend");
+        display_on = false;
+        ui_display_off();
+    } else {
+        // Wakes the display up and redraws on the next frame
+        input_changed = true;
+    }
+}
 
-    current_input_state = unsafe_current_input_state;
+// Run by the scheduler at UI_FPS, limited to save resources and cycles and stuff
+void ui_task() {
+    ui_read_input_events();
+    if (display_list_take_show_request()) {
+        ui_show_display_list();
+    }
+    ui_check_fw_update_confirm();
+    if (display_init_state != DISPLAY_INIT_DONE) {
+        ui_display_init_step();
+        return;
+    }
+    if (usb_suspended) {
+        // Input while suspended is for waking up the host, not for the menus
+        previous_input_state = current_input_state;
+        input_changed = false;
+        return;
+    }
 
+    bool redraw = input_changed || !frame_drawn;
     if (input_changed) {
         input_changed = false;
-        next_display_off = make_timeout_time_ms(5000);
+        next_display_off_us = hal_time_us() + DISPLAY_OFF_DELAY_US;
         if (!display_on) {
             LOGD("Waking display");
             display_on = true;
             ui_display_on();
         }
     } else {
-        if (display_on && time_passed(next_display_off)) {
+        // Stays on while asking about the update
+        if (display_on && time_passed(next_display_off_us) &&
+            current_ui_state != UI_STATE_SCREEN_FW_UPDATE_CONFIRM) {
             LOGD("Shutting down display");
             display_on = false;
             ui_display_off();
@@ -423,6 +952,42 @@ void ui_task() {
     case UI_STATE_SCREEN_FW_FLASH_REBOOTING:
         ui_handle_input_fw_flash_rebooting_screen(button_raising, button_falling, encoder_delta);
         break;
+    case UI_STATE_SCREEN_PERF:
+#if defined(MACROPAD_PERF)
+        ui_handle_input_perf_screen(button_raising, button_falling, encoder_delta);
+#endif
+        break;
+    case UI_STATE_SCREEN_DISPLAY_LIST:
+        ui_handle_input_display_list_screen(button_raising, button_falling, encoder_delta);
+        break;
+    case UI_STATE_SCREEN_FW_UPDATE_CONFIRM:
+        ui_handle_input_fw_update_confirm_screen(button_raising, button_falling, encoder_delta);
+        break;
+    case UI_STATE_SCREEN_FW_UPDATE_INSTALLING:
+        // Rebooting
+        break;
+    }
+
+    previous_input_state = current_input_state;
+
+    const prof_snapshot_t *profile = prof_get_snapshot();
+    uint8_t layer = keymap_get_layer();
+    if (current_ui_state == UI_STATE_SCREEN_PERF && time_passed(next_perf_refresh_us)) {
+        // The numbers change all the time, refresh a few times a second
+        next_perf_refresh_us = hal_time_us() + 250 * 1000;
+        redraw = true;
+    }
+    if (!redraw && current_ui_state == UI_STATE_SCREEN_DISPLAY_LIST &&
+        drawn_ui_state == UI_STATE_SCREEN_DISPLAY_LIST) {
+        if (display_on) {
+            ui_update_display_list();
+        }
+        return;
+    }
+    if (!redraw && current_ui_state == drawn_ui_state &&
+        profile->generation == drawn_profile_generation && layer == drawn_layer &&
+        icon_atlas_generation() == drawn_icon_generation) {
+        return;
     }
 
     // Draw
@@ -441,10 +1006,10 @@ void ui_task() {
         ui_draw_usb_config_screen();
         break;
     case UI_STATE_SCREEN_PROFILE_NAME:
-        ui_draw_profile_name_screen();
+        ui_draw_profile_name_screen(&profile->profile);
         break;
     case UI_STATE_SCREEN_KEYMAP:
-        ui_draw_keymap_screen();
+        ui_draw_keymap_screen(&profile->profile, layer);
         break;
     case UI_STATE_SCREEN_FW_FLASH_CONFIRM:
         ui_draw_fw_flash_confirm_screen();
@@ -452,48 +1017,31 @@ void ui_task() {
     case UI_STATE_SCREEN_FW_FLASH_REBOOTING:
         ui_draw_fw_flash_rebooting_screen();
         break;
+    case UI_STATE_SCREEN_PERF:
+#if defined(MACROPAD_PERF)
+        ui_draw_perf_screen();
+#endif
+        break;
+    case UI_STATE_SCREEN_DISPLAY_LIST:
+        ui_draw_display_list_screen();
+        break;
+    case UI_STATE_SCREEN_FW_UPDATE_CONFIRM:
+        ui_draw_fw_update_confirm_screen();
+        break;
+    case UI_STATE_SCREEN_FW_UPDATE_INSTALLING:
+        ui_draw_fw_update_installing_screen();
+        break;
     }
+    PERF_BEGIN(PERF_SLOT_UI_SEND_BUFFER);
     u8g2_SendBuffer(&u8g2);
-
-    previous_input_state = current_input_state;
-}
-
-void ui_set_input_states(
-    const uint16_t *key_matrix, const uint8_t *encoder_0, const bool *encoder_0_button,
-    const uint8_t *encoder_1, const bool *encoder_1_button) {
-    bool c = false;
-    if (key_matrix) {
-        unsafe_current_input_state.key_matrix = *key_matrix;
-        c = true;
-    }
-    if (encoder_0) {
-        unsafe_current_input_state.encoder_0 = *encoder_0;
-        c = true;
-    }
-    if (encoder_0_button) {
-        unsafe_current_input_state.encoder_0_button = *encoder_0_button;
-        c = true;
-    }
-    if (encoder_1) {
-        unsafe_current_input_state.encoder_1 = *encoder_1;
-        c = true;
-    }
-    if (encoder_1_button) {
-        unsafe_current_input_state.encoder_1_button = *encoder_1_button;
-        c = true;
+    PERF_END(PERF_SLOT_UI_SEND_BUFFER);
+    if (!frame_drawn) {
+        boot_times_mark(BOOT_MILESTONE_FIRST_FRAME);
     }
 
-    input_changed = c;
+    frame_drawn = true;
+    drawn_ui_state = current_ui_state;
+    drawn_profile_generation = profile->generation;
+    drawn_layer = layer;
+    drawn_icon_generation = icon_atlas_generation();
 }
-
-void ui_trigger_profile_change() {
-    // This is called when an USB event is received for a profile change
-    if (current_ui_state == UI_STATE_SCREEN_PROFILE_NAME ||
-        current_ui_state == UI_STATE_SCREEN_MENU || current_ui_state == UI_STATE_SCREEN_VERSION ||
-        current_ui_state == UI_STATE_SCREEN_KEYMAP) {
-        LOGD("Showing profile name screen");
-        profile_name_exit = make_timeout_time_ms(700);
-        current_ui_state = UI_STATE_SCREEN_PROFILE_NAME;
-        input_changed = true;
-    }
-}
\ No newline at end of file
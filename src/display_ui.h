@@ -2,16 +2,15 @@
 #define DISPLAY_UI__H
 
 #include <stdbool.h>
-#include <stdint.h>
 
-void ui_init();
-
-void ui_set_input_states(
-    const uint16_t *key_matrix, const uint8_t *encoder_0, const bool *encoder_0_button,
-    const uint8_t *encoder_1, const bool *encoder_1_button);
+#define UI_FPS               20
+#define UI_FRAME_INTERVAL_US (1000000 / UI_FPS)
 
-void ui_trigger_profile_change();
+void ui_init();
 
 void ui_task();
 
+// Stop drawing and turn the display off while the USB bus is suspended
+void ui_set_suspended(bool suspended);
+
 #endif // DISPLAY_UI__H
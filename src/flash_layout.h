@@ -0,0 +1,36 @@
+#if !defined(FLASH_LAYOUT__H)
+#define FLASH_LAYOUT__H
+
+// How the 2 MB flash is divided, as offsets from the start of flash. CMake
+// reads the firmware region from here for the linker scripts.
+
+// Where flash is mapped to (XIP)
+#define FLASH_LAYOUT_XIP_BASE 0x10000000
+
+// The boot stage (boot_stage/boot_stage.c): installs a confirmed firmware
+// update from staging, then starts the firmware
+#define FLASH_LAYOUT_BOOT_STAGE_OFFSET 0x000000
+#define FLASH_LAYOUT_BOOT_STAGE_SIZE   0x008000
+
+#define FLASH_LAYOUT_FIRMWARE_OFFSET 0x008000
+#define FLASH_LAYOUT_FIRMWARE_SIZE   0x0F8000
+
+// Firmware update images are received here before being copied over the firmware
+#define FLASH_LAYOUT_STAGING_OFFSET 0x100000
+#define FLASH_LAYOUT_STAGING_SIZE   0x0F0000
+
+// 0x1F0000 - 0x1FCFFF: unused
+
+// The update the boot stage is to install, see fw_update_record.h
+#define FLASH_LAYOUT_UPDATE_RECORD_OFFSET 0x1FD000
+#define FLASH_LAYOUT_UPDATE_RECORD_SIZE   0x001000
+
+// Key icons, drawn by the UI straight from flash
+#define FLASH_LAYOUT_ICONS_OFFSET 0x1FE000
+#define FLASH_LAYOUT_ICONS_SIZE   0x001000
+
+// Profiles loaded into the profile cache at boot
+#define FLASH_LAYOUT_PROFILES_OFFSET 0x1FF000
+#define FLASH_LAYOUT_PROFILES_SIZE   0x001000
+
+#endif // FLASH_LAYOUT__H
@@ -0,0 +1,8 @@
+#include "flash_ops.h"
+
+void flash_ops_write_sector(uint32_t offset, const uint8_t *data) {
+    uint32_t irq_state = hal_irq_save();
+    hal_flash_erase(offset, HAL_FLASH_SECTOR_SIZE);
+    hal_flash_program(offset, data, HAL_FLASH_SECTOR_SIZE);
+    hal_irq_restore(irq_state);
+}
@@ -0,0 +1,19 @@
+#if !defined(FLASH_OPS__H)
+#define FLASH_OPS__H
+
+// Writing to flash stalls XIP, so these run with interrupts disabled and
+// must not touch the region the firmware runs from.
+
+#include "hal.h"
+
+#include <stdint.h>
+
+// Erase and program one HAL_FLASH_SECTOR_SIZE sector. data must not be in flash.
+void flash_ops_write_sector(uint32_t offset, const uint8_t *data);
+
+// Flash contents through XIP
+static inline const uint8_t *flash_ops_read_ptr(uint32_t offset) {
+    return hal_flash_read_ptr(offset);
+}
+
+#endif // FLASH_OPS__H
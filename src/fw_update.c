@@ -0,0 +1,453 @@
+#include "fw_update.h"
+
+#include "flash_layout.h"
+#include "flash_ops.h"
+#include "fw_update_record.h"
+#include "hal.h"
+#include "log.h"
+#include "scheduler.h"
+#include "utils.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <string.h>
+
+#define BLOCK_SIZE      HAL_FLASH_SECTOR_SIZE
+#define PAGES_PER_BLOCK (BLOCK_SIZE / HAL_FLASH_PAGE_SIZE)
+#define MAX_IMAGE_SIZE  FLASH_LAYOUT_STAGING_SIZE
+#define DATA_CHUNK_LEN  52
+#define BOOT2_SIZE      256
+
+// Give the APPLY control transfer time to complete before going away
+#define APPLY_DELAY_US (100 * 1000)
+// The user has this long to confirm the update on the pad
+#define CONFIRM_TIMEOUT_US (30 * 1000000)
+
+// Work per task run, so the other tasks get to run in between. Each page is
+// programmed with interrupts off for under a millisecond.
+#define PAGES_PER_RUN  4
+#define VERIFY_PER_RUN (4 * BLOCK_SIZE)
+
+static_assert(MAX_IMAGE_SIZE <= FLASH_LAYOUT_FIRMWARE_SIZE, "staged images must fit the firmware");
+
+enum fw_update_cmd_t {
+    FW_UPDATE_CMD_BEGIN,        // Start receiving an image, staged blocks are kept for resuming
+    FW_UPDATE_CMD_DATA,         // Part of a block
+    FW_UPDATE_CMD_COMMIT_BLOCK, // Check the received block and write it to staging
+    FW_UPDATE_CMD_COPY_BLOCK,   // Delta: stage a block of the running firmware
+    FW_UPDATE_CMD_QUERY_CRC,    // CRC of a staged or running firmware block, see the status
+    FW_UPDATE_CMD_FINISH,       // Verify the whole staged image
+    FW_UPDATE_CMD_APPLY,        // Ask the user to install the verified image, then reboot
+};
+
+enum fw_update_state_t {
+    FW_UPDATE_STATE_IDLE,
+    FW_UPDATE_STATE_RECEIVING,
+    FW_UPDATE_STATE_VERIFIED,
+    FW_UPDATE_STATE_APPLYING,
+    FW_UPDATE_STATE_CONFIRMING, // Waiting for the user to accept the update
+};
+
+enum fw_update_result_t {
+    FW_UPDATE_OK,
+    FW_UPDATE_ERR_BAD_REQUEST,
+    FW_UPDATE_ERR_BAD_STATE,
+    FW_UPDATE_ERR_CRC,      // Received block doesn't match its CRC, resend it
+    FW_UPDATE_ERR_VERIFY,   // Flash contents don't match after writing
+    FW_UPDATE_ERR_IMAGE,    // Not a bootable image for the firmware region
+    FW_UPDATE_BUSY,         // Still working on the last command, poll again
+    FW_UPDATE_ERR_DECLINED, // The user declined the update, or didn't answer in time
+};
+
+enum fw_update_region_t {
+    FW_UPDATE_REGION_FIRMWARE,
+    FW_UPDATE_REGION_STAGING,
+};
+
+// Commands that write or read a lot of flash run in fw_update_task instead of
+// the USB callback
+typedef enum job_t {
+    JOB_NONE,
+    JOB_STAGE,   // Program block_buf to staging
+    JOB_VERIFY,  // CRC of the whole staged image
+    JOB_CONFIRM, // Wait for fw_update_confirm
+    JOB_REBOOT,  // Reboot into the boot stage at the deadline
+} job_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t cmd;
+    uint16_t block;
+    union {
+        struct __attribute__((packed)) {
+            uint16_t offset;
+            uint8_t len;
+            uint8_t data[DATA_CHUNK_LEN];
+        } data;
+        struct __attribute__((packed)) {
+            uint32_t crc;
+            uint16_t src_block; // COPY_BLOCK only
+        } commit;
+        struct __attribute__((packed)) {
+            uint32_t size;
+            uint32_t crc;
+        } image;
+        uint8_t region;
+    };
+} fw_update_request_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t state;
+    uint8_t result; // Of the last command
+    uint16_t block; // Block of the last command
+    uint32_t crc;   // QUERY_CRC result
+    uint32_t image_size;
+    uint32_t max_image_size;
+    uint16_t block_size;
+    uint16_t blocks_written;
+    uint16_t blocks_copied;
+} fw_update_status_t;
+
+static_assert(sizeof(fw_update_request_t) <= FW_UPDATE_REPORT_LEN, "request too long");
+static_assert(sizeof(fw_update_status_t) <= FW_UPDATE_REPORT_LEN, "status too long");
+
+static fw_update_status_t status = {
+    .max_image_size = MAX_IMAGE_SIZE,
+    .block_size = BLOCK_SIZE,
+};
+static uint32_t image_crc = 0;
+
+// One block, received or being copied. Also the update record when applying.
+static uint8_t block_buf[BLOCK_SIZE] __attribute__((aligned(4)));
+static int32_t block_buf_index = -1;
+
+static struct {
+    job_t type;
+    uint16_t block;
+    uint32_t crc;
+    bool copied;      // JOB_STAGE: counts as copied instead of written
+    uint8_t page;     // JOB_STAGE: next page to program
+    uint32_t pos;     // JOB_VERIFY: bytes checked so far
+    uint32_t deadline_us;
+} job;
+
+static inline uint16_t image_blocks() {
+    return (status.image_size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+}
+
+static uint32_t region_offset(uint8_t region) {
+    return region == FW_UPDATE_REGION_STAGING ? FLASH_LAYOUT_STAGING_OFFSET
+                                              : FLASH_LAYOUT_FIRMWARE_OFFSET;
+}
+
+static uint32_t flash_block_crc(uint8_t region, uint16_t block) {
+    return crc32(flash_ops_read_ptr(region_offset(region) + block * BLOCK_SIZE), BLOCK_SIZE, 0);
+}
+
+static bool flash_blank(uint32_t offset, uint32_t len) {
+    const uint8_t *p = flash_ops_read_ptr(offset);
+    for (uint32_t i = 0; i < len; i++) {
+        if (p[i] != 0xff) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void finish_job(uint8_t result) {
+    job.type = JOB_NONE;
+    status.result = result;
+    if (result != FW_UPDATE_OK) {
+        LOGW("Firmware update of block %u failed: %u", status.block, result);
+    }
+}
+
+// The boot ROM only runs an image whose second stage bootloader checksum is right
+static bool boot2_valid(const uint8_t *image) {
+    uint32_t crc = 0xffffffff;
+    for (uint16_t i = 0; i < BOOT2_SIZE - 4; i++) {
+        crc ^= (uint32_t)image[i] << 24;
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            crc = (crc << 1) ^ (0x04c11db7 & -(crc >> 31));
+        }
+    }
+    uint32_t expected;
+    memcpy(&expected, image + BOOT2_SIZE - 4, sizeof(expected));
+    return crc == expected;
+}
+
+// The boot stage jumps to the reset handler in the image's vector table, which
+// must be code of an image linked for the firmware region
+static bool reset_vector_valid(const uint8_t *image) {
+    uint32_t reset;
+    memcpy(&reset, image + FW_UPDATE_VECTOR_TABLE_OFFSET + 4, sizeof(reset));
+    uint32_t start = FLASH_LAYOUT_XIP_BASE + FLASH_LAYOUT_FIRMWARE_OFFSET;
+    return (reset & 1) && reset - start < status.image_size;
+}
+
+static void stage_step() {
+    uint32_t offset = FLASH_LAYOUT_STAGING_OFFSET + job.block * BLOCK_SIZE;
+
+    if (job.page == 0) {
+        if (crc32(block_buf, BLOCK_SIZE, 0) != job.crc) {
+            finish_job(FW_UPDATE_ERR_CRC);
+            return;
+        }
+        // The boot stage leaves staging erased after installing an update, so
+        // this only stalls (for a sector erase, ~45 ms) after an abandoned one
+        if (!flash_blank(offset, BLOCK_SIZE)) {
+            LOGD("Erasing staging block %u", job.block);
+            uint32_t irq_state = hal_irq_save();
+            hal_flash_erase(offset, BLOCK_SIZE);
+            hal_irq_restore(irq_state);
+        }
+    }
+
+    for (uint8_t i = 0; i < PAGES_PER_RUN && job.page < PAGES_PER_BLOCK; i++, job.page++) {
+        uint32_t page_offset = job.page * HAL_FLASH_PAGE_SIZE;
+        uint32_t irq_state = hal_irq_save();
+        hal_flash_program(offset + page_offset, block_buf + page_offset, HAL_FLASH_PAGE_SIZE);
+        hal_irq_restore(irq_state);
+    }
+    if (job.page < PAGES_PER_BLOCK) {
+        sched_wake(SCHED_TASK_FW_UPDATE);
+        return;
+    }
+
+    if (flash_block_crc(FW_UPDATE_REGION_STAGING, job.block) != job.crc) {
+        LOGW("Staged block %u doesn't verify", job.block);
+        finish_job(FW_UPDATE_ERR_VERIFY);
+        return;
+    }
+    if (job.copied) {
+        status.blocks_copied++;
+    } else {
+        status.blocks_written++;
+    }
+    finish_job(FW_UPDATE_OK);
+}
+
+static void verify_step() {
+    const uint8_t *staged = flash_ops_read_ptr(FLASH_LAYOUT_STAGING_OFFSET);
+    uint32_t len = status.image_size - job.pos;
+    len = len < VERIFY_PER_RUN ? len : VERIFY_PER_RUN;
+    job.crc = crc32(staged + job.pos, len, job.crc);
+    job.pos += len;
+    if (job.pos < status.image_size) {
+        sched_wake(SCHED_TASK_FW_UPDATE);
+        return;
+    }
+
+    if (job.crc != image_crc) {
+        finish_job(FW_UPDATE_ERR_VERIFY);
+        return;
+    }
+    if (status.image_size < BOOT2_SIZE + FW_UPDATE_VECTOR_TABLE_OFFSET ||
+        !boot2_valid(staged) || !reset_vector_valid(staged)) {
+        finish_job(FW_UPDATE_ERR_IMAGE);
+        return;
+    }
+    LOGI(
+        "Firmware image verified (%u blocks written, %u copied)", status.blocks_written,
+        status.blocks_copied);
+    status.state = FW_UPDATE_STATE_VERIFIED;
+    finish_job(FW_UPDATE_OK);
+}
+
+static void start_job(job_t type) {
+    job.type = type;
+    job.page = 0;
+    job.pos = 0;
+    job.crc = 0;
+    sched_wake(SCHED_TASK_FW_UPDATE);
+}
+
+static uint8_t handle_request(const fw_update_request_t *req) {
+    bool receiving = status.state == FW_UPDATE_STATE_RECEIVING;
+
+    switch (req->cmd) {
+    case FW_UPDATE_CMD_BEGIN:
+        if (status.state == FW_UPDATE_STATE_APPLYING) {
+            return FW_UPDATE_ERR_BAD_STATE;
+        }
+        if (req->image.size == 0 || req->image.size > MAX_IMAGE_SIZE) {
+            return FW_UPDATE_ERR_BAD_REQUEST;
+        }
+        LOGI("Receiving a %lu byte firmware image", req->image.size);
+        status.state = FW_UPDATE_STATE_RECEIVING;
+        status.image_size = req->image.size;
+        status.blocks_written = 0;
+        status.blocks_copied = 0;
+        image_crc = req->image.crc;
+        block_buf_index = -1;
+        return FW_UPDATE_OK;
+
+    case FW_UPDATE_CMD_DATA:
+        if (!receiving) {
+            return FW_UPDATE_ERR_BAD_STATE;
+        }
+        if (req->block >= image_blocks() || req->data.len > DATA_CHUNK_LEN ||
+            req->data.offset + req->data.len > BLOCK_SIZE) {
+            return FW_UPDATE_ERR_BAD_REQUEST;
+        }
+        if (block_buf_index != req->block) {
+            // Bytes past the end of the image stay erased
+            memset(block_buf, 0xff, BLOCK_SIZE);
+            block_buf_index = req->block;
+        }
+        memcpy(block_buf + req->data.offset, req->data.data, req->data.len);
+        return FW_UPDATE_OK;
+
+    case FW_UPDATE_CMD_COMMIT_BLOCK:
+        if (!receiving) {
+            return FW_UPDATE_ERR_BAD_STATE;
+        }
+        if (block_buf_index != req->block) {
+            return FW_UPDATE_ERR_BAD_REQUEST;
+        }
+        block_buf_index = -1;
+        job.block = req->block;
+        job.copied = false;
+        start_job(JOB_STAGE);
+        job.crc = req->commit.crc;
+        return FW_UPDATE_BUSY;
+
+    case FW_UPDATE_CMD_COPY_BLOCK:
+        if (!receiving) {
+            return FW_UPDATE_ERR_BAD_STATE;
+        }
+        if (req->block >= image_blocks() ||
+            req->commit.src_block >= FLASH_LAYOUT_FIRMWARE_SIZE / BLOCK_SIZE) {
+            return FW_UPDATE_ERR_BAD_REQUEST;
+        }
+        memcpy(
+            block_buf,
+            flash_ops_read_ptr(FLASH_LAYOUT_FIRMWARE_OFFSET + req->commit.src_block * BLOCK_SIZE),
+            BLOCK_SIZE);
+        block_buf_index = -1;
+        job.block = req->block;
+        job.copied = true;
+        start_job(JOB_STAGE);
+        job.crc = req->commit.crc;
+        return FW_UPDATE_BUSY;
+
+    case FW_UPDATE_CMD_QUERY_CRC: {
+        uint32_t region_size = req->region == FW_UPDATE_REGION_STAGING
+                                   ? FLASH_LAYOUT_STAGING_SIZE
+                                   : FLASH_LAYOUT_FIRMWARE_SIZE;
+        if (req->region > FW_UPDATE_REGION_STAGING || req->block >= region_size / BLOCK_SIZE) {
+            return FW_UPDATE_ERR_BAD_REQUEST;
+        }
+        status.crc = flash_block_crc(req->region, req->block);
+        return FW_UPDATE_OK;
+    }
+
+    case FW_UPDATE_CMD_FINISH:
+        if (!receiving) {
+            return FW_UPDATE_ERR_BAD_STATE;
+        }
+        if (req->image.size != status.image_size || req->image.crc != image_crc) {
+            return FW_UPDATE_ERR_BAD_REQUEST;
+        }
+        start_job(JOB_VERIFY);
+        return FW_UPDATE_BUSY;
+
+    case FW_UPDATE_CMD_APPLY:
+        if (status.state != FW_UPDATE_STATE_VERIFIED) {
+            return FW_UPDATE_ERR_BAD_STATE;
+        }
+        LOGI("Firmware update waiting for confirmation");
+        status.state = FW_UPDATE_STATE_CONFIRMING;
+        start_job(JOB_CONFIRM);
+        job.deadline_us = hal_time_us() + CONFIRM_TIMEOUT_US;
+        sched_set_deadline(SCHED_TASK_FW_UPDATE, job.deadline_us);
+        // Show the question right away
+        sched_wake(SCHED_TASK_UI);
+        return FW_UPDATE_BUSY;
+
+    default:
+        return FW_UPDATE_ERR_BAD_REQUEST;
+    }
+}
+
+void fw_update_handle_report(const uint8_t *data, uint16_t len) {
+    fw_update_request_t req = {0};
+    memcpy(&req, data, len < sizeof(req) ? len : sizeof(req));
+
+    if (job.type != JOB_NONE) {
+        // The status keeps showing the running command
+        LOGW("Firmware update busy, ignoring command %u", req.cmd);
+        return;
+    }
+
+    status.block = req.block;
+    status.result = handle_request(&req);
+    if (status.result != FW_UPDATE_OK && status.result != FW_UPDATE_BUSY) {
+        LOGW("Firmware update command %u failed: %u", req.cmd, status.result);
+    }
+}
+
+uint16_t fw_update_get_report(uint8_t *buffer, uint16_t reqlen) {
+    uint8_t report[FW_UPDATE_REPORT_LEN] = {0};
+    memcpy(report, &status, sizeof(status));
+
+    uint16_t len = reqlen < sizeof(report) ? reqlen : sizeof(report);
+    memcpy(buffer, report, len);
+    return len;
+}
+
+bool fw_update_confirm_pending() {
+    return job.type == JOB_CONFIRM;
+}
+
+void fw_update_confirm(bool install) {
+    if (job.type != JOB_CONFIRM) {
+        return;
+    }
+    if (!install) {
+        LOGI("Firmware update declined");
+        status.state = FW_UPDATE_STATE_VERIFIED;
+        finish_job(FW_UPDATE_ERR_DECLINED);
+        return;
+    }
+
+    fw_update_record_t record = {
+        .magic = FW_UPDATE_RECORD_MAGIC,
+        .image_size = status.image_size,
+        .image_crc = image_crc,
+    };
+    record.record_crc = crc32(&record, offsetof(fw_update_record_t, record_crc), 0);
+    memset(block_buf, 0xff, BLOCK_SIZE);
+    memcpy(block_buf, &record, sizeof(record));
+    flash_ops_write_sector(FLASH_LAYOUT_UPDATE_RECORD_OFFSET, block_buf);
+
+    LOGI("Rebooting to install the firmware update");
+    status.state = FW_UPDATE_STATE_APPLYING;
+    finish_job(FW_UPDATE_OK);
+    job.type = JOB_REBOOT;
+    job.deadline_us = hal_time_us() + APPLY_DELAY_US;
+    sched_set_deadline(SCHED_TASK_FW_UPDATE, job.deadline_us);
+}
+
+void fw_update_task() {
+    switch (job.type) {
+    case JOB_NONE:
+        break;
+    case JOB_STAGE:
+        stage_step();
+        break;
+    case JOB_VERIFY:
+        verify_step();
+        break;
+    case JOB_CONFIRM:
+        if (time_passed(job.deadline_us)) {
+            LOGI("Firmware update not confirmed in time");
+            fw_update_confirm(false);
+        }
+        break;
+    case JOB_REBOOT:
+        if (time_passed(job.deadline_us)) {
+            hal_reboot();
+        }
+        break;
+    }
+}
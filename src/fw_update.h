@@ -0,0 +1,34 @@
+#if !defined(FW_UPDATE__H)
+#define FW_UPDATE__H
+
+// Firmware update over HID. The image is received into the staging flash
+// region block by block, each block checked against its CRC, then verified as
+// a whole. Once the user confirms the update on the pad, the boot stage
+// copies it over the firmware on the next boot. scripts/fw_update.py is the
+// host side.
+//
+// Flash writes and the image verification run in fw_update_task a bit at a
+// time. The status reads busy until they are done.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Payload length of the firmware update feature report
+#define FW_UPDATE_REPORT_LEN 60
+
+// Handle a SET_REPORT of the firmware update feature report
+void fw_update_handle_report(const uint8_t *data, uint16_t len);
+
+// Fill a GET_REPORT of the firmware update feature report (the status), returns the length
+uint16_t fw_update_get_report(uint8_t *buffer, uint16_t reqlen);
+
+// Run by the scheduler when woken or at a deadline set by the module
+void fw_update_task();
+
+// The host asked to install a verified update, and the user hasn't answered yet
+bool fw_update_confirm_pending();
+
+// The user's answer. Installing reboots shortly after.
+void fw_update_confirm(bool install);
+
+#endif // FW_UPDATE__H
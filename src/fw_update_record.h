@@ -0,0 +1,25 @@
+#if !defined(FW_UPDATE_RECORD__H)
+#define FW_UPDATE_RECORD__H
+
+// The firmware update waiting to be installed. fw_update.c writes it to
+// FLASH_LAYOUT_UPDATE_RECORD_OFFSET once the user has confirmed the update and
+// reboots. The boot stage then copies the staged image over the firmware and
+// erases the record only after the copy verifies, so a copy cut short by a
+// power loss starts over on the next boot.
+
+#include <stdint.h>
+
+#define FW_UPDATE_RECORD_MAGIC 0x5055574d // "MWUP"
+
+typedef struct {
+    uint32_t magic;
+    uint32_t image_size;
+    uint32_t image_crc;  // crc32() of the image
+    uint32_t record_crc; // crc32() of the fields above
+} fw_update_record_t;
+
+// Where the image's vector table is, after the second stage bootloader the
+// boot ROM only runs from the boot stage
+#define FW_UPDATE_VECTOR_TABLE_OFFSET 0x100
+
+#endif // FW_UPDATE_RECORD__H
@@ -0,0 +1,86 @@
+#if !defined(HAL__H)
+#define HAL__H
+
+// Thin hardware abstraction used by the firmware logic.
+// hal_pico.c implements it on top of the Pico SDK and TinyUSB;
+// everything behind it can be swapped out to run the logic elsewhere.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Time
+
+uint32_t hal_time_us();
+
+void hal_sleep_ms(uint32_t ms);
+
+// Interrupts and events
+
+// Disable interrupts, returns the state for hal_irq_restore
+uint32_t hal_irq_save();
+
+void hal_irq_restore(uint32_t state);
+
+// Complete the memory accesses before it before any after it
+void hal_memory_barrier();
+
+// Wake up hal_wait_for_event, also if it's only about to be called
+void hal_signal_event();
+
+// Sleep until an interrupt or hal_signal_event, or for at most timeout_us
+void hal_wait_for_event(uint32_t timeout_us);
+
+// GPIO
+
+bool hal_gpio_get(uint8_t gpio);
+
+// PIO
+
+bool hal_pio_rx_fifo_empty(uint8_t pio, uint8_t sm);
+
+uint32_t hal_pio_rx_fifo_get(uint8_t pio, uint8_t sm);
+
+// Integer clock divider of a running state machine
+void hal_pio_sm_set_clkdiv(uint8_t pio, uint8_t sm, uint16_t div);
+
+// I2C (display)
+
+void hal_i2c_init(uint8_t sda_gpio, uint8_t scl_gpio, uint32_t baudrate);
+
+// Returns the number of bytes written, or a negative value on error
+int hal_i2c_write(uint8_t address, const uint8_t *data, size_t len);
+
+// USB HID
+
+bool hal_hid_ready();
+
+bool hal_hid_report(uint8_t report_id, const void *report, uint16_t len);
+
+// Signal resume to a suspended host. Returns false if the host hasn't enabled it.
+bool hal_usb_remote_wakeup();
+
+// Flash
+
+#define HAL_FLASH_SECTOR_SIZE 4096
+#define HAL_FLASH_PAGE_SIZE   256
+
+// Flash contents at an offset from the start of flash
+const uint8_t *hal_flash_read_ptr(uint32_t offset);
+
+// Erasing and programming stall XIP. Call with interrupts disabled, and never
+// on the region the firmware runs from. Offsets and lengths are whole sectors
+// for erasing and whole pages for programming.
+void hal_flash_erase(uint32_t offset, uint32_t len);
+
+void hal_flash_program(uint32_t offset, const uint8_t *data, uint32_t len);
+
+// System
+
+uint32_t hal_sys_clock_hz();
+
+__attribute__((noreturn)) void hal_reboot();
+
+__attribute__((noreturn)) void hal_reboot_to_bootloader();
+
+#endif // HAL__H
@@ -0,0 +1,117 @@
+#include "hal.h"
+
+#include "hardware/clocks.h"
+#include "hardware/flash.h"
+#include "hardware/i2c.h"
+#include "hardware/pio.h"
+#include "hardware/sync.h"
+#include "hardware/watchdog.h"
+#include "hot_path.h"
+#include "pico/bootrom.h"
+#include "pico/stdlib.h"
+#include "tusb.h"
+
+#include <assert.h>
+
+#define I2C_INSTANCE i2c0
+
+static_assert(HAL_FLASH_SECTOR_SIZE == FLASH_SECTOR_SIZE, "flash sector size mismatch");
+static_assert(HAL_FLASH_PAGE_SIZE == FLASH_PAGE_SIZE, "flash page size mismatch");
+
+static inline PIO get_pio(uint8_t pio) {
+    return pio == 0 ? pio0 : pio1;
+}
+
+uint32_t HOT_PATH_FUNC(hal_time_us)() {
+    return time_us_32();
+}
+
+void hal_sleep_ms(uint32_t ms) {
+    sleep_ms(ms);
+}
+
+uint32_t HOT_PATH_FUNC(hal_irq_save)() {
+    return save_and_disable_interrupts();
+}
+
+void HOT_PATH_FUNC(hal_irq_restore)(uint32_t state) {
+    restore_interrupts(state);
+}
+
+void HOT_PATH_FUNC(hal_memory_barrier)() {
+    __dmb();
+}
+
+void HOT_PATH_FUNC(hal_signal_event)() {
+    __sev();
+}
+
+void hal_wait_for_event(uint32_t timeout_us) {
+    best_effort_wfe_or_timeout(make_timeout_time_us(timeout_us));
+}
+
+bool hal_gpio_get(uint8_t gpio) {
+    return gpio_get(gpio);
+}
+
+bool HOT_PATH_FUNC(hal_pio_rx_fifo_empty)(uint8_t pio, uint8_t sm) {
+    return pio_sm_is_rx_fifo_empty(get_pio(pio), sm);
+}
+
+uint32_t HOT_PATH_FUNC(hal_pio_rx_fifo_get)(uint8_t pio, uint8_t sm) {
+    return pio_sm_get_blocking(get_pio(pio), sm);
+}
+
+void hal_pio_sm_set_clkdiv(uint8_t pio, uint8_t sm, uint16_t div) {
+    pio_sm_set_clkdiv_int_frac(get_pio(pio), sm, div, 0);
+}
+
+void hal_i2c_init(uint8_t sda_gpio, uint8_t scl_gpio, uint32_t baudrate) {
+    i2c_init(I2C_INSTANCE, baudrate);
+    gpio_set_function(sda_gpio, GPIO_FUNC_I2C);
+    gpio_set_function(scl_gpio, GPIO_FUNC_I2C);
+    gpio_pull_up(sda_gpio);
+    gpio_pull_up(scl_gpio);
+}
+
+int hal_i2c_write(uint8_t address, const uint8_t *data, size_t len) {
+    return i2c_write_blocking(I2C_INSTANCE, address, data, len, false);
+}
+
+bool HOT_PATH_FUNC(hal_hid_ready)() {
+    return tud_hid_ready();
+}
+
+bool HOT_PATH_FUNC(hal_hid_report)(uint8_t report_id, const void *report, uint16_t len) {
+    return tud_hid_n_report(0, report_id, report, len);
+}
+
+bool hal_usb_remote_wakeup() {
+    return tud_remote_wakeup();
+}
+
+const uint8_t *hal_flash_read_ptr(uint32_t offset) {
+    return (const uint8_t *)(XIP_BASE + offset);
+}
+
+void hal_flash_erase(uint32_t offset, uint32_t len) {
+    flash_range_erase(offset, len);
+}
+
+void hal_flash_program(uint32_t offset, const uint8_t *data, uint32_t len) {
+    flash_range_program(offset, data, len);
+}
+
+uint32_t hal_sys_clock_hz() {
+    return clock_get_hz(clk_sys);
+}
+
+void hal_reboot() {
+    watchdog_reboot(0, 0, 0);
+    while (true) {
+    }
+}
+
+void hal_reboot_to_bootloader() {
+    reset_usb_boot(0, 0);
+}
@@ -0,0 +1,24 @@
+#if !defined(HOT_PATH__H)
+#define HOT_PATH__H
+
+// Marks the functions between the input ISRs and the HID reports. Built with
+// the MACROPAD_RAM_HOT_PATH CMake option, they run from SRAM and never wait
+// for an XIP cache miss after e.g. a display update has evicted them.
+
+#if defined(MACROPAD_RAM_HOT_PATH)
+#include "pico.h"
+#define HOT_PATH_FUNC(name) __not_in_flash_func(name)
+#else
+#define HOT_PATH_FUNC(name) name
+#endif
+
+// A log line in a hot path function, e.g. HOT_PATH_LOG(LOGW, "Failed"). printf
+// and the stdio drivers behind it run from flash, so the RAM build leaves
+// these out.
+#if defined(MACROPAD_RAM_HOT_PATH)
+#define HOT_PATH_LOG(log, ...) ((void)0)
+#else
+#define HOT_PATH_LOG(log, ...) log(__VA_ARGS__)
+#endif
+
+#endif // HOT_PATH__H
@@ -0,0 +1,159 @@
+#include "icon_atlas.h"
+
+#include "flash_layout.h"
+#include "flash_ops.h"
+#include "log.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <string.h>
+
+#define ATLAS_MAGIC 0x4e43494d // "MICN"
+
+enum icon_atlas_result_t {
+    ICON_ATLAS_OK,
+    ICON_ATLAS_ERR_BAD_REQUEST,
+    ICON_ATLAS_ERR_BAD_STATE,
+    ICON_ATLAS_ERR_MISSING, // COMMIT before every icon was received
+};
+
+// As stored in flash. Slot 0 is unused, icons are numbered from 1.
+typedef struct {
+    uint32_t magic;
+    uint32_t id;
+    uint8_t count;
+    uint8_t reserved[ICON_ATLAS_ICON_BYTES - 1];
+    uint8_t icons[1 + ICON_ATLAS_MAX_ICONS][ICON_ATLAS_ICON_BYTES];
+} icon_atlas_t;
+
+static_assert(sizeof(icon_atlas_t) <= FLASH_LAYOUT_ICONS_SIZE, "icon atlas too big");
+
+typedef struct __attribute__((packed)) {
+    uint8_t op;
+    union {
+        struct __attribute__((packed)) {
+            uint8_t count;
+            uint32_t id;
+        } begin;
+        struct __attribute__((packed)) {
+            uint8_t first;
+            uint8_t n;
+            uint8_t data[ICON_ATLAS_CHUNK_ICONS * ICON_ATLAS_ICON_BYTES];
+        } icons;
+    };
+} icon_atlas_request_t;
+
+static_assert(sizeof(icon_atlas_request_t) == ICON_ATLAS_REPORT_LEN, "length mismatch");
+
+typedef struct __attribute__((packed)) {
+    uint32_t id;       // Of the stored atlas, 0 without one
+    uint8_t count;     // Icons in the stored atlas
+    uint8_t receiving; // An upload is in progress
+    uint8_t received;  // Icons of the upload received so far
+    uint8_t result;    // Of the last command
+} icon_atlas_status_t;
+
+// The upload is built here and written to flash in one go on COMMIT, so the
+// UI never draws from a half-written atlas
+static uint8_t staging[HAL_FLASH_SECTOR_SIZE] __attribute__((aligned(4)));
+static bool receiving = false;
+static uint8_t received_bits[(1 + ICON_ATLAS_MAX_ICONS + 7) / 8];
+static uint8_t received = 0;
+static uint8_t last_result = ICON_ATLAS_OK;
+static uint32_t generation = 0;
+
+static const icon_atlas_t *stored() {
+    const icon_atlas_t *atlas =
+        (const icon_atlas_t *)flash_ops_read_ptr(FLASH_LAYOUT_ICONS_OFFSET);
+    return atlas->magic == ATLAS_MAGIC ? atlas : NULL;
+}
+
+const uint8_t *icon_atlas_get(uint8_t index) {
+    const icon_atlas_t *atlas = stored();
+    if (!atlas || index == 0 || index > atlas->count) {
+        return NULL;
+    }
+    return atlas->icons[index];
+}
+
+uint32_t icon_atlas_generation() {
+    return generation;
+}
+
+static uint8_t handle_request(const icon_atlas_request_t *req) {
+    icon_atlas_t *atlas = (icon_atlas_t *)staging;
+
+    switch (req->op) {
+    case ICON_ATLAS_OP_BEGIN:
+        memset(staging, 0xff, sizeof(staging));
+        memset(received_bits, 0, sizeof(received_bits));
+        atlas->magic = ATLAS_MAGIC;
+        atlas->id = req->begin.id;
+        atlas->count = req->begin.count;
+        memset(atlas->reserved, 0, sizeof(atlas->reserved));
+        received = 0;
+        receiving = true;
+        return ICON_ATLAS_OK;
+
+    case ICON_ATLAS_OP_ICONS:
+        if (!receiving) {
+            return ICON_ATLAS_ERR_BAD_STATE;
+        }
+        if (req->icons.first == 0 || req->icons.n > ICON_ATLAS_CHUNK_ICONS ||
+            req->icons.first + req->icons.n - 1 > atlas->count) {
+            return ICON_ATLAS_ERR_BAD_REQUEST;
+        }
+        for (uint8_t i = 0; i < req->icons.n; i++) {
+            uint8_t index = req->icons.first + i;
+            memcpy(
+                atlas->icons[index], &req->icons.data[i * ICON_ATLAS_ICON_BYTES],
+                ICON_ATLAS_ICON_BYTES);
+            if (!(received_bits[index / 8] & (1 << (index % 8)))) {
+                received_bits[index / 8] |= 1 << (index % 8);
+                received++;
+            }
+        }
+        return ICON_ATLAS_OK;
+
+    case ICON_ATLAS_OP_COMMIT:
+        if (!receiving) {
+            return ICON_ATLAS_ERR_BAD_STATE;
+        }
+        if (received != atlas->count) {
+            return ICON_ATLAS_ERR_MISSING;
+        }
+        flash_ops_write_sector(FLASH_LAYOUT_ICONS_OFFSET, staging);
+        receiving = false;
+        generation++;
+        LOGI("Stored %u icons, atlas %08lx", atlas->count, atlas->id);
+        return ICON_ATLAS_OK;
+    }
+    return ICON_ATLAS_ERR_BAD_REQUEST;
+}
+
+void icon_atlas_handle_report(const uint8_t *data, uint16_t len) {
+    icon_atlas_request_t req = {0};
+    memcpy(&req, data, len < sizeof(req) ? len : sizeof(req));
+
+    last_result = handle_request(&req);
+    if (last_result != ICON_ATLAS_OK) {
+        LOGW("Icon atlas command %u failed: %u", req.op, last_result);
+    }
+}
+
+uint16_t icon_atlas_get_report(uint8_t *buffer, uint16_t reqlen) {
+    const icon_atlas_t *atlas = stored();
+    icon_atlas_status_t status = {
+        .id = atlas ? atlas->id : 0,
+        .count = atlas ? atlas->count : 0,
+        .receiving = receiving,
+        .received = received,
+        .result = last_result,
+    };
+    uint8_t report[ICON_ATLAS_REPORT_LEN] = {0};
+    memcpy(report, &status, sizeof(status));
+
+    uint16_t len = reqlen < sizeof(report) ? reqlen : sizeof(report);
+    memcpy(buffer, report, len);
+    return len;
+}
@@ -0,0 +1,50 @@
+#if !defined(ICON_ATLAS__H)
+#define ICON_ATLAS__H
+
+// Small 1bpp key icons kept in flash and drawn by the UI straight from XIP,
+// next to the key names. The host uploads the whole atlas once, and profiles
+// pick icons from it by index, so switching profiles never transfers icons.
+// The host names each atlas with an id (a hash of its icons) and skips the
+// upload when the pad already has that one. scripts/icon_atlas.py is the host
+// side.
+//
+// Report payload, one command per report:
+//   BEGIN  count id[4]              start receiving an atlas of icons 1-count
+//   ICONS  first n icons[n * 8]     icons first to first + n - 1
+//   COMMIT                          store the received atlas, stalls for a sector erase
+
+#include <stdint.h>
+
+// XBM: one byte per row, least significant bit leftmost
+#define ICON_ATLAS_ICON_W     8
+#define ICON_ATLAS_ICON_H     8
+#define ICON_ATLAS_ICON_BYTES 8
+
+// Icons are numbered from 1, 0 (PROF_ICON_NONE) is no icon
+#define ICON_ATLAS_MAX_ICONS 255
+
+// Icons in one ICONS command
+#define ICON_ATLAS_CHUNK_ICONS 6
+
+// Payload length of the icon atlas feature report
+#define ICON_ATLAS_REPORT_LEN 51
+
+typedef enum icon_atlas_op_t {
+    ICON_ATLAS_OP_BEGIN = 1,
+    ICON_ATLAS_OP_ICONS,
+    ICON_ATLAS_OP_COMMIT,
+} icon_atlas_op_t;
+
+// The icon in flash, or NULL when the stored atlas doesn't have it
+const uint8_t *icon_atlas_get(uint8_t index);
+
+// Bumped whenever a new atlas is stored
+uint32_t icon_atlas_generation();
+
+// Handle a SET_REPORT of the icon atlas feature report
+void icon_atlas_handle_report(const uint8_t *data, uint16_t len);
+
+// Fill a GET_REPORT of the icon atlas feature report (the status), returns the length
+uint16_t icon_atlas_get_report(uint8_t *buffer, uint16_t reqlen);
+
+#endif // ICON_ATLAS__H
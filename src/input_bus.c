@@ -0,0 +1,97 @@
+#include "input_bus.h"
+
+#include "hal.h"
+#include "hot_path.h"
+
+#include <assert.h>
+#include <stdint.h>
+
+#define QUEUE_MASK (INPUT_BUS_QUEUE_LEN - 1)
+
+static_assert(
+    (INPUT_BUS_QUEUE_LEN & QUEUE_MASK) == 0, "INPUT_BUS_QUEUE_LEN must be a power of two");
+
+// Single-producer ring buffer. The producer only ever writes the
+// slot at head and then publishes it by incrementing head, so
+// consumers never need to write anything shared.
+typedef struct {
+    input_event_t events[INPUT_BUS_QUEUE_LEN];
+    volatile uint32_t head; // Total number of events posted
+} input_queue_t;
+
+static input_queue_t queues[INPUT_SOURCE_COUNT];
+
+void HOT_PATH_FUNC(input_bus_post)(input_source_t source, input_event_t event) {
+    input_queue_t *q = &queues[source];
+    uint32_t head = q->head;
+
+    event.time_us = hal_time_us();
+    q->events[head & QUEUE_MASK] = event;
+
+    // The event must be fully written before it is published
+    hal_memory_barrier();
+    q->head = head + 1;
+}
+
+void input_bus_subscribe(input_consumer_t *consumer) {
+    for (uint8_t s = 0; s < INPUT_SOURCE_COUNT; s++) {
+        consumer->cursors[s] = queues[s].head;
+    }
+    consumer->dropped = 0;
+}
+
+// Copy the next unread event of a source without consuming it.
+// Returns false if the consumer has already read everything.
+static bool HOT_PATH_FUNC(peek_event)(input_consumer_t *consumer, uint8_t source, input_event_t *event) {
+    input_queue_t *q = &queues[source];
+
+    while (true) {
+        uint32_t head = q->head;
+        hal_memory_barrier();
+
+        uint32_t cursor = consumer->cursors[source];
+        if (cursor == head) {
+            return false;
+        }
+
+        if (head - cursor > INPUT_BUS_QUEUE_LEN) {
+            // The producer has lapped us, skip to the oldest event still in the queue
+            consumer->dropped += head - cursor - INPUT_BUS_QUEUE_LEN;
+            consumer->cursors[source] = head - INPUT_BUS_QUEUE_LEN;
+            continue;
+        }
+
+        *event = q->events[cursor & QUEUE_MASK];
+        hal_memory_barrier();
+
+        // If the producer overwrote the slot while we were copying it, the copy
+        // may be torn. Try again: the producer has lapped us by now, so the
+        // branch above counts the event as dropped and skips past it.
+        if (q->head - cursor <= INPUT_BUS_QUEUE_LEN) {
+            return true;
+        }
+    }
+}
+
+bool HOT_PATH_FUNC(input_bus_poll)(input_consumer_t *consumer, input_event_t *event) {
+    int8_t oldest_source = -1;
+
+    // Hand out the events of all the sources in the order they were posted
+    for (uint8_t s = 0; s < INPUT_SOURCE_COUNT; s++) {
+        input_event_t candidate;
+        if (!peek_event(consumer, s, &candidate)) {
+            continue;
+        }
+        if (oldest_source < 0 || (int32_t)(candidate.time_us - event->time_us) < 0) {
+            *event = candidate;
+            oldest_source = s;
+        }
+    }
+
+    if (oldest_source < 0) {
+        return false;
+    }
+
+    consumer->cursors[oldest_source]++;
+    return true;
+}
@@ -0,0 +1,64 @@
+#if !defined(INPUT_BUS__H)
+#define INPUT_BUS__H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Length of each per-source event queue. Must be a power of two.
+#define INPUT_BUS_QUEUE_LEN 64
+
+// Quarter steps of the encoders' quadrature signal from one detent to the next
+#define INPUT_ENCODER_STEPS_PER_DETENT 4
+
+typedef enum input_source_t {
+    INPUT_SOURCE_KEY_MATRIX, // Posted from the key matrix ISR
+    INPUT_SOURCE_ENCODER_0,  // Posted from the encoder 0 ISR
+    INPUT_SOURCE_ENCODER_1,  // Posted from the encoder 1 ISR
+    INPUT_SOURCE_MAIN,       // Posted from the main loop (encoder buttons, USB callbacks)
+
+    // Last
+    INPUT_SOURCE_COUNT,
+} input_source_t;
+
+typedef enum input_event_type_t {
+    INPUT_EVENT_KEYS,    // Debounced key matrix state changed
+    INPUT_EVENT_ENCODER, // Encoder rotated by delta detents, or steps quarter steps
+    INPUT_EVENT_BUTTON,  // Encoder button pressed or released
+    INPUT_EVENT_PROFILE, // Host changed the active profile
+} input_event_type_t;
+
+typedef struct {
+    uint8_t type;  // input_event_type_t
+    uint8_t index; // Encoder index for encoder and button events
+    union {
+        uint16_t keys; // INPUT_EVENT_KEYS: the whole 12-bit key bitmap
+        struct {       // INPUT_EVENT_ENCODER: positive is clockwise
+            int8_t delta; // Detents, 0 for steps between them
+            int8_t steps; // Quarter steps, INPUT_ENCODER_STEPS_PER_DETENT to a detent
+        };
+        bool pressed;  // INPUT_EVENT_BUTTON
+    };
+    uint32_t time_us; // Set by input_bus_post
+} input_event_t;
+
+// Read state of a single consumer. Each consumer owns one of these
+// and reads the queues at its own pace; producers never look at it.
+// A zero-initialized consumer reads everything posted since boot.
+typedef struct {
+    uint32_t cursors[INPUT_SOURCE_COUNT];
+    uint32_t dropped; // Events lost because the consumer fell too far behind
+} input_consumer_t;
+
+// Post an event to the queue of the given source.
+// Each source must only ever be posted to from a single context.
+void input_bus_post(input_source_t source, input_event_t event);
+
+// Start consuming from the current position of every queue,
+// skipping anything posted earlier.
+void input_bus_subscribe(input_consumer_t *consumer);
+
+// Take the oldest unread event for the consumer.
+// Returns false when there's nothing new.
+bool input_bus_poll(input_consumer_t *consumer, input_event_t *event);
+
+#endif // INPUT_BUS__H
@@ -0,0 +1,74 @@
+#include "input_isr.h"
+
+#include "hal.h"
+#include "hot_path.h"
+#include "input_bus.h"
+#include "key_filter.h"
+
+// Latest state from the key matrix PIO, and the filtered state last posted
+static uint16_t key_matrix_raw = 0;
+static uint16_t key_matrix_posted = 0;
+
+// Quarter step count each encoder's program last pushed, and the count at the
+// detent last posted
+static uint32_t encoder_position[2] = {0};
+static uint32_t encoder_detent_position[2] = {0};
+
+static int8_t HOT_PATH_FUNC(clamp_i8)(int32_t value) {
+    return value > INT8_MAX ? INT8_MAX : value < -INT8_MAX ? -INT8_MAX : value;
+}
+
+bool HOT_PATH_FUNC(input_isr_encoder)(uint8_t index) {
+    // Each encoder's program runs on state machine 2 * index and pushes its
+    // count on every quarter step. Only the latest one matters.
+    uint8_t sm = 2 * index;
+    if (hal_pio_rx_fifo_empty(0, sm)) {
+        return false;
+    }
+    uint32_t position;
+    do {
+        position = hal_pio_rx_fifo_get(0, sm);
+    } while (!hal_pio_rx_fifo_empty(0, sm));
+
+    int32_t steps = (int32_t)(position - encoder_position[index]);
+    encoder_position[index] = position;
+    if (steps == 0) {
+        return false;
+    }
+
+    // A detent counts once the encoder is a whole detent away from the last
+    // one counted, so turning back and forth around one doesn't repeat it
+    int32_t detents =
+        (int32_t)(position - encoder_detent_position[index]) / INPUT_ENCODER_STEPS_PER_DETENT;
+    encoder_detent_position[index] += detents * INPUT_ENCODER_STEPS_PER_DETENT;
+
+    input_bus_post(
+        index == 0 ? INPUT_SOURCE_ENCODER_0 : INPUT_SOURCE_ENCODER_1,
+        (input_event_t){
+            .type = INPUT_EVENT_ENCODER,
+            .index = index,
+            .delta = clamp_i8(detents),
+            .steps = clamp_i8(steps)});
+    return true;
+}
+
+static bool HOT_PATH_FUNC(post_keys)(uint16_t keys) {
+    if (keys == key_matrix_posted) {
+        return false;
+    }
+    key_matrix_posted = keys;
+    input_bus_post(
+        INPUT_SOURCE_KEY_MATRIX, (input_event_t){.type = INPUT_EVENT_KEYS, .keys = keys});
+    return true;
+}
+
+bool HOT_PATH_FUNC(input_isr_key_matrix)(uint8_t sm) {
+    if (!hal_pio_rx_fifo_empty(1, sm)) {
+        key_matrix_raw = (uint16_t)hal_pio_rx_fifo_get(1, sm) & 0x0fff;
+    }
+    return post_keys(key_filter_update(key_matrix_raw, hal_time_us()));
+}
+
+bool HOT_PATH_FUNC(input_isr_key_matrix_release_pending)() {
+    return post_keys(key_filter_release_pending(hal_time_us()));
+}
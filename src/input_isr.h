@@ -0,0 +1,26 @@
+#if !defined(INPUT_ISR__H)
+#define INPUT_ISR__H
+
+// The work of the encoder and key matrix interrupt handlers: read the PIO,
+// filter and post to the input bus. main.c sets up the hardware and calls
+// these from the ISRs. They only go through the HAL, so the host tests and
+// test/replay_trace.c run the same input path.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Read the quarter step counts from encoder index's PIO 0 state machine FIFO
+// and post the steps and detents since the last call. Returns true if an event
+// was posted.
+bool input_isr_encoder(uint8_t index);
+
+// Read the key matrix word from the PIO 1 state machine's FIFO, if there is one,
+// and post the filtered key state if it changed. Also to be called with an
+// empty FIFO at key_filter_next_deadline. Returns true if an event was posted.
+bool input_isr_key_matrix(uint8_t sm);
+
+// Post the key changes the filter holds back right away, for when nothing can
+// call input_isr_key_matrix at the deadline. Returns true if an event was posted.
+bool input_isr_key_matrix_release_pending();
+
+#endif // INPUT_ISR__H
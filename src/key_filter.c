@@ -0,0 +1,135 @@
+#include "key_filter.h"
+
+#include "hal.h"
+#include "hot_path.h"
+#include "log.h"
+
+#include <assert.h>
+#include <string.h>
+
+// Extra debounce of each level. A key moves up a level every
+// KEY_FILTER_BOUNCES_TO_RAISE bounces.
+static const uint8_t extra_debounce_ms[] = {0, 5, 10, 20, 40};
+#define LEVEL_MAX (sizeof(extra_debounce_ms) / sizeof(extra_debounce_ms[0]) - 1)
+
+typedef struct {
+    uint32_t last_transition_us;
+    uint32_t last_bounce_us;
+    uint32_t pending_since_us; // When the held-back change was first seen
+    uint8_t recent_bounces;
+    uint8_t level;
+} key_state_t;
+
+static key_state_t keys_state[MACROPAD_KEY_COUNT];
+static uint16_t accepted = 0;
+static uint16_t pending = 0; // Keys with a change held back
+
+typedef struct __attribute__((packed)) {
+    uint16_t bounces[MACROPAD_KEY_COUNT];
+    uint8_t extra_debounce_ms[MACROPAD_KEY_COUNT];
+} key_health_report_t;
+
+static_assert(sizeof(key_health_report_t) == KEY_FILTER_REPORT_LEN, "length mismatch");
+
+static key_health_report_t health;
+
+static void HOT_PATH_FUNC(bounced)(uint8_t key, uint32_t now_us) {
+    key_state_t *k = &keys_state[key];
+    if (health.bounces[key] < UINT16_MAX) {
+        health.bounces[key]++;
+    }
+    if (now_us - k->last_bounce_us > KEY_FILTER_BOUNCE_WINDOW_US) {
+        k->recent_bounces = 0;
+    }
+    k->last_bounce_us = now_us;
+    if (++k->recent_bounces >= KEY_FILTER_BOUNCES_TO_RAISE && k->level < LEVEL_MAX) {
+        k->level++;
+        k->recent_bounces = 0;
+        health.extra_debounce_ms[key] = extra_debounce_ms[k->level];
+    }
+}
+
+static void HOT_PATH_FUNC(accept)(uint8_t key, uint32_t now_us) {
+    key_state_t *k = &keys_state[key];
+    if (now_us - k->last_transition_us < KEY_FILTER_CHATTER_US) {
+        bounced(key, now_us);
+    } else if (k->level > 0 && now_us - k->last_bounce_us > KEY_FILTER_RELAX_US) {
+        // Quiet for long enough, maybe it was a few fast double taps after all
+        k->level--;
+        k->last_bounce_us = now_us;
+        health.extra_debounce_ms[key] = extra_debounce_ms[k->level];
+    }
+    k->last_transition_us = now_us;
+    accepted ^= 1 << key;
+}
+
+uint16_t HOT_PATH_FUNC(key_filter_update)(uint16_t keys, uint32_t now_us) {
+    uint16_t changed = keys ^ accepted;
+    for (uint8_t key = 0; key < MACROPAD_KEY_COUNT; key++) {
+        uint16_t bit = 1 << key;
+        key_state_t *k = &keys_state[key];
+        if (!(changed & bit)) {
+            if (pending & bit) {
+                // Went back before its debounce ran out
+                pending &= ~bit;
+                bounced(key, now_us);
+            }
+        } else if (k->level == 0) {
+            accept(key, now_us);
+        } else if (!(pending & bit)) {
+            pending |= bit;
+            k->pending_since_us = now_us;
+        } else if (now_us - k->pending_since_us >= extra_debounce_ms[k->level] * 1000u) {
+            pending &= ~bit;
+            accept(key, now_us);
+        }
+    }
+    return accepted;
+}
+
+uint16_t HOT_PATH_FUNC(key_filter_release_pending)(uint32_t now_us) {
+    for (uint8_t key = 0; key < MACROPAD_KEY_COUNT; key++) {
+        if (pending & (1 << key)) {
+            accept(key, now_us);
+        }
+    }
+    pending = 0;
+    return accepted;
+}
+
+bool HOT_PATH_FUNC(key_filter_next_deadline)(uint32_t *deadline_us) {
+    bool found = false;
+    for (uint8_t key = 0; key < MACROPAD_KEY_COUNT; key++) {
+        if (!(pending & (1 << key))) {
+            continue;
+        }
+        const key_state_t *k = &keys_state[key];
+        uint32_t due = k->pending_since_us + extra_debounce_ms[k->level] * 1000u;
+        if (!found || (int32_t)(due - *deadline_us) < 0) {
+            *deadline_us = due;
+            found = true;
+        }
+    }
+    return found;
+}
+
+void key_filter_handle_report(
+    __attribute__((unused)) const uint8_t *data, __attribute__((unused)) uint16_t len) {
+    LOGI("Resetting the key bounce counts");
+    // The key matrix ISR uses the same state
+    uint32_t irq_state = hal_irq_save();
+    memset(&health, 0, sizeof(health));
+    for (uint8_t key = 0; key < MACROPAD_KEY_COUNT; key++) {
+        keys_state[key].recent_bounces = 0;
+        keys_state[key].level = 0;
+    }
+    // Held-back changes go through on the next update
+    pending = 0;
+    hal_irq_restore(irq_state);
+}
+
+uint16_t key_filter_get_report(uint8_t *buffer, uint16_t reqlen) {
+    uint16_t len = reqlen < sizeof(health) ? reqlen : sizeof(health);
+    memcpy(buffer, &health, len);
+    return len;
+}
@@ -0,0 +1,48 @@
+#if !defined(KEY_FILTER__H)
+#define KEY_FILTER__H
+
+// Per-key chatter detection on top of the key matrix PIO debounce. A
+// transition that reverses the key's previous one within KEY_FILTER_CHATTER_US
+// counts as a bounce. Keys that keep bouncing get a longer debounce of their
+// own: their changes must then also stay stable for the key's extra time.
+// Healthy keys keep the fast PIO debounce only.
+//
+// Run from the key matrix ISR only, apart from the feature report.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "constants.h"
+
+// A reversal this soon after a key's last transition is a bounce
+#define KEY_FILTER_CHATTER_US 20000
+// Bounces within this time of each other that raise the key's debounce
+#define KEY_FILTER_BOUNCES_TO_RAISE 3
+#define KEY_FILTER_BOUNCE_WINDOW_US (60 * 1000000)
+// A key with no bounces for this long steps its debounce back down
+#define KEY_FILTER_RELAX_US (10 * 60 * 1000000)
+
+// Payload length of the key health feature report
+#define KEY_FILTER_REPORT_LEN (3 * MACROPAD_KEY_COUNT)
+
+// Feed the PIO-debounced key matrix state, returns the state to report.
+// Call again at the time key_filter_next_deadline gives even if the matrix
+// didn't change, to let the held-back changes through.
+uint16_t key_filter_update(uint16_t keys, uint32_t now_us);
+
+// When held-back changes are due, returns false if there are none
+bool key_filter_next_deadline(uint32_t *deadline_us);
+
+// Let the held-back changes through right away, returns the state to report.
+// For when nothing can call key_filter_update at the deadline.
+uint16_t key_filter_release_pending(uint32_t now_us);
+
+// Handle a SET_REPORT of the key health feature report: any payload resets the
+// counts and the debounce times
+void key_filter_handle_report(const uint8_t *data, uint16_t len);
+
+// Fill a GET_REPORT of the key health feature report: bounces per key
+// (uint16_t each), then the extra debounce per key in milliseconds
+uint16_t key_filter_get_report(uint8_t *buffer, uint16_t reqlen);
+
+#endif // KEY_FILTER__H
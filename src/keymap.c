@@ -0,0 +1,195 @@
+#include "keymap.h"
+
+#include "hot_path.h"
+#include "log.h"
+
+#include <assert.h>
+#include <string.h>
+
+static_assert(sizeof(keymap_config_t) == KEYMAP_CONFIG_REPORT_LEN, "keymap config length mismatch");
+
+typedef enum {
+    KEY_STATE_IDLE,
+    KEY_STATE_DOWN,    // Normal or layer key held
+    KEY_STATE_PENDING, // Tap-hold key held, not decided yet
+    KEY_STATE_HOLD,    // Tap-hold key decided as a hold
+} key_state_t;
+
+typedef struct {
+    uint8_t state;
+    uint32_t press_time_us;
+} key_slot_t;
+
+static keymap_config_t config = {.tapping_term_ms = 200};
+
+static key_slot_t keys[MACROPAD_KEY_COUNT];
+static uint16_t raw_keys = 0;
+static bool button_down[2];
+
+static uint16_t held_keys = 0;     // Normal keys held
+static uint16_t tap_keys = 0;      // Taps to report once
+static uint16_t reported_keys = 0; // Both of the above, as of the last update
+static uint8_t reported_layer = 0;
+
+static uint8_t HOT_PATH_FUNC(active_layer)() {
+    uint8_t l = 0;
+    for (uint8_t i = 0; i < MACROPAD_KEY_COUNT; i++) {
+        bool held_layer = keys[i].state == KEY_STATE_HOLD ||
+                          (keys[i].state == KEY_STATE_DOWN && config.kind[i] == KEYMAP_KEY_LAYER);
+        if (held_layer && config.layer[i] > l) {
+            l = config.layer[i];
+        }
+    }
+    for (uint8_t i = 0; i < 2; i++) {
+        if (button_down[i] && config.button_layer[i] > l) {
+            l = config.button_layer[i];
+        }
+    }
+    return l;
+}
+
+// Recompute the reported state, returns true if it changed
+static bool HOT_PATH_FUNC(update_output)() {
+    uint16_t prev_keys = reported_keys;
+    uint8_t prev_layer = reported_layer;
+
+    held_keys = 0;
+    for (uint8_t i = 0; i < MACROPAD_KEY_COUNT; i++) {
+        if (keys[i].state == KEY_STATE_DOWN && config.kind[i] != KEYMAP_KEY_LAYER) {
+            held_keys |= 1 << i;
+        }
+    }
+    reported_keys = held_keys | tap_keys;
+
+    if (reported_keys == 0 || prev_keys == 0) {
+        reported_layer = active_layer();
+    }
+
+    return reported_keys != prev_keys || reported_layer != prev_layer;
+}
+
+// A pending tap-hold key becomes a hold once another key goes down, so that
+// key lands on the new layer
+static void HOT_PATH_FUNC(resolve_pending_as_hold)() {
+    for (uint8_t i = 0; i < MACROPAD_KEY_COUNT; i++) {
+        if (keys[i].state == KEY_STATE_PENDING) {
+            keys[i].state = KEY_STATE_HOLD;
+        }
+    }
+}
+
+void keymap_set_config(const keymap_config_t *new_config) {
+    config = *new_config;
+    for (uint8_t i = 0; i < MACROPAD_KEY_COUNT; i++) {
+        if (config.kind[i] > KEYMAP_KEY_TAP_HOLD || config.layer[i] >= KEYMAP_MAX_LAYERS) {
+            LOGW("Invalid keymap config for key %u", i);
+            config.kind[i] = KEYMAP_KEY_NORMAL;
+        }
+    }
+    for (uint8_t i = 0; i < 2; i++) {
+        if (config.button_layer[i] >= KEYMAP_MAX_LAYERS) {
+            config.button_layer[i] = 0;
+        }
+    }
+
+    // Start over. Tap-hold keys that are still held are reported as normal keys.
+    memset(keys, 0, sizeof(keys));
+    for (uint8_t i = 0; i < MACROPAD_KEY_COUNT; i++) {
+        if (raw_keys & (1 << i)) {
+            keys[i].state = KEY_STATE_DOWN;
+        }
+    }
+    update_output();
+}
+
+const keymap_config_t *keymap_get_config() {
+    return &config;
+}
+
+bool HOT_PATH_FUNC(keymap_process_keys)(uint16_t new_keys, uint32_t time_us) {
+    uint16_t pressed = new_keys & ~raw_keys;
+    uint16_t released = raw_keys & ~new_keys;
+    raw_keys = new_keys;
+
+    for (uint8_t i = 0; i < MACROPAD_KEY_COUNT; i++) {
+        if (!(released & (1 << i))) {
+            continue;
+        }
+        if (keys[i].state == KEY_STATE_PENDING) {
+            // Released within the tapping term
+            tap_keys |= 1 << i;
+        }
+        keys[i].state = KEY_STATE_IDLE;
+    }
+
+    if (pressed) {
+        // Presses of tap-hold keys count too, that makes rolling over two
+        // tap-hold keys select the first one's layer
+        resolve_pending_as_hold();
+    }
+
+    for (uint8_t i = 0; i < MACROPAD_KEY_COUNT; i++) {
+        if (!(pressed & (1 << i))) {
+            continue;
+        }
+        keys[i].press_time_us = time_us;
+        keys[i].state =
+            config.kind[i] == KEYMAP_KEY_TAP_HOLD ? KEY_STATE_PENDING : KEY_STATE_DOWN;
+    }
+
+    return update_output();
+}
+
+bool HOT_PATH_FUNC(keymap_process_button)(uint8_t index, bool pressed, bool *consumed) {
+    *consumed = index < 2 && config.button_layer[index] != 0;
+    if (!*consumed) {
+        return false;
+    }
+
+    button_down[index] = pressed;
+    return update_output();
+}
+
+bool HOT_PATH_FUNC(keymap_tick)(uint32_t now_us) {
+    bool resolved = false;
+    for (uint8_t i = 0; i < MACROPAD_KEY_COUNT; i++) {
+        if (keys[i].state == KEY_STATE_PENDING &&
+            now_us - keys[i].press_time_us >= (uint32_t)config.tapping_term_ms * 1000) {
+            keys[i].state = KEY_STATE_HOLD;
+            resolved = true;
+        }
+    }
+    return resolved && update_output();
+}
+
+bool HOT_PATH_FUNC(keymap_next_deadline)(uint32_t *time_us) {
+    bool pending = false;
+    for (uint8_t i = 0; i < MACROPAD_KEY_COUNT; i++) {
+        if (keys[i].state != KEY_STATE_PENDING) {
+            continue;
+        }
+        uint32_t end = keys[i].press_time_us + (uint32_t)config.tapping_term_ms * 1000;
+        if (!pending || (int32_t)(end - *time_us) < 0) {
+            *time_us = end;
+            pending = true;
+        }
+    }
+    return pending;
+}
+
+bool HOT_PATH_FUNC(keymap_report_sent)() {
+    if (!tap_keys) {
+        return false;
+    }
+    tap_keys = 0;
+    update_output();
+    return true;
+}
+
+uint16_t HOT_PATH_FUNC(keymap_get_keys)() {
+    return reported_keys;
+}
+
+uint8_t HOT_PATH_FUNC(keymap_get_layer)() {
+    return reported_layer;
+}
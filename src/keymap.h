@@ -0,0 +1,62 @@
+#if !defined(KEYMAP__H)
+#define KEYMAP__H
+
+// Layers and tap-hold keys, evaluated on the debounced key matrix state
+// before it's reported to the host. The keypad report carries the active
+// layer next to the key bits; the host maps (layer, key) to an action.
+
+#include "constants.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define KEYMAP_MAX_LAYERS 16
+
+// Payload length of the layer config feature report
+#define KEYMAP_CONFIG_REPORT_LEN 28
+
+typedef enum {
+    KEYMAP_KEY_NORMAL,    // Reported as is
+    KEYMAP_KEY_LAYER,     // Activates its layer while held, never reported
+    KEYMAP_KEY_TAP_HOLD,  // Reported when tapped, activates its layer when held
+} keymap_key_kind_t;
+
+typedef struct __attribute__((packed)) {
+    // Indexed by the key's bit in the key matrix word
+    uint8_t kind[MACROPAD_KEY_COUNT];
+    uint8_t layer[MACROPAD_KEY_COUNT];
+    // Layer activated by holding the encoder button, 0 to use the button normally
+    uint8_t button_layer[2];
+    // A tap-hold key held longer than this is a hold
+    uint16_t tapping_term_ms;
+} keymap_config_t;
+
+void keymap_set_config(const keymap_config_t *config);
+
+const keymap_config_t *keymap_get_config();
+
+// The following return true if the reported key state or layer changed
+
+bool keymap_process_keys(uint16_t keys, uint32_t time_us);
+
+// Sets *consumed if the button is used as a layer key
+bool keymap_process_button(uint8_t index, bool pressed, bool *consumed);
+
+// Resolves tap-hold keys held past the tapping term
+bool keymap_tick(uint32_t now_us);
+
+// Sets *time_us to the end of the earliest tapping term still running,
+// returns false if no tap-hold key is pending
+bool keymap_next_deadline(uint32_t *time_us);
+
+// Called after a report with the current state was sent. Taps are
+// reported as a press in one report and a release in the next one.
+bool keymap_report_sent();
+
+uint16_t keymap_get_keys();
+
+// The layer for the keypad report. It only changes while no keys are
+// reported down, so every key is released on the layer it was pressed on.
+uint8_t keymap_get_layer();
+
+#endif // KEYMAP__H
@@ -1,7 +1,7 @@
 #if !defined(LOG__H)
 #define LOG__H
 
-#include "hardware/clocks.h"
+#include "hal.h"
 #include <stdio.h>
 
 #define RESET  "\033[0m"
@@ -12,7 +12,7 @@
 #define GRAY   "\033[90m"
 
 #define __LOG(level, format, ...)                                                                  \
-    printf(level " [%lu] " format "\n", time_us_32() / 1000, ##__VA_ARGS__)
+    printf(level " [%lu] " format "\n", hal_time_us() / 1000, ##__VA_ARGS__)
 
 #define LOGE(format, ...) __LOG(RED BOLD "ERR", format RESET, ##__VA_ARGS__)
 #define LOGW(format, ...) __LOG(YELLOW "WRN", format RESET, ##__VA_ARGS__)
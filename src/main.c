@@ -1,14 +1,27 @@
 #include "usb_hid.h"
 
+#include "boot_times.h"
 #include "display_ui.h"
 #include "encoder.pio.h"
+#include "fw_update.h"
+#include "hal.h"
 #include "hardware/clocks.h"
 #include "hardware/irq.h"
 #include "hardware/pio.h"
+#include "hot_path.h"
+#include "input_bus.h"
+#include "input_isr.h"
+#include "key_filter.h"
 #include "key_matrix.pio.h"
 #include "log.h"
+#include "msc_disk.h"
+#include "perf.h"
 #include "pico/stdlib.h"
+#include "profiles.h"
+#include "scheduler.h"
+#include "time_sync.h"
 #include "tusb.h"
+#include "usb_midi.h"
 #include "utils.h"
 #include <stdbool.h>
 #include <stdint.h>
@@ -28,51 +41,43 @@
 static uint encoder0_sm = 0;
 static uint encoder1_sm = 0;
 static uint key_matrix_sm = 0;
+static uint16_t key_matrix_clk_div = 0;
 
-static volatile uint8_t encoder0_rotation = 0;
-static volatile uint8_t encoder1_rotation = 0;
+static alarm_id_t key_filter_alarm = 0;
+static uint32_t key_filter_alarm_due_us;
 
-static void encoder0_isr() {
-    int8_t change = 0;
-    if (pio_interrupt_get(pio0, 0)) {
-        // CCW
-        change--;
-    }
-    if (pio_interrupt_get(pio0, 1)) {
-        // CW
-        change++;
-    }
-
-    encoder0_rotation += change;
+// Key matrix scanning is slowed down by this much while the USB bus is suspended
+#define SUSPEND_SCAN_SLOWDOWN 4
+static volatile bool usb_suspended = false;
 
-    // Reset interrupt flags
-    pio_interrupt_clear(pio0, 0);
-    pio_interrupt_clear(pio0, 1);
+// While the bus is suspended, input is there to wake the host up. Have the HID
+// task request the wakeup right away instead of on its next tick.
+static void HOT_PATH_FUNC(input_posted)() {
+    if (usb_suspended) {
+        sched_wake(SCHED_TASK_HID);
+    }
+}
 
-    uint8_t rot = encoder0_rotation;
-    ui_set_input_states(NULL, &rot, NULL, NULL, NULL);
+// Detents go out in the next report the host polls, together with any that
+// come in before it, instead of waiting for the HID task's next tick
+static void HOT_PATH_FUNC(encoder_posted)() {
+    sched_wake(SCHED_TASK_HID);
 }
 
-static void encoder1_isr() {
-    int8_t change = 0;
-    if (pio_interrupt_get(pio0, 2)) {
-        // CW
-        change--;
-    }
-    if (pio_interrupt_get(pio0, 3)) {
-        // CCW
-        change++;
+static void HOT_PATH_FUNC(encoder0_isr)() {
+    PERF_BEGIN(PERF_SLOT_ISR_ENCODER_0);
+    if (input_isr_encoder(0)) {
+        encoder_posted();
     }
+    PERF_END(PERF_SLOT_ISR_ENCODER_0);
+}
 
-    encoder1_rotation += change;
-
-    // Reset interrupt flags
-    pio_interrupt_clear(pio0, 2);
-    pio_interrupt_clear(pio0, 3);
-
-    uint8_t rot = encoder1_rotation;
-    ui_set_input_states(NULL, NULL, NULL, &rot, NULL);
-    usb_hid_set_encoder_rotation(rot);
+static void HOT_PATH_FUNC(encoder1_isr)() {
+    PERF_BEGIN(PERF_SLOT_ISR_ENCODER_1);
+    if (input_isr_encoder(1)) {
+        encoder_posted();
+    }
+    PERF_END(PERF_SLOT_ISR_ENCODER_1);
 }
 
 static inline void setup_encoders() {
@@ -81,11 +86,11 @@ static inline void setup_encoders() {
 
     pio_claim_sm_mask(pio0, 5); // Claims SMs 0 and 2 (0b101)
 
+    // At offset 0 (.origin), one copy for both state machines
     uint offset = pio_add_program(pio0, &encoder_program);
     encoder_pio_init(pio0, 0, encoder0_sm, offset, ENCODER_0_A_GPIO);
     irq_set_exclusive_handler(PIO0_IRQ_0, encoder0_isr);
 
-    offset = pio_add_program(pio0, &encoder_program);
     encoder_pio_init(pio0, 1, encoder1_sm, offset, ENCODER_1_A_GPIO);
     irq_set_exclusive_handler(PIO0_IRQ_1, encoder1_isr);
 
@@ -96,12 +101,43 @@ static inline void setup_encoders() {
     gpio_pull_up(ENCODER_1_BUTTON_GPIO);
 }
 
-static void key_matrix_isr() {
-    if (!pio_sm_is_rx_fifo_empty(pio1, key_matrix_sm)) {
-        uint16_t data = (uint16_t)pio_sm_get_blocking(pio1, key_matrix_sm);
-        usb_hid_set_keys(data);
-        ui_set_input_states(&data, NULL, NULL, NULL, NULL);
+static int64_t key_filter_alarm_cb(
+    __attribute__((unused)) alarm_id_t id, __attribute__((unused)) void *user_data) {
+    key_filter_alarm = 0;
+    // Let the key matrix ISR release the held-back key changes, so that it
+    // stays the only producer of its input bus queue
+    irq_set_pending(PIO1_IRQ_0);
+    return 0;
+}
+
+static void HOT_PATH_FUNC(key_matrix_isr)() {
+    PERF_BEGIN(PERF_SLOT_ISR_KEY_MATRIX);
+    // Also run by key_filter_alarm_cb, with nothing in the FIFO
+    if (input_isr_key_matrix(key_matrix_sm)) {
+        input_posted();
+    }
+
+    uint32_t due;
+    if (key_filter_next_deadline(&due) &&
+        (!key_filter_alarm || (int32_t)(due - key_filter_alarm_due_us) < 0)) {
+        if (key_filter_alarm) {
+            cancel_alarm(key_filter_alarm);
+        }
+        int32_t delay = due - hal_time_us();
+        key_filter_alarm =
+            add_alarm_in_us(delay > 0 ? delay : 0, key_filter_alarm_cb, NULL, true);
+        key_filter_alarm_due_us = due;
+        if (key_filter_alarm < 0) {
+            // Out of alarms. Nothing would run the filter at the deadline, so
+            // a held-back release could stay unreported until the next key
+            // change. Rather skip the extra debounce this once.
+            key_filter_alarm = 0;
+            if (input_isr_key_matrix_release_pending()) {
+                input_posted();
+            }
+        }
     }
+    PERF_END(PERF_SLOT_ISR_KEY_MATRIX);
 }
 
 static inline void setup_key_matrix() {
@@ -116,6 +152,7 @@ static inline void setup_key_matrix() {
         (target_debounce_time_ms * (sys_freq / 1000)) /* instructions during the target time */
         / total_debounce_instructions;
     uint16_t clk_div = target_clk_div > UINT16_MAX ? UINT16_MAX : target_clk_div;
+    key_matrix_clk_div = clk_div;
 
     float effective_freq = (float)sys_freq / clk_div;
 
@@ -140,21 +177,21 @@ static inline void setup_key_matrix() {
 typedef struct {
     bool stable_state;
     bool debouncing;
-    absolute_time_t debounce_end;
+    uint32_t debounce_end_us;
 } debounce_state_t;
 
 // Returns true if the button state was changed
 static bool check_button_debounced(uint8_t gpio, debounce_state_t *state) {
-    bool s = !gpio_get(gpio);
+    bool s = !hal_gpio_get(gpio);
     if (s != state->stable_state) {
         if (state->debouncing) {
-            if (time_passed(state->debounce_end)) {
+            if (time_passed(state->debounce_end_us)) {
                 state->debouncing = false;
                 state->stable_state = s;
                 return true;
             }
         } else {
-            state->debounce_end = make_timeout_time_ms(5);
+            state->debounce_end_us = hal_time_us() + 5000;
             state->debouncing = true;
         }
     } else {
@@ -171,30 +208,137 @@ static void check_encoder_buttons() {
     static debounce_state_t encoder1_debounce_state = {0};
 
     if (check_button_debounced(ENCODER_0_BUTTON_GPIO, &encoder0_debounce_state)) {
-        ui_set_input_states(NULL, NULL, &encoder0_debounce_state.stable_state, NULL, NULL);
+        input_bus_post(
+            INPUT_SOURCE_MAIN,
+            (input_event_t){
+                .type = INPUT_EVENT_BUTTON,
+                .index = 0,
+                .pressed = encoder0_debounce_state.stable_state});
+        input_posted();
     }
     if (check_button_debounced(ENCODER_1_BUTTON_GPIO, &encoder1_debounce_state)) {
-        ui_set_input_states(NULL, NULL, NULL, NULL, &encoder1_debounce_state.stable_state);
-        usb_hid_set_encoder_button(encoder1_debounce_state.stable_state);
+        input_bus_post(
+            INPUT_SOURCE_MAIN,
+            (input_event_t){
+                .type = INPUT_EVENT_BUTTON,
+                .index = 1,
+                .pressed = encoder1_debounce_state.stable_state});
+        input_posted();
     }
 }
 
+// TinyUSB callbacks, run from tud_task
+
+void tud_mount_cb() {
+    boot_times_mark(BOOT_MILESTONE_USB_MOUNTED);
+}
+
+uint16_t tud_hid_get_report_cb(
+    __attribute__((unused)) uint8_t itf, uint8_t report_id,
+    __attribute__((unused)) hid_report_type_t report_type, uint8_t *buffer, uint16_t reqlen) {
+    return usb_hid_get_report(report_id, buffer, reqlen);
+}
+
+void tud_hid_set_report_cb(
+    __attribute__((unused)) uint8_t itf, uint8_t report_id,
+    __attribute__((unused)) hid_report_type_t report_type, uint8_t const *buffer,
+    uint16_t bufsize) {
+    usb_hid_set_report(report_id, buffer, bufsize);
+}
+
+void tud_hid_report_complete_cb(
+    __attribute__((unused)) uint8_t interface, __attribute__((unused)) uint8_t const *report,
+    __attribute__((unused)) uint8_t len) {
+    usb_hid_report_complete();
+}
+
+void tud_suspend_cb(bool remote_wakeup_en) {
+    LOGI("USB suspended (remote wakeup %s)", remote_wakeup_en ? "enabled" : "disabled");
+    // Scan slower to save power, the debounce time grows by the same factor
+    uint32_t div = (uint32_t)key_matrix_clk_div * SUSPEND_SCAN_SLOWDOWN;
+    hal_pio_sm_set_clkdiv(1, key_matrix_sm, div > UINT16_MAX ? UINT16_MAX : div);
+    usb_suspended = true;
+
+    usb_hid_suspend(remote_wakeup_en);
+    ui_set_suspended(true);
+}
+
+void tud_resume_cb() {
+    LOGI("USB resumed");
+    hal_pio_sm_set_clkdiv(1, key_matrix_sm, key_matrix_clk_div);
+    usb_suspended = false;
+
+    usb_hid_resume();
+    ui_set_suspended(false);
+}
+
+#if defined(MACROPAD_TIME_SYNC) || defined(MACROPAD_MIDI)
+void tud_sof_cb(__attribute__((unused)) uint32_t frame_count) {
+#if defined(MACROPAD_TIME_SYNC)
+    time_sync_sof(frame_count, hal_time_us());
+#endif
+#if defined(MACROPAD_MIDI)
+    // Send what came in during the past frame
+    sched_wake(SCHED_TASK_MIDI);
+#endif
+}
+#endif
+
+#if defined(MACROPAD_PERF)
+static void usb_task() {
+    PERF_BEGIN(PERF_SLOT_TUD_TASK);
+    tud_task();
+    PERF_END(PERF_SLOT_TUD_TASK);
+}
+
+static void hid_task_measured() {
+    PERF_BEGIN(PERF_SLOT_HID_TASK);
+    hid_task();
+    PERF_END(PERF_SLOT_HID_TASK);
+}
+
+static void ui_task_measured() {
+    PERF_BEGIN(PERF_SLOT_UI_TASK);
+    ui_task();
+    PERF_END(PERF_SLOT_UI_TASK);
+}
+#else
+#define usb_task          tud_task
+#define hid_task_measured hid_task
+#define ui_task_measured  ui_task
+#endif
+
 int main() {
+    boot_times_mark(BOOT_MILESTONE_MAIN);
 
     stdio_init_all();
+    perf_init();
+    prof_store_load();
+#if defined(MACROPAD_MSC)
+    msc_disk_init();
+#endif
     tusb_init();
+#if defined(MACROPAD_TIME_SYNC) || defined(MACROPAD_MIDI)
+    tud_sof_cb_enable(true);
+#endif
+#if defined(MACROPAD_MIDI)
+    usb_midi_init();
+#endif
 
     setup_encoders();
     setup_key_matrix();
 
     ui_init();
 
-    while (true) {
-        check_encoder_buttons();
-        tud_task();
-        hid_task();
-        ui_task();
-    }
+    sched_add_task(SCHED_TASK_BUTTONS, "buttons", check_encoder_buttons, 1000);
+    sched_add_task(SCHED_TASK_USB, "usb", usb_task, SCHED_EVERY_PASS);
+    sched_add_task(SCHED_TASK_HID, "hid", hid_task_measured, USB_HID_REPORT_INTERVAL_US);
+    sched_add_task(SCHED_TASK_UI, "ui", ui_task_measured, UI_FRAME_INTERVAL_US);
+    sched_add_task(SCHED_TASK_FW_UPDATE, "fw_update", fw_update_task, SCHED_ON_DEMAND);
+#if defined(MACROPAD_MIDI)
+    sched_add_task(SCHED_TASK_MIDI, "midi", usb_midi_task, SCHED_ON_DEMAND);
+#endif
+    sched_run();
 
     return 1;
 }
\ No newline at end of file
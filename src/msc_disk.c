@@ -0,0 +1,515 @@
+#if defined(MACROPAD_MSC)
+
+#include "msc_disk.h"
+
+#include "hal.h"
+#include "icon_atlas.h"
+#include "log.h"
+#include "profiles.h"
+#include "tusb.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+// Volume layout: boot sector, one FAT, the root directory, then one sector per cluster
+#define ROOT_ENTRIES  64
+#define FAT_LBA       1
+#define ROOT_LBA      2
+#define ROOT_SECTORS  (ROOT_ENTRIES * sizeof(dir_entry_t) / MSC_DISK_SECTOR_SIZE)
+#define DATA_LBA      (ROOT_LBA + ROOT_SECTORS)
+#define CLUSTERS      (MSC_DISK_SECTORS - DATA_LBA)
+#define FIRST_CLUSTER 2
+#define END_OF_CHAIN  0xfff
+
+#define ATTR_READ_ONLY 0x01
+#define ATTR_VOLUME_ID 0x08
+#define ATTR_DIRECTORY 0x10
+#define ATTR_LFN       0x0f // Long file name part
+#define DELETED_ENTRY  0xe5
+
+// 2024-01-01 00:00
+#define FILE_DATE ((2024 - 1980) << 9 | 1 << 5 | 1)
+
+// Longest profile file read back
+#define MAX_FILE_LEN 1024
+
+typedef struct __attribute__((packed)) {
+    uint8_t jump[3];
+    char oem[8];
+    uint16_t bytes_per_sector;
+    uint8_t sectors_per_cluster;
+    uint16_t reserved_sectors;
+    uint8_t fats;
+    uint16_t root_entries;
+    uint16_t total_sectors;
+    uint8_t media;
+    uint16_t sectors_per_fat;
+    uint16_t sectors_per_track;
+    uint16_t heads;
+    uint32_t hidden_sectors;
+    uint32_t total_sectors_32;
+    uint8_t drive;
+    uint8_t reserved;
+    uint8_t boot_signature;
+    uint32_t volume_id;
+    char label[11];
+    char fs_type[8];
+} boot_sector_t;
+
+typedef struct __attribute__((packed)) {
+    char name[11]; // 8.3, space padded
+    uint8_t attr;
+    uint8_t reserved[10]; // Creation and access times, FAT32 cluster high bits
+    uint16_t time;
+    uint16_t date;
+    uint16_t cluster;
+    uint32_t size;
+} dir_entry_t;
+
+static_assert(sizeof(dir_entry_t) == 32, "directory entry size");
+static_assert(CLUSTERS * 3 / 2 + 3 <= MSC_DISK_SECTOR_SIZE, "the FAT must fit one sector");
+
+static const char *const encoder_mode_names[PROF_ENCODER_MODE_COUNT] = {
+    "none", "dial", "volume", "wheel", "pan",
+};
+
+static const char readme[] =
+    "Macropad profiles. Each PROF_n.TXT is one profile, up to 8 of them:\r\n"
+    "\r\n"
+    "name=Firefox\r\n"
+    "encoders=wheel,volume\r\n"
+    "keys=Back,Fwd,Tab,Home,...\r\n"
+    "midi_channel=1\r\n"
+    "midi_notes=36,37,38,39,...\r\n"
+    "midi_encoders=-,16\r\n"
+    "midi_buttons=-,48\r\n"
+    "icons=1,2,-,...\r\n"
+    "\r\n"
+    "Encoder modes are none, dial, volume, wheel and pan. The 12 key names go\r\n"
+    "left to right, top to bottom, and are up to 4 characters each.\r\n"
+    "The midi lines are optional: the MIDI channel (1-16), the note of each\r\n"
+    "key, the controller of each encoder and the note of each encoder button.\r\n"
+    "A - sends nothing. The optional icons are the icon atlas numbers of the\r\n"
+    "keys, - for none.\r\n"
+    "Edit, add or delete the files, then eject the drive to store them.\r\n";
+
+static uint8_t disk[MSC_DISK_SECTORS][MSC_DISK_SECTOR_SIZE];
+static uint16_t next_cluster;
+static uint8_t next_entry;
+
+static bool dirty = false; // Written since the volume was built
+static bool ejected = false;
+static uint32_t ejected_at_us;
+
+static char file_buf[MAX_FILE_LEN];
+static profile_t parsed[PROF_CACHE_SIZE];
+
+static uint16_t fat_get(uint16_t cluster) {
+    const uint8_t *p = &disk[FAT_LBA][cluster * 3 / 2];
+    uint16_t v = p[0] | p[1] << 8;
+    return cluster & 1 ? v >> 4 : v & 0xfff;
+}
+
+static void fat_set(uint16_t cluster, uint16_t value) {
+    uint8_t *p = &disk[FAT_LBA][cluster * 3 / 2];
+    if (cluster & 1) {
+        p[0] = (p[0] & 0x0f) | (value << 4);
+        p[1] = value >> 4;
+    } else {
+        p[0] = value;
+        p[1] = (p[1] & 0xf0) | ((value >> 8) & 0x0f);
+    }
+}
+
+static dir_entry_t *root_dir() {
+    return (dir_entry_t *)disk[ROOT_LBA];
+}
+
+static void add_file(const char *name, uint8_t attr, const char *data, uint32_t len) {
+    uint16_t clusters = (len + MSC_DISK_SECTOR_SIZE - 1) / MSC_DISK_SECTOR_SIZE;
+    if (next_entry == ROOT_ENTRIES || next_cluster + clusters > FIRST_CLUSTER + CLUSTERS) {
+        LOGW("No room for %.11s on the drive", name);
+        return;
+    }
+    dir_entry_t *e = &root_dir()[next_entry++];
+    memcpy(e->name, name, sizeof(e->name));
+    e->attr = attr;
+    e->date = FILE_DATE;
+    if (attr & ATTR_VOLUME_ID) {
+        return;
+    }
+    e->size = len;
+    e->cluster = len > 0 ? next_cluster : 0;
+
+    for (uint16_t i = 0; i < clusters; i++) {
+        uint32_t chunk = len - i * MSC_DISK_SECTOR_SIZE;
+        chunk = chunk < MSC_DISK_SECTOR_SIZE ? chunk : MSC_DISK_SECTOR_SIZE;
+        uint8_t *sector = disk[DATA_LBA + next_cluster - FIRST_CLUSTER];
+        memcpy(sector, data + i * MSC_DISK_SECTOR_SIZE, chunk);
+        fat_set(next_cluster, i + 1 < clusters ? next_cluster + 1 : END_OF_CHAIN);
+        next_cluster++;
+    }
+}
+
+// Append a "key=value,value,...\r\n" line of numbers, with - for none
+static int format_values(
+    int len, const char *key, const uint8_t *values, uint8_t count, uint8_t none) {
+    len += snprintf(file_buf + len, sizeof(file_buf) - len, "%s=", key);
+    for (uint8_t i = 0; i < count; i++) {
+        const char *sep = i > 0 ? "," : "";
+        if (values[i] == none) {
+            len += snprintf(file_buf + len, sizeof(file_buf) - len, "%s-", sep);
+        } else {
+            len += snprintf(file_buf + len, sizeof(file_buf) - len, "%s%u", sep, values[i]);
+        }
+    }
+    len += snprintf(file_buf + len, sizeof(file_buf) - len, "\r\n");
+    return len;
+}
+
+static uint32_t format_profile(const profile_t *profile) {
+    int len = snprintf(
+        file_buf, sizeof(file_buf), "name=%s\r\nencoders=%s,%s\r\nkeys=", profile->name,
+        encoder_mode_names[profile->encoder_modes[0]],
+        encoder_mode_names[profile->encoder_modes[1]]);
+    for (uint8_t k = 0; k < MACROPAD_KEY_COUNT; k++) {
+        const char *key = &profile->key_names[k * MACROPAD_KEY_NAME_LENGTH];
+        uint8_t key_len = MACROPAD_KEY_NAME_LENGTH;
+        while (key_len > 0 && key[key_len - 1] == ' ') {
+            key_len--;
+        }
+        len += snprintf(
+            file_buf + len, sizeof(file_buf) - len, "%s%.*s", k > 0 ? "," : "", key_len, key);
+    }
+    len += snprintf(
+        file_buf + len, sizeof(file_buf) - len, "\r\nmidi_channel=%u\r\n",
+        profile->midi.channel + 1);
+    const prof_midi_t *midi = &profile->midi;
+    len = format_values(len, "midi_notes", midi->key_notes, MACROPAD_KEY_COUNT, PROF_MIDI_NONE);
+    len = format_values(len, "midi_encoders", midi->encoder_ccs, 2, PROF_MIDI_NONE);
+    len = format_values(len, "midi_buttons", midi->button_notes, 2, PROF_MIDI_NONE);
+    len = format_values(len, "icons", profile->key_icons, MACROPAD_KEY_COUNT, PROF_ICON_NONE);
+    return len;
+}
+
+static void build_volume() {
+    memset(disk, 0, sizeof(disk));
+
+    boot_sector_t *boot = (boot_sector_t *)disk[0];
+    *boot = (boot_sector_t){
+        .jump = {0xeb, 0x3c, 0x90},
+        .oem = {'M', 'S', 'D', 'O', 'S', '5', '.', '0'},
+        .bytes_per_sector = MSC_DISK_SECTOR_SIZE,
+        .sectors_per_cluster = 1,
+        .reserved_sectors = FAT_LBA,
+        .fats = 1,
+        .root_entries = ROOT_ENTRIES,
+        .total_sectors = MSC_DISK_SECTORS,
+        .media = 0xf8,
+        .sectors_per_fat = ROOT_LBA - FAT_LBA,
+        .sectors_per_track = 1,
+        .heads = 1,
+        .drive = 0x80,
+        .boot_signature = 0x29,
+        .volume_id = 0x4d500001,
+        .label = {'M', 'A', 'C', 'R', 'O', 'P', 'A', 'D', ' ', ' ', ' '},
+        .fs_type = {'F', 'A', 'T', '1', '2', ' ', ' ', ' '},
+    };
+    disk[0][510] = 0x55;
+    disk[0][511] = 0xaa;
+
+    fat_set(0, 0xf00 | boot->media);
+    fat_set(1, END_OF_CHAIN);
+    next_cluster = FIRST_CLUSTER;
+    next_entry = 0;
+
+    add_file("MACROPAD   ", ATTR_VOLUME_ID, NULL, 0);
+    add_file("README  TXT", ATTR_READ_ONLY, readme, sizeof(readme) - 1);
+    uint8_t n = 0;
+    for (uint8_t i = 0; i < PROF_CACHE_SIZE; i++) {
+        const profile_t *profile = prof_get_cached(i);
+        if (!profile) {
+            continue;
+        }
+        char name[12];
+        snprintf(name, sizeof(name), "PROF_%-3uTXT", ++n);
+        add_file(name, 0, file_buf, format_profile(profile));
+    }
+    dirty = false;
+}
+
+void msc_disk_init() {
+    build_volume();
+}
+
+// Profile files
+
+static void trim(const char **start, const char **end) {
+    while (*start < *end && (**start == ' ' || **start == '\t')) {
+        (*start)++;
+    }
+    while (*end > *start && ((*end)[-1] == ' ' || (*end)[-1] == '\t')) {
+        (*end)--;
+    }
+}
+
+static bool is_key(const char *start, const char *end, const char *key) {
+    return (size_t)(end - start) == strlen(key) && memcmp(start, key, end - start) == 0;
+}
+
+// Call fn for each comma separated, trimmed item of the value
+static void for_each_item(
+    const char *start, const char *end, profile_t *profile,
+    void (*fn)(uint8_t index, const char *start, const char *end, profile_t *profile)) {
+    for (uint8_t index = 0;; index++) {
+        const char *comma = memchr(start, ',', end - start);
+        const char *item_start = start, *item_end = comma ? comma : end;
+        trim(&item_start, &item_end);
+        fn(index, item_start, item_end, profile);
+        if (!comma) {
+            break;
+        }
+        start = comma + 1;
+    }
+}
+
+static void parse_encoder(uint8_t index, const char *start, const char *end, profile_t *profile) {
+    if (index >= 2) {
+        return;
+    }
+    for (uint8_t mode = 0; mode < PROF_ENCODER_MODE_COUNT; mode++) {
+        if (is_key(start, end, encoder_mode_names[mode])) {
+            profile->encoder_modes[index] = mode;
+            return;
+        }
+    }
+    LOGW("Unknown encoder mode %.*s", (int)(end - start), start);
+}
+
+static void parse_key(uint8_t index, const char *start, const char *end, profile_t *profile) {
+    if (index >= MACROPAD_KEY_COUNT) {
+        return;
+    }
+    char *key = &profile->key_names[index * MACROPAD_KEY_NAME_LENGTH];
+    for (uint8_t i = 0; i < MACROPAD_KEY_NAME_LENGTH && start + i < end; i++) {
+        char c = start[i];
+        // Same as prof_set_current_key_names
+        key[i] = c < 32 || c > 126 ? ' ' : c;
+    }
+}
+
+// A number up to max, anything else (like "-") is none
+static uint8_t parse_value(const char *start, const char *end, uint8_t max, uint8_t none) {
+    if (start == end || end - start > 3) {
+        return none;
+    }
+    uint16_t value = 0;
+    for (const char *c = start; c < end; c++) {
+        if (*c < '0' || *c > '9') {
+            return none;
+        }
+        value = value * 10 + (*c - '0');
+    }
+    return value <= max ? value : none;
+}
+
+static void parse_midi_note(uint8_t index, const char *start, const char *end, profile_t *profile) {
+    if (index < MACROPAD_KEY_COUNT) {
+        profile->midi.key_notes[index] = parse_value(start, end, 127, PROF_MIDI_NONE);
+    }
+}
+
+static void parse_midi_cc(uint8_t index, const char *start, const char *end, profile_t *profile) {
+    if (index < 2) {
+        // Same as prof_set_current_midi, 120-127 are channel mode messages
+        profile->midi.encoder_ccs[index] = parse_value(start, end, 119, PROF_MIDI_NONE);
+    }
+}
+
+static void parse_midi_button(
+    uint8_t index, const char *start, const char *end, profile_t *profile) {
+    if (index < 2) {
+        profile->midi.button_notes[index] = parse_value(start, end, 127, PROF_MIDI_NONE);
+    }
+}
+
+static void parse_icon(uint8_t index, const char *start, const char *end, profile_t *profile) {
+    if (index < MACROPAD_KEY_COUNT) {
+        profile->key_icons[index] = parse_value(start, end, ICON_ATLAS_MAX_ICONS, PROF_ICON_NONE);
+    }
+}
+
+static bool parse_profile(const char *text, uint32_t len, profile_t *profile) {
+    memset(profile, 0, sizeof(*profile));
+    memset(profile->key_names, ' ', sizeof(profile->key_names));
+    profile->encoder_modes[0] = PROF_DEFAULT_ENCODER_0_MODE;
+    profile->encoder_modes[1] = PROF_DEFAULT_ENCODER_1_MODE;
+    profile->midi = *prof_get_default_midi();
+
+    bool has_name = false;
+    const char *end = text + len;
+    for (const char *line = text; line < end;) {
+        const char *eol = memchr(line, '\n', end - line);
+        const char *line_end = eol ? eol : end;
+        const char *eq = memchr(line, '=', line_end - line);
+        if (eq) {
+            const char *key_start = line, *key_end = eq;
+            const char *value = eq + 1, *value_end = line_end;
+            trim(&key_start, &key_end);
+            if (value_end > value && value_end[-1] == '\r') {
+                value_end--;
+            }
+            trim(&value, &value_end);
+
+            if (is_key(key_start, key_end, "name")) {
+                uint32_t n = value_end - value;
+                n = n < MACROPAD_PROFILE_NAME_LENGTH ? n : MACROPAD_PROFILE_NAME_LENGTH;
+                memcpy(profile->name, value, n);
+                has_name = n > 0;
+            } else if (is_key(key_start, key_end, "encoders")) {
+                for_each_item(value, value_end, profile, parse_encoder);
+            } else if (is_key(key_start, key_end, "keys")) {
+                for_each_item(value, value_end, profile, parse_key);
+            } else if (is_key(key_start, key_end, "midi_channel")) {
+                uint8_t channel = parse_value(value, value_end, 16, 0);
+                profile->midi.channel = channel >= 1 && channel <= 16 ? channel - 1 : 0;
+            } else if (is_key(key_start, key_end, "midi_notes")) {
+                for_each_item(value, value_end, profile, parse_midi_note);
+            } else if (is_key(key_start, key_end, "midi_encoders")) {
+                for_each_item(value, value_end, profile, parse_midi_cc);
+            } else if (is_key(key_start, key_end, "midi_buttons")) {
+                for_each_item(value, value_end, profile, parse_midi_button);
+            } else if (is_key(key_start, key_end, "icons")) {
+                for_each_item(value, value_end, profile, parse_icon);
+            }
+        }
+        line = line_end + 1;
+    }
+    return has_name;
+}
+
+static uint32_t read_file(const dir_entry_t *e) {
+    uint32_t len = e->size < sizeof(file_buf) ? e->size : sizeof(file_buf);
+    uint32_t done = 0;
+    for (uint16_t c = e->cluster;
+         done < len && c >= FIRST_CLUSTER && c < FIRST_CLUSTER + CLUSTERS; c = fat_get(c)) {
+        uint32_t chunk = len - done < MSC_DISK_SECTOR_SIZE ? len - done : MSC_DISK_SECTOR_SIZE;
+        memcpy(file_buf + done, disk[DATA_LBA + c - FIRST_CLUSTER], chunk);
+        done += chunk;
+    }
+    return done;
+}
+
+// Replace the stored profiles with the profile files on the volume
+static void commit() {
+    uint8_t count = 0;
+    for (uint8_t i = 0; i < ROOT_ENTRIES; i++) {
+        const dir_entry_t *e = &root_dir()[i];
+        if (e->name[0] == 0) {
+            break;
+        }
+        if ((uint8_t)e->name[0] == DELETED_ENTRY || (e->attr & ATTR_LFN) == ATTR_LFN ||
+            (e->attr & (ATTR_VOLUME_ID | ATTR_DIRECTORY)) || memcmp(e->name + 8, "TXT", 3) != 0 ||
+            memcmp(e->name, "README  ", 8) == 0) {
+            continue;
+        }
+        if (count == PROF_CACHE_SIZE) {
+            LOGW("Only %d profiles fit, ignoring the rest", PROF_CACHE_SIZE);
+            break;
+        }
+        if (parse_profile(file_buf, read_file(e), &parsed[count])) {
+            count++;
+        } else {
+            LOGW("%.8s.TXT has no profile name, skipping it", e->name);
+        }
+    }
+    LOGI("Storing %d profiles from the drive", count);
+    prof_store_replace(parsed, count);
+}
+
+// TinyUSB MSC callbacks, run from tud_task
+
+void tud_msc_inquiry_cb(
+    __attribute__((unused)) uint8_t lun, uint8_t vendor_id[8], uint8_t product_id[16],
+    uint8_t product_rev[4]) {
+    memcpy(vendor_id, "Luryus  ", 8);
+    memcpy(product_id, "Macropad Profile", 16);
+    memcpy(product_rev, "1.0 ", 4);
+}
+
+bool tud_msc_test_unit_ready_cb(uint8_t lun) {
+    if (!ejected) {
+        return true;
+    }
+    if (hal_time_us() - ejected_at_us < MSC_DISK_REINSERT_US) {
+        // Medium not present
+        tud_msc_set_sense(lun, SCSI_SENSE_NOT_READY, 0x3a, 0x00);
+        return false;
+    }
+    // Back with the stored profiles. Medium may have changed.
+    build_volume();
+    ejected = false;
+    tud_msc_set_sense(lun, SCSI_SENSE_UNIT_ATTENTION, 0x28, 0x00);
+    return false;
+}
+
+void tud_msc_capacity_cb(
+    __attribute__((unused)) uint8_t lun, uint32_t *block_count, uint16_t *block_size) {
+    *block_count = MSC_DISK_SECTORS;
+    *block_size = MSC_DISK_SECTOR_SIZE;
+}
+
+bool tud_msc_start_stop_cb(
+    __attribute__((unused)) uint8_t lun, __attribute__((unused)) uint8_t power_condition,
+    bool start, bool load_eject) {
+    if (load_eject && !start && !ejected) {
+        LOGI("Profile drive ejected");
+        if (dirty) {
+            commit();
+        }
+        ejected = true;
+        ejected_at_us = hal_time_us();
+    }
+    return true;
+}
+
+int32_t tud_msc_read10_cb(
+    __attribute__((unused)) uint8_t lun, uint32_t lba, uint32_t offset, void *buffer,
+    uint32_t bufsize) {
+    if (ejected || lba >= MSC_DISK_SECTORS) {
+        return -1;
+    }
+    uint32_t pos = lba * MSC_DISK_SECTOR_SIZE + offset;
+    uint32_t len = sizeof(disk) - pos < bufsize ? sizeof(disk) - pos : bufsize;
+    memcpy(buffer, (const uint8_t *)disk + pos, len);
+    return len;
+}
+
+int32_t tud_msc_write10_cb(
+    __attribute__((unused)) uint8_t lun, uint32_t lba, uint32_t offset, uint8_t *buffer,
+    uint32_t bufsize) {
+    if (ejected || lba >= MSC_DISK_SECTORS) {
+        return -1;
+    }
+    uint32_t pos = lba * MSC_DISK_SECTOR_SIZE + offset;
+    uint32_t len = sizeof(disk) - pos < bufsize ? sizeof(disk) - pos : bufsize;
+    memcpy((uint8_t *)disk + pos, buffer, len);
+    dirty = true;
+    return len;
+}
+
+int32_t tud_msc_scsi_cb(
+    uint8_t lun, uint8_t const scsi_cmd[16], __attribute__((unused)) void *buffer,
+    __attribute__((unused)) uint16_t bufsize) {
+    switch (scsi_cmd[0]) {
+    case SCSI_CMD_PREVENT_ALLOW_MEDIUM_REMOVAL:
+        // The drive can go at any time, there's no cache to flush
+        return 0;
+    default:
+        tud_msc_set_sense(lun, SCSI_SENSE_ILLEGAL_REQUEST, 0x20, 0x00);
+        return -1;
+    }
+}
+
+#endif // MACROPAD_MSC
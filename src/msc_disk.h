@@ -0,0 +1,37 @@
+#if !defined(MSC_DISK__H)
+#define MSC_DISK__H
+
+// USB mass storage drive with the cached profiles as text files, for copying
+// whole profile sets at bulk transfer speed. The drive is a small FAT12 volume
+// in RAM, built from the profile cache. When the host ejects it, the profile
+// files on it replace the stored profiles, and the drive comes back a few
+// seconds later with the new contents. Only built with the MACROPAD_MSC CMake
+// option.
+//
+// A profile file (any *.TXT in the root directory but README.TXT):
+//   name=Firefox
+//   encoders=wheel,volume
+//   keys=Back,Fwd,Tab,Home,...     (12 names of up to 4 characters)
+//   midi_channel=1                 (optional, see profile_t's MIDI map)
+//   midi_notes=36,37,38,39,...     (- for no note)
+//   midi_encoders=-,16
+//   midi_buttons=-,48
+//   icons=1,2,-,...                (optional, icon atlas numbers, - for none)
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define MSC_DISK_SECTOR_SIZE 512
+#define MSC_DISK_SECTORS     64
+
+// How long the drive stays ejected before it comes back
+#define MSC_DISK_REINSERT_US 3000000
+
+#if defined(MACROPAD_MSC)
+
+// Build the volume from the profile cache
+void msc_disk_init();
+
+#endif // MACROPAD_MSC
+
+#endif // MSC_DISK__H
@@ -0,0 +1,132 @@
+#if defined(MACROPAD_PERF)
+
+#include "perf.h"
+
+#include "hal.h"
+#include "log.h"
+
+#include <assert.h>
+#include <string.h>
+
+#define SLOT_NAME_LEN 8
+
+enum perf_cmd_t {
+    PERF_CMD_SELECT, // Select the slot the next GET_REPORT returns
+    PERF_CMD_RESET,  // Clear all the stats
+};
+
+typedef struct __attribute__((packed)) {
+    uint8_t cmd;
+    uint8_t slot;
+} perf_request_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t slot;
+    uint8_t slot_count;
+    uint32_t clk_sys_hz;
+    uint32_t count;
+    uint64_t total_cycles;
+    uint32_t min_cycles;
+    uint32_t max_cycles;
+    char name[SLOT_NAME_LEN]; // Not null terminated when 8 characters long
+    uint64_t xip_accesses;
+    uint64_t xip_misses;
+    uint8_t flags;
+} perf_report_t;
+
+enum perf_flags_t {
+    PERF_FLAG_RAM_HOT_PATH = 1 << 0, // Built with MACROPAD_RAM_HOT_PATH
+};
+
+static_assert(sizeof(perf_report_t) == PERF_REPORT_LEN, "perf report length mismatch");
+
+static const char *const slot_names[PERF_SLOT_COUNT] = {
+    [PERF_SLOT_TUD_TASK] = "tud",
+    [PERF_SLOT_HID_TASK] = "hid",
+    [PERF_SLOT_UI_TASK] = "ui",
+    [PERF_SLOT_UI_SEND_BUFFER] = "ui_send",
+    [PERF_SLOT_ISR_ENCODER_0] = "isr_enc0",
+    [PERF_SLOT_ISR_ENCODER_1] = "isr_enc1",
+    [PERF_SLOT_ISR_KEY_MATRIX] = "isr_keys",
+};
+
+perf_slot_stats_t perf_stats[PERF_SLOT_COUNT];
+uint32_t perf_cycles_per_us = 1;
+uint32_t perf_systick_span_us = UINT32_MAX;
+
+static uint8_t selected_slot = 0;
+
+void perf_init() {
+    perf_reset();
+    perf_cycles_per_us = hal_sys_clock_hz() / 1000000;
+    // Half a SysTick wrap: shorter spans are counted in cycles, exactly
+    perf_systick_span_us = (M0PLUS_SYST_RVR_BITS + 1) / perf_cycles_per_us / 2;
+    systick_hw->rvr = M0PLUS_SYST_RVR_BITS;
+    systick_hw->cvr = 0;
+    // Count processor clock cycles, no interrupt
+    systick_hw->csr = M0PLUS_SYST_CSR_CLKSOURCE_BITS | M0PLUS_SYST_CSR_ENABLE_BITS;
+    LOGI("Perf counters enabled");
+}
+
+void perf_reset() {
+    // The ISR slots are written from interrupts
+    uint32_t irq_state = hal_irq_save();
+    for (uint8_t i = 0; i < PERF_SLOT_COUNT; i++) {
+        perf_stats[i] = (perf_slot_stats_t){.min_cycles = UINT32_MAX};
+    }
+    hal_irq_restore(irq_state);
+}
+
+const char *perf_slot_name(perf_slot_t slot) {
+    return slot_names[slot];
+}
+
+void perf_handle_report(const uint8_t *data, uint16_t len) {
+    perf_request_t req = {0};
+    memcpy(&req, data, len < sizeof(req) ? len : sizeof(req));
+
+    switch (req.cmd) {
+    case PERF_CMD_SELECT:
+        if (req.slot >= PERF_SLOT_COUNT) {
+            LOGW("Invalid perf slot %u", req.slot);
+            return;
+        }
+        selected_slot = req.slot;
+        break;
+    case PERF_CMD_RESET:
+        perf_reset();
+        break;
+    default:
+        LOGW("Unknown perf command %u", req.cmd);
+    }
+}
+
+uint16_t perf_get_report(uint8_t *buffer, uint16_t reqlen) {
+    uint32_t irq_state = hal_irq_save();
+    perf_slot_stats_t s = perf_stats[selected_slot];
+    hal_irq_restore(irq_state);
+
+    perf_report_t rep = {
+        .slot = selected_slot,
+        .slot_count = PERF_SLOT_COUNT,
+        .clk_sys_hz = hal_sys_clock_hz(),
+        .count = s.count,
+        .total_cycles = s.total_cycles,
+        .min_cycles = s.count ? s.min_cycles : 0,
+        .max_cycles = s.max_cycles,
+        .xip_accesses = s.xip_accesses,
+        .xip_misses = s.xip_misses,
+#if defined(MACROPAD_RAM_HOT_PATH)
+        .flags = PERF_FLAG_RAM_HOT_PATH,
+#endif
+    };
+    size_t name_len = strlen(slot_names[selected_slot]);
+    memcpy(
+        rep.name, slot_names[selected_slot], name_len < SLOT_NAME_LEN ? name_len : SLOT_NAME_LEN);
+
+    uint16_t len = reqlen < sizeof(rep) ? reqlen : sizeof(rep);
+    memcpy(buffer, &rep, len);
+    return len;
+}
+
+#endif // MACROPAD_PERF
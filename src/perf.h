@@ -0,0 +1,119 @@
+#if !defined(PERF__H)
+#define PERF__H
+
+// Cycle counts of the main loop tasks and the ISRs, measured with the
+// SysTick counter (or the microsecond timer for spans it can't count), and
+// the XIP cache accesses and misses during them.
+// Only built with the MACROPAD_PERF CMake option, the scopes compile to
+// nothing otherwise.
+
+#include <stdint.h>
+
+// Payload length of the perf feature report (excluding the report id)
+#define PERF_REPORT_LEN 51
+
+typedef enum perf_slot_t {
+    PERF_SLOT_TUD_TASK,
+    PERF_SLOT_HID_TASK,
+    PERF_SLOT_UI_TASK,
+    PERF_SLOT_UI_SEND_BUFFER,
+    PERF_SLOT_ISR_ENCODER_0,
+    PERF_SLOT_ISR_ENCODER_1,
+    PERF_SLOT_ISR_KEY_MATRIX,
+
+    // Last
+    PERF_SLOT_COUNT,
+} perf_slot_t;
+
+typedef struct {
+    uint32_t count;
+    uint64_t total_cycles;
+    uint32_t min_cycles;
+    uint32_t max_cycles;
+    uint64_t xip_accesses; // Cached flash reads, including instruction fetches
+    uint64_t xip_misses;
+} perf_slot_stats_t;
+
+#if defined(MACROPAD_PERF)
+
+#include "hardware/structs/systick.h"
+#include "hardware/structs/timer.h"
+#include "hardware/structs/xip_ctrl.h"
+
+typedef struct {
+    uint32_t cycles;
+    uint32_t time_us;
+    uint32_t xip_hits;
+    uint32_t xip_accesses;
+} perf_mark_t;
+
+// Written by whichever context owns the slot, each slot has only one
+extern perf_slot_stats_t perf_stats[PERF_SLOT_COUNT];
+
+// Set by perf_init from the system clock
+extern uint32_t perf_cycles_per_us;
+// Spans at least this long are timed in microseconds, SysTick may have wrapped
+extern uint32_t perf_systick_span_us;
+
+// Start the SysTick counter
+void perf_init();
+
+void perf_reset();
+
+const char *perf_slot_name(perf_slot_t slot);
+
+// Handle a SET_REPORT of the perf feature report
+void perf_handle_report(const uint8_t *data, uint16_t len);
+
+// Fill a GET_REPORT of the perf feature report, returns the length
+uint16_t perf_get_report(uint8_t *buffer, uint16_t reqlen);
+
+static inline perf_mark_t perf_mark() {
+    return (perf_mark_t){
+        .cycles = systick_hw->cvr,
+        .time_us = timer_hw->timerawl,
+        .xip_hits = xip_ctrl_hw->ctr_hit,
+        .xip_accesses = xip_ctrl_hw->ctr_acc,
+    };
+}
+
+static inline void perf_record(perf_slot_t slot, perf_mark_t start) {
+    perf_mark_t end = perf_mark();
+    // SysTick counts down and wraps at 24 bits (134 ms at 125 MHz)
+    uint32_t cycles = (start.cycles - end.cycles) & M0PLUS_SYST_RVR_BITS;
+    uint32_t elapsed_us = end.time_us - start.time_us;
+    if (elapsed_us >= perf_systick_span_us) {
+        cycles = elapsed_us < UINT32_MAX / perf_cycles_per_us ? elapsed_us * perf_cycles_per_us
+                                                              : UINT32_MAX;
+    }
+    uint32_t accesses = end.xip_accesses - start.xip_accesses;
+    uint32_t hits = end.xip_hits - start.xip_hits;
+
+    perf_slot_stats_t *s = &perf_stats[slot];
+    s->count++;
+    s->total_cycles += cycles;
+    s->xip_accesses += accesses;
+    s->xip_misses += accesses - hits;
+    if (cycles < s->min_cycles) {
+        s->min_cycles = cycles;
+    }
+    if (cycles > s->max_cycles) {
+        s->max_cycles = cycles;
+    }
+}
+
+// Measure the code between PERF_BEGIN and PERF_END in the same block
+#define PERF_BEGIN(slot) perf_mark_t perf_start_##slot = perf_mark()
+#define PERF_END(slot)   perf_record(slot, perf_start_##slot)
+
+#else
+
+static inline void perf_init() {
+}
+
+#define PERF_BEGIN(slot)
+#define PERF_END(slot)
+
+#endif // MACROPAD_PERF
+
+#endif // PERF__H
@@ -1,14 +1,19 @@
 #include "pico_u8g2_i2c.h"
 
-#include "hardware/i2c.h"
+#include "hal.h"
 #include "log.h"
-#include "pico/stdlib.h"
 #include "u8g2.h"
+#include <assert.h>
 #include <stdint.h>
 
 #define DISPLAY_SDA_PIN 16
 #define DISPLAY_SCL_PIN 17
-#define I2C_INSTANCE    i2c0
+
+static uint16_t delay_credit_ms = 0;
+
+void pico_u8g2_delay_credit(uint16_t ms) {
+    delay_credit_ms = ms;
+}
 
 uint8_t pico_u8g2_delay_cb(
     u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, __attribute__((unused)) void *arg_ptr) {
@@ -17,7 +22,12 @@ uint8_t pico_u8g2_delay_cb(
     switch (msg) {
     case U8X8_MSG_DELAY_MILLI:
         // arg_int * 1 ms delay
-        sleep_ms(arg_int);
+        if (arg_int <= delay_credit_ms) {
+            delay_credit_ms -= arg_int;
+            break;
+        }
+        hal_sleep_ms(arg_int - delay_credit_ms);
+        delay_credit_ms = 0;
         break;
     default:
         LOGW("pico_u8g2_delay_cb called with unimplemented msg %u", msg);
@@ -27,21 +37,13 @@ uint8_t pico_u8g2_delay_cb(
     return 1;
 }
 
-static void init_i2c() {
-    i2c_init(I2C_INSTANCE, 400 * 1000);
-    gpio_set_function(DISPLAY_SDA_PIN, GPIO_FUNC_I2C);
-    gpio_set_function(DISPLAY_SCL_PIN, GPIO_FUNC_I2C);
-    gpio_pull_up(DISPLAY_SDA_PIN);
-    gpio_pull_up(DISPLAY_SCL_PIN);
-}
-
 uint8_t pico_u8g2_byte_i2c(u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, void *arg_ptr) {
     static uint8_t buffer[32]; // At most 32 bytes sent between start/end transfer
     static uint8_t buffer_size = 0;
 
     switch (msg) {
     case U8X8_MSG_BYTE_INIT:
-        init_i2c();
+        hal_i2c_init(DISPLAY_SDA_PIN, DISPLAY_SCL_PIN, 400 * 1000);
         break;
 
     case U8X8_MSG_BYTE_SEND:
@@ -65,7 +67,7 @@ uint8_t pico_u8g2_byte_i2c(u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, void *arg
         // Send the data
         assert(buffer_size > 0);
         uint8_t address = u8x8_GetI2CAddress(u8x8) >> 1;
-        int written = i2c_write_blocking(I2C_INSTANCE, address, buffer, buffer_size, false);
+        int written = hal_i2c_write(address, buffer, buffer_size);
         if (written != buffer_size) {
             LOGE("Error writing i2c data: %d", written);
             return 0;
@@ -5,6 +5,10 @@
 #include <stdint.h>
 
 uint8_t pico_u8g2_delay_cb(u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, void *arg_ptr);
+
+// Skip the next delays u8g2 asks for, up to ms in total. For time that
+// was already waited without blocking.
+void pico_u8g2_delay_credit(uint16_t ms);
 uint8_t pico_u8g2_byte_i2c(u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, void *arg_ptr);
 
 #endif // PICO_U8G2_I2C__H
@@ -1,38 +1,251 @@
 #include "profiles.h"
 
 #include "constants.h"
+#include "flash_layout.h"
+#include "flash_ops.h"
+#include "hal.h"
+#include "hot_path.h"
+#include "log.h"
 
+#include <assert.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
-static char current_profile_name[1 + MACROPAD_PROFILE_NAME_LENGTH] = {0};
-static char current_key_names[MACROPAD_KEY_NAME_LENGTH * MACROPAD_KEY_COUNT] = {0};
+#define FNV_OFFSET_BASIS 2166136261u
+#define FNV_PRIME        16777619u
+
+// Bumped when profile_t changes, older stores are ignored
+#define STORE_MAGIC 0x3350504d // "MPP3"
+
+// Keys from note 36 up like drum pads, and encoder 1 (the Dial) on controller
+// 16 with its button on the note after the keys
+#define DEFAULT_MIDI                                                   \
+    {                                                                  \
+        .channel = 0,                                                  \
+        .key_notes = {36, 37, 38, 39, 40, 41, 42, 43, 44, 45, 46, 47}, \
+        .encoder_ccs = {PROF_MIDI_NONE, 16},                           \
+        .button_notes = {PROF_MIDI_NONE, 48},                          \
+    }
+
+static_assert(MACROPAD_KEY_COUNT == 12, "DEFAULT_MIDI has a note for every key");
+
+typedef struct {
+    profile_t profile;
+    uint32_t hash;
+    uint32_t last_used; // 0: empty slot
+} prof_cache_entry_t;
+
+static const prof_midi_t default_midi = DEFAULT_MIDI;
+
+static prof_snapshot_t snapshots[2] = {
+    {
+        .profile.encoder_modes = {PROF_DEFAULT_ENCODER_0_MODE, PROF_DEFAULT_ENCODER_1_MODE},
+        .profile.midi = DEFAULT_MIDI,
+    },
+};
+static volatile uint8_t published = 0;
+
+static prof_cache_entry_t cache[PROF_CACHE_SIZE];
+static uint32_t use_counter = 0;
+static prof_cache_stats_t cache_stats = {0};
+
+typedef struct {
+    uint32_t magic;
+    uint32_t count;
+    profile_t profiles[PROF_CACHE_SIZE];
+} prof_store_t;
+
+static_assert(sizeof(prof_store_t) <= FLASH_LAYOUT_PROFILES_SIZE, "profile store too big");
+
+static uint32_t fnv1a(uint32_t hash, const char *data, uint32_t len) {
+    for (uint32_t i = 0; i < len; i++) {
+        hash ^= (uint8_t)data[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+uint32_t prof_hash(const profile_t *profile) {
+    uint32_t hash = FNV_OFFSET_BASIS;
+    hash = fnv1a(hash, profile->name, MACROPAD_PROFILE_NAME_LENGTH);
+    hash = fnv1a(hash, profile->key_names, sizeof(profile->key_names));
+    hash = fnv1a(hash, (const char *)profile->encoder_modes, sizeof(profile->encoder_modes));
+    hash = fnv1a(hash, (const char *)&profile->midi, sizeof(profile->midi));
+    hash = fnv1a(hash, (const char *)profile->key_icons, sizeof(profile->key_icons));
+    return hash;
+}
+
+static prof_cache_entry_t *cache_find(uint32_t hash) {
+    for (uint8_t i = 0; i < PROF_CACHE_SIZE; i++) {
+        if (cache[i].last_used != 0 && cache[i].hash == hash) {
+            return &cache[i];
+        }
+    }
+    return NULL;
+}
+
+// Start an update from a copy of the published snapshot
+static prof_snapshot_t *begin_update() {
+    prof_snapshot_t *next = &snapshots[published ^ 1];
+    *next = snapshots[published];
+    return next;
+}
+
+static void publish(prof_snapshot_t *next) {
+    next->hash = prof_hash(&next->profile);
+    next->generation = snapshots[published].generation + 1;
+    // The snapshot must be complete before readers can see it
+    hal_memory_barrier();
+    published = next - snapshots;
+}
+
+static void cache_store(const profile_t *profile, uint32_t hash) {
+    prof_cache_entry_t *e = cache_find(hash);
+    if (!e) {
+        // Take an empty slot, or evict the least recently used profile
+        e = &cache[0];
+        for (uint8_t i = 1; i < PROF_CACHE_SIZE && e->last_used != 0; i++) {
+            if (cache[i].last_used < e->last_used) {
+                e = &cache[i];
+            }
+        }
+        if (e->last_used != 0) {
+            cache_stats.evictions++;
+        } else {
+            cache_stats.entries++;
+        }
+        e->profile = *profile;
+        e->hash = hash;
+    }
+    e->last_used = ++use_counter;
+}
 
 void prof_set_current_profile_name(const char *name) {
-    memset(current_profile_name, 0, sizeof(current_profile_name));
-    strncpy(current_profile_name, name, MACROPAD_PROFILE_NAME_LENGTH);
+    prof_snapshot_t *next = begin_update();
+    memset(next->profile.name, 0, sizeof(next->profile.name));
+    strncpy(next->profile.name, name, MACROPAD_PROFILE_NAME_LENGTH);
+    next->profile.encoder_modes[0] = PROF_DEFAULT_ENCODER_0_MODE;
+    next->profile.encoder_modes[1] = PROF_DEFAULT_ENCODER_1_MODE;
+    next->profile.midi = default_midi;
+    memset(next->profile.key_icons, PROF_ICON_NONE, sizeof(next->profile.key_icons));
+    publish(next);
+}
+
+void prof_set_current_encoder_modes(const uint8_t modes[2]) {
+    prof_snapshot_t *next = begin_update();
+    for (uint8_t i = 0; i < 2; i++) {
+        next->profile.encoder_modes[i] =
+            modes[i] < PROF_ENCODER_MODE_COUNT ? modes[i] : PROF_ENCODER_MODE_NONE;
+    }
+    publish(next);
+}
+
+void prof_set_current_key_icons(const uint8_t icons[MACROPAD_KEY_COUNT]) {
+    prof_snapshot_t *next = begin_update();
+    // Indexes missing from the atlas are just not drawn
+    memcpy(next->profile.key_icons, icons, sizeof(next->profile.key_icons));
+    publish(next);
+}
+
+static uint8_t midi_value_or_none(uint8_t value, uint8_t max) {
+    return value <= max ? value : PROF_MIDI_NONE;
+}
+
+void prof_set_current_midi(const prof_midi_t *midi) {
+    prof_snapshot_t *next = begin_update();
+    prof_midi_t *m = &next->profile.midi;
+    m->channel = midi->channel & 0x0f;
+    for (uint8_t i = 0; i < MACROPAD_KEY_COUNT; i++) {
+        m->key_notes[i] = midi_value_or_none(midi->key_notes[i], 127);
+    }
+    for (uint8_t i = 0; i < 2; i++) {
+        // Controllers 120-127 are channel mode messages
+        m->encoder_ccs[i] = midi_value_or_none(midi->encoder_ccs[i], 119);
+        m->button_notes[i] = midi_value_or_none(midi->button_notes[i], 127);
+    }
+    publish(next);
+}
+
+const prof_midi_t *prof_get_default_midi() {
+    return &default_midi;
 }
 
 void prof_set_current_key_names(const char *key_names) {
-    // key_names must be a 12-element array of 4-element char arrays (no null terminators)
-    // Just copy it into its place
-    memcpy(current_key_names, key_names, sizeof(current_key_names));
+    prof_snapshot_t *next = begin_update();
+    char *names = next->profile.key_names;
+
+    // Just copy the names into their place
+    memcpy(names, key_names, sizeof(next->profile.key_names));
 
     // Then ensure that all the characters are valid.
     // Replace invalid characters with spaces.
-    for (uint8_t i = 0; i < sizeof(current_key_names); i++) {
-        char c = current_key_names[i];
+    for (uint8_t i = 0; i < sizeof(next->profile.key_names); i++) {
+        char c = names[i];
         if (c < 32 || c > 126) {
-            current_key_names[i] = ' ';
+            names[i] = ' ';
         }
     }
+
+    publish(next);
+    cache_store(&next->profile, next->hash);
 }
 
-char *prof_get_current_name() {
-    return current_profile_name;
+const prof_snapshot_t *HOT_PATH_FUNC(prof_get_snapshot)() {
+    return &snapshots[published];
 }
 
-char *prof_get_current_key_names() {
-    return current_key_names;
+bool prof_activate_by_hash(uint32_t hash) {
+    prof_cache_entry_t *e = cache_find(hash);
+    if (!e) {
+        cache_stats.misses++;
+        LOGD("Profile %08lx not cached", hash);
+        return false;
+    }
+
+    cache_stats.hits++;
+    e->last_used = ++use_counter;
+    if (hash != snapshots[published].hash) {
+        prof_snapshot_t *next = begin_update();
+        next->profile = e->profile;
+        publish(next);
+    }
+    return true;
+}
+
+const prof_cache_stats_t *prof_get_cache_stats() {
+    return &cache_stats;
+}
+
+const profile_t *prof_get_cached(uint8_t index) {
+    return cache[index].last_used != 0 ? &cache[index].profile : NULL;
+}
+
+void prof_store_load() {
+    const prof_store_t *store =
+        (const prof_store_t *)flash_ops_read_ptr(FLASH_LAYOUT_PROFILES_OFFSET);
+    if (store->magic != STORE_MAGIC || store->count > PROF_CACHE_SIZE) {
+        LOGI("No stored profiles");
+        return;
+    }
+    for (uint8_t i = 0; i < store->count; i++) {
+        cache_store(&store->profiles[i], prof_hash(&store->profiles[i]));
+    }
+    LOGI("Loaded %lu stored profiles", store->count);
+}
+
+void prof_store_replace(const profile_t *profiles, uint8_t count) {
+    // Built outside flash, it can't be read while being written
+    static uint8_t sector[HAL_FLASH_SECTOR_SIZE] __attribute__((aligned(4)));
+    prof_store_t *store = (prof_store_t *)sector;
+
+    memset(sector, 0xff, sizeof(sector));
+    store->magic = STORE_MAGIC;
+    store->count = count < PROF_CACHE_SIZE ? count : PROF_CACHE_SIZE;
+    memcpy(store->profiles, profiles, store->count * sizeof(profile_t));
+    flash_ops_write_sector(FLASH_LAYOUT_PROFILES_OFFSET, sector);
+
+    memset(cache, 0, sizeof(cache));
+    cache_stats.entries = 0;
+    prof_store_load();
 }
@@ -1,12 +1,109 @@
 #if !defined(PROFILES__H)
 #define PROFILES__H
 
+#include "constants.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Recently used profiles kept on the device, so the host can switch back to
+// one by sending just its hash
+#define PROF_CACHE_SIZE 8
+
+// What an encoder's rotation is reported as
+typedef enum {
+    PROF_ENCODER_MODE_NONE,   // Not reported, only drives the UI
+    PROF_ENCODER_MODE_DIAL,   // Vendor dial report, encoder 1 only
+    PROF_ENCODER_MODE_VOLUME, // Consumer control volume up/down, button mutes
+    PROF_ENCODER_MODE_WHEEL,  // Mouse wheel
+    PROF_ENCODER_MODE_PAN,    // Horizontal mouse wheel
+
+    PROF_ENCODER_MODE_COUNT,
+} prof_encoder_mode_t;
+
+#define PROF_DEFAULT_ENCODER_0_MODE PROF_ENCODER_MODE_NONE
+#define PROF_DEFAULT_ENCODER_1_MODE PROF_ENCODER_MODE_DIAL
+
+// No icon for a key, see icon_atlas.h
+#define PROF_ICON_NONE 0
+
+// No MIDI message for a key, encoder or button
+#define PROF_MIDI_NONE 0xff
+
+// What the USB MIDI interface sends, see usb_midi.h
+typedef struct {
+    uint8_t channel;                       // 0-15
+    uint8_t key_notes[MACROPAD_KEY_COUNT]; // Note on while pressed
+    uint8_t encoder_ccs[2];                // Controller of the relative steps
+    uint8_t button_notes[2];               // Note on while an encoder button is pressed
+} prof_midi_t;
+
+typedef struct {
+    char name[1 + MACROPAD_PROFILE_NAME_LENGTH];
+    // 12-element array of 4-element char arrays (no null terminators)
+    char key_names[MACROPAD_KEY_NAME_LENGTH * MACROPAD_KEY_COUNT];
+    // Icon atlas index of each key, drawn next to the name
+    uint8_t key_icons[MACROPAD_KEY_COUNT];
+    uint8_t encoder_modes[2];
+    prof_midi_t midi;
+} profile_t;
+
+// An immutable, published version of the current profile
+typedef struct {
+    profile_t profile;
+    uint32_t hash;
+    uint32_t generation; // Bumped on every change, 0 before the first one
+} prof_snapshot_t;
+
+typedef struct {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t evictions;
+    uint8_t entries;
+} prof_cache_stats_t;
+
+// Uploading a profile: the name starts a new profile with the default
+// encoder modes and MIDI map and no icons, then optionally the encoder modes,
+// the MIDI map and the key icons, then the key names.
+
 void prof_set_current_profile_name(const char *name);
 
+void prof_set_current_encoder_modes(const uint8_t modes[2]);
+
+void prof_set_current_key_icons(const uint8_t icons[MACROPAD_KEY_COUNT]);
+
+// Out of range notes and controllers become PROF_MIDI_NONE
+void prof_set_current_midi(const prof_midi_t *midi);
+
+const prof_midi_t *prof_get_default_midi();
+
+// Also stores the current profile in the cache
 void prof_set_current_key_names(const char *key_names);
 
-char *prof_get_current_name();
+// The latest snapshot. Writers fill in the other of two buffers and swap them,
+// so the returned snapshot stays intact until the second update after this call.
+// Don't hold on to it across scheduler passes.
+const prof_snapshot_t *prof_get_snapshot();
+
+// FNV-1a over the name (zero padded to MACROPAD_PROFILE_NAME_LENGTH), the key
+// names, the encoder modes, the MIDI map and the key icons
+uint32_t prof_hash(const profile_t *profile);
+
+// Make a cached profile current. Returns false if it isn't in the cache.
+bool prof_activate_by_hash(uint32_t hash);
+
+const prof_cache_stats_t *prof_get_cache_stats();
+
+// A cached profile, or NULL for an empty slot. index < PROF_CACHE_SIZE.
+const profile_t *prof_get_cached(uint8_t index);
+
+// Profiles kept in flash. They fill the cache at boot, so the host can
+// switch to any of them by hash.
+
+void prof_store_load();
 
-char *prof_get_current_key_names();
+// Replace the stored profiles with the given ones (at most PROF_CACHE_SIZE)
+// and refill the cache with them. Stalls for a flash sector erase.
+void prof_store_replace(const profile_t *profiles, uint8_t count);
 
 #endif // PROFILES__H
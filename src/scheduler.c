@@ -0,0 +1,196 @@
+#include "scheduler.h"
+
+#include "hal.h"
+#include "hot_path.h"
+#include "log.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+#define TASK_NAME_LEN 8
+
+enum sched_cmd_t {
+    SCHED_CMD_SELECT, // Select the task the next GET_REPORT returns
+    SCHED_CMD_RESET,  // Clear the stats of all tasks
+};
+
+typedef struct __attribute__((packed)) {
+    uint8_t cmd;
+    uint8_t task;
+} sched_request_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t task;
+    uint8_t task_count;
+    char name[TASK_NAME_LEN]; // Not null terminated when 8 characters long
+    uint32_t run_count;
+    uint32_t max_runtime_us;
+    uint32_t missed_deadlines;
+} sched_report_t;
+
+static_assert(sizeof(sched_report_t) == SCHED_REPORT_LEN, "scheduler report length mismatch");
+
+typedef struct {
+    const char *name;
+    sched_task_fn_t fn;
+    uint32_t period_us;
+    uint32_t deadline;
+    bool armed; // Deadline is valid
+    volatile bool woken;
+    sched_task_stats_t stats;
+} sched_task_t;
+
+static sched_task_t tasks[SCHED_TASK_COUNT];
+static uint8_t selected_task = 0;
+
+// Wrap-safe comparison of two hal_time_us() timestamps
+static inline bool time_reached(uint32_t now, uint32_t time) {
+    return (int32_t)(now - time) >= 0;
+}
+
+void sched_add_task(sched_task_id_t id, const char *name, sched_task_fn_t fn, uint32_t period_us) {
+    sched_task_t *t = &tasks[id];
+    t->name = name;
+    t->fn = fn;
+    t->period_us = period_us;
+    t->deadline = hal_time_us();
+    t->armed = period_us != SCHED_EVERY_PASS && period_us != SCHED_ON_DEMAND;
+    t->woken = false;
+}
+
+void HOT_PATH_FUNC(sched_wake)(sched_task_id_t id) {
+    tasks[id].woken = true;
+    // Make sure the loop doesn't go to sleep if it was just about to
+    hal_signal_event();
+}
+
+void sched_set_deadline(sched_task_id_t id, uint32_t time_us) {
+    tasks[id].deadline = time_us;
+    tasks[id].armed = true;
+}
+
+static void run_task(sched_task_t *t, uint32_t now) {
+    bool deadline_run = t->armed && time_reached(now, t->deadline);
+
+    t->woken = false;
+    if (deadline_run) {
+        if (t->period_us == SCHED_ON_DEMAND) {
+            // One-off deadline
+            t->armed = false;
+        } else {
+            t->deadline += t->period_us;
+            if (time_reached(now, t->deadline)) {
+                // Already late for the next one too, don't try to catch up
+                t->stats.missed_deadlines++;
+                t->deadline = now + t->period_us;
+            }
+        }
+    }
+
+    uint32_t start = hal_time_us();
+    t->fn();
+    uint32_t runtime = hal_time_us() - start;
+
+    t->stats.run_count++;
+    if (runtime > t->stats.max_runtime_us) {
+        t->stats.max_runtime_us = runtime;
+    }
+}
+
+void sched_run_pass() {
+    uint32_t now = hal_time_us();
+    bool any_woken = false;
+
+    for (uint8_t i = 0; i < SCHED_TASK_COUNT; i++) {
+        sched_task_t *t = &tasks[i];
+        if (!t->fn) {
+            continue;
+        }
+
+        if (t->woken || t->period_us == SCHED_EVERY_PASS ||
+            (t->armed && time_reached(now, t->deadline))) {
+            run_task(t, now);
+            now = hal_time_us();
+        }
+    }
+
+    // Find out how long we can sleep
+    int32_t sleep_us = INT32_MAX;
+    for (uint8_t i = 0; i < SCHED_TASK_COUNT; i++) {
+        sched_task_t *t = &tasks[i];
+        if (!t->fn) {
+            continue;
+        }
+        any_woken |= t->woken;
+        if (t->armed) {
+            int32_t until = (int32_t)(t->deadline - now);
+            if (until < sleep_us) {
+                sleep_us = until;
+            }
+        }
+    }
+
+    if (!any_woken && sleep_us > 0) {
+        // Any interrupt (or sched_wake) ends the sleep early
+        hal_wait_for_event(sleep_us);
+    }
+}
+
+void sched_run() {
+    LOGI("Starting scheduler");
+
+    while (true) {
+        sched_run_pass();
+    }
+}
+
+const sched_task_stats_t *sched_get_task_stats(sched_task_id_t id) {
+    return &tasks[id].stats;
+}
+
+void sched_reset_stats() {
+    for (uint8_t i = 0; i < SCHED_TASK_COUNT; i++) {
+        tasks[i].stats = (sched_task_stats_t){0};
+    }
+}
+
+void sched_handle_report(const uint8_t *data, uint16_t len) {
+    sched_request_t req = {0};
+    memcpy(&req, data, len < sizeof(req) ? len : sizeof(req));
+
+    switch (req.cmd) {
+    case SCHED_CMD_SELECT:
+        if (req.task >= SCHED_TASK_COUNT) {
+            LOGW("Invalid scheduler task %u", req.task);
+            return;
+        }
+        selected_task = req.task;
+        break;
+    case SCHED_CMD_RESET:
+        sched_reset_stats();
+        break;
+    default:
+        LOGW("Unknown scheduler command %u", req.cmd);
+    }
+}
+
+uint16_t sched_get_report(uint8_t *buffer, uint16_t reqlen) {
+    const sched_task_t *t = &tasks[selected_task];
+    sched_report_t rep = {
+        .task = selected_task,
+        .task_count = SCHED_TASK_COUNT,
+        .run_count = t->stats.run_count,
+        .max_runtime_us = t->stats.max_runtime_us,
+        .missed_deadlines = t->stats.missed_deadlines,
+    };
+    // Tasks not built in (MIDI) have no name
+    if (t->name) {
+        size_t name_len = strlen(t->name);
+        memcpy(rep.name, t->name, name_len < TASK_NAME_LEN ? name_len : TASK_NAME_LEN);
+    }
+
+    uint16_t len = reqlen < sizeof(rep) ? reqlen : sizeof(rep);
+    memcpy(buffer, &rep, len);
+    return len;
+}
@@ -0,0 +1,64 @@
+#if !defined(SCHEDULER__H)
+#define SCHEDULER__H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Payload length of the scheduler stats feature report
+#define SCHED_REPORT_LEN 22
+
+// Period for tasks that should run on every pass of the scheduler loop,
+// i.e. whenever the core wakes up for any reason.
+#define SCHED_EVERY_PASS 0
+// Period for tasks that only run when woken or when a deadline is set for them.
+#define SCHED_ON_DEMAND UINT32_MAX
+
+typedef enum sched_task_id_t {
+    SCHED_TASK_BUTTONS,
+    SCHED_TASK_USB,
+    SCHED_TASK_HID,
+    SCHED_TASK_UI,
+    SCHED_TASK_MIDI, // Only with MACROPAD_MIDI
+    SCHED_TASK_FW_UPDATE,
+
+    // Last
+    SCHED_TASK_COUNT,
+} sched_task_id_t;
+
+typedef void (*sched_task_fn_t)();
+
+typedef struct {
+    uint32_t run_count;
+    uint32_t max_runtime_us;
+    uint32_t missed_deadlines; // Runs that started after the following deadline had passed
+} sched_task_stats_t;
+
+// Register a task. A periodic task first runs right away, and then
+// every period_us microseconds.
+void sched_add_task(sched_task_id_t id, const char *name, sched_task_fn_t fn, uint32_t period_us);
+
+// Make the task run on the next pass of the scheduler loop.
+// Safe to call from ISRs.
+void sched_wake(sched_task_id_t id);
+
+// Move the next run of the task to the given hal_time_us() timestamp.
+void sched_set_deadline(sched_task_id_t id, uint32_t time_us);
+
+// Run the tasks that are due, then sleep until the next deadline or event.
+void sched_run_pass();
+
+// Run the tasks forever, sleeping in between.
+__attribute__((noreturn)) void sched_run();
+
+const sched_task_stats_t *sched_get_task_stats(sched_task_id_t id);
+
+void sched_reset_stats();
+
+// Handle a SET_REPORT of the scheduler stats feature report
+void sched_handle_report(const uint8_t *data, uint16_t len);
+
+// Fill a GET_REPORT of the scheduler stats feature report (the selected
+// task's stats), returns the length
+uint16_t sched_get_report(uint8_t *buffer, uint16_t reqlen);
+
+#endif // SCHEDULER__H
@@ -0,0 +1,325 @@
+#if defined(MACROPAD_TIME_SYNC)
+
+#include "time_sync.h"
+
+#include "hal.h"
+#include "hot_path.h"
+#include "log.h"
+
+#include <assert.h>
+#include <string.h>
+
+// A longer gap in the SOFs (suspend, unplug) can hide frame number wraps
+#define RESYNC_GAP_US 500000
+// Period measurements further than this from the nominal one are glitches
+#define MAX_DRIFT_Q16 ((TIME_SYNC_FRAME_US << 16) / 1000)
+#define NO_FRAME      0xffff
+// Queued-to-poll times longer than this are from reports the host never took
+#define MAX_POLL_WAIT_US 100000
+// Nearest the HID task runs again after a poll was prepared for
+#define MIN_PREPARE_GAP_US 200
+
+typedef struct {
+    uint8_t report_id; // 0 for an unused tag
+    uint8_t seq;
+    uint32_t event_us;
+    uint32_t queued_us;
+} tag_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t report_id;
+    uint8_t seq;
+    uint16_t event_frame; // Of the input that caused the report
+    uint16_t event_offset_us;
+    uint16_t queued_frame; // When the report was handed to the USB stack
+    uint16_t queued_offset_us;
+} time_sync_report_tag_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t locked;
+    uint16_t now_frame; // When the report was filled
+    uint16_t now_offset_us;
+    uint32_t us_per_frame_q16; // Local timer microseconds per frame, 16.16 fixed point
+    uint32_t sofs;
+    uint32_t resyncs;
+    time_sync_report_tag_t tags[TIME_SYNC_TAGS]; // Oldest first
+} time_sync_report_t;
+
+static_assert(sizeof(time_sync_report_t) == TIME_SYNC_REPORT_LEN, "length mismatch");
+
+typedef struct __attribute__((packed)) {
+    uint8_t aligned; // Built with MACROPAD_POLL_ALIGN
+    uint8_t locked;  // Poll phase known
+    uint16_t poll_offset_us;
+    uint16_t lead_us;
+    // Time from queueing a report to its completion
+    uint32_t reports;
+    uint16_t min_us;
+    uint16_t max_us;
+    uint32_t sum_us;
+    uint64_t sum_sq_us;
+    uint16_t histogram[TIME_SYNC_POLL_BUCKETS];
+} time_sync_poll_report_t;
+
+static_assert(sizeof(time_sync_poll_report_t) == TIME_SYNC_POLL_REPORT_LEN, "length mismatch");
+
+// Last SOF, and the SOFs since the last resync with frame number wraps counted in
+static bool have_sof = false;
+static uint32_t last_sof_us;
+static uint16_t last_frame;
+static uint32_t frames;
+
+// The SOF of the current window seen soonest after its start of frame
+static uint32_t window_start_frames;
+static uint32_t window_start_us;
+static bool window_has_best;
+static int32_t best_lag_us;
+static uint32_t best_frames;
+static uint32_t best_us;
+static uint16_t best_frame;
+
+// Mapping from the last complete window
+static uint8_t anchors = 0; // Windows completed since the last resync, saturates
+static uint32_t anchor_frames;
+static uint32_t anchor_us;
+static uint16_t anchor_frame;
+static uint32_t us_per_frame_q16 = TIME_SYNC_FRAME_US << 16;
+
+static uint32_t sofs = 0;
+static uint32_t resyncs = 0;
+
+static tag_t tags[TIME_SYNC_TAGS];
+static uint8_t next_tag = 0;
+
+// Where in the frame the host polls. Completions are seen a varying time
+// after the poll, each window of them moves the estimate to the soonest one.
+static int32_t poll_offset_us;
+static uint32_t poll_samples = 0;
+static int32_t poll_window_min_us;
+static bool report_in_flight = false;
+static uint32_t report_queued_us;
+static time_sync_poll_report_t poll_stats;
+
+static void start_window(uint32_t now_us) {
+    window_start_frames = frames;
+    window_start_us = now_us;
+    window_has_best = false;
+}
+
+static void finish_window() {
+    if (anchors > 0) {
+        uint32_t q16 = ((uint64_t)(best_us - anchor_us) << 16) / (best_frames - anchor_frames);
+        int32_t drift = (int32_t)(q16 - (TIME_SYNC_FRAME_US << 16));
+        if (drift > MAX_DRIFT_Q16 || drift < -MAX_DRIFT_Q16) {
+            LOGW("Ignoring a frame period of %lu/65536 us", q16);
+            return;
+        }
+        if (anchors == 1) {
+            us_per_frame_q16 = q16;
+        } else {
+            // Smooth out what's left of the task latency in the anchors
+            us_per_frame_q16 += (int32_t)(q16 - us_per_frame_q16) / 8;
+        }
+    }
+    anchor_frames = best_frames;
+    anchor_us = best_us;
+    anchor_frame = best_frame;
+    if (anchors < UINT8_MAX) {
+        anchors++;
+    }
+}
+
+void time_sync_sof(uint32_t frame_count, uint32_t now_us) {
+    uint16_t frame = frame_count & 0x7ff;
+    sofs++;
+    if (!have_sof || now_us - last_sof_us > RESYNC_GAP_US) {
+        if (have_sof) {
+            LOGI("Resyncing to the USB frames");
+            resyncs++;
+        }
+        frames = 0;
+        anchors = 0;
+        start_window(now_us);
+    } else {
+        frames += (frame - last_frame) & 0x7ff;
+    }
+    have_sof = true;
+    last_sof_us = now_us;
+    last_frame = frame;
+
+    // How much later than the window's first SOF this one was seen, relative to its frame
+    uint32_t expected_us = ((uint64_t)(frames - window_start_frames) * us_per_frame_q16) >> 16;
+    int32_t lag = (int32_t)(now_us - window_start_us - expected_us);
+    if (!window_has_best || lag < best_lag_us) {
+        window_has_best = true;
+        best_lag_us = lag;
+        best_frames = frames;
+        best_us = now_us;
+        best_frame = frame;
+    }
+
+    if (frames - window_start_frames >= TIME_SYNC_WINDOW_FRAMES) {
+        finish_window();
+        start_window(now_us);
+    }
+}
+
+bool HOT_PATH_FUNC(time_sync_to_frame)(
+    uint32_t local_us, uint16_t *frame, uint16_t *offset_us) {
+    if (anchors < 2) {
+        return false;
+    }
+    // Host microseconds since the anchor's start of frame
+    int64_t host_us =
+        ((int64_t)(int32_t)(local_us - anchor_us) * (TIME_SYNC_FRAME_US << 16)) / us_per_frame_q16;
+    int32_t frames_since = host_us / TIME_SYNC_FRAME_US;
+    int32_t offset = host_us % TIME_SYNC_FRAME_US;
+    if (offset < 0) {
+        offset += TIME_SYNC_FRAME_US;
+        frames_since--;
+    }
+    *frame = (anchor_frame + frames_since) & 0x7ff;
+    *offset_us = offset;
+    return true;
+}
+
+void HOT_PATH_FUNC(time_sync_report_queued)(
+    uint8_t report_id, uint8_t seq, uint32_t event_time_us) {
+    uint32_t now = hal_time_us();
+    tags[next_tag] = (tag_t){
+        .report_id = report_id,
+        .seq = seq,
+        .event_us = event_time_us,
+        .queued_us = now,
+    };
+    next_tag = (next_tag + 1) % TIME_SYNC_TAGS;
+    report_in_flight = true;
+    report_queued_us = now;
+}
+
+static void update_poll_phase(uint32_t now_us) {
+    uint16_t frame, offset_us;
+    if (!time_sync_to_frame(now_us, &frame, &offset_us)) {
+        return;
+    }
+    if (poll_samples == 0) {
+        poll_offset_us = offset_us;
+    }
+    int32_t diff = offset_us - poll_offset_us;
+    if (diff >= TIME_SYNC_FRAME_US / 2) {
+        diff -= TIME_SYNC_FRAME_US;
+    } else if (diff < -TIME_SYNC_FRAME_US / 2) {
+        diff += TIME_SYNC_FRAME_US;
+    }
+    if (poll_samples % TIME_SYNC_POLL_WINDOW == 0 || diff < poll_window_min_us) {
+        poll_window_min_us = diff;
+    }
+    if (++poll_samples % TIME_SYNC_POLL_WINDOW == 0) {
+        poll_offset_us =
+            (poll_offset_us + poll_window_min_us + TIME_SYNC_FRAME_US) % TIME_SYNC_FRAME_US;
+    }
+}
+
+void time_sync_report_complete(uint32_t now_us) {
+    update_poll_phase(now_us);
+
+    // Only the tagged input reports are measured, the other reports use the
+    // same endpoint but one is in flight at a time
+    if (!report_in_flight) {
+        return;
+    }
+    report_in_flight = false;
+    uint32_t wait = now_us - report_queued_us;
+    if (wait > MAX_POLL_WAIT_US) {
+        return;
+    }
+    if (poll_stats.reports == 0 || wait < poll_stats.min_us) {
+        poll_stats.min_us = wait;
+    }
+    if (wait > poll_stats.max_us) {
+        poll_stats.max_us = wait;
+    }
+    poll_stats.reports++;
+    poll_stats.sum_us += wait;
+    poll_stats.sum_sq_us += (uint64_t)wait * wait;
+    uint32_t bucket = wait / TIME_SYNC_POLL_BUCKET_US;
+    bucket = bucket < TIME_SYNC_POLL_BUCKETS ? bucket : TIME_SYNC_POLL_BUCKETS - 1;
+    if (poll_stats.histogram[bucket] < UINT16_MAX) {
+        poll_stats.histogram[bucket]++;
+    }
+}
+
+bool HOT_PATH_FUNC(time_sync_next_poll)(uint32_t now_us, uint32_t *prepare_us) {
+    uint16_t frame, offset_us;
+    if (poll_samples < TIME_SYNC_POLL_WINDOW ||
+        !time_sync_to_frame(now_us, &frame, &offset_us)) {
+        return false;
+    }
+    int32_t until = poll_offset_us - TIME_SYNC_POLL_LEAD_US - offset_us;
+    while (until < MIN_PREPARE_GAP_US) {
+        until += TIME_SYNC_FRAME_US;
+    }
+    // Host microseconds to local ones
+    *prepare_us = now_us + (((uint64_t)until * us_per_frame_q16) / (TIME_SYNC_FRAME_US << 16));
+    return true;
+}
+
+// Frame number in the low half, offset in the high half
+static uint32_t to_frame_or_none(uint32_t local_us) {
+    // Only read when set, but GCC can't tell through the inlined call
+    uint16_t frame = 0, offset_us = 0;
+    if (!time_sync_to_frame(local_us, &frame, &offset_us)) {
+        return NO_FRAME;
+    }
+    return frame | (uint32_t)offset_us << 16;
+}
+
+uint16_t time_sync_get_report(uint8_t *buffer, uint16_t reqlen) {
+    time_sync_report_t rep = {
+        .locked = anchors >= 2,
+        .us_per_frame_q16 = us_per_frame_q16,
+        .sofs = sofs,
+        .resyncs = resyncs,
+    };
+    uint32_t now = to_frame_or_none(hal_time_us());
+    rep.now_frame = now;
+    rep.now_offset_us = now >> 16;
+    for (uint8_t i = 0; i < TIME_SYNC_TAGS; i++) {
+        const tag_t *t = &tags[(next_tag + i) % TIME_SYNC_TAGS];
+        uint32_t event = to_frame_or_none(t->event_us);
+        uint32_t queued = to_frame_or_none(t->queued_us);
+        rep.tags[i] = (time_sync_report_tag_t){
+            .report_id = t->report_id,
+            .seq = t->seq,
+            .event_frame = event,
+            .event_offset_us = event >> 16,
+            .queued_frame = queued,
+            .queued_offset_us = queued >> 16,
+        };
+    }
+
+    uint16_t len = reqlen < sizeof(rep) ? reqlen : sizeof(rep);
+    memcpy(buffer, &rep, len);
+    return len;
+}
+
+void time_sync_handle_poll_report(
+    __attribute__((unused)) const uint8_t *data, __attribute__((unused)) uint16_t len) {
+    LOGI("Resetting the queued-to-poll stats");
+    memset(&poll_stats, 0, sizeof(poll_stats));
+}
+
+uint16_t time_sync_get_poll_report(uint8_t *buffer, uint16_t reqlen) {
+#if defined(MACROPAD_POLL_ALIGN)
+    poll_stats.aligned = true;
+#endif
+    poll_stats.locked = poll_samples >= TIME_SYNC_POLL_WINDOW;
+    poll_stats.poll_offset_us = poll_offset_us;
+    poll_stats.lead_us = TIME_SYNC_POLL_LEAD_US;
+
+    uint16_t len = reqlen < sizeof(poll_stats) ? reqlen : sizeof(poll_stats);
+    memcpy(buffer, &poll_stats, len);
+    return len;
+}
+
+#endif // MACROPAD_TIME_SYNC
@@ -0,0 +1,88 @@
+#if !defined(TIME_SYNC__H)
+#define TIME_SYNC__H
+
+// Maps the local timer to the USB frame clock. The host starts a frame every
+// millisecond by its own clock, so a local time given as frame number and
+// offset into the frame can be converted to host time by the host. Input
+// reports are tagged with the frame times of their input and of their
+// queueing, scripts/time_sync.py uses them to measure latency from the key
+// press to the host application.
+//
+// SOFs are seen from tud_task, a little after they arrive. Each window keeps
+// the SOF seen soonest as the anchor, which leaves only the smallest task
+// latency (tens of microseconds) as a constant bias. Only built with the
+// MACROPAD_TIME_SYNC CMake option, the hooks compile to nothing otherwise.
+//
+// Report completions give where in the frame the host polls the input
+// endpoint. MACROPAD_POLL_ALIGN builds poll every frame and run the HID task
+// just before the poll, so a report doesn't wait a random part of a frame for
+// it. The time from queueing to the poll is measured in both modes.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Payload length of the time sync feature report (excluding the report id)
+#define TIME_SYNC_REPORT_LEN 57
+
+#define TIME_SYNC_FRAME_US 1000
+// SOFs per anchor window
+#define TIME_SYNC_WINDOW_FRAMES 256
+// Reports remembered with their frame times
+#define TIME_SYNC_TAGS 4
+
+// Payload length of the poll phase feature report (excluding the report id)
+#define TIME_SYNC_POLL_REPORT_LEN 54
+// Histogram of the queued-to-poll times, the last bucket takes the rest
+#define TIME_SYNC_POLL_BUCKETS   14
+#define TIME_SYNC_POLL_BUCKET_US 400
+// Report completions per poll phase update
+#define TIME_SYNC_POLL_WINDOW 32
+// How long before the poll the HID task runs in MACROPAD_POLL_ALIGN builds
+#define TIME_SYNC_POLL_LEAD_US 150
+
+#if defined(MACROPAD_POLL_ALIGN) && !defined(MACROPAD_TIME_SYNC)
+#error "MACROPAD_POLL_ALIGN needs MACROPAD_TIME_SYNC"
+#endif
+
+#if defined(MACROPAD_TIME_SYNC)
+
+// A start of frame was seen. Called from tud_task.
+void time_sync_sof(uint32_t frame_count, uint32_t now_us);
+
+// Convert a hal_time_us() timestamp to the 11-bit frame number and
+// microseconds into the frame. Returns false before the mapping is known.
+bool time_sync_to_frame(uint32_t local_us, uint16_t *frame, uint16_t *offset_us);
+
+// An input report caused by input at event_time_us was queued
+void time_sync_report_queued(uint8_t report_id, uint8_t seq, uint32_t event_time_us);
+
+// The host took the last queued input report. Called from tud_task.
+void time_sync_report_complete(uint32_t now_us);
+
+// Time to prepare the next report, TIME_SYNC_POLL_LEAD_US before the next
+// poll. Returns false before the poll phase is known.
+bool time_sync_next_poll(uint32_t now_us, uint32_t *prepare_us);
+
+// Fill a GET_REPORT of the time sync feature report, returns the length
+uint16_t time_sync_get_report(uint8_t *buffer, uint16_t reqlen);
+
+// Handle a SET_REPORT of the poll phase feature report: any payload resets
+// the queued-to-poll stats
+void time_sync_handle_poll_report(const uint8_t *data, uint16_t len);
+
+// Fill a GET_REPORT of the poll phase feature report, returns the length
+uint16_t time_sync_get_poll_report(uint8_t *buffer, uint16_t reqlen);
+
+#else
+
+static inline void time_sync_report_queued(
+    __attribute__((unused)) uint8_t report_id, __attribute__((unused)) uint8_t seq,
+    __attribute__((unused)) uint32_t event_time_us) {
+}
+
+static inline void time_sync_report_complete(__attribute__((unused)) uint32_t now_us) {
+}
+
+#endif // MACROPAD_TIME_SYNC
+
+#endif // TIME_SYNC__H
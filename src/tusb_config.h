@@ -70,11 +70,26 @@
 //------------- CLASS -------------//
 #define CFG_TUD_HID    1
 #define CFG_TUD_CDC    0
-#define CFG_TUD_MSC    0
-#define CFG_TUD_MIDI   0
+#if defined(MACROPAD_MSC)
+#define CFG_TUD_MSC 1
+#else
+#define CFG_TUD_MSC 0
+#endif
+#if defined(MACROPAD_MIDI)
+#define CFG_TUD_MIDI 1
+#else
+#define CFG_TUD_MIDI 0
+#endif
 #define CFG_TUD_VENDOR 0
 
 // HID buffer size Should be sufficient to hold ID (if any) + Data
 #define CFG_TUD_HID_EP_BUFSIZE 64
 
+// One sector of the profile drive
+#define CFG_TUD_MSC_EP_BUFSIZE 512
+
+// A frame's MIDI batch is at most 16 packets, 64 bytes
+#define CFG_TUD_MIDI_RX_BUFSIZE 64
+#define CFG_TUD_MIDI_TX_BUFSIZE 64
+
 #endif // TUSB_CONFIG__H
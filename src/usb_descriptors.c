@@ -3,7 +3,16 @@
 #include "tusb.h"
 #include <stdint.h>
 
+#include "boot_times.h"
 #include "constants.h"
+#include "display_list.h"
+#include "fw_update.h"
+#include "icon_atlas.h"
+#include "key_filter.h"
+#include "keymap.h"
+#include "perf.h"
+#include "scheduler.h"
+#include "time_sync.h"
 #include "usb_hid.h"
 
 /// Device descriptor
@@ -128,11 +137,64 @@ uint16_t const *tud_descriptor_string_cb(uint8_t index, __attribute__((unused))
 // clang-format off
 uint8_t const hid_report_descriptor[] = {
 
+#if defined(MACROPAD_COMBINED_REPORT)
+    // Keys and encoder 1 in one input report, replacing reports 1 and 2
+    HID_USAGE_PAGE(HID_USAGE_PAGE_DESKTOP),
+    HID_USAGE(HID_USAGE_DESKTOP_KEYPAD),
+    HID_COLLECTION(HID_COLLECTION_APPLICATION),
+        HID_REPORT_ID(USB_HID_REPORT_NUM_COMBINED)
+        // 12 bits, one for each key
+        HID_USAGE_PAGE(HID_USAGE_PAGE_KEYBOARD),
+            HID_USAGE_MIN(0x68),
+            HID_USAGE_MAX(0x73),
+            HID_LOGICAL_MIN(0),
+            HID_LOGICAL_MAX(1),
+            HID_REPORT_COUNT(12),
+            HID_REPORT_SIZE(1),
+            HID_INPUT(HID_DATA|HID_VARIABLE|HID_ABSOLUTE),
+
+        // 4 bits for the active layer
+        HID_USAGE_PAGE_N(0xFF00, 2),   // Vendor-defined page
+            HID_USAGE(0x05),           // 5 == layer usage
+            HID_LOGICAL_MIN(0),
+            HID_LOGICAL_MAX(KEYMAP_MAX_LAYERS - 1),
+            HID_REPORT_COUNT(1),
+            HID_REPORT_SIZE(4),
+            HID_INPUT(HID_DATA|HID_VARIABLE|HID_ABSOLUTE),
+
+        // Steps of encoder 1 since the previous report. Encoder 0 drives the UI.
+        HID_USAGE_PAGE(HID_USAGE_PAGE_DESKTOP),
+            HID_USAGE(HID_USAGE_DESKTOP_DIAL),
+            HID_LOGICAL_MIN(-127),
+            HID_LOGICAL_MAX(127),
+            HID_REPORT_COUNT(1),
+            HID_REPORT_SIZE(8),
+            HID_INPUT(HID_DATA|HID_VARIABLE|HID_RELATIVE),
+        HID_USAGE_PAGE(HID_USAGE_PAGE_BUTTON),
+            HID_USAGE(0x01),
+            HID_LOGICAL_MIN(0),
+            HID_LOGICAL_MAX(1),
+            HID_REPORT_COUNT(1),
+            HID_REPORT_SIZE(1),
+            HID_INPUT(HID_DATA|HID_VARIABLE|HID_ABSOLUTE),
+            // 7 bit padding
+            HID_REPORT_COUNT(1),
+            HID_REPORT_SIZE(7),
+            HID_INPUT(HID_CONSTANT),
+        HID_USAGE_PAGE_N(0xFF00, 2),
+            HID_USAGE(0x06),           // Report sequence number
+            HID_LOGICAL_MIN(0),
+            HID_LOGICAL_MAX_N(UINT8_MAX, 2),
+            HID_REPORT_COUNT(1),
+            HID_REPORT_SIZE(8),
+            HID_INPUT(HID_DATA|HID_VARIABLE|HID_ABSOLUTE),
+    HID_COLLECTION_END,
+#else
     // Keypad input report
     HID_USAGE_PAGE(HID_USAGE_PAGE_DESKTOP),
     HID_USAGE(HID_USAGE_DESKTOP_KEYPAD),
     HID_COLLECTION(HID_COLLECTION_APPLICATION),
-        HID_REPORT_ID(1)
+        HID_REPORT_ID(USB_HID_REPORT_NUM_KEYPAD)
         // 12 bits, one for each key
         HID_USAGE_PAGE(HID_USAGE_PAGE_KEYBOARD),
             HID_USAGE_MIN(0x68),
@@ -143,10 +205,21 @@ uint8_t const hid_report_descriptor[] = {
             HID_REPORT_SIZE(1),
             HID_INPUT(HID_DATA|HID_VARIABLE|HID_ABSOLUTE),
             
-            // 4 bit padding
+        // 4 bits for the active layer
+        HID_USAGE_PAGE_N(0xFF00, 2),   // Vendor-defined page
+            HID_USAGE(0x05),           // 5 == layer usage
+            HID_LOGICAL_MIN(0),
+            HID_LOGICAL_MAX(KEYMAP_MAX_LAYERS - 1),
             HID_REPORT_COUNT(1),
             HID_REPORT_SIZE(4),
-            HID_INPUT(HID_CONSTANT),
+            HID_INPUT(HID_DATA|HID_VARIABLE|HID_ABSOLUTE),
+        // Report sequence number, for finding lost reports on the host
+            HID_USAGE(0x06),           // 6 == sequence number usage
+            HID_LOGICAL_MIN(0),
+            HID_LOGICAL_MAX_N(UINT8_MAX, 2),
+            HID_REPORT_COUNT(1),
+            HID_REPORT_SIZE(8),
+            HID_INPUT(HID_DATA|HID_VARIABLE|HID_ABSOLUTE),
 
     HID_COLLECTION_END,
 
@@ -154,7 +227,7 @@ uint8_t const hid_report_descriptor[] = {
     HID_USAGE_PAGE(HID_USAGE_PAGE_DESKTOP),
     HID_USAGE(HID_USAGE_DESKTOP_MULTI_AXIS_CONTROLLER),
     HID_COLLECTION(HID_COLLECTION_APPLICATION),
-        HID_REPORT_ID(2)
+        HID_REPORT_ID(USB_HID_REPORT_NUM_ENCODER)
         HID_USAGE_PAGE(HID_USAGE_PAGE_DESKTOP),
             HID_USAGE(HID_USAGE_DESKTOP_DIAL),
             HID_LOGICAL_MIN(INT8_MIN),
@@ -173,13 +246,100 @@ uint8_t const hid_report_descriptor[] = {
             HID_REPORT_COUNT(1),
             HID_REPORT_SIZE(7),
             HID_INPUT(HID_CONSTANT),
+        HID_USAGE_PAGE_N(0xFF00, 2),
+            HID_USAGE(0x06),           // Report sequence number
+            HID_LOGICAL_MIN(0),
+            HID_LOGICAL_MAX_N(UINT8_MAX, 2),
+            HID_REPORT_COUNT(1),
+            HID_REPORT_SIZE(8),
+            HID_INPUT(HID_DATA|HID_VARIABLE|HID_ABSOLUTE),
+    HID_COLLECTION_END,
+#endif
+
+    // Consumer control, for encoders in volume mode
+    HID_USAGE_PAGE(HID_USAGE_PAGE_CONSUMER),
+    HID_USAGE(HID_USAGE_CONSUMER_CONTROL),
+    HID_COLLECTION(HID_COLLECTION_APPLICATION),
+        HID_REPORT_ID(USB_HID_REPORT_NUM_CONSUMER)
+            HID_LOGICAL_MIN(0x00),
+            HID_LOGICAL_MAX_N(0x03FF, 2),
+            HID_USAGE_MIN(0x00),
+            HID_USAGE_MAX_N(0x03FF, 2),
+            HID_REPORT_COUNT(1),
+            HID_REPORT_SIZE(16),
+            HID_INPUT(HID_DATA|HID_ARRAY|HID_ABSOLUTE),
+    HID_COLLECTION_END,
+
+    // Mouse wheel and horizontal wheel, for encoders in wheel and pan modes.
+    // With the resolution multipliers set by the host, one detent is
+    // USB_HID_WHEEL_RESOLUTION_MULTIPLIER wheel units, sent a quarter step of
+    // the encoder at a time.
+    HID_USAGE_PAGE(HID_USAGE_PAGE_DESKTOP),
+    HID_USAGE(HID_USAGE_DESKTOP_MOUSE),
+    HID_COLLECTION(HID_COLLECTION_APPLICATION),
+        HID_USAGE(HID_USAGE_DESKTOP_POINTER),
+        HID_COLLECTION(HID_COLLECTION_PHYSICAL),
+            HID_REPORT_ID(USB_HID_REPORT_NUM_MOUSE)
+            // X and Y, always 0
+            HID_USAGE(HID_USAGE_DESKTOP_X),
+            HID_USAGE(HID_USAGE_DESKTOP_Y),
+                HID_LOGICAL_MIN(-127),
+                HID_LOGICAL_MAX(127),
+                HID_REPORT_COUNT(2),
+                HID_REPORT_SIZE(8),
+                HID_INPUT(HID_DATA|HID_VARIABLE|HID_RELATIVE),
+
+            HID_COLLECTION(HID_COLLECTION_LOGICAL),
+                HID_USAGE(HID_USAGE_DESKTOP_RESOLUTION_MULTIPLIER),
+                    HID_LOGICAL_MIN(0),
+                    HID_LOGICAL_MAX(1),
+                    HID_PHYSICAL_MIN(1),
+                    HID_PHYSICAL_MAX(USB_HID_WHEEL_RESOLUTION_MULTIPLIER),
+                    HID_REPORT_COUNT(1),
+                    HID_REPORT_SIZE(2),
+                    HID_FEATURE(HID_DATA|HID_VARIABLE|HID_ABSOLUTE),
+                HID_USAGE(HID_USAGE_DESKTOP_WHEEL),
+                    HID_LOGICAL_MIN_N(-32767, 2),
+                    HID_LOGICAL_MAX_N(32767, 2),
+                    HID_PHYSICAL_MIN(0),
+                    HID_PHYSICAL_MAX(0),
+                    HID_REPORT_COUNT(1),
+                    HID_REPORT_SIZE(16),
+                    HID_INPUT(HID_DATA|HID_VARIABLE|HID_RELATIVE),
+            HID_COLLECTION_END,
+
+            HID_COLLECTION(HID_COLLECTION_LOGICAL),
+                HID_USAGE(HID_USAGE_DESKTOP_RESOLUTION_MULTIPLIER),
+                    HID_LOGICAL_MIN(0),
+                    HID_LOGICAL_MAX(1),
+                    HID_PHYSICAL_MIN(1),
+                    HID_PHYSICAL_MAX(USB_HID_WHEEL_RESOLUTION_MULTIPLIER),
+                    HID_REPORT_COUNT(1),
+                    HID_REPORT_SIZE(2),
+                    HID_FEATURE(HID_DATA|HID_VARIABLE|HID_ABSOLUTE),
+                HID_USAGE_PAGE(HID_USAGE_PAGE_CONSUMER),
+                HID_USAGE_N(HID_USAGE_CONSUMER_AC_PAN, 2),
+                    HID_LOGICAL_MIN_N(-32767, 2),
+                    HID_LOGICAL_MAX_N(32767, 2),
+                    HID_PHYSICAL_MIN(0),
+                    HID_PHYSICAL_MAX(0),
+                    HID_REPORT_COUNT(1),
+                    HID_REPORT_SIZE(16),
+                    HID_INPUT(HID_DATA|HID_VARIABLE|HID_RELATIVE),
+            HID_COLLECTION_END,
+
+            // Pad the multipliers to a byte
+            HID_REPORT_COUNT(1),
+            HID_REPORT_SIZE(4),
+            HID_FEATURE(HID_CONSTANT),
+        HID_COLLECTION_END,
     HID_COLLECTION_END,
 
     HID_USAGE_PAGE(0x14),  // Auxiliary display page
     HID_USAGE(0x02),  // Auxiliary display collection
     HID_COLLECTION(HID_COLLECTION_APPLICATION),
         // Active profile name output report
-        HID_REPORT_ID(3)
+        HID_REPORT_ID(USB_HID_REPORT_NUM_PROFILE_NAME)
         HID_USAGE_PAGE_N(0xFF00, 2),   // Vendor-defined page
             HID_USAGE(0x01),           // 1 == profile name usage
             HID_LOGICAL_MIN(0),
@@ -189,7 +349,7 @@ uint8_t const hid_report_descriptor[] = {
             HID_REPORT_ITEM(HID_DATA|HID_VARIABLE|HID_BUFFERED_BYTES, RI_MAIN_OUTPUT, RI_TYPE_MAIN, 2),
 
         // Active profile key names output report
-        HID_REPORT_ID(4)
+        HID_REPORT_ID(USB_HID_REPORT_NUM_KEY_NAMES)
         HID_USAGE_PAGE_N(0xFF00, 2),   // Vendor-defined page
             HID_USAGE(0x02),           // 2 == key name usage
             HID_LOGICAL_MIN(0),
@@ -197,7 +357,170 @@ uint8_t const hid_report_descriptor[] = {
             HID_REPORT_COUNT(MACROPAD_KEY_COUNT),
             HID_REPORT_SIZE(8*MACROPAD_KEY_NAME_LENGTH),
             HID_REPORT_ITEM(HID_DATA|HID_VARIABLE|HID_BUFFERED_BYTES, RI_MAIN_OUTPUT, RI_TYPE_MAIN, 2),
+
+        // Activate a cached profile by its hash
+        HID_REPORT_ID(USB_HID_REPORT_NUM_PROFILE_HASH)
+        HID_USAGE_PAGE_N(0xFF00, 2),   // Vendor-defined page
+            HID_USAGE(0x03),           // 3 == profile hash usage
+            HID_LOGICAL_MIN(0),
+            HID_LOGICAL_MAX(255),
+            HID_REPORT_COUNT(4),
+            HID_REPORT_SIZE(8),
+            HID_FEATURE(HID_DATA|HID_VARIABLE|HID_ABSOLUTE),
+
+        // Profile cache status
+        HID_REPORT_ID(USB_HID_REPORT_NUM_PROFILE_CACHE)
+        HID_USAGE_PAGE_N(0xFF00, 2),   // Vendor-defined page
+            HID_USAGE(0x04),           // 4 == profile cache status usage
+            HID_LOGICAL_MIN(0),
+            HID_LOGICAL_MAX(255),
+            HID_REPORT_COUNT(USB_HID_PROFILE_CACHE_REPORT_LEN),
+            HID_REPORT_SIZE(8),
+            HID_FEATURE(HID_DATA|HID_VARIABLE|HID_ABSOLUTE),
+    HID_COLLECTION_END,
+
+    // Device configuration
+    HID_USAGE_PAGE_N(0xFF00, 2),
+    HID_USAGE(0x20),
+    HID_COLLECTION(HID_COLLECTION_APPLICATION),
+        // Layer and tap-hold key config
+        HID_REPORT_ID(USB_HID_REPORT_NUM_KEYMAP_CONFIG)
+        HID_USAGE(0x21),
+            HID_LOGICAL_MIN(0),
+            HID_LOGICAL_MAX(255),
+            HID_REPORT_COUNT(KEYMAP_CONFIG_REPORT_LEN),
+            HID_REPORT_SIZE(8),
+            HID_FEATURE(HID_DATA|HID_VARIABLE|HID_ABSOLUTE),
+
+        // Encoder modes of the current profile, one byte per encoder
+        HID_REPORT_ID(USB_HID_REPORT_NUM_ENCODER_MODES)
+        HID_USAGE(0x22),
+            HID_LOGICAL_MIN(0),
+            HID_LOGICAL_MAX(255),
+            HID_REPORT_COUNT(2),
+            HID_REPORT_SIZE(8),
+            HID_FEATURE(HID_DATA|HID_VARIABLE|HID_ABSOLUTE),
+
+        // Firmware update: commands (set), status (get)
+        HID_REPORT_ID(USB_HID_REPORT_NUM_FW_UPDATE)
+        HID_USAGE(0x23),
+            HID_LOGICAL_MIN(0),
+            HID_LOGICAL_MAX(255),
+            HID_REPORT_COUNT(FW_UPDATE_REPORT_LEN),
+            HID_REPORT_SIZE(8),
+            HID_FEATURE(HID_DATA|HID_VARIABLE|HID_ABSOLUTE),
+
+        // Suspend and remote wakeup status (get only)
+        HID_REPORT_ID(USB_HID_REPORT_NUM_USB_POWER)
+        HID_USAGE(0x24),
+            HID_LOGICAL_MIN(0),
+            HID_LOGICAL_MAX(255),
+            HID_REPORT_COUNT(USB_HID_USB_POWER_REPORT_LEN),
+            HID_REPORT_SIZE(8),
+            HID_FEATURE(HID_DATA|HID_VARIABLE|HID_ABSOLUTE),
+
+        // Boot milestone times (get only)
+        HID_REPORT_ID(USB_HID_REPORT_NUM_BOOT_TIMES)
+        HID_USAGE(0x25),
+            HID_LOGICAL_MIN(0),
+            HID_LOGICAL_MAX(255),
+            HID_REPORT_COUNT(BOOT_TIMES_REPORT_LEN),
+            HID_REPORT_SIZE(8),
+            HID_FEATURE(HID_DATA|HID_VARIABLE|HID_ABSOLUTE),
+
+        // Display list widgets: operations (set), status (get)
+        HID_REPORT_ID(USB_HID_REPORT_NUM_DISPLAY_LIST)
+        HID_USAGE(0x26),
+            HID_LOGICAL_MIN(0),
+            HID_LOGICAL_MAX(255),
+            HID_REPORT_COUNT(DISPLAY_LIST_REPORT_LEN),
+            HID_REPORT_SIZE(8),
+            HID_FEATURE(HID_DATA|HID_VARIABLE|HID_ABSOLUTE),
+
+        // Key health: bounce counts and debounce times (get), reset (set)
+        HID_REPORT_ID(USB_HID_REPORT_NUM_KEY_HEALTH)
+        HID_USAGE(0x27),
+            HID_LOGICAL_MIN(0),
+            HID_LOGICAL_MAX(255),
+            HID_REPORT_COUNT(KEY_FILTER_REPORT_LEN),
+            HID_REPORT_SIZE(8),
+            HID_FEATURE(HID_DATA|HID_VARIABLE|HID_ABSOLUTE),
+
+        // MIDI notes and controllers of the current profile
+        HID_REPORT_ID(USB_HID_REPORT_NUM_MIDI_MAP)
+        HID_USAGE(0x28),
+            HID_LOGICAL_MIN(0),
+            HID_LOGICAL_MAX(255),
+            HID_REPORT_COUNT(USB_HID_MIDI_MAP_REPORT_LEN),
+            HID_REPORT_SIZE(8),
+            HID_FEATURE(HID_DATA|HID_VARIABLE|HID_ABSOLUTE),
+
+        // Icon atlas upload: commands (set), status (get)
+        HID_REPORT_ID(USB_HID_REPORT_NUM_ICON_ATLAS)
+        HID_USAGE(0x29),
+            HID_LOGICAL_MIN(0),
+            HID_LOGICAL_MAX(255),
+            HID_REPORT_COUNT(ICON_ATLAS_REPORT_LEN),
+            HID_REPORT_SIZE(8),
+            HID_FEATURE(HID_DATA|HID_VARIABLE|HID_ABSOLUTE),
+
+        // Icon atlas indexes of the current profile's keys, one byte per key
+        HID_REPORT_ID(USB_HID_REPORT_NUM_KEY_ICONS)
+        HID_USAGE(0x2A),
+            HID_LOGICAL_MIN(0),
+            HID_LOGICAL_MAX(255),
+            HID_REPORT_COUNT(MACROPAD_KEY_COUNT),
+            HID_REPORT_SIZE(8),
+            HID_FEATURE(HID_DATA|HID_VARIABLE|HID_ABSOLUTE),
+
+        // Scheduler stats: task select and reset (set), one task's stats (get)
+        HID_REPORT_ID(USB_HID_REPORT_NUM_SCHED_STATS)
+        HID_USAGE(0x2B),
+            HID_LOGICAL_MIN(0),
+            HID_LOGICAL_MAX(255),
+            HID_REPORT_COUNT(SCHED_REPORT_LEN),
+            HID_REPORT_SIZE(8),
+            HID_FEATURE(HID_DATA|HID_VARIABLE|HID_ABSOLUTE),
+    HID_COLLECTION_END,
+
+#if defined(MACROPAD_PERF)
+    // Cycle counters: slot select and reset (set), one slot's stats (get)
+    HID_USAGE_PAGE_N(0xFF00, 2),
+    HID_USAGE(0x11),
+    HID_COLLECTION(HID_COLLECTION_APPLICATION),
+        HID_REPORT_ID(USB_HID_REPORT_NUM_PERF)
+        HID_USAGE(0x11),
+            HID_LOGICAL_MIN(0),
+            HID_LOGICAL_MAX(255),
+            HID_REPORT_COUNT(PERF_REPORT_LEN),
+            HID_REPORT_SIZE(8),
+            HID_FEATURE(HID_DATA|HID_VARIABLE|HID_ABSOLUTE),
     HID_COLLECTION_END,
+#endif
+
+#if defined(MACROPAD_TIME_SYNC)
+    // USB frame time of now and of the latest input reports (get)
+    HID_USAGE_PAGE_N(0xFF00, 2),
+    HID_USAGE(0x12),
+    HID_COLLECTION(HID_COLLECTION_APPLICATION),
+        HID_REPORT_ID(USB_HID_REPORT_NUM_TIME_SYNC)
+        HID_USAGE(0x12),
+            HID_LOGICAL_MIN(0),
+            HID_LOGICAL_MAX(255),
+            HID_REPORT_COUNT(TIME_SYNC_REPORT_LEN),
+            HID_REPORT_SIZE(8),
+            HID_FEATURE(HID_DATA|HID_VARIABLE|HID_ABSOLUTE),
+
+        // Poll phase and queued-to-poll stats (get), stats reset (set)
+        HID_REPORT_ID(USB_HID_REPORT_NUM_POLL_PHASE)
+        HID_USAGE(0x13),
+            HID_LOGICAL_MIN(0),
+            HID_LOGICAL_MAX(255),
+            HID_REPORT_COUNT(TIME_SYNC_POLL_REPORT_LEN),
+            HID_REPORT_SIZE(8),
+            HID_FEATURE(HID_DATA|HID_VARIABLE|HID_ABSOLUTE),
+    HID_COLLECTION_END,
+#endif
 };
 
 // clang-format on
@@ -209,29 +532,64 @@ uint8_t const *tud_hid_descriptor_report_cb(__attribute__((unused)) uint8_t inte
 /// Configuration Descriptor
 /// ========================
 
-#define CONFIG_TOTAL_LEN (TUD_CONFIG_DESC_LEN + TUD_HID_DESC_LEN)
+// Interfaces: HID, the profile drive with MACROPAD_MSC, and the MIDI audio
+// control and streaming interfaces with MACROPAD_MIDI
+#define ITF_NUM_HID 0
+#if defined(MACROPAD_MSC)
+#define ITF_NUM_MSC  1
+#define ITF_NUM_MIDI 2
+#define MSC_DESC_LEN TUD_MSC_DESC_LEN
+#else
+#define ITF_NUM_MIDI 1
+#define MSC_DESC_LEN 0
+#endif
+#if defined(MACROPAD_MIDI)
+#define INTERFACE_COUNT (ITF_NUM_MIDI + 2)
+#define MIDI_DESC_LEN   TUD_MIDI_DESC_LEN
+#else
+#define INTERFACE_COUNT ITF_NUM_MIDI
+#define MIDI_DESC_LEN   0
+#endif
+
+#define CONFIG_TOTAL_LEN (TUD_CONFIG_DESC_LEN + TUD_HID_DESC_LEN + MSC_DESC_LEN + MIDI_DESC_LEN)
 
 // MSB: direction IN
 // bits 0-2: device number (0b001)
 #define EPNUM 0x81
 
+// Profile drive bulk endpoints
+#define EPNUM_MSC_OUT 0x02
+#define EPNUM_MSC_IN  0x82
+
+// MIDI bulk endpoints
+#define EPNUM_MIDI_OUT 0x03
+#define EPNUM_MIDI_IN  0x83
+
 uint8_t const configuration_descriptor[] = {
 
     TUD_CONFIG_DESCRIPTOR(
         1, // Configuration number. Only one configuration ==> 1
-        1, // Interface count. Just a single HID interface
+        INTERFACE_COUNT, // HID, and the profile drive and MIDI when built in
         0, // String index. Zero, as no description required
         CONFIG_TOTAL_LEN,
-        0,  // Attributes. None required for this
-        100 // Pull 100mA max
+        TUSB_DESC_CONFIG_ATT_REMOTE_WAKEUP, // A keypress can wake up a suspended host
+        100                                 // Pull 100mA max
         ),
 
-    // Only one interface
     TUD_HID_DESCRIPTOR(
-        0,                     // First interface --> index 0
+        ITF_NUM_HID,           // First interface --> index 0
         0,                     // String index. Again, none required
         HID_ITF_PROTOCOL_NONE, // do not try to conform to a keyboard protocol
-        sizeof(hid_report_descriptor), EPNUM, CFG_TUD_HID_EP_BUFSIZE, 5),
+        sizeof(hid_report_descriptor), EPNUM, CFG_TUD_HID_EP_BUFSIZE, USB_HID_POLL_INTERVAL_MS),
+
+#if defined(MACROPAD_MSC)
+    // Full speed bulk endpoints are 64 bytes
+    TUD_MSC_DESCRIPTOR(ITF_NUM_MSC, 0, EPNUM_MSC_OUT, EPNUM_MSC_IN, 64),
+#endif
+
+#if defined(MACROPAD_MIDI)
+    TUD_MIDI_DESCRIPTOR(ITF_NUM_MIDI, 0, EPNUM_MIDI_OUT, EPNUM_MIDI_IN, 64),
+#endif
 };
 
 uint8_t const *tud_descriptor_configuration_cb(__attribute__((unused)) uint8_t index) {
@@ -1,52 +1,289 @@
 #include "usb_hid.h"
 
+#include "boot_times.h"
 #include "constants.h"
-#include "display_ui.h"
+#include "display_list.h"
+#include "fw_update.h"
+#include "hal.h"
+#include "hot_path.h"
+#include "icon_atlas.h"
+#include "input_bus.h"
+#include "key_filter.h"
+#include "keymap.h"
 #include "log.h"
+#include "perf.h"
 #include "profiles.h"
-#include "tusb.h"
-#include "utils.h"
+#include "scheduler.h"
+#include "time_sync.h"
 
+#include <assert.h>
 #include <stdlib.h>
+#include <string.h>
 
-static volatile uint16_t curr_key_states = 0x0;
-static volatile uint8_t curr_encoder_rot = 0x0;
-static volatile bool curr_encoder_btn = false;
-static volatile bool keypad_dirty = true;
-static volatile bool encoder_dirty = true;
+// Consumer page usages of the volume encoders
+#define CONSUMER_USAGE_MUTE             0x00e2
+#define CONSUMER_USAGE_VOLUME_INCREMENT 0x00e9
+#define CONSUMER_USAGE_VOLUME_DECREMENT 0x00ea
+
+// Position and button of encoder 1 in dial mode. Encoder 0 drives the UI
+// and is never reported as a dial.
+static uint8_t dial_rot = 0;
+static bool dial_button = false;
+static bool keypad_dirty = true;
+static bool encoder_dirty = true;
+// Time of the first input since the last report, for time sync tags
+static uint32_t keypad_input_time_us;
+static uint32_t encoder_input_time_us;
+
+// Encoders in the volume, wheel and pan modes. Detents are collected
+// while a report is waiting for the host's poll and sent together in the
+// next one, so at most one report per poll.
+static int16_t volume_steps = 0;
+static uint8_t mute_taps = 0;
+static uint16_t consumer_usage_down = 0;
+static int16_t wheel_detents = 0;
+static int16_t pan_detents = 0;
+// The same turns in quarter steps, for the high-resolution wheel
+static int16_t wheel_steps = 0;
+static int16_t pan_steps = 0;
+
+// Resolution multiplier feature, set by the host: bits 0-1 wheel, bits 2-3 pan
+static uint8_t resolution_multipliers = 0;
 
 static bool event_sending_enabled = true;
 
-void usb_hid_set_keys(uint16_t key_states) {
-    keypad_dirty = true;
-    curr_key_states = key_states & 0x0fff;
+#if defined(MACROPAD_COMBINED_REPORT)
+// Dial steps not sent yet. The combined report carries up to 127 of them,
+// the rest go in the next one.
+static int16_t dial_steps_pending = 0;
+#endif
+
+// Bus suspend and remote wakeup
+static bool suspended = false;
+static bool remote_wakeup_enabled = false;
+static bool wakeup_requested = false; // By us, waiting for the first report after it
+static uint32_t wakeup_input_time_us; // Time of the input that woke the host up
+
+typedef struct __attribute__((packed)) {
+    uint8_t suspended;
+    uint8_t remote_wakeup_enabled;
+    uint16_t wakeups;                // Remote wakeups requested since boot
+    uint32_t last_wake_to_resume_us; // From the waking input to the host resuming the bus
+    uint32_t last_wake_to_report_us; // From the waking input to the first report delivered
+    uint32_t max_wake_to_report_us;
+} usb_power_report_t;
+
+static_assert(sizeof(usb_power_report_t) == USB_HID_USB_POWER_REPORT_LEN, "length mismatch");
+
+static usb_power_report_t power_status;
+
+// Reads input events from boot onwards
+static input_consumer_t input_consumer = {0};
+
+// Not in the hot path, only called while suspended
+static void request_wakeup(uint32_t input_time_us) {
+    if (!remote_wakeup_enabled || wakeup_requested) {
+        return;
+    }
+    if (hal_usb_remote_wakeup()) {
+        LOGI("Waking up the host");
+        wakeup_requested = true;
+        wakeup_input_time_us = input_time_us;
+        power_status.wakeups++;
+    }
 }
 
-void usb_hid_set_encoder_rotation(uint8_t rot) {
-    encoder_dirty = true;
-    curr_encoder_rot = rot;
+static void HOT_PATH_FUNC(read_input_events)() {
+    uint32_t dropped_before = input_consumer.dropped;
+
+    input_event_t ev;
+    while (input_bus_poll(&input_consumer, &ev)) {
+        if (suspended && ev.type != INPUT_EVENT_PROFILE) {
+            // The input itself is reported once the host has resumed
+            request_wakeup(ev.time_us);
+        }
+        switch (ev.type) {
+        case INPUT_EVENT_KEYS:
+            if (!keypad_dirty) {
+                keypad_input_time_us = ev.time_us;
+            }
+            keypad_dirty |= keymap_process_keys(ev.keys, ev.time_us);
+            break;
+        case INPUT_EVENT_ENCODER:
+            // Encoder 0 drives the UI instead in the none and dial modes
+            switch (prof_get_snapshot()->profile.encoder_modes[ev.index]) {
+            case PROF_ENCODER_MODE_DIAL:
+                // Steps between detents are only for the wheel
+                if (ev.index == 1 && ev.delta != 0) {
+                    if (!encoder_dirty) {
+                        encoder_input_time_us = ev.time_us;
+                    }
+                    encoder_dirty = true;
+                    dial_rot += ev.delta;
+#if defined(MACROPAD_COMBINED_REPORT)
+                    int32_t steps = dial_steps_pending + ev.delta;
+                    dial_steps_pending = steps > INT16_MAX    ? INT16_MAX
+                                         : steps < -INT16_MAX ? -INT16_MAX
+                                                              : steps;
+#endif
+                }
+                break;
+            case PROF_ENCODER_MODE_VOLUME:
+                volume_steps += ev.delta;
+                break;
+            case PROF_ENCODER_MODE_WHEEL:
+                wheel_detents += ev.delta;
+                wheel_steps += ev.steps;
+                break;
+            case PROF_ENCODER_MODE_PAN:
+                pan_detents += ev.delta;
+                pan_steps += ev.steps;
+                break;
+            }
+            break;
+        case INPUT_EVENT_BUTTON: {
+            // Encoder buttons can be layer keys
+            bool layer_key;
+            if (!keypad_dirty) {
+                keypad_input_time_us = ev.time_us;
+            }
+            keypad_dirty |= keymap_process_button(ev.index, ev.pressed, &layer_key);
+            if (layer_key) {
+                break;
+            }
+            uint8_t mode = prof_get_snapshot()->profile.encoder_modes[ev.index];
+            if (mode == PROF_ENCODER_MODE_DIAL && ev.index == 1) {
+                if (!encoder_dirty) {
+                    encoder_input_time_us = ev.time_us;
+                }
+                encoder_dirty = true;
+                dial_button = ev.pressed;
+                HOT_PATH_LOG(LOGD, "encoder button %d", ev.pressed);
+            } else if (mode == PROF_ENCODER_MODE_VOLUME && ev.pressed) {
+                mute_taps++;
+            }
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    if (input_consumer.dropped != dropped_before) {
+        HOT_PATH_LOG(LOGW, "HID lost %lu input events", input_consumer.dropped - dropped_before);
+    }
 }
 
-void usb_hid_set_encoder_button(bool state) {
-    encoder_dirty = true;
-    curr_encoder_btn = state;
-    LOGD("set_encoder_button %d", state);
+typedef struct __attribute__((packed)) {
+    uint32_t current_hash;
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t evictions;
+    uint8_t entries;
+    uint8_t capacity;
+} hid_report_profile_cache_t;
+
+static_assert(
+    sizeof(hid_report_profile_cache_t) == USB_HID_PROFILE_CACHE_REPORT_LEN,
+    "profile cache report length mismatch");
+
+static_assert(
+    sizeof(prof_midi_t) == USB_HID_MIDI_MAP_REPORT_LEN, "MIDI map report length mismatch");
+
+static uint16_t get_profile_cache_report(uint8_t *buffer, uint16_t reqlen) {
+    const prof_cache_stats_t *stats = prof_get_cache_stats();
+    hid_report_profile_cache_t rep = {
+        .current_hash = prof_get_snapshot()->hash,
+        .hits = stats->hits,
+        .misses = stats->misses,
+        .evictions = stats->evictions,
+        .entries = stats->entries,
+        .capacity = PROF_CACHE_SIZE,
+    };
+
+    uint16_t len = reqlen < sizeof(rep) ? reqlen : sizeof(rep);
+    memcpy(buffer, &rep, len);
+    return len;
 }
 
-uint16_t tud_hid_get_report_cb(
-    __attribute__((unused)) uint8_t itf, __attribute__((unused)) uint8_t report_id,
-    __attribute__((unused)) hid_report_type_t report_type, __attribute__((unused)) uint8_t *buffer,
-    __attribute__((unused)) uint16_t reqlen) {
+uint16_t usb_hid_get_report(uint8_t report_id, uint8_t *buffer, uint16_t reqlen) {
+    switch (report_id) {
+    case USB_HID_REPORT_NUM_PROFILE_CACHE:
+        return get_profile_cache_report(buffer, reqlen);
+    case USB_HID_REPORT_NUM_KEYMAP_CONFIG: {
+        uint16_t len = reqlen < KEYMAP_CONFIG_REPORT_LEN ? reqlen : KEYMAP_CONFIG_REPORT_LEN;
+        memcpy(buffer, keymap_get_config(), len);
+        return len;
+    }
+    case USB_HID_REPORT_NUM_MOUSE:
+        if (reqlen < 1) {
+            return 0;
+        }
+        buffer[0] = resolution_multipliers;
+        return 1;
+    case USB_HID_REPORT_NUM_ENCODER_MODES: {
+        const uint8_t *modes = prof_get_snapshot()->profile.encoder_modes;
+        uint16_t len = reqlen < 2 ? reqlen : 2;
+        memcpy(buffer, modes, len);
+        return len;
+    }
+    case USB_HID_REPORT_NUM_MIDI_MAP: {
+        uint16_t len = reqlen < sizeof(prof_midi_t) ? reqlen : sizeof(prof_midi_t);
+        memcpy(buffer, &prof_get_snapshot()->profile.midi, len);
+        return len;
+    }
+    case USB_HID_REPORT_NUM_KEY_ICONS: {
+        const uint8_t *icons = prof_get_snapshot()->profile.key_icons;
+        uint16_t len = reqlen < MACROPAD_KEY_COUNT ? reqlen : MACROPAD_KEY_COUNT;
+        memcpy(buffer, icons, len);
+        return len;
+    }
+    case USB_HID_REPORT_NUM_ICON_ATLAS:
+        return icon_atlas_get_report(buffer, reqlen);
+    case USB_HID_REPORT_NUM_FW_UPDATE:
+        return fw_update_get_report(buffer, reqlen);
+#if defined(MACROPAD_PERF)
+    case USB_HID_REPORT_NUM_PERF:
+        return perf_get_report(buffer, reqlen);
+#endif
+#if defined(MACROPAD_TIME_SYNC)
+    case USB_HID_REPORT_NUM_TIME_SYNC:
+        return time_sync_get_report(buffer, reqlen);
+    case USB_HID_REPORT_NUM_POLL_PHASE:
+        return time_sync_get_poll_report(buffer, reqlen);
+#endif
+    case USB_HID_REPORT_NUM_BOOT_TIMES:
+        return boot_times_get_report(buffer, reqlen);
+    case USB_HID_REPORT_NUM_DISPLAY_LIST:
+        return display_list_get_report(buffer, reqlen);
+    case USB_HID_REPORT_NUM_KEY_HEALTH:
+        return key_filter_get_report(buffer, reqlen);
+    case USB_HID_REPORT_NUM_SCHED_STATS:
+        return sched_get_report(buffer, reqlen);
+    case USB_HID_REPORT_NUM_USB_POWER: {
+        power_status.suspended = suspended;
+        power_status.remote_wakeup_enabled = remote_wakeup_enabled;
+        uint16_t len = reqlen < sizeof(power_status) ? reqlen : sizeof(power_status);
+        memcpy(buffer, &power_status, len);
+        return len;
+    }
+    }
     return 0;
 }
 
-void tud_hid_set_report_cb(
-    __attribute__((unused)) uint8_t itf, uint8_t report_id, hid_report_type_t report_type,
-    uint8_t const *buffer, uint16_t bufsize) {
+static void profile_changed() {
+    input_bus_post(INPUT_SOURCE_MAIN, (input_event_t){.type = INPUT_EVENT_PROFILE});
+    // Show the new profile without waiting for the next frame
+    sched_wake(SCHED_TASK_UI);
+}
 
-    LOGD(
-        "tud_hid_set_report_cb: report_id %hhu, report_type %u, bufsize %hu", report_id,
-        (uint8_t)report_type, bufsize);
+void usb_hid_set_report(uint8_t report_id, const uint8_t *buffer, uint16_t bufsize) {
+    LOGD("usb_hid_set_report: report_id %hhu, bufsize %hu", report_id, bufsize);
+    if (bufsize < 1) {
+        // Not even the report id, the handlers below get bufsize - 1 bytes after it
+        LOGW("Empty report %hhu", report_id);
+        return;
+    }
     char *buf = (char *)calloc(2 * bufsize + 1, sizeof(char));
     for (int i = 0; i < bufsize; i++) {
         snprintf(buf + i * 2, 3, "%02X", buffer[i]);
@@ -54,56 +291,222 @@ void tud_hid_set_report_cb(
     LOGD("%s", buf);
     free(buf);
 
-    if (report_id == 3) {
+    switch (report_id) {
+    case USB_HID_REPORT_NUM_PROFILE_NAME:
         if (bufsize != 1 + MACROPAD_PROFILE_NAME_LENGTH) {
             LOGW("Invalid report 3 (profile name) message, len %d", bufsize);
             return;
         }
         prof_set_current_profile_name((const char *)(buffer + 1));
-        ui_trigger_profile_change();
-    } else if (report_id == 4) {
+        profile_changed();
+        break;
+    case USB_HID_REPORT_NUM_KEY_NAMES:
         if (bufsize != MACROPAD_KEY_NAME_LENGTH * MACROPAD_KEY_COUNT + 1) {
             LOGW("Invalid report 4 (key names) message, len %d", bufsize);
             return;
         }
         prof_set_current_key_names((const char *)(buffer + 1));
+        break;
+    case USB_HID_REPORT_NUM_PROFILE_HASH: {
+        if (bufsize != 1 + sizeof(uint32_t)) {
+            LOGW("Invalid report 6 (profile hash) message, len %d", bufsize);
+            return;
+        }
+        uint32_t hash;
+        memcpy(&hash, buffer + 1, sizeof(hash));
+        // On a miss the host reads the cache report, sees the hash didn't
+        // change and uploads the profile with reports 3 and 4
+        if (prof_activate_by_hash(hash)) {
+            profile_changed();
+        }
+        break;
+    }
+    case USB_HID_REPORT_NUM_KEYMAP_CONFIG: {
+        if (bufsize != 1 + KEYMAP_CONFIG_REPORT_LEN) {
+            LOGW("Invalid report 8 (keymap config) message, len %d", bufsize);
+            return;
+        }
+        keymap_config_t config;
+        memcpy(&config, buffer + 1, sizeof(config));
+        keymap_set_config(&config);
+        keypad_dirty = true;
+        break;
+    }
+    case USB_HID_REPORT_NUM_MOUSE:
+        // Resolution multiplier feature
+        if (bufsize != 2) {
+            LOGW("Invalid report 10 (resolution multiplier) message, len %d", bufsize);
+            return;
+        }
+        resolution_multipliers = buffer[1];
+        LOGI("Resolution multipliers set to 0x%02x", resolution_multipliers);
+        break;
+    case USB_HID_REPORT_NUM_ENCODER_MODES:
+        if (bufsize != 3) {
+            LOGW("Invalid report 11 (encoder modes) message, len %d", bufsize);
+            return;
+        }
+        prof_set_current_encoder_modes(buffer + 1);
+        break;
+    case USB_HID_REPORT_NUM_MIDI_MAP: {
+        if (bufsize != 1 + sizeof(prof_midi_t)) {
+            LOGW("Invalid report 21 (MIDI map) message, len %d", bufsize);
+            return;
+        }
+        prof_midi_t midi;
+        memcpy(&midi, buffer + 1, sizeof(midi));
+        prof_set_current_midi(&midi);
+        break;
+    }
+    case USB_HID_REPORT_NUM_KEY_ICONS:
+        if (bufsize != 1 + MACROPAD_KEY_COUNT) {
+            LOGW("Invalid report 23 (key icons) message, len %d", bufsize);
+            return;
+        }
+        prof_set_current_key_icons(buffer + 1);
+        break;
+    case USB_HID_REPORT_NUM_ICON_ATLAS:
+        icon_atlas_handle_report(buffer + 1, bufsize - 1);
+        break;
+    case USB_HID_REPORT_NUM_FW_UPDATE:
+        fw_update_handle_report(buffer + 1, bufsize - 1);
+        break;
+    case USB_HID_REPORT_NUM_DISPLAY_LIST:
+        display_list_handle_report(buffer + 1, bufsize - 1);
+        // Redraw the changed widgets without waiting for the next frame
+        sched_wake(SCHED_TASK_UI);
+        break;
+    case USB_HID_REPORT_NUM_KEY_HEALTH:
+        key_filter_handle_report(buffer + 1, bufsize - 1);
+        break;
+    case USB_HID_REPORT_NUM_SCHED_STATS:
+        sched_handle_report(buffer + 1, bufsize - 1);
+        break;
+#if defined(MACROPAD_PERF)
+    case USB_HID_REPORT_NUM_PERF:
+        perf_handle_report(buffer + 1, bufsize - 1);
+        break;
+#endif
+#if defined(MACROPAD_TIME_SYNC)
+    case USB_HID_REPORT_NUM_POLL_PHASE:
+        time_sync_handle_poll_report(buffer + 1, bufsize - 1);
+        break;
+#endif
     }
 }
 
 typedef struct __attribute__((packed)) {
-    uint16_t keys;
+    uint16_t keys; // Bits 0-11: keys, bits 12-15: layer
+    uint8_t seq;
 } hid_report_keypad_t;
 
 typedef struct __attribute__((packed)) {
     uint8_t encoder_rot;
     uint8_t button;
+    uint8_t seq;
 } hid_report_encoder_t;
 
-static void send_keyboard_hid_report() {
-    if (!tud_hid_ready()) {
+typedef struct __attribute__((packed)) {
+    uint16_t keys; // Bits 0-11: keys, bits 12-15: layer
+    int8_t dial_steps;
+    uint8_t button;
+    uint8_t seq;
+} hid_report_combined_t;
+
+// Sequence numbers of the keypad (or combined) and encoder reports. Only
+// reports the USB stack took use up a number, so a gap on the host is a
+// report lost after that. Failed sends are retried, or show up as merges.
+static uint8_t keypad_seq = 0;
+#if !defined(MACROPAD_COMBINED_REPORT)
+static uint8_t encoder_seq = 0;
+#endif
+
+typedef struct __attribute__((packed)) {
+    uint16_t usage;
+} hid_report_consumer_t;
+
+typedef struct __attribute__((packed)) {
+    int8_t x; // Always 0, some hosts don't accept a mouse without a pointer
+    int8_t y;
+    int16_t wheel;
+    int16_t pan;
+} hid_report_mouse_t;
+
+#if defined(MACROPAD_COMBINED_REPORT)
+// Keys and dials in one report, so changes to both reach the host in the same poll
+static void HOT_PATH_FUNC(send_combined_hid_report)() {
+    if (!hal_hid_ready()) {
         return;
     }
 
-    if (!keypad_dirty) {
+    if (!keypad_dirty && !encoder_dirty) {
         return;
     }
 
-    hid_report_keypad_t rep = {.keys = curr_key_states};
+    // Tagged with the earlier input of the two
+    uint32_t input_time_us = keypad_input_time_us;
+    if (!keypad_dirty ||
+        (encoder_dirty && (int32_t)(encoder_input_time_us - keypad_input_time_us) < 0)) {
+        input_time_us = encoder_input_time_us;
+    }
+
+    int8_t steps = dial_steps_pending > INT8_MAX    ? INT8_MAX
+                   : dial_steps_pending < -INT8_MAX ? -INT8_MAX
+                                                    : dial_steps_pending;
+    hid_report_combined_t rep = {
+        .keys = keymap_get_keys() | (keymap_get_layer() << 12),
+        .dial_steps = steps,
+        .button = dial_button,
+    };
+    HOT_PATH_LOG(
+        LOGD, "Sending keys: 0x%04x, dial: %d, button: %d", rep.keys, rep.dial_steps,
+        rep.button);
 
-    keypad_dirty = false;
-    LOGD("Sending keys: 0x%03x", rep.keys);
+    if (event_sending_enabled) {
+        rep.seq = keypad_seq;
+        if (!hal_hid_report(USB_HID_REPORT_NUM_COMBINED, &rep, sizeof(rep))) {
+            // Nothing is marked as sent, the next run tries again
+            HOT_PATH_LOG(LOGW, "Failed to send combined report");
+            return;
+        }
+        keypad_seq++;
+        time_sync_report_queued(USB_HID_REPORT_NUM_COMBINED, rep.seq, input_time_us);
+    }
+
+    keypad_dirty = keymap_report_sent();
+    dial_steps_pending -= steps;
+    encoder_dirty = dial_steps_pending != 0;
+}
+#else
+static void HOT_PATH_FUNC(send_keyboard_hid_report)() {
+    if (!hal_hid_ready()) {
+        return;
+    }
 
-    if (!event_sending_enabled) {
+    if (!keypad_dirty) {
         return;
     }
-    bool send_report_res = tud_hid_n_report(0, 1, &rep, sizeof(rep));
-    if (!send_report_res) {
-        LOGW("Failed to send keyboard report");
+
+    hid_report_keypad_t rep = {.keys = keymap_get_keys() | (keymap_get_layer() << 12)};
+    HOT_PATH_LOG(LOGD, "Sending keys: 0x%04x", rep.keys);
+
+    if (event_sending_enabled) {
+        rep.seq = keypad_seq;
+        if (!hal_hid_report(USB_HID_REPORT_NUM_KEYPAD, &rep, sizeof(rep))) {
+            // Still dirty, taps included, so the next run tries again
+            HOT_PATH_LOG(LOGW, "Failed to send keyboard report");
+            return;
+        }
+        keypad_seq++;
+        time_sync_report_queued(USB_HID_REPORT_NUM_KEYPAD, rep.seq, keypad_input_time_us);
     }
+
+    // A tap needs another report to release the key
+    keypad_dirty = keymap_report_sent();
 }
 
-static void send_encoder_hid_report() {
-    if (!tud_hid_ready()) {
+static void HOT_PATH_FUNC(send_encoder_hid_report)() {
+    if (!hal_hid_ready()) {
         return;
     }
 
@@ -111,40 +514,173 @@ static void send_encoder_hid_report() {
         return;
     }
 
-    LOGD("send_encoder_hid_report: curr_encoder_btn: %d", curr_encoder_btn);
+    hid_report_encoder_t rep = {.encoder_rot = dial_rot, .button = dial_button};
+    HOT_PATH_LOG(LOGD, "Sending encoder: 0x%02x, button: 0x%02x", rep.encoder_rot, rep.button);
 
-    hid_report_encoder_t rep = {
-        .encoder_rot = curr_encoder_rot, .button = curr_encoder_btn ? 0x01 : 0x00};
+    if (event_sending_enabled) {
+        rep.seq = encoder_seq;
+        if (!hal_hid_report(USB_HID_REPORT_NUM_ENCODER, &rep, sizeof(rep))) {
+            // Still dirty, the next run tries again
+            HOT_PATH_LOG(LOGW, "Failed to send encoder report");
+            return;
+        }
+        encoder_seq++;
+        time_sync_report_queued(USB_HID_REPORT_NUM_ENCODER, rep.seq, encoder_input_time_us);
+    }
 
     encoder_dirty = false;
-    LOGD("Sending encoder: 0x%02x, button: 0x%02x", rep.encoder_rot, rep.button);
+}
+#endif
 
-    if (!event_sending_enabled) {
+// Volume steps and mutes are sent as a press in one report and a release in the next
+static void HOT_PATH_FUNC(send_consumer_hid_report)() {
+    if (!hal_hid_ready()) {
         return;
     }
-    bool send_report_res = tud_hid_n_report(0, 2, &rep, sizeof(rep));
-    if (!send_report_res) {
-        LOGW("Failed to send encoder report");
+
+    uint16_t usage = 0;
+    if (consumer_usage_down == 0) {
+        if (mute_taps > 0) {
+            usage = CONSUMER_USAGE_MUTE;
+        } else if (volume_steps > 0) {
+            usage = CONSUMER_USAGE_VOLUME_INCREMENT;
+        } else if (volume_steps < 0) {
+            usage = CONSUMER_USAGE_VOLUME_DECREMENT;
+        } else {
+            return;
+        }
     }
+
+    hid_report_consumer_t rep = {.usage = usage};
+    if (event_sending_enabled &&
+        !hal_hid_report(USB_HID_REPORT_NUM_CONSUMER, &rep, sizeof(rep))) {
+        // Nothing pressed or released yet, the next run tries again
+        HOT_PATH_LOG(LOGW, "Failed to send consumer report");
+        return;
+    }
+
+    consumer_usage_down = usage;
+    switch (usage) {
+    case CONSUMER_USAGE_MUTE:
+        mute_taps--;
+        break;
+    case CONSUMER_USAGE_VOLUME_INCREMENT:
+        volume_steps--;
+        break;
+    case CONSUMER_USAGE_VOLUME_DECREMENT:
+        volume_steps++;
+        break;
+    }
+}
+
+// Wheel units of a turn: detents, or with the resolution multiplier set, every
+// quarter step a fraction of a detent
+static int16_t HOT_PATH_FUNC(wheel_units)(int16_t detents, int16_t steps, bool high_resolution) {
+    int32_t value = high_resolution ? steps * (USB_HID_WHEEL_RESOLUTION_MULTIPLIER /
+                                               INPUT_ENCODER_STEPS_PER_DETENT)
+                                    : detents;
+    if (value > INT16_MAX) {
+        return INT16_MAX;
+    }
+    if (value < -INT16_MAX) {
+        return -INT16_MAX;
+    }
+    return value;
 }
 
-void hid_task() {
-    const uint8_t REPORT_SEND_INTERVAL_MS = 10;
+static void HOT_PATH_FUNC(send_mouse_hid_report)() {
+    if (!hal_hid_ready()) {
+        return;
+    }
 
-    static absolute_time_t next_send_time = {0};
+    if (wheel_steps == 0 && pan_steps == 0 && wheel_detents == 0 && pan_detents == 0) {
+        return;
+    }
 
-    if (!time_passed(next_send_time)) {
+    hid_report_mouse_t rep = {
+        .wheel = wheel_units(wheel_detents, wheel_steps, resolution_multipliers & 0x3),
+        .pan = wheel_units(pan_detents, pan_steps, (resolution_multipliers >> 2) & 0x3),
+    };
+    // Nothing to send for steps short of a detent at low resolution, or a turn
+    // back to where the last report left off
+    bool moved = rep.wheel != 0 || rep.pan != 0;
+    if (moved && event_sending_enabled &&
+        !hal_hid_report(USB_HID_REPORT_NUM_MOUSE, &rep, sizeof(rep))) {
+        // The detents are sent with the ones that come in until the next run
+        HOT_PATH_LOG(LOGW, "Failed to send mouse report");
         return;
     }
-    next_send_time = delayed_by_ms(next_send_time, REPORT_SEND_INTERVAL_MS);
 
+    wheel_detents = 0;
+    pan_detents = 0;
+    wheel_steps = 0;
+    pan_steps = 0;
+}
+
+// Run by the scheduler every USB_HID_REPORT_INTERVAL_US
+void HOT_PATH_FUNC(hid_task)() {
+    read_input_events();
+    keypad_dirty |= keymap_tick(hal_time_us());
+
+#if defined(MACROPAD_COMBINED_REPORT)
+    send_combined_hid_report();
+#else
     send_keyboard_hid_report();
     send_encoder_hid_report();
+#endif
+    send_consumer_hid_report();
+    send_mouse_hid_report();
+
+    uint32_t next_run = hal_time_us() + USB_HID_REPORT_INTERVAL_US;
+#if defined(MACROPAD_POLL_ALIGN)
+    if (time_sync_next_poll(hal_time_us(), &next_run)) {
+        sched_set_deadline(SCHED_TASK_HID, next_run);
+    }
+#endif
+    // Report a tap-hold key as held right when its tapping term ends
+    uint32_t tap_deadline;
+    if (keymap_next_deadline(&tap_deadline) && (int32_t)(tap_deadline - next_run) < 0) {
+        sched_set_deadline(SCHED_TASK_HID, tap_deadline);
+    }
 }
 
-void tud_hid_report_complete_cb(
-    __attribute__((unused)) uint8_t interface, __attribute__((unused)) uint8_t const *report,
-    __attribute__((unused)) uint8_t len) {
+void usb_hid_report_complete() {
+    time_sync_report_complete(hal_time_us());
+    boot_times_mark(BOOT_MILESTONE_FIRST_REPORT);
+    // The endpoint is free again, send what came in while it was busy
+    if (keypad_dirty || encoder_dirty || consumer_usage_down != 0 || mute_taps > 0 ||
+        volume_steps != 0 || wheel_detents != 0 || pan_detents != 0 || wheel_steps != 0 ||
+        pan_steps != 0) {
+        sched_wake(SCHED_TASK_HID);
+    }
+    if (!wakeup_requested) {
+        return;
+    }
+    // The first report the host received after we woke it up
+    wakeup_requested = false;
+    uint32_t latency = hal_time_us() - wakeup_input_time_us;
+    power_status.last_wake_to_report_us = latency;
+    if (latency > power_status.max_wake_to_report_us) {
+        power_status.max_wake_to_report_us = latency;
+    }
+    LOGI(
+        "Wakeup to first report took %lu us (bus resumed after %lu us)", latency,
+        power_status.last_wake_to_resume_us);
+}
+
+void usb_hid_suspend(bool remote_wakeup_en) {
+    suspended = true;
+    remote_wakeup_enabled = remote_wakeup_en;
+    wakeup_requested = false;
+}
+
+void usb_hid_resume() {
+    suspended = false;
+    if (wakeup_requested) {
+        power_status.last_wake_to_resume_us = hal_time_us() - wakeup_input_time_us;
+        // Make sure a report follows even if the waking input doesn't produce one
+        keypad_dirty = true;
+    }
 }
 
 bool usb_hid_is_event_sending_enabled() {
@@ -4,16 +4,68 @@
 #include <stdbool.h>
 #include <stdint.h>
 
-#define USB_HID_REPORT_NUM_KEYPAD  1
-#define USB_HID_REPORT_NUM_ENCODER 2
+#define USB_HID_REPORT_NUM_KEYPAD       1
+#define USB_HID_REPORT_NUM_ENCODER      2
+#define USB_HID_REPORT_NUM_PROFILE_NAME 3
+#define USB_HID_REPORT_NUM_KEY_NAMES    4
+#define USB_HID_REPORT_NUM_PROFILE_HASH  6
+#define USB_HID_REPORT_NUM_PROFILE_CACHE 7
+#define USB_HID_REPORT_NUM_KEYMAP_CONFIG 8
+#define USB_HID_REPORT_NUM_CONSUMER      9
+#define USB_HID_REPORT_NUM_MOUSE         10
+#define USB_HID_REPORT_NUM_ENCODER_MODES 11
+#define USB_HID_REPORT_NUM_FW_UPDATE     12
+#define USB_HID_REPORT_NUM_PERF          13
+#define USB_HID_REPORT_NUM_USB_POWER     14
+#define USB_HID_REPORT_NUM_BOOT_TIMES    15
+#define USB_HID_REPORT_NUM_COMBINED      16
+#define USB_HID_REPORT_NUM_DISPLAY_LIST  17
+#define USB_HID_REPORT_NUM_KEY_HEALTH    18
+#define USB_HID_REPORT_NUM_TIME_SYNC     19
+#define USB_HID_REPORT_NUM_POLL_PHASE    20
+#define USB_HID_REPORT_NUM_MIDI_MAP      21
+#define USB_HID_REPORT_NUM_ICON_ATLAS    22
+#define USB_HID_REPORT_NUM_KEY_ICONS     23
+#define USB_HID_REPORT_NUM_SCHED_STATS   24
+
+// Wheel units per detent once the host enables high-resolution scrolling, sent
+// a quarter step at a time
+#define USB_HID_WHEEL_RESOLUTION_MULTIPLIER 120
+
+// Payload length of the profile cache status feature report
+#define USB_HID_PROFILE_CACHE_REPORT_LEN 18
+
+// Payload length of the suspend and remote wakeup status feature report
+#define USB_HID_USB_POWER_REPORT_LEN 16
+
+// Payload length of the MIDI map feature report, a prof_midi_t
+#define USB_HID_MIDI_MAP_REPORT_LEN 17
+
+#if defined(MACROPAD_POLL_ALIGN)
+// Polled every frame, the HID task runs just before each poll once the phase is known
+#define USB_HID_POLL_INTERVAL_MS   1
+#define USB_HID_REPORT_INTERVAL_US 1000
+#else
+#define USB_HID_POLL_INTERVAL_MS   5
+#define USB_HID_REPORT_INTERVAL_US 10000
+#endif
 
 void hid_task();
 
-void usb_hid_set_keys(uint16_t key_states);
+// GET_REPORT of a feature report, returns the length written to buffer
+uint16_t usb_hid_get_report(uint8_t report_id, uint8_t *buffer, uint16_t reqlen);
+
+// SET_REPORT of a feature report. The buffer starts with the report id.
+void usb_hid_set_report(uint8_t report_id, const uint8_t *buffer, uint16_t bufsize);
+
+// The host has read the last input report
+void usb_hid_report_complete();
 
-void usb_hid_set_encoder_rotation(uint8_t rot);
+// The host suspended the bus. Input is kept and reported after resuming; with
+// remote_wakeup_enabled, the first input wakes the host up.
+void usb_hid_suspend(bool remote_wakeup_enabled);
 
-void usb_hid_set_encoder_button(bool state);
+void usb_hid_resume();
 
 bool usb_hid_is_event_sending_enabled();
 
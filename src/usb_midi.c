@@ -0,0 +1,205 @@
+#if defined(MACROPAD_MIDI)
+
+#include "usb_midi.h"
+
+#include "constants.h"
+#include "input_bus.h"
+#include "log.h"
+#include "profiles.h"
+#include "tusb.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#define NOTE_OFF       0x80
+#define NOTE_ON        0x90
+#define CONTROL_CHANGE 0xb0
+#define ON_VELOCITY    127
+#define OFF_VELOCITY   64
+
+// Note bits: keys 0-11, then the encoder buttons
+#define KEYS_MASK         ((1 << MACROPAD_KEY_COUNT) - 1)
+#define BUTTON_BIT(index) (1 << (MACROPAD_KEY_COUNT + (index)))
+#define NOTE_BITS         (MACROPAD_KEY_COUNT + 2)
+
+// Every note changing and both encoders turning, three bytes each.
+// 16 USB MIDI packets, one full speed bulk packet.
+#define BATCH_MAX_MESSAGES (NOTE_BITS + 2)
+#define BATCH_MAX_LEN      (3 * BATCH_MAX_MESSAGES)
+
+static input_consumer_t input_consumer;
+
+// The map the sounding notes were sent with
+static prof_midi_t map;
+static uint32_t map_generation;
+
+static uint16_t held = 0;     // Keys and buttons down at the end of the frame
+static uint16_t sounding = 0; // Note on sent
+static uint16_t muted = 0;    // Held over a map change, silent until released
+static int16_t steps[2] = {0};
+
+static uint8_t batch[BATCH_MAX_LEN];
+static uint8_t batch_len;
+
+// What each message in the batch changes, applied once it's written
+typedef struct {
+    uint8_t status;
+    uint8_t bit;  // Note bit, or the encoder of a control change
+    int8_t steps; // Control change
+} batch_change_t;
+
+static batch_change_t changes[BATCH_MAX_MESSAGES];
+
+static void read_input_events() {
+    uint32_t dropped_before = input_consumer.dropped;
+
+    input_event_t ev;
+    while (input_bus_poll(&input_consumer, &ev)) {
+        switch (ev.type) {
+        case INPUT_EVENT_KEYS:
+            held = (held & ~KEYS_MASK) | (ev.keys & KEYS_MASK);
+            break;
+        case INPUT_EVENT_ENCODER:
+            steps[ev.index] += ev.delta;
+            break;
+        case INPUT_EVENT_BUTTON:
+            if (ev.pressed) {
+                held |= BUTTON_BIT(ev.index);
+            } else {
+                held &= ~BUTTON_BIT(ev.index);
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    if (input_consumer.dropped != dropped_before) {
+        LOGW("MIDI lost %lu input events", input_consumer.dropped - dropped_before);
+    }
+}
+
+static void apply_change(const batch_change_t *c) {
+    switch (c->status) {
+    case NOTE_OFF:
+        sounding &= ~(1 << c->bit);
+        break;
+    case NOTE_ON:
+        sounding |= 1 << c->bit;
+        break;
+    case CONTROL_CHANGE:
+        steps[c->bit] -= c->steps;
+        break;
+    }
+}
+
+static void add_message(batch_change_t change, uint8_t data1, uint8_t data2) {
+    changes[batch_len / 3] = change;
+    batch[batch_len++] = change.status | map.channel;
+    batch[batch_len++] = data1;
+    batch[batch_len++] = data2;
+}
+
+static uint8_t note_of(uint8_t bit) {
+    return bit < MACROPAD_KEY_COUNT ? map.key_notes[bit]
+                                    : map.button_notes[bit - MACROPAD_KEY_COUNT];
+}
+
+static void add_notes(uint16_t bits, uint8_t status, uint8_t velocity) {
+    for (uint8_t bit = 0; bit < NOTE_BITS; bit++) {
+        if (!(bits & (1 << bit))) {
+            continue;
+        }
+        batch_change_t change = {.status = status, .bit = bit};
+        uint8_t note = note_of(bit);
+        if (note == PROF_MIDI_NONE) {
+            // Nothing to send, it's just kept track of
+            apply_change(&change);
+        } else {
+            add_message(change, note, velocity);
+        }
+    }
+}
+
+static void add_steps(uint8_t index) {
+    uint8_t cc = map.encoder_ccs[index];
+    if (cc == PROF_MIDI_NONE) {
+        steps[index] = 0;
+        return;
+    }
+    int16_t s = steps[index];
+    s = s > USB_MIDI_MAX_STEPS ? USB_MIDI_MAX_STEPS : s;
+    s = s < -USB_MIDI_MAX_STEPS ? -USB_MIDI_MAX_STEPS : s;
+    if (s != 0) {
+        batch_change_t change = {.status = CONTROL_CHANGE, .bit = index, .steps = s};
+        add_message(change, cc, s & 0x7f);
+    }
+}
+
+void usb_midi_init() {
+    input_bus_subscribe(&input_consumer);
+    const prof_snapshot_t *snapshot = prof_get_snapshot();
+    map = snapshot->profile.midi;
+    map_generation = snapshot->generation;
+}
+
+void usb_midi_task() {
+    read_input_events();
+
+    // Nothing listens to the host's MIDI, drop it to keep the endpoint going
+    uint8_t packet[4];
+    while (tud_midi_available()) {
+        tud_midi_packet_read(packet);
+    }
+
+    if (!tud_midi_mounted()) {
+        // Don't play what happened while nobody was listening
+        muted = held;
+        sounding = 0;
+        steps[0] = steps[1] = 0;
+        return;
+    }
+
+    batch_len = 0;
+    bool releasing = false;
+    const prof_snapshot_t *snapshot = prof_get_snapshot();
+    if (snapshot->generation != map_generation) {
+        if (memcmp(&snapshot->profile.midi, &map, sizeof(map)) == 0) {
+            map_generation = snapshot->generation;
+        } else if (sounding != 0) {
+            // Release with the old map first, the new one may have other notes
+            // or channel. Switched once all the note offs are out.
+            add_notes(sounding, NOTE_OFF, OFF_VELOCITY);
+            releasing = true;
+        } else {
+            map_generation = snapshot->generation;
+            map = snapshot->profile.midi;
+            muted = held;
+        }
+    }
+
+    if (!releasing) {
+        muted &= held;
+        add_notes(sounding & ~held, NOTE_OFF, OFF_VELOCITY);
+        add_notes(held & ~sounding & ~muted, NOTE_ON, ON_VELOCITY);
+        add_steps(0);
+        add_steps(1);
+    }
+
+    if (batch_len == 0) {
+        return;
+    }
+    // One write, so the whole batch goes out in the same bulk transfer. The
+    // stream only takes a message when its whole packet fits in the FIFO, so
+    // the ones that didn't fit are sent again from the state next frame.
+    uint32_t written = tud_midi_stream_write(0, batch, batch_len);
+    for (uint8_t i = 0; i < written / 3; i++) {
+        apply_change(&changes[i]);
+    }
+    if (written < batch_len) {
+        LOGW("MIDI host not reading, %lu bytes left for the next frame", batch_len - written);
+    }
+}
+
+#endif // MACROPAD_MIDI
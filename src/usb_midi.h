@@ -0,0 +1,27 @@
+#if !defined(USB_MIDI__H)
+#define USB_MIDI__H
+
+// USB MIDI interface next to the HID one, so audio and video software gets the
+// keys and encoders without a host daemon translating them. Keys and encoder
+// buttons send note on while pressed and note off when released, encoder
+// rotation sends relative control changes in two's complement (1-63 steps
+// clockwise, 127-65 counterclockwise). The notes, controllers and channel come
+// from the current profile's MIDI map. Only built with the MACROPAD_MIDI CMake
+// option.
+//
+// Everything that changed during a USB frame goes out as one batch at the next
+// start of frame, with the steps of each encoder summed into one message.
+
+#if defined(MACROPAD_MIDI)
+
+// Steps of one encoder in one control change, the rest go in the next batch
+#define USB_MIDI_MAX_STEPS 63
+
+void usb_midi_init();
+
+// Send the batch of the past frame. Woken on every start of frame.
+void usb_midi_task();
+
+#endif // MACROPAD_MIDI
+
+#endif // USB_MIDI__H
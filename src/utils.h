@@ -1,8 +1,15 @@
 #if !defined(UTILS__H)
 #define UTILS__H
 
-#include "pico/stdlib.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
-bool time_passed(absolute_time_t time);
+// Whether a hal_time_us() deadline has passed. Deadlines must be less than
+// half the 32-bit wrap (about 35 minutes) away.
+bool time_passed(uint32_t deadline_us);
+
+// CRC-32 as used by zlib. Start with crc 0, or continue from a previous result.
+uint32_t crc32(const void *data, size_t len, uint32_t crc);
 
 #endif // UTILS__H
@@ -0,0 +1,82 @@
+#if !defined(U8G2_H)
+#define U8G2_H
+
+// Recording stand-in for u8g2 in the host tests. Drawing keeps a log of the
+// strings drawn since the last u8g2_ClearBuffer, and counts the transfers to
+// the display, which goes through the byte callback like the real one.
+
+#include "u8x8.h"
+
+#include <stdbool.h>
+
+typedef uint16_t u8g2_uint_t;
+
+typedef struct u8g2_struct {
+    u8x8_t u8x8;
+} u8g2_t;
+
+typedef struct {
+    int rotation;
+} u8g2_cb_t;
+
+extern const u8g2_cb_t u8g2_cb_r0;
+#define U8G2_R0 (&u8g2_cb_r0)
+
+#define U8G2_FAKE_STRINGS    32
+#define U8G2_FAKE_STRING_LEN 32
+
+typedef struct {
+    char strings[U8G2_FAKE_STRINGS][U8G2_FAKE_STRING_LEN];
+    uint8_t string_font_modes[U8G2_FAKE_STRINGS]; // font_mode each string was drawn in
+    uint8_t string_count;
+    uint16_t buffers_sent;
+    uint16_t areas_updated;
+    bool power_save;
+    uint8_t font_mode; // 1: transparent
+    uint8_t draw_color;
+} u8g2_fake_t;
+
+extern u8g2_fake_t u8g2_fake;
+
+// Whether the string was drawn since the last u8g2_ClearBuffer
+bool u8g2_fake_drew(const char *str);
+
+// Whether the string was drawn since the last u8g2_ClearBuffer with a solid
+// background, in font mode 0
+bool u8g2_fake_drew_solid(const char *str);
+
+void u8g2_Setup_ssd1306_i2c_128x32_univision_f(
+    u8g2_t *u8g2, const u8g2_cb_t *rotation, u8x8_msg_cb byte_cb, u8x8_msg_cb gpio_and_delay_cb);
+
+#define u8g2_InitDisplay(u8g2) u8x8_InitDisplay(&(u8g2)->u8x8)
+#define u8g2_GetU8x8(u8g2)     (&(u8g2)->u8x8)
+
+void u8g2_SetPowerSave(u8g2_t *u8g2, uint8_t is_enable);
+void u8g2_ClearBuffer(u8g2_t *u8g2);
+void u8g2_SendBuffer(u8g2_t *u8g2);
+void u8g2_UpdateDisplayArea(u8g2_t *u8g2, uint8_t tx, uint8_t ty, uint8_t tw, uint8_t th);
+
+void u8g2_SetDrawColor(u8g2_t *u8g2, uint8_t color);
+void u8g2_SetFont(u8g2_t *u8g2, const uint8_t *font);
+void u8g2_SetFontMode(u8g2_t *u8g2, uint8_t is_transparent);
+
+u8g2_uint_t u8g2_DrawGlyph(u8g2_t *u8g2, u8g2_uint_t x, u8g2_uint_t y, uint16_t encoding);
+u8g2_uint_t u8g2_DrawStr(u8g2_t *u8g2, u8g2_uint_t x, u8g2_uint_t y, const char *str);
+void u8g2_DrawBox(u8g2_t *u8g2, u8g2_uint_t x, u8g2_uint_t y, u8g2_uint_t w, u8g2_uint_t h);
+void u8g2_DrawFrame(u8g2_t *u8g2, u8g2_uint_t x, u8g2_uint_t y, u8g2_uint_t w, u8g2_uint_t h);
+void u8g2_DrawXBM(
+    u8g2_t *u8g2, u8g2_uint_t x, u8g2_uint_t y, u8g2_uint_t w, u8g2_uint_t h,
+    const uint8_t *bitmap);
+
+// Every font is 6 pixels wide, 8 up and 2 down from the baseline
+u8g2_uint_t u8g2_GetStrWidth(u8g2_t *u8g2, const char *str);
+int8_t u8g2_GetAscent(u8g2_t *u8g2);
+int8_t u8g2_GetDescent(u8g2_t *u8g2);
+#define u8g2_GetMaxCharWidth(u8g2) 6
+
+extern const uint8_t u8g2_font_t0_11_mr[];
+extern const uint8_t u8g2_font_t0_14_mr[];
+extern const uint8_t u8g2_font_4x6_mr[];
+extern const uint8_t u8g2_font_streamline_computers_devices_electronics_t[];
+
+#endif // U8G2_H
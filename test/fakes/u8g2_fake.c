@@ -0,0 +1,149 @@
+#include "u8g2.h"
+
+#include <string.h>
+
+#define DISPLAY_I2C_ADDRESS 0x3c
+
+u8g2_fake_t u8g2_fake;
+
+const u8g2_cb_t u8g2_cb_r0 = {0};
+
+const uint8_t u8g2_font_t0_11_mr[] = {0};
+const uint8_t u8g2_font_t0_14_mr[] = {0};
+const uint8_t u8g2_font_4x6_mr[] = {0};
+const uint8_t u8g2_font_streamline_computers_devices_electronics_t[] = {0};
+
+static const u8x8_display_info_t display_info = {
+    .post_reset_wait_ms = 100,
+    .reset_pulse_width_ms = 100,
+};
+
+bool u8g2_fake_drew(const char *str) {
+    for (uint8_t i = 0; i < u8g2_fake.string_count; i++) {
+        if (strcmp(u8g2_fake.strings[i], str) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool u8g2_fake_drew_solid(const char *str) {
+    for (uint8_t i = 0; i < u8g2_fake.string_count; i++) {
+        if (strcmp(u8g2_fake.strings[i], str) == 0 && u8g2_fake.string_font_modes[i] == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// One transfer of a command and a bit of data, as each real one starts
+static void transfer(u8g2_t *u8g2) {
+    uint8_t data[17] = {0x40};
+    u8g2->u8x8.byte_cb(&u8g2->u8x8, U8X8_MSG_BYTE_START_TRANSFER, 0, NULL);
+    u8g2->u8x8.byte_cb(&u8g2->u8x8, U8X8_MSG_BYTE_SEND, sizeof(data), data);
+    u8g2->u8x8.byte_cb(&u8g2->u8x8, U8X8_MSG_BYTE_END_TRANSFER, 0, NULL);
+}
+
+void u8x8_SetGPIOResult(
+    __attribute__((unused)) u8x8_t *u8x8, __attribute__((unused)) uint8_t val) {
+}
+
+uint8_t u8x8_GetI2CAddress(__attribute__((unused)) u8x8_t *u8x8) {
+    return DISPLAY_I2C_ADDRESS << 1;
+}
+
+void u8x8_InitDisplay(u8x8_t *u8x8) {
+    u8x8->byte_cb(u8x8, U8X8_MSG_BYTE_INIT, 0, NULL);
+    u8x8->gpio_and_delay_cb(u8x8, U8X8_MSG_DELAY_MILLI, display_info.reset_pulse_width_ms, NULL);
+    u8x8->gpio_and_delay_cb(u8x8, U8X8_MSG_DELAY_MILLI, display_info.post_reset_wait_ms, NULL);
+}
+
+void u8g2_Setup_ssd1306_i2c_128x32_univision_f(
+    u8g2_t *u8g2, __attribute__((unused)) const u8g2_cb_t *rotation, u8x8_msg_cb byte_cb,
+    u8x8_msg_cb gpio_and_delay_cb) {
+    memset(&u8g2_fake, 0, sizeof(u8g2_fake));
+    u8g2->u8x8.display_info = &display_info;
+    u8g2->u8x8.byte_cb = byte_cb;
+    u8g2->u8x8.gpio_and_delay_cb = gpio_and_delay_cb;
+}
+
+void u8g2_SetPowerSave(u8g2_t *u8g2, uint8_t is_enable) {
+    u8g2_fake.power_save = is_enable;
+    transfer(u8g2);
+}
+
+void u8g2_ClearBuffer(__attribute__((unused)) u8g2_t *u8g2) {
+    u8g2_fake.string_count = 0;
+}
+
+void u8g2_SendBuffer(u8g2_t *u8g2) {
+    u8g2_fake.buffers_sent++;
+    transfer(u8g2);
+}
+
+void u8g2_UpdateDisplayArea(
+    u8g2_t *u8g2, __attribute__((unused)) uint8_t tx, __attribute__((unused)) uint8_t ty,
+    __attribute__((unused)) uint8_t tw, __attribute__((unused)) uint8_t th) {
+    u8g2_fake.areas_updated++;
+    transfer(u8g2);
+}
+
+void u8g2_SetDrawColor(__attribute__((unused)) u8g2_t *u8g2, uint8_t color) {
+    u8g2_fake.draw_color = color;
+}
+
+void u8g2_SetFont(
+    __attribute__((unused)) u8g2_t *u8g2, __attribute__((unused)) const uint8_t *font) {
+}
+
+void u8g2_SetFontMode(__attribute__((unused)) u8g2_t *u8g2, uint8_t is_transparent) {
+    u8g2_fake.font_mode = is_transparent;
+}
+
+u8g2_uint_t u8g2_DrawGlyph(
+    __attribute__((unused)) u8g2_t *u8g2, __attribute__((unused)) u8g2_uint_t x,
+    __attribute__((unused)) u8g2_uint_t y, __attribute__((unused)) uint16_t encoding) {
+    return 6;
+}
+
+u8g2_uint_t u8g2_DrawStr(
+    u8g2_t *u8g2, __attribute__((unused)) u8g2_uint_t x, __attribute__((unused)) u8g2_uint_t y,
+    const char *str) {
+    if (u8g2_fake.string_count < U8G2_FAKE_STRINGS) {
+        u8g2_fake.string_font_modes[u8g2_fake.string_count] = u8g2_fake.font_mode;
+        char *s = u8g2_fake.strings[u8g2_fake.string_count++];
+        strncpy(s, str, U8G2_FAKE_STRING_LEN - 1);
+        s[U8G2_FAKE_STRING_LEN - 1] = '\0';
+    }
+    return u8g2_GetStrWidth(u8g2, str);
+}
+
+void u8g2_DrawBox(
+    __attribute__((unused)) u8g2_t *u8g2, __attribute__((unused)) u8g2_uint_t x,
+    __attribute__((unused)) u8g2_uint_t y, __attribute__((unused)) u8g2_uint_t w,
+    __attribute__((unused)) u8g2_uint_t h) {
+}
+
+void u8g2_DrawFrame(
+    __attribute__((unused)) u8g2_t *u8g2, __attribute__((unused)) u8g2_uint_t x,
+    __attribute__((unused)) u8g2_uint_t y, __attribute__((unused)) u8g2_uint_t w,
+    __attribute__((unused)) u8g2_uint_t h) {
+}
+
+void u8g2_DrawXBM(
+    __attribute__((unused)) u8g2_t *u8g2, __attribute__((unused)) u8g2_uint_t x,
+    __attribute__((unused)) u8g2_uint_t y, __attribute__((unused)) u8g2_uint_t w,
+    __attribute__((unused)) u8g2_uint_t h, __attribute__((unused)) const uint8_t *bitmap) {
+}
+
+u8g2_uint_t u8g2_GetStrWidth(__attribute__((unused)) u8g2_t *u8g2, const char *str) {
+    return 6 * strlen(str);
+}
+
+int8_t u8g2_GetAscent(__attribute__((unused)) u8g2_t *u8g2) {
+    return 8;
+}
+
+int8_t u8g2_GetDescent(__attribute__((unused)) u8g2_t *u8g2) {
+    return -2;
+}
@@ -0,0 +1,35 @@
+#if !defined(U8X8_H)
+#define U8X8_H
+
+// The parts of u8x8 the firmware uses, see u8g2.h
+
+#include <stdint.h>
+
+typedef struct u8x8_struct u8x8_t;
+
+typedef uint8_t (*u8x8_msg_cb)(u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, void *arg_ptr);
+
+typedef struct {
+    uint8_t post_reset_wait_ms;
+    uint8_t reset_pulse_width_ms;
+} u8x8_display_info_t;
+
+struct u8x8_struct {
+    const u8x8_display_info_t *display_info;
+    u8x8_msg_cb byte_cb;
+    u8x8_msg_cb gpio_and_delay_cb;
+};
+
+#define U8X8_MSG_BYTE_INIT           20
+#define U8X8_MSG_BYTE_SEND           23
+#define U8X8_MSG_BYTE_START_TRANSFER 24
+#define U8X8_MSG_BYTE_END_TRANSFER   25
+#define U8X8_MSG_DELAY_MILLI         41
+
+void u8x8_SetGPIOResult(u8x8_t *u8x8, uint8_t val);
+
+uint8_t u8x8_GetI2CAddress(u8x8_t *u8x8);
+
+void u8x8_InitDisplay(u8x8_t *u8x8);
+
+#endif // U8X8_H
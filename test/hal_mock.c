@@ -0,0 +1,160 @@
+#include "hal_mock.h"
+
+#include <assert.h>
+#include <string.h>
+
+hal_mock_t hal_mock;
+jmp_buf hal_mock_reboot_jmp;
+
+void hal_mock_reset() {
+    memset(&hal_mock, 0, sizeof(hal_mock));
+    memset(hal_mock.flash, 0xff, sizeof(hal_mock.flash));
+    hal_mock.hid_ready = true;
+    hal_mock.remote_wakeup_allowed = true;
+}
+
+void hal_mock_advance_us(uint32_t us) {
+    hal_mock.time_us += us;
+}
+
+void hal_mock_pio_push(uint8_t pio, uint8_t sm, uint32_t word) {
+    assert(hal_mock.pio_fifo_count[pio][sm] < HAL_MOCK_FIFO_LEN);
+    hal_mock.pio_fifo[pio][sm][hal_mock.pio_fifo_count[pio][sm]++] = word;
+}
+
+const hal_mock_report_t *hal_mock_last_report(uint8_t report_id) {
+    for (int i = hal_mock.report_count - 1; i >= 0; i--) {
+        if (hal_mock.reports[i].report_id == report_id) {
+            return &hal_mock.reports[i];
+        }
+    }
+    return NULL;
+}
+
+uint32_t hal_time_us() {
+    return hal_mock.time_us;
+}
+
+void hal_sleep_ms(uint32_t ms) {
+    hal_mock.time_us += ms * 1000;
+}
+
+uint32_t hal_irq_save() {
+    return hal_mock.irq_depth++;
+}
+
+void hal_irq_restore(uint32_t state) {
+    assert(hal_mock.irq_depth == state + 1);
+    hal_mock.irq_depth = state;
+}
+
+void hal_memory_barrier() {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+void hal_signal_event() {
+}
+
+void hal_wait_for_event(uint32_t timeout_us) {
+    hal_mock.time_us += timeout_us;
+}
+
+bool hal_gpio_get(uint8_t gpio) {
+    return hal_mock.gpio[gpio];
+}
+
+bool hal_pio_rx_fifo_empty(uint8_t pio, uint8_t sm) {
+    return hal_mock.pio_fifo_count[pio][sm] == 0;
+}
+
+uint32_t hal_pio_rx_fifo_get(uint8_t pio, uint8_t sm) {
+    assert(hal_mock.pio_fifo_count[pio][sm] > 0);
+    uint32_t word = hal_mock.pio_fifo[pio][sm][0];
+    hal_mock.pio_fifo_count[pio][sm]--;
+    memmove(
+        hal_mock.pio_fifo[pio][sm], hal_mock.pio_fifo[pio][sm] + 1,
+        hal_mock.pio_fifo_count[pio][sm] * sizeof(uint32_t));
+    return word;
+}
+
+void hal_pio_sm_set_clkdiv(uint8_t pio, uint8_t sm, uint16_t div) {
+    hal_mock.pio_clkdiv[pio][sm] = div;
+}
+
+void hal_i2c_init(
+    __attribute__((unused)) uint8_t sda_gpio, __attribute__((unused)) uint8_t scl_gpio,
+    __attribute__((unused)) uint32_t baudrate) {
+}
+
+int hal_i2c_write(
+    __attribute__((unused)) uint8_t address, __attribute__((unused)) const uint8_t *data,
+    size_t len) {
+    hal_mock.i2c_bytes += len;
+    return len;
+}
+
+bool hal_hid_ready() {
+    return hal_mock.hid_ready;
+}
+
+bool hal_hid_report(uint8_t report_id, const void *report, uint16_t len) {
+    if (hal_mock.hid_fail || !hal_mock.hid_ready) {
+        return false;
+    }
+    assert(len <= HAL_MOCK_REPORT_LEN);
+    assert(hal_mock.report_count < HAL_MOCK_REPORTS);
+    hal_mock_report_t *r = &hal_mock.reports[hal_mock.report_count++];
+    r->report_id = report_id;
+    r->len = len;
+    memcpy(r->data, report, len);
+    if (hal_mock.hid_one_in_flight) {
+        hal_mock.hid_ready = false;
+    }
+    return true;
+}
+
+bool hal_usb_remote_wakeup() {
+    if (!hal_mock.remote_wakeup_allowed) {
+        return false;
+    }
+    hal_mock.remote_wakeups++;
+    return true;
+}
+
+const uint8_t *hal_flash_read_ptr(uint32_t offset) {
+    assert(offset < HAL_MOCK_FLASH_SIZE);
+    return hal_mock.flash + offset;
+}
+
+void hal_flash_erase(uint32_t offset, uint32_t len) {
+    // As on the device: whole sectors, with interrupts off
+    assert(hal_mock.irq_depth > 0);
+    assert(offset % HAL_FLASH_SECTOR_SIZE == 0 && len % HAL_FLASH_SECTOR_SIZE == 0);
+    assert(offset + len <= HAL_MOCK_FLASH_SIZE);
+    memset(hal_mock.flash + offset, 0xff, len);
+    hal_mock.flash_erases += len / HAL_FLASH_SECTOR_SIZE;
+}
+
+void hal_flash_program(uint32_t offset, const uint8_t *data, uint32_t len) {
+    assert(hal_mock.irq_depth > 0);
+    assert(offset % HAL_FLASH_PAGE_SIZE == 0 && len % HAL_FLASH_PAGE_SIZE == 0);
+    assert(offset + len <= HAL_MOCK_FLASH_SIZE);
+    // Programming only clears bits
+    for (uint32_t i = 0; i < len; i++) {
+        hal_mock.flash[offset + i] &= data[i];
+    }
+}
+
+uint32_t hal_sys_clock_hz() {
+    return 125000000;
+}
+
+void hal_reboot() {
+    hal_mock.rebooted = true;
+    longjmp(hal_mock_reboot_jmp, 1);
+}
+
+void hal_reboot_to_bootloader() {
+    hal_mock.rebooted_to_bootloader = true;
+    longjmp(hal_mock_reboot_jmp, 1);
+}
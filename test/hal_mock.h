@@ -0,0 +1,69 @@
+#if !defined(HAL_MOCK__H)
+#define HAL_MOCK__H
+
+// The HAL (src/hal.h) for the host tests: time only moves when a test moves
+// it, input comes from queues the test fills, and USB reports, I2C writes and
+// flash end up in arrays the test can look at.
+
+#include "hal.h"
+
+#include <setjmp.h>
+
+#define HAL_MOCK_FLASH_SIZE (2 * 1024 * 1024)
+#define HAL_MOCK_REPORTS    64
+#define HAL_MOCK_REPORT_LEN 64
+#define HAL_MOCK_FIFO_LEN   32
+
+typedef struct {
+    uint8_t report_id;
+    uint16_t len;
+    uint8_t data[HAL_MOCK_REPORT_LEN];
+} hal_mock_report_t;
+
+typedef struct {
+    uint32_t time_us;
+    bool gpio[32];
+
+    // PIO, indexed by PIO block and state machine
+    uint32_t pio_fifo[2][4][HAL_MOCK_FIFO_LEN];
+    uint8_t pio_fifo_count[2][4];
+    uint16_t pio_clkdiv[2][4];
+
+    uint32_t i2c_bytes;
+
+    // USB: reports sent, in order
+    bool hid_ready;
+    bool hid_fail; // hal_hid_report fails without sending
+    // Like the single IN endpoint of the device: a report sent makes
+    // hid_ready false, until the test sets it again for the host's poll
+    bool hid_one_in_flight;
+    hal_mock_report_t reports[HAL_MOCK_REPORTS];
+    uint16_t report_count;
+    bool remote_wakeup_allowed;
+    uint16_t remote_wakeups;
+
+    // Aligned like through XIP, the firmware reads structs straight from it
+    uint8_t flash[HAL_MOCK_FLASH_SIZE] __attribute__((aligned(HAL_FLASH_SECTOR_SIZE)));
+    uint16_t flash_erases; // Sectors erased
+
+    uint8_t irq_depth; // hal_irq_save calls not yet restored
+    bool rebooted;
+    bool rebooted_to_bootloader;
+} hal_mock_t;
+
+extern hal_mock_t hal_mock;
+
+// Erased flash, time 0, USB ready and nothing sent
+void hal_mock_reset();
+
+void hal_mock_advance_us(uint32_t us);
+
+void hal_mock_pio_push(uint8_t pio, uint8_t sm, uint32_t word);
+
+// The last report with the id, or NULL if none was sent
+const hal_mock_report_t *hal_mock_last_report(uint8_t report_id);
+
+// Where hal_reboot and hal_reboot_to_bootloader return to, with setjmp
+extern jmp_buf hal_mock_reboot_jmp;
+
+#endif // HAL_MOCK__H
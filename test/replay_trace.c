@@ -0,0 +1,361 @@
+// Replays a recorded input trace through the firmware's input path and HID
+// report pipeline on the host, and measures how the reports carry it.
+//
+// Key matrix words go through the PIO FIFOs of the mock HAL into
+// input_isr_key_matrix, encoder quarter step counts into input_isr_encoder:
+// the code the device's ISRs run. hid_task runs every
+// USB_HID_REPORT_INTERVAL_US like the scheduler runs it, and the host polls
+// every USB_HID_POLL_INTERVAL_MS. Like on the device, a report sent keeps the
+// endpoint busy until the host's next poll picks it up.
+//
+// Trace format: one event per line, "time_us,kind,value", where kind is
+// "keys" (value: key matrix word) or "enc1" (value: signed detent count).
+// Lines starting with # are ignored.
+//
+//     replay_trace [--verbose] [--lossless] session.csv
+//
+// --lossless fails the replay if any event didn't reach the host or a key
+// state in the trace never showed up in a report.
+
+#include "hal_mock.h"
+
+#include "input_bus.h"
+#include "input_isr.h"
+#include "key_filter.h"
+#include "profiles.h"
+#include "usb_hid.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define KEY_MATRIX_SM 0
+#define ENCODER_1_SM  2
+
+// The trace starts well after boot, so its first key change isn't taken for a bounce
+#define START_US 1000000
+// Time for the last reports to reach the host after the trace ends
+#define DRAIN_US 100000
+
+#define POLL_INTERVAL_US (USB_HID_POLL_INTERVAL_MS * 1000)
+
+enum { KIND_KEYS, KIND_ENCODER_1 };
+
+typedef struct {
+    uint32_t time_us;
+    uint8_t kind;
+    int32_t value;
+} trace_entry_t;
+
+// An event the ISRs posted, and what became of it
+typedef struct {
+    uint8_t kind;
+    uint16_t keys;
+    uint32_t posted_us;
+    uint32_t queued_us;    // Handed to the USB stack in a report
+    uint32_t delivered_us; // Read by the host's poll, 0 until then
+    bool reported;
+} tracked_event_t;
+
+// Events waiting for a report of their kind, or for the host to poll it
+typedef struct {
+    uint32_t *indexes;
+    uint32_t count;
+} event_list_t;
+
+static trace_entry_t *trace;
+static uint32_t trace_len;
+
+static tracked_event_t *events;
+static uint32_t events_len;
+
+static event_list_t pending_keys;
+static event_list_t pending_encoder;
+static event_list_t in_flight;
+
+static uint32_t reports;
+static uint32_t events_merged;
+
+// Key states the host saw, by the key word
+static bool keys_seen[1 << 12];
+
+// Quarter step count of encoder 1's PIO program
+static uint32_t encoder_1_position;
+
+static void *checked_realloc(void *ptr, size_t size) {
+    ptr = realloc(ptr, size);
+    if (!ptr) {
+        fprintf(stderr, "Out of memory\n");
+        exit(2);
+    }
+    return ptr;
+}
+
+static void list_add(event_list_t *list, uint32_t index) {
+    list->indexes = checked_realloc(list->indexes, (list->count + 1) * sizeof(uint32_t));
+    list->indexes[list->count++] = index;
+}
+
+static void load_trace(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        exit(2);
+    }
+
+    char line[128];
+    uint32_t line_no = 0;
+    while (fgets(line, sizeof(line), f)) {
+        line_no++;
+        char *p = line + strspn(line, " \t");
+        if (*p == '#' || *p == '\n' || *p == '\0') {
+            continue;
+        }
+        unsigned long time_us;
+        char kind[8];
+        char value[16];
+        if (sscanf(p, " %lu , %7[a-z0-9] , %15s", &time_us, kind, value) != 3) {
+            fprintf(stderr, "%s:%u: expected time_us,kind,value\n", path, line_no);
+            exit(2);
+        }
+        trace_entry_t e = {.time_us = time_us, .value = strtol(value, NULL, 0)};
+        if (strcmp(kind, "keys") == 0) {
+            e.kind = KIND_KEYS;
+        } else if (strcmp(kind, "enc1") == 0) {
+            e.kind = KIND_ENCODER_1;
+        } else {
+            fprintf(stderr, "%s:%u: unknown kind %s\n", path, line_no, kind);
+            exit(2);
+        }
+        if (trace_len > 0 && e.time_us < trace[trace_len - 1].time_us) {
+            fprintf(stderr, "%s:%u: time goes backwards\n", path, line_no);
+            exit(2);
+        }
+        trace = checked_realloc(trace, (trace_len + 1) * sizeof(trace_entry_t));
+        trace[trace_len++] = e;
+    }
+    fclose(f);
+}
+
+// Do what the PIO and the ISRs would for the entry
+static void feed_entry(const trace_entry_t *e) {
+    if (e->kind == KIND_KEYS) {
+        hal_mock_pio_push(1, KEY_MATRIX_SM, e->value);
+        input_isr_key_matrix(KEY_MATRIX_SM);
+        return;
+    }
+    // A count pushed and an interrupt per quarter step
+    for (int32_t i = 0; i < abs(e->value) * INPUT_ENCODER_STEPS_PER_DETENT; i++) {
+        encoder_1_position += e->value > 0 ? 1 : -1;
+        hal_mock_pio_push(0, ENCODER_1_SM, encoder_1_position);
+        input_isr_encoder(1);
+    }
+}
+
+// Track what the HID task is about to read: everything posted since its last run
+static void take_posted_events(input_consumer_t *consumer) {
+    input_event_t ev;
+    while (input_bus_poll(consumer, &ev)) {
+        if (ev.type == INPUT_EVENT_ENCODER && ev.delta == 0) {
+            // Steps between detents, the dial only reports detents
+            continue;
+        }
+        events = checked_realloc(events, (events_len + 1) * sizeof(tracked_event_t));
+        events[events_len] = (tracked_event_t){
+            .kind = ev.type == INPUT_EVENT_KEYS ? KIND_KEYS : KIND_ENCODER_1,
+            .keys = ev.keys,
+            .posted_us = ev.time_us,
+        };
+        list_add(ev.type == INPUT_EVENT_KEYS ? &pending_keys : &pending_encoder, events_len);
+        events_len++;
+    }
+}
+
+// The report carries every pending event of its kind
+static void report_queued(event_list_t *pending) {
+    reports++;
+    if (pending->count > 1) {
+        events_merged += pending->count - 1;
+    }
+    for (uint32_t i = 0; i < pending->count; i++) {
+        events[pending->indexes[i]].queued_us = hal_time_us();
+        list_add(&in_flight, pending->indexes[i]);
+    }
+    pending->count = 0;
+}
+
+static void run_hid_task(input_consumer_t *consumer) {
+    take_posted_events(consumer);
+    hid_task();
+
+    for (uint16_t i = 0; i < hal_mock.report_count; i++) {
+        const hal_mock_report_t *r = &hal_mock.reports[i];
+        if (r->report_id == USB_HID_REPORT_NUM_KEYPAD) {
+            uint16_t keys;
+            memcpy(&keys, r->data, sizeof(keys));
+            keys_seen[keys & 0x0fff] = true;
+            report_queued(&pending_keys);
+        } else if (r->report_id == USB_HID_REPORT_NUM_ENCODER) {
+            report_queued(&pending_encoder);
+        }
+    }
+    hal_mock.report_count = 0;
+}
+
+static void host_poll() {
+    if (hal_mock.hid_ready) {
+        return;
+    }
+    for (uint32_t i = 0; i < in_flight.count; i++) {
+        tracked_event_t *e = &events[in_flight.indexes[i]];
+        e->delivered_us = hal_time_us();
+        e->reported = true;
+    }
+    in_flight.count = 0;
+    hal_mock.hid_ready = true;
+    usb_hid_report_complete();
+}
+
+static int compare_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void print_latency(FILE *out, const char *name, uint32_t *latencies, uint32_t count) {
+    if (count == 0) {
+        fprintf(out, "%-24s -\n", name);
+        return;
+    }
+    qsort(latencies, count, sizeof(uint32_t), compare_u32);
+    uint32_t p50 = latencies[(count - 1) * 50 / 100];
+    uint32_t p90 = latencies[(count - 1) * 90 / 100];
+    uint32_t p99 = latencies[(count - 1) * 99 / 100];
+    fprintf(out, "%-24s %u/%u/%u/%u us\n", name, p50, p90, p99, latencies[count - 1]);
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "usage: %s [--verbose] [--lossless] trace.csv\n", name);
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    bool verbose = false;
+    bool lossless = false;
+    const char *path = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--verbose") == 0) {
+            verbose = true;
+        } else if (strcmp(argv[i], "--lossless") == 0) {
+            lossless = true;
+        } else if (argv[i][0] == '-' || path) {
+            usage(argv[0]);
+        } else {
+            path = argv[i];
+        }
+    }
+    if (!path) {
+        usage(argv[0]);
+    }
+
+    load_trace(path);
+    if (trace_len == 0) {
+        fprintf(stderr, "Empty trace\n");
+        return 2;
+    }
+
+    // The firmware logs with printf, keep that apart from the results
+    FILE *out = fdopen(dup(STDOUT_FILENO), "w");
+    if (!verbose && !freopen("/dev/null", "w", stdout)) {
+        perror("/dev/null");
+        return 2;
+    }
+
+    hal_mock_reset();
+    hal_mock.hid_one_in_flight = true;
+    hal_mock.time_us = START_US;
+    // Default encoder modes: encoder 1 is reported as a dial
+    prof_set_current_profile_name("Replay");
+
+    // Reads the bus alongside the HID task
+    input_consumer_t consumer;
+    input_bus_subscribe(&consumer);
+
+    uint32_t offset = START_US - trace[0].time_us;
+    uint32_t end_us = trace[trace_len - 1].time_us + offset + DRAIN_US;
+    uint32_t next_hid_us = START_US;
+    uint32_t next_poll_us = START_US;
+    uint32_t next_entry = 0;
+    while ((int32_t)(hal_time_us() - end_us) < 0) {
+        uint32_t next_us = (int32_t)(next_poll_us - next_hid_us) < 0 ? next_poll_us : next_hid_us;
+        uint32_t entry_us = 0;
+        if (next_entry < trace_len) {
+            entry_us = trace[next_entry].time_us + offset;
+            if ((int32_t)(entry_us - next_us) < 0) {
+                next_us = entry_us;
+            }
+        }
+        uint32_t filter_us;
+        bool filter_due = key_filter_next_deadline(&filter_us);
+        if (filter_due && (int32_t)(filter_us - next_us) < 0) {
+            next_us = filter_us;
+        }
+        if ((int32_t)(next_us - hal_time_us()) > 0) {
+            hal_mock.time_us = next_us;
+        }
+
+        if (next_entry < trace_len && entry_us == next_us) {
+            feed_entry(&trace[next_entry++]);
+        } else if (filter_due && filter_us == next_us) {
+            // The key filter alarm runs the ISR with nothing in the FIFO
+            input_isr_key_matrix(KEY_MATRIX_SM);
+        } else if (next_poll_us == next_us) {
+            host_poll();
+            next_poll_us += POLL_INTERVAL_US;
+        } else {
+            run_hid_task(&consumer);
+            next_hid_us += USB_HID_REPORT_INTERVAL_US;
+        }
+    }
+    take_posted_events(&consumer);
+
+    uint32_t *queue_latencies = checked_realloc(NULL, (events_len + 1) * sizeof(uint32_t));
+    uint32_t *host_latencies = checked_realloc(NULL, (events_len + 1) * sizeof(uint32_t));
+    uint32_t reported = 0;
+    uint32_t key_events = 0;
+    uint32_t keys_unseen = 0;
+    for (uint32_t i = 0; i < events_len; i++) {
+        const tracked_event_t *e = &events[i];
+        if (e->kind == KIND_KEYS) {
+            key_events++;
+            keys_unseen += !keys_seen[e->keys];
+        }
+        if (e->reported) {
+            queue_latencies[reported] = e->queued_us - e->posted_us;
+            host_latencies[reported] = e->delivered_us - e->posted_us;
+            reported++;
+        }
+    }
+    uint32_t unreported = events_len - reported;
+
+    fprintf(out, "Trace entries:           %u\n", trace_len);
+    fprintf(out, "Events posted:           %u (%u key changes)\n", events_len, key_events);
+    fprintf(out, "Events dropped:          %u\n", consumer.dropped);
+    fprintf(out, "Events reported:         %u\n", reported);
+    fprintf(out, "Events merged:           %u\n", events_merged);
+    fprintf(out, "Events not reported:     %u\n", unreported);
+    fprintf(out, "Reports:                 %u\n", reports);
+    fprintf(out, "Key states never seen:   %u\n", keys_unseen);
+    fprintf(out, "Latency p50/p90/p99/max\n");
+    print_latency(out, "  to the USB stack:", queue_latencies, reported);
+    print_latency(out, "  to the host:", host_latencies, reported);
+    fclose(out);
+    free(queue_latencies);
+    free(host_latencies);
+
+    if (lossless && (consumer.dropped > 0 || unreported > 0 || keys_unseen > 0)) {
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,42 @@
+#if !defined(TEST__H)
+#define TEST__H
+
+// A minimal runner for the host tests. Each test executable covers one module
+// and runs its test functions in order; the module's state carries over from
+// one to the next. Failed checks are printed, and make main return non-zero.
+
+#include "hal_mock.h"
+
+#include <stdio.h>
+
+static int test_failures = 0;
+
+#define CHECK(cond)                                                                                \
+    do {                                                                                           \
+        if (!(cond)) {                                                                             \
+            printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond);                        \
+            test_failures++;                                                                       \
+        }                                                                                          \
+    } while (0)
+
+#define CHECK_EQ(actual, expected)                                                                 \
+    do {                                                                                           \
+        long long actual_ = (actual);                                                              \
+        long long expected_ = (expected);                                                          \
+        if (actual_ != expected_) {                                                                \
+            printf(                                                                                \
+                "%s:%d: CHECK_EQ(%s, %s) failed: %lld != %lld\n", __FILE__, __LINE__, #actual,     \
+                #expected, actual_, expected_);                                                    \
+            test_failures++;                                                                       \
+        }                                                                                          \
+    } while (0)
+
+#define RUN_TEST(fn)                                                                               \
+    do {                                                                                           \
+        printf("-- " #fn "\n");                                                                    \
+        fn();                                                                                      \
+    } while (0)
+
+#define TEST_RESULT() (test_failures == 0 ? 0 : 1)
+
+#endif // TEST__H
@@ -0,0 +1,133 @@
+#include "test.h"
+
+#include "display_list.h"
+
+#include <string.h>
+
+typedef struct __attribute__((packed)) {
+    uint16_t used;
+    uint32_t ops;
+    uint32_t rejected;
+} status_t;
+
+static status_t get_status() {
+    status_t status;
+    CHECK_EQ(display_list_get_report((uint8_t *)&status, sizeof(status)), sizeof(status));
+    return status;
+}
+
+// A SET of a text entry, returns its length
+static uint16_t set_text(uint8_t *op, uint8_t index, const char *text) {
+    display_list_entry_t entry = {.type = DISPLAY_LIST_TYPE_TEXT, .x = 1, .y = 10};
+    strncpy(entry.text, text, sizeof(entry.text));
+    op[0] = DISPLAY_LIST_OP_SET;
+    op[1] = index;
+    memcpy(op + 2, &entry, sizeof(entry));
+    return 2 + sizeof(entry);
+}
+
+static void test_set_and_patch() {
+    uint8_t report[DISPLAY_LIST_REPORT_LEN] = {0};
+    uint16_t len = set_text(report, 3, "hello");
+    len += set_text(report + len, 5, "world");
+    display_list_handle_report(report, sizeof(report));
+
+    CHECK_EQ(display_list_take_changed(), (1 << 3) | (1 << 5));
+    CHECK_EQ(display_list_take_changed(), 0);
+    CHECK_EQ(display_list_get(3)->type, DISPLAY_LIST_TYPE_TEXT);
+    CHECK(strcmp(display_list_get(3)->text, "hello") == 0);
+    CHECK(strcmp(display_list_get(5)->text, "world") == 0);
+    CHECK(!display_list_take_show_request());
+
+    const uint8_t patch[] = {DISPLAY_LIST_OP_PATCH, 5, 8, 1, 'W', DISPLAY_LIST_OP_SHOW};
+    display_list_handle_report(patch, sizeof(patch));
+    CHECK_EQ(display_list_take_changed(), 1 << 5);
+    CHECK(strcmp(display_list_get(5)->text, "World") == 0);
+    CHECK(display_list_take_show_request());
+    CHECK(!display_list_take_show_request());
+
+    status_t status = get_status();
+    CHECK_EQ(status.used, (1 << 3) | (1 << 5));
+    CHECK_EQ(status.ops, 4);
+    CHECK_EQ(status.rejected, 0);
+}
+
+static void test_invalid_ops_are_rejected() {
+    status_t before = get_status();
+
+    // Index out of range: nothing after it is applied
+    uint8_t report[DISPLAY_LIST_REPORT_LEN] = {0};
+    uint16_t len = set_text(report, DISPLAY_LIST_ENTRIES, "bad");
+    report[len] = DISPLAY_LIST_OP_SHOW;
+    display_list_handle_report(report, len + 1);
+    CHECK(!display_list_take_show_request());
+
+    // Patching past the entry
+    const uint8_t past_entry[] = {DISPLAY_LIST_OP_PATCH, 3, 23, 2, 'a', 'b'};
+    display_list_handle_report(past_entry, sizeof(past_entry));
+
+    // Patch data missing from the report
+    const uint8_t short_data[] = {DISPLAY_LIST_OP_PATCH, 3, 8, 4, 'a'};
+    display_list_handle_report(short_data, sizeof(short_data));
+
+    // SET cut short by the report's end
+    set_text(report, 3, "short");
+    display_list_handle_report(report, 10);
+
+    const uint8_t unknown[] = {0x7f};
+    display_list_handle_report(unknown, sizeof(unknown));
+
+    status_t status = get_status();
+    CHECK_EQ(status.rejected, before.rejected + 5);
+    CHECK_EQ(status.ops, before.ops);
+    CHECK_EQ(display_list_take_changed(), 0);
+    CHECK(strcmp(display_list_get(3)->text, "hello") == 0);
+}
+
+static void test_ops_bounded_by_len() {
+    status_t before = get_status();
+
+    // Each operation cut at every byte, with valid bytes after the cut that
+    // mustn't be read
+    uint8_t set[DISPLAY_LIST_REPORT_LEN];
+    uint16_t set_len = set_text(set, 7, "cut");
+    const uint8_t patch[] = {DISPLAY_LIST_OP_PATCH, 3, 8, 2, 'H', 'E'};
+    for (uint16_t len = 1; len < set_len; len++) {
+        display_list_handle_report(set, len);
+    }
+    for (uint16_t len = 1; len < sizeof(patch); len++) {
+        display_list_handle_report(patch, len);
+    }
+
+    status_t status = get_status();
+    CHECK_EQ(status.rejected, before.rejected + (set_len - 1) + (sizeof(patch) - 1));
+    CHECK_EQ(status.ops, before.ops);
+    CHECK_EQ(display_list_take_changed(), 0);
+    CHECK_EQ(display_list_get(7)->type, DISPLAY_LIST_TYPE_NONE);
+    CHECK(strcmp(display_list_get(3)->text, "hello") == 0);
+
+    // An empty report, and one-byte operations that fill it exactly
+    const uint8_t show = DISPLAY_LIST_OP_SHOW;
+    display_list_handle_report(&show, 0);
+    CHECK(!display_list_take_show_request());
+    display_list_handle_report(&show, 1);
+    CHECK(display_list_take_show_request());
+    CHECK_EQ(get_status().rejected, status.rejected);
+}
+
+static void test_clear() {
+    const uint8_t clear[] = {DISPLAY_LIST_OP_CLEAR};
+    display_list_handle_report(clear, sizeof(clear));
+    CHECK_EQ(display_list_take_changed(), (1 << 3) | (1 << 5));
+    CHECK_EQ(get_status().used, 0);
+    CHECK_EQ(display_list_get(3)->type, DISPLAY_LIST_TYPE_NONE);
+}
+
+int main() {
+    hal_mock_reset();
+    RUN_TEST(test_set_and_patch);
+    RUN_TEST(test_invalid_ops_are_rejected);
+    RUN_TEST(test_ops_bounded_by_len);
+    RUN_TEST(test_clear);
+    return TEST_RESULT();
+}
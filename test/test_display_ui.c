@@ -0,0 +1,183 @@
+#include "test.h"
+
+#include "display_list.h"
+#include "display_ui.h"
+#include "input_bus.h"
+#include "profiles.h"
+#include "u8g2.h"
+#include "usb_hid.h"
+
+#include <string.h>
+
+static void run_frame() {
+    hal_mock_advance_us(UI_FRAME_INTERVAL_US);
+    ui_task();
+}
+
+static void click() {
+    input_event_t ev = {.type = INPUT_EVENT_BUTTON, .index = 0, .pressed = true};
+    input_bus_post(INPUT_SOURCE_MAIN, ev);
+    run_frame();
+    ev.pressed = false;
+    input_bus_post(INPUT_SOURCE_MAIN, ev);
+    run_frame();
+}
+
+static void turn(int8_t delta) {
+    input_bus_post(
+        INPUT_SOURCE_ENCODER_0,
+        (input_event_t){.type = INPUT_EVENT_ENCODER, .index = 0, .delta = delta});
+    run_frame();
+}
+
+static void test_display_init_does_not_block() {
+    ui_init();
+    uint32_t start = hal_time_us();
+    ui_task();
+    // Only the time the frame took, no sleeping through the reset delays
+    CHECK_EQ(hal_time_us(), start);
+    CHECK_EQ(hal_mock.i2c_bytes, 0);
+
+    hal_mock_advance_us(300 * 1000);
+    for (int i = 0; i < 3; i++) {
+        ui_task();
+    }
+    CHECK_EQ(hal_time_us(), start + 300 * 1000);
+    CHECK(hal_mock.i2c_bytes > 0);
+    CHECK_EQ(u8g2_fake.power_save, 0);
+    CHECK_EQ(u8g2_fake.buffers_sent, 0);
+}
+
+static void test_version_screen_first() {
+    run_frame();
+    CHECK_EQ(u8g2_fake.buffers_sent, 1);
+    CHECK(u8g2_fake_drew("Pico Macropad"));
+
+    // Unchanged frames are skipped
+    run_frame();
+    CHECK_EQ(u8g2_fake.buffers_sent, 1);
+}
+
+static void test_menu_navigation() {
+    click();
+    CHECK(u8g2_fake_drew("Debug"));
+    CHECK(u8g2_fake_drew("USBConf"));
+
+    turn(1);
+    click();
+    CHECK(u8g2_fake_drew("HID enabled"));
+    turn(1);
+    click();
+    CHECK(!usb_hid_is_event_sending_enabled());
+    CHECK(u8g2_fake_drew("Debug"));
+
+    click();
+    CHECK(u8g2_fake_drew("HID disabled"));
+    turn(-1);
+    click();
+    CHECK(usb_hid_is_event_sending_enabled());
+}
+
+static void test_reported_encoder_0_leaves_ui() {
+    // On the menu, at USBConf
+    uint8_t modes[2] = {PROF_ENCODER_MODE_VOLUME, PROF_DEFAULT_ENCODER_1_MODE};
+    prof_set_current_encoder_modes(modes);
+    turn(1);
+    click();
+    CHECK(u8g2_fake_drew("USBConf"));
+
+    // The wheel modes leave the button to the UI
+    modes[0] = PROF_ENCODER_MODE_WHEEL;
+    prof_set_current_encoder_modes(modes);
+    turn(1);
+    click();
+    CHECK(u8g2_fake_drew("HID enabled"));
+    click();
+
+    modes[0] = PROF_DEFAULT_ENCODER_0_MODE;
+    prof_set_current_encoder_modes(modes);
+}
+
+static void test_profile_name_shown_briefly() {
+    prof_set_current_profile_name("Browser");
+    input_bus_post(INPUT_SOURCE_MAIN, (input_event_t){.type = INPUT_EVENT_PROFILE});
+    run_frame();
+    CHECK(u8g2_fake_drew("Browser"));
+
+    for (int i = 0; i < 700 * 1000 / UI_FRAME_INTERVAL_US; i++) {
+        run_frame();
+    }
+    // On to the key names of the profile
+    CHECK(!u8g2_fake_drew("Browser"));
+}
+
+static void test_display_off_without_input() {
+    for (int i = 0; i < 5 * UI_FPS; i++) {
+        run_frame();
+    }
+    CHECK_EQ(u8g2_fake.power_save, 1);
+
+    turn(1);
+    CHECK_EQ(u8g2_fake.power_save, 0);
+}
+
+static void test_display_off_while_suspended() {
+    ui_set_suspended(true);
+    CHECK_EQ(u8g2_fake.power_save, 1);
+
+    // Input is for waking up the host, not for the UI
+    uint32_t sent = u8g2_fake.buffers_sent;
+    click();
+    CHECK_EQ(u8g2_fake.power_save, 1);
+    CHECK_EQ(u8g2_fake.buffers_sent, sent);
+
+    ui_set_suspended(false);
+    run_frame();
+    CHECK_EQ(u8g2_fake.power_save, 0);
+}
+
+static void set_text(uint8_t index, const char *text) {
+    uint8_t op[2 + sizeof(display_list_entry_t)] = {DISPLAY_LIST_OP_SET, index};
+    display_list_entry_t entry = {.type = DISPLAY_LIST_TYPE_TEXT, .x = 10, .y = 20};
+    strncpy(entry.text, text, sizeof(entry.text));
+    memcpy(op + 2, &entry, sizeof(entry));
+    display_list_handle_report(op, sizeof(op));
+}
+
+static void test_display_list_text_keeps_entries_under_it() {
+    // Two texts on top of each other
+    set_text(0, "under");
+    set_text(1, "over");
+    const uint8_t show = DISPLAY_LIST_OP_SHOW;
+    display_list_handle_report(&show, 1);
+    run_frame();
+    CHECK(u8g2_fake_drew("under"));
+    CHECK(!u8g2_fake_drew_solid("over"));
+
+    // Only the changed tiles are sent, with both texts redrawn in them
+    uint16_t areas = u8g2_fake.areas_updated;
+    uint32_t sent = u8g2_fake.buffers_sent;
+    const uint8_t patch[] = {DISPLAY_LIST_OP_PATCH, 1, 8, 1, 'O'};
+    display_list_handle_report(patch, sizeof(patch));
+    run_frame();
+    CHECK_EQ(u8g2_fake.buffers_sent, sent);
+    CHECK(u8g2_fake.areas_updated > areas);
+    CHECK(u8g2_fake_drew("Over"));
+    CHECK(!u8g2_fake_drew_solid("Over"));
+    CHECK(!u8g2_fake_drew_solid("under"));
+    // The other screens draw text with its background
+    CHECK_EQ(u8g2_fake.font_mode, 0);
+}
+
+int main() {
+    hal_mock_reset();
+    RUN_TEST(test_display_init_does_not_block);
+    RUN_TEST(test_version_screen_first);
+    RUN_TEST(test_menu_navigation);
+    RUN_TEST(test_reported_encoder_0_leaves_ui);
+    RUN_TEST(test_profile_name_shown_briefly);
+    RUN_TEST(test_display_off_without_input);
+    RUN_TEST(test_display_off_while_suspended);
+    RUN_TEST(test_display_list_text_keeps_entries_under_it);
+    return TEST_RESULT();
+}
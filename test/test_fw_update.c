@@ -0,0 +1,233 @@
+#include "test.h"
+
+#include "flash_layout.h"
+#include "fw_update.h"
+#include "fw_update_record.h"
+#include "utils.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#define BLOCK_SIZE HAL_FLASH_SECTOR_SIZE
+#define IMAGE_SIZE (2 * BLOCK_SIZE)
+#define CHUNK_LEN  52
+#define BOOT2_SIZE 256
+
+// Commands, results and states as in fw_update.c and scripts/fw_update.py
+enum {
+    CMD_BEGIN,
+    CMD_DATA,
+    CMD_COMMIT_BLOCK,
+    CMD_COPY_BLOCK,
+    CMD_QUERY_CRC,
+    CMD_FINISH,
+    CMD_APPLY,
+};
+
+enum { STATE_IDLE, STATE_RECEIVING, STATE_VERIFIED, STATE_APPLYING, STATE_CONFIRMING };
+
+enum { OK, ERR_BAD_REQUEST, ERR_BAD_STATE, ERR_CRC, ERR_VERIFY, ERR_IMAGE, BUSY, ERR_DECLINED };
+
+typedef struct __attribute__((packed)) {
+    uint8_t state;
+    uint8_t result;
+    uint16_t block;
+    uint32_t crc;
+    uint32_t image_size;
+    uint32_t max_image_size;
+    uint16_t block_size;
+    uint16_t blocks_written;
+    uint16_t blocks_copied;
+} status_t;
+
+static uint8_t image[IMAGE_SIZE];
+
+static status_t get_status() {
+    uint8_t report[FW_UPDATE_REPORT_LEN];
+    CHECK_EQ(fw_update_get_report(report, sizeof(report)), FW_UPDATE_REPORT_LEN);
+    status_t status;
+    memcpy(&status, report, sizeof(status));
+    return status;
+}
+
+static void send(uint8_t cmd, uint16_t block, const void *args, uint8_t args_len) {
+    uint8_t report[FW_UPDATE_REPORT_LEN] = {cmd, block & 0xff, block >> 8};
+    if (args_len > 0) {
+        memcpy(report + 3, args, args_len);
+    }
+    fw_update_handle_report(report, sizeof(report));
+}
+
+// Run the task until the last command is done, as the scheduler would
+static uint8_t wait_result() {
+    for (int i = 0; i < 1000 && get_status().result == BUSY; i++) {
+        fw_update_task();
+    }
+    return get_status().result;
+}
+
+static void send_image_args(uint8_t cmd) {
+    uint32_t args[2] = {IMAGE_SIZE, crc32(image, IMAGE_SIZE, 0)};
+    send(cmd, 0, args, sizeof(args));
+}
+
+static void send_block(uint16_t block, uint32_t crc) {
+    const uint8_t *data = image + block * BLOCK_SIZE;
+    for (uint16_t offset = 0; offset < BLOCK_SIZE; offset += CHUNK_LEN) {
+        uint8_t args[3 + CHUNK_LEN] = {offset & 0xff, offset >> 8};
+        args[2] = BLOCK_SIZE - offset < CHUNK_LEN ? BLOCK_SIZE - offset : CHUNK_LEN;
+        memcpy(args + 3, data + offset, args[2]);
+        send(CMD_DATA, block, args, sizeof(args));
+        CHECK_EQ(get_status().result, OK);
+    }
+    send(CMD_COMMIT_BLOCK, block, &crc, sizeof(crc));
+}
+
+// Random bytes with a valid second stage bootloader checksum and a reset
+// vector into the image, linked for the firmware region
+static void make_image() {
+    uint32_t x = 12345;
+    for (uint32_t i = 0; i < IMAGE_SIZE; i++) {
+        x = x * 1103515245 + 12345;
+        image[i] = x >> 16;
+    }
+    uint32_t crc = 0xffffffff;
+    for (uint16_t i = 0; i < BOOT2_SIZE - 4; i++) {
+        crc ^= (uint32_t)image[i] << 24;
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            crc = (crc << 1) ^ (0x04c11db7 & -(crc >> 31));
+        }
+    }
+    memcpy(image + BOOT2_SIZE - 4, &crc, sizeof(crc));
+    uint32_t reset = FLASH_LAYOUT_XIP_BASE + FLASH_LAYOUT_FIRMWARE_OFFSET + 0x201;
+    memcpy(image + FW_UPDATE_VECTOR_TABLE_OFFSET + 4, &reset, sizeof(reset));
+}
+
+static void test_commands_need_begin() {
+    uint32_t crc = 0;
+    send(CMD_COMMIT_BLOCK, 0, &crc, sizeof(crc));
+    CHECK_EQ(get_status().result, ERR_BAD_STATE);
+    send(CMD_APPLY, 0, NULL, 0);
+    CHECK_EQ(get_status().result, ERR_BAD_STATE);
+
+    uint32_t too_big[2] = {FLASH_LAYOUT_STAGING_SIZE + 1, 0};
+    send(CMD_BEGIN, 0, too_big, sizeof(too_big));
+    CHECK_EQ(get_status().result, ERR_BAD_REQUEST);
+    CHECK_EQ(get_status().state, STATE_IDLE);
+}
+
+static void test_block_is_staged() {
+    send_image_args(CMD_BEGIN);
+    status_t status = get_status();
+    CHECK_EQ(status.result, OK);
+    CHECK_EQ(status.state, STATE_RECEIVING);
+    CHECK_EQ(status.block_size, BLOCK_SIZE);
+
+    send_block(0, crc32(image, BLOCK_SIZE, 0));
+    CHECK_EQ(get_status().result, BUSY);
+
+    // Commands while busy are ignored
+    uint8_t region = 1;
+    send(CMD_QUERY_CRC, 0, &region, sizeof(region));
+    CHECK_EQ(get_status().result, BUSY);
+
+    CHECK_EQ(wait_result(), OK);
+    CHECK_EQ(get_status().blocks_written, 1);
+    CHECK(memcmp(hal_mock.flash + FLASH_LAYOUT_STAGING_OFFSET, image, BLOCK_SIZE) == 0);
+    CHECK_EQ(hal_mock.irq_depth, 0);
+
+    send(CMD_QUERY_CRC, 0, &region, sizeof(region));
+    CHECK_EQ(get_status().result, OK);
+    CHECK_EQ(get_status().crc, crc32(image, BLOCK_SIZE, 0));
+}
+
+static void test_corrupt_block_is_rejected() {
+    send_block(1, crc32(image, BLOCK_SIZE, 0));
+    CHECK_EQ(wait_result(), ERR_CRC);
+    CHECK_EQ(get_status().blocks_written, 1);
+}
+
+static void test_block_copied_from_firmware() {
+    // The running firmware has the second block at its block 5
+    memcpy(
+        hal_mock.flash + FLASH_LAYOUT_FIRMWARE_OFFSET + 5 * BLOCK_SIZE, image + BLOCK_SIZE,
+        BLOCK_SIZE);
+    struct __attribute__((packed)) {
+        uint32_t crc;
+        uint16_t src_block;
+    } args = {crc32(image + BLOCK_SIZE, BLOCK_SIZE, 0), 5};
+    send(CMD_COPY_BLOCK, 1, &args, sizeof(args));
+    CHECK_EQ(wait_result(), OK);
+    CHECK_EQ(get_status().blocks_copied, 1);
+}
+
+static void test_finish_verifies_image() {
+    send_image_args(CMD_FINISH);
+    CHECK_EQ(get_status().result, BUSY);
+    CHECK_EQ(wait_result(), OK);
+    CHECK_EQ(get_status().state, STATE_VERIFIED);
+}
+
+static void test_declined_on_the_pad() {
+    send(CMD_APPLY, 0, NULL, 0);
+    CHECK_EQ(get_status().state, STATE_CONFIRMING);
+    CHECK(fw_update_confirm_pending());
+    fw_update_task();
+    CHECK_EQ(get_status().result, BUSY);
+
+    fw_update_confirm(false);
+    CHECK(!fw_update_confirm_pending());
+    CHECK_EQ(get_status().result, ERR_DECLINED);
+    CHECK_EQ(get_status().state, STATE_VERIFIED);
+}
+
+static void test_unanswered_confirmation_times_out() {
+    send(CMD_APPLY, 0, NULL, 0);
+    hal_mock_advance_us(29 * 1000000);
+    fw_update_task();
+    CHECK(fw_update_confirm_pending());
+    hal_mock_advance_us(1000000);
+    fw_update_task();
+    CHECK(!fw_update_confirm_pending());
+    CHECK_EQ(get_status().result, ERR_DECLINED);
+}
+
+static void test_confirmed_update_reboots() {
+    send(CMD_APPLY, 0, NULL, 0);
+    fw_update_confirm(true);
+    CHECK_EQ(get_status().state, STATE_APPLYING);
+    CHECK_EQ(get_status().result, OK);
+
+    fw_update_record_t record;
+    memcpy(&record, hal_mock.flash + FLASH_LAYOUT_UPDATE_RECORD_OFFSET, sizeof(record));
+    CHECK_EQ(record.magic, FW_UPDATE_RECORD_MAGIC);
+    CHECK_EQ(record.image_size, IMAGE_SIZE);
+    CHECK_EQ(record.image_crc, crc32(image, IMAGE_SIZE, 0));
+    CHECK_EQ(record.record_crc, crc32(&record, offsetof(fw_update_record_t, record_crc), 0));
+
+    // Not before the APPLY transfer had time to complete
+    fw_update_task();
+    CHECK(!hal_mock.rebooted);
+    send_image_args(CMD_BEGIN);
+    CHECK_EQ(get_status().state, STATE_APPLYING);
+
+    hal_mock_advance_us(100 * 1000);
+    if (setjmp(hal_mock_reboot_jmp) == 0) {
+        fw_update_task();
+    }
+    CHECK(hal_mock.rebooted);
+}
+
+int main() {
+    hal_mock_reset();
+    make_image();
+    RUN_TEST(test_commands_need_begin);
+    RUN_TEST(test_block_is_staged);
+    RUN_TEST(test_corrupt_block_is_rejected);
+    RUN_TEST(test_block_copied_from_firmware);
+    RUN_TEST(test_finish_verifies_image);
+    RUN_TEST(test_declined_on_the_pad);
+    RUN_TEST(test_unanswered_confirmation_times_out);
+    RUN_TEST(test_confirmed_update_reboots);
+    return TEST_RESULT();
+}
@@ -0,0 +1,84 @@
+#include "test.h"
+
+#include "input_bus.h"
+
+static input_event_t key_event(uint16_t keys) {
+    return (input_event_t){.type = INPUT_EVENT_KEYS, .keys = keys};
+}
+
+static input_event_t encoder_event(uint8_t index, int8_t delta) {
+    return (input_event_t){.type = INPUT_EVENT_ENCODER, .index = index, .delta = delta};
+}
+
+static void test_events_in_posting_order() {
+    input_consumer_t consumer = {0};
+    input_bus_post(INPUT_SOURCE_ENCODER_1, encoder_event(1, 2));
+    hal_mock_advance_us(10);
+    input_bus_post(INPUT_SOURCE_KEY_MATRIX, key_event(0x001));
+    hal_mock_advance_us(10);
+    input_bus_post(INPUT_SOURCE_ENCODER_1, encoder_event(1, -1));
+
+    input_event_t ev;
+    CHECK(input_bus_poll(&consumer, &ev));
+    CHECK_EQ(ev.type, INPUT_EVENT_ENCODER);
+    CHECK_EQ(ev.delta, 2);
+    CHECK_EQ(ev.time_us, 0);
+    CHECK(input_bus_poll(&consumer, &ev));
+    CHECK_EQ(ev.type, INPUT_EVENT_KEYS);
+    CHECK_EQ(ev.keys, 0x001);
+    CHECK_EQ(ev.time_us, 10);
+    CHECK(input_bus_poll(&consumer, &ev));
+    CHECK_EQ(ev.delta, -1);
+    CHECK(!input_bus_poll(&consumer, &ev));
+    CHECK_EQ(consumer.dropped, 0);
+}
+
+static void test_consumers_read_independently() {
+    input_consumer_t a, b;
+    input_bus_subscribe(&a);
+    input_bus_post(INPUT_SOURCE_MAIN, (input_event_t){.type = INPUT_EVENT_PROFILE});
+    input_bus_subscribe(&b);
+    input_bus_post(INPUT_SOURCE_MAIN, (input_event_t){.type = INPUT_EVENT_BUTTON, .pressed = true});
+
+    input_event_t ev;
+    CHECK(input_bus_poll(&a, &ev));
+    CHECK_EQ(ev.type, INPUT_EVENT_PROFILE);
+    CHECK(input_bus_poll(&a, &ev));
+    CHECK_EQ(ev.type, INPUT_EVENT_BUTTON);
+    CHECK(!input_bus_poll(&a, &ev));
+
+    // Subscribed after the first event
+    CHECK(input_bus_poll(&b, &ev));
+    CHECK_EQ(ev.type, INPUT_EVENT_BUTTON);
+    CHECK(!input_bus_poll(&b, &ev));
+}
+
+static void test_lapped_consumer_counts_dropped() {
+    input_consumer_t consumer;
+    input_bus_subscribe(&consumer);
+    for (int i = 0; i < INPUT_BUS_QUEUE_LEN + 5; i++) {
+        input_bus_post(INPUT_SOURCE_KEY_MATRIX, key_event(i));
+        hal_mock_advance_us(1);
+    }
+
+    input_event_t ev;
+    CHECK(input_bus_poll(&consumer, &ev));
+    // The oldest event still in the queue
+    CHECK_EQ(ev.keys, 5);
+    CHECK_EQ(consumer.dropped, 5);
+
+    int read = 1;
+    while (input_bus_poll(&consumer, &ev)) {
+        read++;
+    }
+    CHECK_EQ(read, INPUT_BUS_QUEUE_LEN);
+    CHECK_EQ(ev.keys, INPUT_BUS_QUEUE_LEN + 4);
+}
+
+int main() {
+    hal_mock_reset();
+    RUN_TEST(test_events_in_posting_order);
+    RUN_TEST(test_consumers_read_independently);
+    RUN_TEST(test_lapped_consumer_counts_dropped);
+    return TEST_RESULT();
+}
@@ -0,0 +1,97 @@
+#include "test.h"
+
+#include "input_bus.h"
+#include "input_isr.h"
+
+#define ENCODER_1_SM 2
+
+// Quarter step count of encoder 1's PIO program
+static uint32_t position = 0;
+
+static void turn(int32_t steps) {
+    position += steps;
+    hal_mock_pio_push(0, ENCODER_1_SM, position);
+}
+
+static input_event_t take_event(input_consumer_t *consumer) {
+    input_event_t ev = {0};
+    CHECK(input_bus_poll(consumer, &ev));
+    CHECK_EQ(ev.type, INPUT_EVENT_ENCODER);
+    CHECK_EQ(ev.index, 1);
+    return ev;
+}
+
+static void test_steps_and_detents() {
+    input_consumer_t consumer;
+    input_bus_subscribe(&consumer);
+
+    CHECK(!input_isr_encoder(1));
+    for (int i = 1; i < INPUT_ENCODER_STEPS_PER_DETENT; i++) {
+        turn(1);
+        CHECK(input_isr_encoder(1));
+        input_event_t ev = take_event(&consumer);
+        CHECK_EQ(ev.steps, 1);
+        CHECK_EQ(ev.delta, 0);
+    }
+    turn(1);
+    CHECK(input_isr_encoder(1));
+    input_event_t ev = take_event(&consumer);
+    CHECK_EQ(ev.steps, 1);
+    CHECK_EQ(ev.delta, 1);
+
+    // Only the latest count in the FIFO matters
+    turn(-2);
+    turn(-3);
+    turn(-3);
+    CHECK(input_isr_encoder(1));
+    ev = take_event(&consumer);
+    CHECK_EQ(ev.steps, -8);
+    CHECK_EQ(ev.delta, -2);
+    CHECK(!input_bus_poll(&consumer, &ev));
+}
+
+static void test_detent_needs_a_whole_turn_back() {
+    input_consumer_t consumer;
+    input_bus_subscribe(&consumer);
+
+    // Back and forth around the detent just counted
+    turn(-1);
+    input_isr_encoder(1);
+    turn(1);
+    input_isr_encoder(1);
+    turn(-3);
+    input_isr_encoder(1);
+    turn(3);
+    input_isr_encoder(1);
+    input_event_t ev;
+    while (input_bus_poll(&consumer, &ev)) {
+        CHECK_EQ(ev.delta, 0);
+    }
+
+    turn(-INPUT_ENCODER_STEPS_PER_DETENT);
+    input_isr_encoder(1);
+    ev = take_event(&consumer);
+    CHECK_EQ(ev.delta, -1);
+}
+
+static void test_count_wraps() {
+    position = UINT32_MAX - 1;
+    hal_mock_pio_push(0, ENCODER_1_SM, position);
+    input_isr_encoder(1);
+    input_consumer_t consumer;
+    input_bus_subscribe(&consumer);
+
+    turn(INPUT_ENCODER_STEPS_PER_DETENT);
+    CHECK(input_isr_encoder(1));
+    input_event_t ev = take_event(&consumer);
+    CHECK_EQ(ev.steps, INPUT_ENCODER_STEPS_PER_DETENT);
+    CHECK_EQ(ev.delta, 1);
+}
+
+int main() {
+    hal_mock_reset();
+    RUN_TEST(test_steps_and_detents);
+    RUN_TEST(test_detent_needs_a_whole_turn_back);
+    RUN_TEST(test_count_wraps);
+    return TEST_RESULT();
+}
@@ -0,0 +1,76 @@
+#include "test.h"
+
+#include "key_filter.h"
+
+#define KEY (1 << 3)
+
+// Press and release the key fast enough for every release to be a bounce
+static void chatter(uint32_t times) {
+    for (uint32_t i = 0; i < times; i++) {
+        key_filter_update(KEY, hal_time_us());
+        hal_mock_advance_us(1000);
+        key_filter_update(0, hal_time_us());
+        hal_mock_advance_us(1000);
+    }
+}
+
+static uint8_t extra_debounce_ms(uint8_t key) {
+    uint8_t report[KEY_FILTER_REPORT_LEN];
+    CHECK_EQ(key_filter_get_report(report, sizeof(report)), KEY_FILTER_REPORT_LEN);
+    return report[2 * MACROPAD_KEY_COUNT + key];
+}
+
+static void test_healthy_key_passes_right_away() {
+    CHECK_EQ(key_filter_update(KEY, hal_time_us()), KEY);
+    hal_mock_advance_us(100 * 1000);
+    CHECK_EQ(key_filter_update(0, hal_time_us()), 0);
+    uint32_t deadline;
+    CHECK(!key_filter_next_deadline(&deadline));
+    CHECK_EQ(extra_debounce_ms(3), 0);
+}
+
+static void test_chattering_key_gets_debounced() {
+    hal_mock_advance_us(100 * 1000);
+    chatter(2);
+    CHECK(extra_debounce_ms(3) > 0);
+
+    // Now held back for the extra debounce
+    hal_mock_advance_us(100 * 1000);
+    uint32_t pressed_at = hal_time_us();
+    CHECK_EQ(key_filter_update(KEY, pressed_at), 0);
+    uint32_t deadline;
+    CHECK(key_filter_next_deadline(&deadline));
+    CHECK_EQ(deadline, pressed_at + extra_debounce_ms(3) * 1000);
+
+    hal_mock.time_us = deadline;
+    CHECK_EQ(key_filter_update(KEY, hal_time_us()), KEY);
+    CHECK(!key_filter_next_deadline(&deadline));
+}
+
+static void test_release_pending_lets_changes_through() {
+    hal_mock_advance_us(100 * 1000);
+    CHECK_EQ(key_filter_update(0, hal_time_us()), KEY);
+    uint32_t deadline;
+    CHECK(key_filter_next_deadline(&deadline));
+
+    CHECK_EQ(key_filter_release_pending(hal_time_us()), 0);
+    CHECK(!key_filter_next_deadline(&deadline));
+}
+
+static void test_report_resets_the_debounce() {
+    key_filter_handle_report(NULL, 0);
+    CHECK_EQ(extra_debounce_ms(3), 0);
+    hal_mock_advance_us(100 * 1000);
+    CHECK_EQ(key_filter_update(KEY, hal_time_us()), KEY);
+}
+
+int main() {
+    hal_mock_reset();
+    // Far from the keys' initial last transition at 0
+    hal_mock.time_us = 1000000;
+    RUN_TEST(test_healthy_key_passes_right_away);
+    RUN_TEST(test_chattering_key_gets_debounced);
+    RUN_TEST(test_release_pending_lets_changes_through);
+    RUN_TEST(test_report_resets_the_debounce);
+    return TEST_RESULT();
+}
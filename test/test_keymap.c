@@ -0,0 +1,150 @@
+#include "test.h"
+
+#include "keymap.h"
+
+#define KEY_NORMAL    (1 << 0)
+#define KEY_LAYER     (1 << 1)
+#define KEY_TAP_HOLD  (1 << 2)
+#define KEY_TAP_HOLD2 (1 << 3)
+
+#define MS 1000
+
+static void set_config() {
+    keymap_config_t config = {.tapping_term_ms = 200};
+    config.kind[1] = KEYMAP_KEY_LAYER;
+    config.layer[1] = 2;
+    config.kind[2] = KEYMAP_KEY_TAP_HOLD;
+    config.layer[2] = 3;
+    config.kind[3] = KEYMAP_KEY_TAP_HOLD;
+    config.layer[3] = 4;
+    config.button_layer[1] = 5;
+    keymap_set_config(&config);
+}
+
+static void test_normal_keys_pass_through() {
+    CHECK(keymap_process_keys(KEY_NORMAL, 0));
+    CHECK_EQ(keymap_get_keys(), KEY_NORMAL);
+    CHECK_EQ(keymap_get_layer(), 0);
+    CHECK(keymap_process_keys(0, 10 * MS));
+    CHECK_EQ(keymap_get_keys(), 0);
+}
+
+static void test_layer_key_selects_layer() {
+    CHECK(keymap_process_keys(KEY_LAYER, 0));
+    CHECK_EQ(keymap_get_keys(), 0);
+    CHECK_EQ(keymap_get_layer(), 2);
+
+    keymap_process_keys(KEY_LAYER | KEY_NORMAL, 10 * MS);
+    CHECK_EQ(keymap_get_keys(), KEY_NORMAL);
+    CHECK_EQ(keymap_get_layer(), 2);
+
+    // The layer stays until the key on it is released
+    keymap_process_keys(KEY_NORMAL, 20 * MS);
+    CHECK_EQ(keymap_get_layer(), 2);
+    keymap_process_keys(0, 30 * MS);
+    CHECK_EQ(keymap_get_keys(), 0);
+    CHECK_EQ(keymap_get_layer(), 0);
+}
+
+static void test_tap_is_reported_once() {
+    CHECK(!keymap_process_keys(KEY_TAP_HOLD, 0));
+    CHECK_EQ(keymap_get_keys(), 0);
+    CHECK(keymap_process_keys(0, 100 * MS));
+    CHECK_EQ(keymap_get_keys(), KEY_TAP_HOLD);
+    CHECK_EQ(keymap_get_layer(), 0);
+
+    CHECK(keymap_report_sent());
+    CHECK_EQ(keymap_get_keys(), 0);
+    CHECK(!keymap_report_sent());
+}
+
+static void test_hold_past_tapping_term() {
+    keymap_process_keys(KEY_TAP_HOLD, 0);
+    CHECK(!keymap_tick(199 * MS));
+    CHECK(keymap_tick(200 * MS));
+    CHECK_EQ(keymap_get_keys(), 0);
+    CHECK_EQ(keymap_get_layer(), 3);
+
+    CHECK(keymap_process_keys(0, 300 * MS));
+    CHECK_EQ(keymap_get_keys(), 0);
+    CHECK_EQ(keymap_get_layer(), 0);
+}
+
+static void test_next_deadline_is_end_of_tapping_term() {
+    uint32_t deadline;
+    CHECK(!keymap_next_deadline(&deadline));
+
+    keymap_process_keys(KEY_TAP_HOLD, 1000 * MS);
+    CHECK(keymap_next_deadline(&deadline));
+    CHECK_EQ(deadline, 1200 * MS);
+    keymap_tick(1200 * MS);
+    CHECK(!keymap_next_deadline(&deadline));
+
+    keymap_process_keys(0, 1300 * MS);
+    CHECK_EQ(keymap_get_layer(), 0);
+}
+
+static void test_other_key_resolves_hold() {
+    keymap_process_keys(KEY_TAP_HOLD, 0);
+    CHECK(keymap_process_keys(KEY_TAP_HOLD | KEY_NORMAL, 50 * MS));
+    CHECK_EQ(keymap_get_keys(), KEY_NORMAL);
+    CHECK_EQ(keymap_get_layer(), 3);
+    keymap_process_keys(0, 100 * MS);
+    CHECK_EQ(keymap_get_layer(), 0);
+
+    // Rolling over two tap-hold keys selects the first one's layer
+    keymap_process_keys(KEY_TAP_HOLD, 200 * MS);
+    CHECK(keymap_process_keys(KEY_TAP_HOLD | KEY_TAP_HOLD2, 250 * MS));
+    CHECK_EQ(keymap_get_keys(), 0);
+    CHECK_EQ(keymap_get_layer(), 3);
+
+    // The second one was tapped on that layer
+    keymap_process_keys(KEY_TAP_HOLD, 300 * MS);
+    CHECK_EQ(keymap_get_keys(), KEY_TAP_HOLD2);
+    CHECK_EQ(keymap_get_layer(), 3);
+    CHECK(keymap_report_sent());
+    CHECK_EQ(keymap_get_keys(), 0);
+    keymap_process_keys(0, 400 * MS);
+    CHECK_EQ(keymap_get_layer(), 0);
+}
+
+static void test_button_layer() {
+    bool consumed;
+    CHECK(!keymap_process_button(0, true, &consumed));
+    CHECK(!consumed);
+
+    CHECK(keymap_process_button(1, true, &consumed));
+    CHECK(consumed);
+    CHECK_EQ(keymap_get_layer(), 5);
+    CHECK(keymap_process_button(1, false, &consumed));
+    CHECK_EQ(keymap_get_layer(), 0);
+}
+
+static void test_invalid_config_falls_back() {
+    keymap_config_t config = {.tapping_term_ms = 200};
+    config.kind[0] = 7;
+    config.kind[1] = KEYMAP_KEY_LAYER;
+    config.layer[1] = KEYMAP_MAX_LAYERS;
+    config.button_layer[0] = KEYMAP_MAX_LAYERS;
+    keymap_set_config(&config);
+
+    CHECK_EQ(keymap_get_config()->kind[0], KEYMAP_KEY_NORMAL);
+    CHECK_EQ(keymap_get_config()->kind[1], KEYMAP_KEY_NORMAL);
+    CHECK_EQ(keymap_get_config()->button_layer[0], 0);
+    keymap_process_keys(KEY_LAYER, 0);
+    CHECK_EQ(keymap_get_keys(), KEY_LAYER);
+    keymap_process_keys(0, 10 * MS);
+}
+
+int main() {
+    set_config();
+    RUN_TEST(test_normal_keys_pass_through);
+    RUN_TEST(test_layer_key_selects_layer);
+    RUN_TEST(test_tap_is_reported_once);
+    RUN_TEST(test_hold_past_tapping_term);
+    RUN_TEST(test_next_deadline_is_end_of_tapping_term);
+    RUN_TEST(test_other_key_resolves_hold);
+    RUN_TEST(test_button_layer);
+    RUN_TEST(test_invalid_config_falls_back);
+    return TEST_RESULT();
+}
@@ -0,0 +1,93 @@
+"""Run a host daemon against its mock pads and check the reports it sends.
+
+    python test_macropad_host.py python3 scripts/macropad_host.py
+    python test_macropad_host.py build/host/macropad_hostd
+
+The arguments are the daemon's command line, without the daemon's options.
+"""
+
+import os
+import re
+import subprocess
+import sys
+import tempfile
+import time
+
+PADS = 2
+# Well past the time a focus change takes to reach the mock pads
+SETTLE_S = 0.5
+
+A = '{"name": "Firefox", "keys": ["Back", "Fwd", "Tab"]}'
+B = '{"name": "Terminal", "keys": ["Copy", "Pste"], "encoders": ["wheel", "dial"]}'
+C = '{"name": "Live", "keys": ["Play"], "midi": {"channel": 2}, "icons": [1, null, 3]}'
+
+failures = 0
+
+
+def check(what, actual, expected):
+    global failures
+    if actual != expected:
+        print(f"{what}: {actual} != {expected}")
+        failures += 1
+
+
+def pad_stats(stderr):
+    """(reports sent, updates skipped) of each pad, from the stats the daemon prints on exit"""
+    return re.findall(r"\] (\d+) reports sent, (\d+) updates skipped", stderr)
+
+
+def test_focus_log_file(daemon):
+    # stdin a regular file: every change arrives within the coalescing window,
+    # only the last is sent, at the end of the input
+    with tempfile.NamedTemporaryFile("w", suffix=".jsonl", delete=False) as log:
+        log.write("\n".join([A, B, "not json", C]) + "\n")
+    try:
+        with open(log.name) as stdin:
+            r = subprocess.run(
+                daemon + ["--mock", str(PADS), "--coalesce-ms", "5000"],
+                stdin=stdin,
+                capture_output=True,
+                text=True,
+                timeout=30,
+            )
+    finally:
+        os.unlink(log.name)
+    check("exit status", r.returncode, 0)
+    check("bad line reported", "Ignoring bad focus change" in r.stderr, True)
+    # Name, MIDI map, icons and key names; the encoder modes are the defaults
+    check("file stats", pad_stats(r.stderr), [("4", "0")] * PADS)
+
+
+def test_focus_changes_over_time(daemon):
+    p = subprocess.Popen(
+        daemon + ["--mock", str(PADS), "--coalesce-ms", "0"],
+        stdin=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+        text=True,
+    )
+    for change in [
+        A,  # Uploaded: name and key names
+        A,  # What the pads have: skipped
+        B,  # Uploaded: name, encoder modes and key names
+    ]:
+        p.stdin.write(change + "\n")
+        p.stdin.flush()
+        time.sleep(SETTLE_S)
+    # Cached on the pads, activated by hash, and still sent with the input
+    # closed right after it
+    p.stdin.write(A + "\n")
+    p.stdin.close()
+    stderr = p.stderr.read()
+    check("exit status", p.wait(timeout=30), 0)
+    check("stats over time", pad_stats(stderr), [("6", "1")] * PADS)
+
+
+def main():
+    daemon = sys.argv[1:]
+    test_focus_log_file(daemon)
+    test_focus_changes_over_time(daemon)
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,138 @@
+#include "test.h"
+
+#include "flash_layout.h"
+#include "profiles.h"
+
+#include <string.h>
+
+static const char key_names[] = "Key0Key1Key2Key3Key4Key5Key6Key7Key8Key9KeyAKeyB";
+
+static uint32_t upload(const char *name) {
+    prof_set_current_profile_name(name);
+    prof_set_current_key_names(key_names);
+    return prof_get_snapshot()->hash;
+}
+
+static void test_upload_publishes_snapshot() {
+    const prof_snapshot_t *before = prof_get_snapshot();
+    CHECK_EQ(before->generation, 0);
+
+    uint32_t hash = upload("Editor");
+    const prof_snapshot_t *s = prof_get_snapshot();
+    CHECK(strcmp(s->profile.name, "Editor") == 0);
+    CHECK(memcmp(s->profile.key_names, key_names, sizeof(s->profile.key_names)) == 0);
+    CHECK_EQ(s->profile.encoder_modes[0], PROF_DEFAULT_ENCODER_0_MODE);
+    CHECK_EQ(s->profile.encoder_modes[1], PROF_DEFAULT_ENCODER_1_MODE);
+    CHECK_EQ(s->generation, 2);
+    CHECK_EQ(hash, prof_hash(&s->profile));
+    CHECK_EQ(prof_get_cache_stats()->entries, 1);
+}
+
+static void test_invalid_characters_become_spaces() {
+    char names[sizeof(key_names)];
+    memcpy(names, key_names, sizeof(names));
+    names[0] = '\n';
+    names[5] = (char)0xe4;
+    prof_set_current_profile_name("Odd");
+    prof_set_current_key_names(names);
+    const char *stored = prof_get_snapshot()->profile.key_names;
+    CHECK_EQ(stored[0], ' ');
+    CHECK_EQ(stored[5], ' ');
+    CHECK_EQ(stored[1], 'e');
+}
+
+static void test_settings_are_checked() {
+    prof_set_current_profile_name("Checked");
+    uint8_t modes[2] = {PROF_ENCODER_MODE_WHEEL, PROF_ENCODER_MODE_COUNT};
+    prof_set_current_encoder_modes(modes);
+    const profile_t *p = &prof_get_snapshot()->profile;
+    CHECK_EQ(p->encoder_modes[0], PROF_ENCODER_MODE_WHEEL);
+    CHECK_EQ(p->encoder_modes[1], PROF_ENCODER_MODE_NONE);
+
+    prof_midi_t midi = *prof_get_default_midi();
+    midi.channel = 0x13;
+    midi.key_notes[0] = 128;
+    midi.encoder_ccs[0] = 120;
+    midi.encoder_ccs[1] = 119;
+    prof_set_current_midi(&midi);
+    p = &prof_get_snapshot()->profile;
+    CHECK_EQ(p->midi.channel, 3);
+    CHECK_EQ(p->midi.key_notes[0], PROF_MIDI_NONE);
+    CHECK_EQ(p->midi.key_notes[1], prof_get_default_midi()->key_notes[1]);
+    CHECK_EQ(p->midi.encoder_ccs[0], PROF_MIDI_NONE);
+    CHECK_EQ(p->midi.encoder_ccs[1], 119);
+}
+
+static void test_activate_by_hash() {
+    uint32_t editor = upload("Editor");
+    uint32_t browser = upload("Browser");
+    CHECK(editor != browser);
+
+    uint32_t hits = prof_get_cache_stats()->hits;
+    CHECK(prof_activate_by_hash(editor));
+    CHECK(strcmp(prof_get_snapshot()->profile.name, "Editor") == 0);
+    CHECK_EQ(prof_get_snapshot()->hash, editor);
+    CHECK_EQ(prof_get_cache_stats()->hits, hits + 1);
+
+    uint32_t misses = prof_get_cache_stats()->misses;
+    CHECK(!prof_activate_by_hash(0x12345678));
+    CHECK_EQ(prof_get_cache_stats()->misses, misses + 1);
+    CHECK(strcmp(prof_get_snapshot()->profile.name, "Editor") == 0);
+}
+
+static void test_least_recently_used_is_evicted() {
+    uint32_t first = upload("P0");
+    uint32_t second = upload("P1");
+    for (uint8_t i = 2; i < PROF_CACHE_SIZE; i++) {
+        char name[8] = "P";
+        name[1] = '0' + i;
+        upload(name);
+    }
+    CHECK_EQ(prof_get_cache_stats()->entries, PROF_CACHE_SIZE);
+
+    // Used last, so "P1" goes instead
+    CHECK(prof_activate_by_hash(first));
+    uint32_t evictions = prof_get_cache_stats()->evictions;
+    upload("New");
+    CHECK_EQ(prof_get_cache_stats()->evictions, evictions + 1);
+    CHECK(prof_activate_by_hash(first));
+    CHECK(!prof_activate_by_hash(second));
+}
+
+static void test_store_survives_reload() {
+    profile_t stored[2] = {0};
+    strcpy(stored[0].name, "Stored 0");
+    strcpy(stored[1].name, "Stored 1");
+    memcpy(stored[0].key_names, key_names, sizeof(stored[0].key_names));
+    memcpy(stored[1].key_names, key_names, sizeof(stored[1].key_names));
+    uint32_t hash = prof_hash(&stored[1]);
+    uint32_t old = upload("Not stored");
+
+    prof_store_replace(stored, 2);
+    CHECK_EQ(prof_get_cache_stats()->entries, 2);
+    CHECK(!prof_activate_by_hash(old));
+    CHECK(prof_activate_by_hash(hash));
+    CHECK(strcmp(prof_get_snapshot()->profile.name, "Stored 1") == 0);
+
+    // What a boot would find
+    const uint8_t *flash = hal_flash_read_ptr(FLASH_LAYOUT_PROFILES_OFFSET);
+    uint8_t copy[HAL_FLASH_SECTOR_SIZE];
+    memcpy(copy, flash, sizeof(copy));
+    prof_store_replace(stored, 0);
+    CHECK_EQ(prof_get_cache_stats()->entries, 0);
+    memcpy(hal_mock.flash + FLASH_LAYOUT_PROFILES_OFFSET, copy, sizeof(copy));
+    prof_store_load();
+    CHECK_EQ(prof_get_cache_stats()->entries, 2);
+    CHECK(prof_activate_by_hash(hash));
+}
+
+int main() {
+    hal_mock_reset();
+    RUN_TEST(test_upload_publishes_snapshot);
+    RUN_TEST(test_invalid_characters_become_spaces);
+    RUN_TEST(test_settings_are_checked);
+    RUN_TEST(test_activate_by_hash);
+    RUN_TEST(test_least_recently_used_is_evicted);
+    RUN_TEST(test_store_survives_reload);
+    return TEST_RESULT();
+}
@@ -0,0 +1,168 @@
+#include "test.h"
+
+#include "scheduler.h"
+
+#include <string.h>
+
+#define LOG_LEN 32
+
+typedef struct {
+    sched_task_id_t task;
+    uint32_t time_us;
+} run_t;
+
+// The runs of all tasks, in order
+static run_t runs[LOG_LEN];
+static uint8_t run_count;
+
+// How long each run of late_task takes
+static uint32_t slow_runtime_us;
+
+static void log_run(sched_task_id_t task) {
+    CHECK(run_count < LOG_LEN);
+    if (run_count < LOG_LEN) {
+        runs[run_count++] = (run_t){.task = task, .time_us = hal_time_us()};
+    }
+}
+
+static void fast_task() {
+    log_run(SCHED_TASK_BUTTONS);
+}
+
+static void slow_task() {
+    log_run(SCHED_TASK_UI);
+}
+
+static void on_demand_task() {
+    log_run(SCHED_TASK_FW_UPDATE);
+}
+
+static void late_task() {
+    hal_mock_advance_us(slow_runtime_us);
+}
+
+static void run_until(uint32_t time_us) {
+    while ((int32_t)(hal_time_us() - time_us) < 0) {
+        sched_run_pass();
+    }
+}
+
+static void test_periods_and_order() {
+    sched_add_task(SCHED_TASK_UI, "ui", slow_task, 3000);
+    sched_add_task(SCHED_TASK_BUTTONS, "buttons", fast_task, 1000);
+    run_count = 0;
+
+    // Both run right away, in task order, then each at its own deadlines
+    // with the sleeps in between ending exactly on them
+    sched_run_pass();
+    run_until(6000);
+    sched_run_pass();
+    const run_t expected[] = {
+        {SCHED_TASK_BUTTONS, 0}, {SCHED_TASK_UI, 0},      {SCHED_TASK_BUTTONS, 1000},
+        {SCHED_TASK_BUTTONS, 2000}, {SCHED_TASK_BUTTONS, 3000}, {SCHED_TASK_UI, 3000},
+        {SCHED_TASK_BUTTONS, 4000}, {SCHED_TASK_BUTTONS, 5000}, {SCHED_TASK_BUTTONS, 6000},
+        {SCHED_TASK_UI, 6000},
+    };
+    CHECK_EQ(run_count, sizeof(expected) / sizeof(expected[0]));
+    for (uint8_t i = 0; i < run_count && i < sizeof(expected) / sizeof(expected[0]); i++) {
+        CHECK_EQ(runs[i].task, expected[i].task);
+        CHECK_EQ(runs[i].time_us, expected[i].time_us);
+    }
+    CHECK_EQ(sched_get_task_stats(SCHED_TASK_BUTTONS)->run_count, 7);
+    CHECK_EQ(sched_get_task_stats(SCHED_TASK_UI)->run_count, 3);
+    CHECK_EQ(sched_get_task_stats(SCHED_TASK_BUTTONS)->missed_deadlines, 0);
+}
+
+static void test_wake_and_deadline() {
+    sched_add_task(SCHED_TASK_FW_UPDATE, "fw_update", on_demand_task, SCHED_ON_DEMAND);
+    run_until(7000);
+    CHECK_EQ(sched_get_task_stats(SCHED_TASK_FW_UPDATE)->run_count, 0);
+
+    // Woken: runs on the next pass, after the tasks before it that are due
+    run_count = 0;
+    sched_wake(SCHED_TASK_FW_UPDATE);
+    sched_run_pass();
+    CHECK_EQ(run_count, 2);
+    CHECK_EQ(runs[1].task, SCHED_TASK_FW_UPDATE);
+    CHECK_EQ(runs[1].time_us, 7000);
+    run_until(9000);
+    CHECK_EQ(sched_get_task_stats(SCHED_TASK_FW_UPDATE)->run_count, 1);
+
+    // A one-off deadline between the periodic ones, the sleep ends on it
+    run_count = 0;
+    sched_set_deadline(SCHED_TASK_FW_UPDATE, 9500);
+    run_until(11000);
+    CHECK_EQ(sched_get_task_stats(SCHED_TASK_FW_UPDATE)->run_count, 2);
+    bool ran_at_deadline = false;
+    for (uint8_t i = 0; i < run_count; i++) {
+        if (runs[i].task == SCHED_TASK_FW_UPDATE) {
+            ran_at_deadline = runs[i].time_us == 9500;
+        }
+    }
+    CHECK(ran_at_deadline);
+}
+
+static void test_missed_deadlines() {
+    sched_add_task(SCHED_TASK_HID, "hid", late_task, 1000);
+    sched_run_pass();
+    CHECK_EQ(sched_get_task_stats(SCHED_TASK_HID)->run_count, 1);
+
+    // Runs well past its next deadline: counted once, and no catching up
+    // with back to back runs
+    run_until(hal_time_us() + 1000);
+    slow_runtime_us = 2500;
+    sched_run_pass();
+    slow_runtime_us = 0;
+    uint32_t runs_before = sched_get_task_stats(SCHED_TASK_HID)->run_count;
+    run_until(hal_time_us() + 100);
+    const sched_task_stats_t *stats = sched_get_task_stats(SCHED_TASK_HID);
+    CHECK_EQ(stats->missed_deadlines, 1);
+    CHECK_EQ(stats->run_count, runs_before + 1);
+    CHECK_EQ(stats->max_runtime_us, 2500);
+    CHECK_EQ(sched_get_task_stats(SCHED_TASK_BUTTONS)->missed_deadlines, 1);
+}
+
+typedef struct __attribute__((packed)) {
+    uint8_t task;
+    uint8_t task_count;
+    char name[8];
+    uint32_t run_count;
+    uint32_t max_runtime_us;
+    uint32_t missed_deadlines;
+} report_t;
+
+static void test_stats_report() {
+    uint8_t select[] = {0, SCHED_TASK_HID};
+    sched_handle_report(select, sizeof(select));
+    report_t rep;
+    CHECK_EQ(sched_get_report((uint8_t *)&rep, sizeof(rep)), SCHED_REPORT_LEN);
+    CHECK_EQ(rep.task, SCHED_TASK_HID);
+    CHECK_EQ(rep.task_count, SCHED_TASK_COUNT);
+    CHECK(memcmp(rep.name, "hid\0", 4) == 0);
+    CHECK_EQ(rep.run_count, sched_get_task_stats(SCHED_TASK_HID)->run_count);
+    CHECK_EQ(rep.max_runtime_us, 2500);
+    CHECK_EQ(rep.missed_deadlines, 1);
+
+    // Out of range: the selection stays
+    uint8_t bad[] = {0, SCHED_TASK_COUNT};
+    sched_handle_report(bad, sizeof(bad));
+    sched_get_report((uint8_t *)&rep, sizeof(rep));
+    CHECK_EQ(rep.task, SCHED_TASK_HID);
+
+    uint8_t reset[] = {1, 0};
+    sched_handle_report(reset, sizeof(reset));
+    sched_get_report((uint8_t *)&rep, sizeof(rep));
+    CHECK_EQ(rep.run_count, 0);
+    CHECK_EQ(rep.max_runtime_us, 0);
+    CHECK_EQ(rep.missed_deadlines, 0);
+    CHECK_EQ(sched_get_task_stats(SCHED_TASK_UI)->run_count, 0);
+}
+
+int main() {
+    hal_mock_reset();
+    RUN_TEST(test_periods_and_order);
+    RUN_TEST(test_wake_and_deadline);
+    RUN_TEST(test_missed_deadlines);
+    RUN_TEST(test_stats_report);
+    return TEST_RESULT();
+}
@@ -0,0 +1,317 @@
+#include "test.h"
+
+#include "input_bus.h"
+#include "keymap.h"
+#include "profiles.h"
+#include "usb_hid.h"
+
+#include <string.h>
+
+static void post_keys(uint16_t keys) {
+    input_bus_post(
+        INPUT_SOURCE_KEY_MATRIX, (input_event_t){.type = INPUT_EVENT_KEYS, .keys = keys});
+}
+
+static void post_encoder_steps(uint8_t index, int8_t delta, int8_t steps) {
+    input_bus_post(
+        index == 0 ? INPUT_SOURCE_ENCODER_0 : INPUT_SOURCE_ENCODER_1,
+        (input_event_t){
+            .type = INPUT_EVENT_ENCODER, .index = index, .delta = delta, .steps = steps});
+}
+
+// Whole detents
+static void post_encoder(uint8_t index, int8_t delta) {
+    post_encoder_steps(index, delta, delta * INPUT_ENCODER_STEPS_PER_DETENT);
+}
+
+static void post_button(uint8_t index, bool pressed) {
+    input_bus_post(
+        INPUT_SOURCE_MAIN,
+        (input_event_t){.type = INPUT_EVENT_BUTTON, .index = index, .pressed = pressed});
+}
+
+static void set_encoder_modes(uint8_t mode0, uint8_t mode1) {
+    uint8_t report[] = {USB_HID_REPORT_NUM_ENCODER_MODES, mode0, mode1};
+    usb_hid_set_report(report[0], report, sizeof(report));
+}
+
+static uint16_t report_u16(const hal_mock_report_t *r, uint8_t offset) {
+    uint16_t value;
+    memcpy(&value, r->data + offset, sizeof(value));
+    return value;
+}
+
+static void run_hid_task() {
+    hal_mock_advance_us(USB_HID_REPORT_INTERVAL_US);
+    hid_task();
+}
+
+static void test_first_run_reports_keys() {
+    run_hid_task();
+    const hal_mock_report_t *r = hal_mock_last_report(USB_HID_REPORT_NUM_KEYPAD);
+    CHECK(r != NULL);
+    CHECK_EQ(r->len, 3);
+    CHECK_EQ(report_u16(r, 0), 0);
+
+    // Nothing changed since
+    uint16_t sent = hal_mock.report_count;
+    run_hid_task();
+    CHECK_EQ(hal_mock.report_count, sent);
+}
+
+static void test_keys_are_reported() {
+    uint8_t seq = hal_mock_last_report(USB_HID_REPORT_NUM_KEYPAD)->data[2];
+    post_keys(0x005);
+    run_hid_task();
+    const hal_mock_report_t *r = hal_mock_last_report(USB_HID_REPORT_NUM_KEYPAD);
+    CHECK_EQ(report_u16(r, 0), 0x005);
+    CHECK_EQ(r->data[2], (uint8_t)(seq + 1));
+
+    post_keys(0);
+    run_hid_task();
+    r = hal_mock_last_report(USB_HID_REPORT_NUM_KEYPAD);
+    CHECK_EQ(report_u16(r, 0), 0);
+    CHECK_EQ(r->data[2], (uint8_t)(seq + 2));
+}
+
+static void test_failed_report_is_retried() {
+    keymap_config_t config = {.tapping_term_ms = 200};
+    config.kind[0] = KEYMAP_KEY_TAP_HOLD;
+    config.layer[0] = 1;
+    keymap_set_config(&config);
+
+    // A tap is reported in the first report that goes through
+    post_keys(0x001);
+    run_hid_task();
+    post_keys(0);
+    hal_mock.hid_fail = true;
+    run_hid_task();
+    run_hid_task();
+    hal_mock.hid_fail = false;
+    run_hid_task();
+    CHECK_EQ(report_u16(hal_mock_last_report(USB_HID_REPORT_NUM_KEYPAD), 0), 0x001);
+    run_hid_task();
+    CHECK_EQ(report_u16(hal_mock_last_report(USB_HID_REPORT_NUM_KEYPAD), 0), 0);
+
+    keymap_set_config(&(keymap_config_t){.tapping_term_ms = 200});
+}
+
+static void test_dial_reports_encoder_1_only() {
+    set_encoder_modes(PROF_ENCODER_MODE_NONE, PROF_ENCODER_MODE_DIAL);
+    uint16_t sent = hal_mock.report_count;
+    post_encoder(0, 3);
+    run_hid_task();
+    CHECK_EQ(hal_mock.report_count, sent);
+
+    post_encoder(1, 2);
+    post_encoder(1, 1);
+    post_button(1, true);
+    run_hid_task();
+    CHECK_EQ(hal_mock.report_count, sent + 1);
+    const hal_mock_report_t *r = hal_mock_last_report(USB_HID_REPORT_NUM_ENCODER);
+    CHECK(r != NULL);
+    CHECK_EQ(r->data[0], 3);
+    CHECK_EQ(r->data[1], 1);
+
+    post_button(1, false);
+    post_encoder(1, -5);
+    run_hid_task();
+    r = hal_mock_last_report(USB_HID_REPORT_NUM_ENCODER);
+    CHECK_EQ(r->data[0], (uint8_t)-2);
+    CHECK_EQ(r->data[1], 0);
+
+    // Steps between detents aren't reported
+    sent = hal_mock.report_count;
+    post_encoder_steps(1, 0, 1);
+    run_hid_task();
+    CHECK_EQ(hal_mock.report_count, sent);
+}
+
+static void test_volume_steps_are_pressed_and_released() {
+    set_encoder_modes(PROF_ENCODER_MODE_NONE, PROF_ENCODER_MODE_VOLUME);
+    post_encoder(1, 2);
+    uint16_t usages[4];
+    for (uint8_t i = 0; i < 4; i++) {
+        run_hid_task();
+        const hal_mock_report_t *r = hal_mock_last_report(USB_HID_REPORT_NUM_CONSUMER);
+        CHECK(r != NULL);
+        usages[i] = report_u16(r, 0);
+    }
+    CHECK_EQ(usages[0], 0x00e9);
+    CHECK_EQ(usages[1], 0);
+    CHECK_EQ(usages[2], 0x00e9);
+    CHECK_EQ(usages[3], 0);
+
+    post_button(1, true);
+    post_button(1, false);
+    run_hid_task();
+    CHECK_EQ(report_u16(hal_mock_last_report(USB_HID_REPORT_NUM_CONSUMER), 0), 0x00e2);
+    run_hid_task();
+    CHECK_EQ(report_u16(hal_mock_last_report(USB_HID_REPORT_NUM_CONSUMER), 0), 0);
+
+    uint16_t sent = hal_mock.report_count;
+    run_hid_task();
+    CHECK_EQ(hal_mock.report_count, sent);
+
+    // A press that didn't go out is still to be sent, and its release after it
+    post_encoder(1, -1);
+    hal_mock.hid_fail = true;
+    run_hid_task();
+    hal_mock.hid_fail = false;
+    run_hid_task();
+    CHECK_EQ(report_u16(hal_mock_last_report(USB_HID_REPORT_NUM_CONSUMER), 0), 0x00ea);
+    run_hid_task();
+    CHECK_EQ(report_u16(hal_mock_last_report(USB_HID_REPORT_NUM_CONSUMER), 0), 0);
+    sent = hal_mock.report_count;
+    run_hid_task();
+    CHECK_EQ(hal_mock.report_count, sent);
+}
+
+static void test_wheel_uses_resolution_multiplier() {
+    set_encoder_modes(PROF_ENCODER_MODE_WHEEL, PROF_ENCODER_MODE_PAN);
+    post_encoder(0, -2);
+    post_encoder(1, 1);
+    run_hid_task();
+    const hal_mock_report_t *r = hal_mock_last_report(USB_HID_REPORT_NUM_MOUSE);
+    CHECK(r != NULL);
+    CHECK_EQ((int16_t)report_u16(r, 2), -2);
+    CHECK_EQ((int16_t)report_u16(r, 4), 1);
+
+    // One report per poll, with the detents that came in while waiting for it
+    hal_mock.hid_one_in_flight = true;
+    post_encoder(0, 1);
+    run_hid_task();
+    post_encoder(0, 1);
+    post_encoder(0, 2);
+    run_hid_task();
+    CHECK_EQ((int16_t)report_u16(hal_mock_last_report(USB_HID_REPORT_NUM_MOUSE), 2), 1);
+    hal_mock.hid_ready = true;
+    usb_hid_report_complete();
+    run_hid_task();
+    CHECK_EQ((int16_t)report_u16(hal_mock_last_report(USB_HID_REPORT_NUM_MOUSE), 2), 3);
+    hal_mock.hid_ready = true;
+    hal_mock.hid_one_in_flight = false;
+
+    // At low resolution, steps short of a detent wait for it
+    uint16_t sent = hal_mock.report_count;
+    post_encoder_steps(0, 0, 3);
+    run_hid_task();
+    CHECK_EQ(hal_mock.report_count, sent);
+
+    uint8_t multiplier[] = {USB_HID_REPORT_NUM_MOUSE, 0x1};
+    usb_hid_set_report(multiplier[0], multiplier, sizeof(multiplier));
+    uint8_t read;
+    CHECK_EQ(usb_hid_get_report(USB_HID_REPORT_NUM_MOUSE, &read, 1), 1);
+    CHECK_EQ(read, 0x1);
+    post_encoder(0, 1);
+    run_hid_task();
+    r = hal_mock_last_report(USB_HID_REPORT_NUM_MOUSE);
+    CHECK_EQ((int16_t)report_u16(r, 2), USB_HID_WHEEL_RESOLUTION_MULTIPLIER);
+
+    // At high resolution, every quarter step scrolls
+    post_encoder_steps(0, 0, 1);
+    run_hid_task();
+    r = hal_mock_last_report(USB_HID_REPORT_NUM_MOUSE);
+    CHECK_EQ((int16_t)report_u16(r, 2), USB_HID_WHEEL_RESOLUTION_MULTIPLIER / 4);
+    post_encoder_steps(0, 1, 2);
+    post_encoder_steps(0, 0, -1);
+    run_hid_task();
+    r = hal_mock_last_report(USB_HID_REPORT_NUM_MOUSE);
+    CHECK_EQ((int16_t)report_u16(r, 2), USB_HID_WHEEL_RESOLUTION_MULTIPLIER / 4);
+}
+
+static void test_profile_reports() {
+    uint8_t name[1 + MACROPAD_PROFILE_NAME_LENGTH] = {USB_HID_REPORT_NUM_PROFILE_NAME};
+    strcpy((char *)name + 1, "Terminal");
+    usb_hid_set_report(name[0], name, sizeof(name));
+    uint8_t names[1 + MACROPAD_KEY_NAME_LENGTH * MACROPAD_KEY_COUNT] = {
+        USB_HID_REPORT_NUM_KEY_NAMES};
+    memset(names + 1, 'a', sizeof(names) - 1);
+    usb_hid_set_report(names[0], names, sizeof(names));
+    CHECK(strcmp(prof_get_snapshot()->profile.name, "Terminal") == 0);
+    uint32_t terminal = prof_get_snapshot()->hash;
+
+    // Wrong lengths are ignored
+    usb_hid_set_report(name[0], name, sizeof(name) - 1);
+    usb_hid_set_report(name[0], name, 0);
+    CHECK_EQ(prof_get_snapshot()->hash, terminal);
+
+    strcpy((char *)name + 1, "Other");
+    usb_hid_set_report(name[0], name, sizeof(name));
+    usb_hid_set_report(names[0], names, sizeof(names));
+
+    uint8_t hash[5] = {USB_HID_REPORT_NUM_PROFILE_HASH};
+    memcpy(hash + 1, &terminal, sizeof(terminal));
+    usb_hid_set_report(hash[0], hash, sizeof(hash));
+    CHECK(strcmp(prof_get_snapshot()->profile.name, "Terminal") == 0);
+
+    uint8_t cache[USB_HID_PROFILE_CACHE_REPORT_LEN];
+    CHECK_EQ(
+        usb_hid_get_report(USB_HID_REPORT_NUM_PROFILE_CACHE, cache, sizeof(cache)),
+        sizeof(cache));
+    uint32_t current;
+    memcpy(&current, cache, sizeof(current));
+    CHECK_EQ(current, terminal);
+    CHECK_EQ(cache[16], 2);
+    CHECK_EQ(cache[17], PROF_CACHE_SIZE);
+}
+
+static void test_suspended_input_wakes_host() {
+    usb_hid_suspend(true);
+    post_keys(0x100);
+    run_hid_task();
+    CHECK_EQ(hal_mock.remote_wakeups, 1);
+
+    // Only once until the host resumes
+    post_keys(0);
+    run_hid_task();
+    CHECK_EQ(hal_mock.remote_wakeups, 1);
+
+    hal_mock_advance_us(2000);
+    usb_hid_resume();
+    run_hid_task();
+    usb_hid_report_complete();
+    uint8_t power[USB_HID_USB_POWER_REPORT_LEN];
+    usb_hid_get_report(USB_HID_REPORT_NUM_USB_POWER, power, sizeof(power));
+    CHECK_EQ(power[0], 0);
+    uint16_t wakeups;
+    memcpy(&wakeups, power + 2, sizeof(wakeups));
+    CHECK_EQ(wakeups, 1);
+    uint32_t wake_to_report;
+    memcpy(&wake_to_report, power + 8, sizeof(wake_to_report));
+    CHECK(wake_to_report > 2000);
+
+    // Without remote wakeup, input waits for the host
+    usb_hid_suspend(false);
+    post_keys(0x100);
+    run_hid_task();
+    CHECK_EQ(hal_mock.remote_wakeups, 1);
+    usb_hid_resume();
+    post_keys(0);
+    run_hid_task();
+}
+
+static void test_disabled_event_sending() {
+    usb_hid_set_event_sending_enabled(false);
+    uint16_t sent = hal_mock.report_count;
+    post_keys(0x001);
+    run_hid_task();
+    post_keys(0);
+    run_hid_task();
+    CHECK_EQ(hal_mock.report_count, sent);
+    usb_hid_set_event_sending_enabled(true);
+}
+
+int main() {
+    hal_mock_reset();
+    RUN_TEST(test_first_run_reports_keys);
+    RUN_TEST(test_keys_are_reported);
+    RUN_TEST(test_failed_report_is_retried);
+    RUN_TEST(test_dial_reports_encoder_1_only);
+    RUN_TEST(test_volume_steps_are_pressed_and_released);
+    RUN_TEST(test_wheel_uses_resolution_multiplier);
+    RUN_TEST(test_profile_reports);
+    RUN_TEST(test_suspended_input_wakes_host);
+    RUN_TEST(test_disabled_event_sending);
+    return TEST_RESULT();
+}
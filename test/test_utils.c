@@ -0,0 +1,36 @@
+#include "test.h"
+
+#include "utils.h"
+
+#include <string.h>
+
+static void test_crc32_check_value() {
+    const char *check = "123456789";
+    CHECK_EQ(crc32(check, strlen(check), 0), 0xCBF43926);
+    CHECK_EQ(crc32(check, 0, 0), 0);
+}
+
+static void test_crc32_continues() {
+    const char *check = "123456789";
+    uint32_t crc = crc32(check, 4, 0);
+    CHECK_EQ(crc32(check + 4, 5, crc), 0xCBF43926);
+}
+
+static void test_time_passed_wraps() {
+    hal_mock.time_us = UINT32_MAX - 10;
+    uint32_t deadline = hal_mock.time_us + 20;
+    CHECK(!time_passed(deadline));
+    hal_mock_advance_us(19);
+    CHECK(!time_passed(deadline));
+    hal_mock_advance_us(1);
+    CHECK(time_passed(deadline));
+    CHECK(time_passed(deadline - 1000));
+}
+
+int main() {
+    hal_mock_reset();
+    RUN_TEST(test_crc32_check_value);
+    RUN_TEST(test_crc32_continues);
+    RUN_TEST(test_time_passed_wraps);
+    return TEST_RESULT();
+}